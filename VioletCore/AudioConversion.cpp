@@ -0,0 +1,356 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The audio sample format conversions which bypass swresample.
+* File Name: AudioConversion.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+
+#include "AudioConversion.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define AUDIO_CONVERSION_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC accepts the intrinsics of any instruction set, GCC and Clang need the
+// target on the function.
+#if defined(AUDIO_CONVERSION_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	// Float and 32 bit integer samples are both moved as 32 bit words
+	template <typename Sample, int Channels>
+	void InterleaveScalar(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		auto dst = reinterpret_cast<Sample*>(dstData);
+		for (int i = 0; i < samples; ++i)
+		{
+			for (int c = 0; c < Channels; ++c)
+			{
+				dst[i * Channels + c] = reinterpret_cast<const Sample*>(srcData[c])[i];
+			}
+		}
+	}
+
+	// Offsets the planes to the given sample, for the scalar tails
+	template <typename Sample, int Channels>
+	void InterleaveTail(const uint8_t* const* srcData, uint8_t* dstData, int start, int samples)
+	{
+		const uint8_t* tail[Channels];
+		for (int c = 0; c < Channels; ++c)
+		{
+			tail[c] = srcData[c] + start * sizeof(Sample);
+		}
+
+		InterleaveScalar<Sample, Channels>(tail, dstData + start * Channels * sizeof(Sample), samples - start);
+	}
+
+#ifdef AUDIO_CONVERSION_X86
+	inline __m128i Load(const uint8_t* plane, int sampleOffset)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + sampleOffset));
+	}
+
+	inline void Store(uint8_t* dst, __m128i value)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+	}
+
+	// Transposes four vectors of four 32 bit words
+	inline void Transpose4x32(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+	{
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+		__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+		r0 = _mm_unpacklo_epi64(t0, t1);
+		r1 = _mm_unpackhi_epi64(t0, t1);
+		r2 = _mm_unpacklo_epi64(t2, t3);
+		r3 = _mm_unpackhi_epi64(t2, t3);
+	}
+
+	// Transposes eight vectors of eight 16 bit words
+	inline void Transpose8x16(__m128i r[8])
+	{
+		__m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+		__m128i a1 = _mm_unpacklo_epi16(r[2], r[3]);
+		__m128i a2 = _mm_unpacklo_epi16(r[4], r[5]);
+		__m128i a3 = _mm_unpacklo_epi16(r[6], r[7]);
+		__m128i a4 = _mm_unpackhi_epi16(r[0], r[1]);
+		__m128i a5 = _mm_unpackhi_epi16(r[2], r[3]);
+		__m128i a6 = _mm_unpackhi_epi16(r[4], r[5]);
+		__m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+		__m128i b0 = _mm_unpacklo_epi32(a0, a1);
+		__m128i b1 = _mm_unpacklo_epi32(a2, a3);
+		__m128i b2 = _mm_unpackhi_epi32(a0, a1);
+		__m128i b3 = _mm_unpackhi_epi32(a2, a3);
+		__m128i b4 = _mm_unpacklo_epi32(a4, a5);
+		__m128i b5 = _mm_unpacklo_epi32(a6, a7);
+		__m128i b6 = _mm_unpackhi_epi32(a4, a5);
+		__m128i b7 = _mm_unpackhi_epi32(a6, a7);
+
+		r[0] = _mm_unpacklo_epi64(b0, b1);
+		r[1] = _mm_unpackhi_epi64(b0, b1);
+		r[2] = _mm_unpacklo_epi64(b2, b3);
+		r[3] = _mm_unpackhi_epi64(b2, b3);
+		r[4] = _mm_unpacklo_epi64(b4, b5);
+		r[5] = _mm_unpackhi_epi64(b4, b5);
+		r[6] = _mm_unpacklo_epi64(b6, b7);
+		r[7] = _mm_unpackhi_epi64(b6, b7);
+	}
+
+	void Interleave2x32Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 4 <= samples; i += 4)
+		{
+			__m128i left = Load(srcData[0], i * 4);
+			__m128i right = Load(srcData[1], i * 4);
+			Store(dstData + i * 8, _mm_unpacklo_epi32(left, right));
+			Store(dstData + i * 8 + 16, _mm_unpackhi_epi32(left, right));
+		}
+
+		InterleaveTail<uint32_t, 2>(srcData, dstData, i, samples);
+	}
+
+	TARGET_AVX2 void Interleave2x32Avx2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			__m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcData[0] + i * 4));
+			__m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcData[1] + i * 4));
+
+			// The unpacks work within the 128 bit lanes, put the lanes back in order
+			__m256i low = _mm256_unpacklo_epi32(left, right);
+			__m256i high = _mm256_unpackhi_epi32(left, right);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstData + i * 8), _mm256_permute2x128_si256(low, high, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstData + i * 8 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+		}
+
+		InterleaveTail<uint32_t, 2>(srcData, dstData, i, samples);
+	}
+
+	void Interleave6x32Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 4 <= samples; i += 4)
+		{
+			__m128i c0 = Load(srcData[0], i * 4);
+			__m128i c1 = Load(srcData[1], i * 4);
+			__m128i c2 = Load(srcData[2], i * 4);
+			__m128i c3 = Load(srcData[3], i * 4);
+			Transpose4x32(c0, c1, c2, c3);
+
+			// The last two channels of the samples as pairs
+			__m128i c4 = Load(srcData[4], i * 4);
+			__m128i c5 = Load(srcData[5], i * 4);
+			__m128i pairs01 = _mm_unpacklo_epi32(c4, c5);
+			__m128i pairs23 = _mm_unpackhi_epi32(c4, c5);
+
+			uint8_t* dst = dstData + i * 24;
+			Store(dst, c0);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), pairs01);
+			Store(dst + 24, c1);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 40), _mm_srli_si128(pairs01, 8));
+			Store(dst + 48, c2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 64), pairs23);
+			Store(dst + 72, c3);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 88), _mm_srli_si128(pairs23, 8));
+		}
+
+		InterleaveTail<uint32_t, 6>(srcData, dstData, i, samples);
+	}
+
+	void Interleave8x32Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 4 <= samples; i += 4)
+		{
+			__m128i c0 = Load(srcData[0], i * 4);
+			__m128i c1 = Load(srcData[1], i * 4);
+			__m128i c2 = Load(srcData[2], i * 4);
+			__m128i c3 = Load(srcData[3], i * 4);
+			__m128i c4 = Load(srcData[4], i * 4);
+			__m128i c5 = Load(srcData[5], i * 4);
+			__m128i c6 = Load(srcData[6], i * 4);
+			__m128i c7 = Load(srcData[7], i * 4);
+			Transpose4x32(c0, c1, c2, c3);
+			Transpose4x32(c4, c5, c6, c7);
+
+			uint8_t* dst = dstData + i * 32;
+			Store(dst, c0);
+			Store(dst + 16, c4);
+			Store(dst + 32, c1);
+			Store(dst + 48, c5);
+			Store(dst + 64, c2);
+			Store(dst + 80, c6);
+			Store(dst + 96, c3);
+			Store(dst + 112, c7);
+		}
+
+		InterleaveTail<uint32_t, 8>(srcData, dstData, i, samples);
+	}
+
+	void Interleave2x16Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			__m128i left = Load(srcData[0], i * 2);
+			__m128i right = Load(srcData[1], i * 2);
+			Store(dstData + i * 4, _mm_unpacklo_epi16(left, right));
+			Store(dstData + i * 4 + 16, _mm_unpackhi_epi16(left, right));
+		}
+
+		InterleaveTail<uint16_t, 2>(srcData, dstData, i, samples);
+	}
+
+	TARGET_AVX2 void Interleave2x16Avx2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 16 <= samples; i += 16)
+		{
+			__m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcData[0] + i * 2));
+			__m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcData[1] + i * 2));
+
+			// The unpacks work within the 128 bit lanes, put the lanes back in order
+			__m256i low = _mm256_unpacklo_epi16(left, right);
+			__m256i high = _mm256_unpackhi_epi16(left, right);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstData + i * 4), _mm256_permute2x128_si256(low, high, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstData + i * 4 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+		}
+
+		InterleaveTail<uint16_t, 2>(srcData, dstData, i, samples);
+	}
+
+	void Interleave6x16Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			// Transposed with two empty channels, of which only the six real ones are stored
+			__m128i r[8];
+			for (int c = 0; c < 6; ++c)
+			{
+				r[c] = Load(srcData[c], i * 2);
+			}
+			r[6] = _mm_setzero_si128();
+			r[7] = _mm_setzero_si128();
+			Transpose8x16(r);
+
+			uint8_t* dst = dstData + i * 12;
+			for (int s = 0; s < 8; ++s)
+			{
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + s * 12), r[s]);
+				int last = _mm_cvtsi128_si32(_mm_srli_si128(r[s], 8));
+				memcpy(dst + s * 12 + 8, &last, 4);
+			}
+		}
+
+		InterleaveTail<uint16_t, 6>(srcData, dstData, i, samples);
+	}
+
+	void Interleave8x16Sse2(const uint8_t* const* srcData, uint8_t* dstData, int samples)
+	{
+		int i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			__m128i r[8];
+			for (int c = 0; c < 8; ++c)
+			{
+				r[c] = Load(srcData[c], i * 2);
+			}
+			Transpose8x16(r);
+
+			uint8_t* dst = dstData + i * 16;
+			for (int s = 0; s < 8; ++s)
+			{
+				Store(dst + s * 16, r[s]);
+			}
+		}
+
+		InterleaveTail<uint16_t, 8>(srcData, dstData, i, samples);
+	}
+#endif
+
+	// The kernels for 2, 6 and 8 channels of one sample size
+	struct InterleaveKernels
+	{
+		AudioInterleaveFunction stereo;
+		AudioInterleaveFunction surround51;
+		AudioInterleaveFunction surround71;
+	};
+
+	InterleaveKernels Select32BitKernels()
+	{
+		InterleaveKernels kernels = { InterleaveScalar<uint32_t, 2>, InterleaveScalar<uint32_t, 6>, InterleaveScalar<uint32_t, 8> };
+#ifdef AUDIO_CONVERSION_X86
+		int cpuFlags = av_get_cpu_flags();
+		if (cpuFlags & AV_CPU_FLAG_SSE2)
+		{
+			kernels.stereo = cpuFlags & AV_CPU_FLAG_AVX2 ? Interleave2x32Avx2 : Interleave2x32Sse2;
+			kernels.surround51 = Interleave6x32Sse2;
+			kernels.surround71 = Interleave8x32Sse2;
+		}
+#endif
+		return kernels;
+	}
+
+	InterleaveKernels Select16BitKernels()
+	{
+		InterleaveKernels kernels = { InterleaveScalar<uint16_t, 2>, InterleaveScalar<uint16_t, 6>, InterleaveScalar<uint16_t, 8> };
+#ifdef AUDIO_CONVERSION_X86
+		int cpuFlags = av_get_cpu_flags();
+		if (cpuFlags & AV_CPU_FLAG_SSE2)
+		{
+			kernels.stereo = cpuFlags & AV_CPU_FLAG_AVX2 ? Interleave2x16Avx2 : Interleave2x16Sse2;
+			kernels.surround51 = Interleave6x16Sse2;
+			kernels.surround71 = Interleave8x16Sse2;
+		}
+#endif
+		return kernels;
+	}
+
+	AudioInterleaveFunction GetKernel(const InterleaveKernels& kernels, int channels)
+	{
+		switch (channels)
+		{
+		case 2:
+			return kernels.stereo;
+		case 6:
+			return kernels.surround51;
+		case 8:
+			return kernels.surround71;
+		default:
+			return nullptr;
+		}
+	}
+}
+
+AudioInterleaveFunction FFmpegInterop::GetAudioInterleave(AVSampleFormat srcFormat, int channels)
+{
+	// Thread safe initialization, every thread would pick the same functions anyway
+	static const InterleaveKernels kernels32 = Select32BitKernels();
+	static const InterleaveKernels kernels16 = Select16BitKernels();
+
+	switch (srcFormat)
+	{
+	case AV_SAMPLE_FMT_FLTP:
+	case AV_SAMPLE_FMT_S32P:
+		return GetKernel(kernels32, channels);
+	case AV_SAMPLE_FMT_S16P:
+		return GetKernel(kernels16, channels);
+	default:
+		return nullptr;
+	}
+}
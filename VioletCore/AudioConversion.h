@@ -0,0 +1,24 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The audio sample format conversions which bypass swresample.
+* File Name: AudioConversion.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// Interleaves the planes of a planar frame into one packed buffer. The
+	// result is bit exact with swr_convert from the planar to the packed
+	// format at the same rate and channel layout.
+	typedef void (*AudioInterleaveFunction)(const uint8_t* const* srcData, uint8_t* dstData, int samples);
+
+	// Returns the interleaving of the planar sample format (FLTP, S16P or
+	// S32P) with 2, 6 or 8 channels, or nullptr if there is none and
+	// swresample has to be used. The kernel is picked once with
+	// av_get_cpu_flags: AVX2 or SSE2 where they help, or the scalar fallback.
+	AudioInterleaveFunction GetAudioInterleave(AVSampleFormat srcFormat, int channels);
+}
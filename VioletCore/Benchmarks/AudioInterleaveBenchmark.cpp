@@ -0,0 +1,135 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The audio interleaving kernels against swresample.
+* File Name: AudioInterleaveBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "AudioConversion.h"
+#include "BenchmarkUtilities.h"
+
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+
+// The samples of one AAC frame, what a decoder hands out at a time.
+static const int FrameSamples = 1024;
+
+// Repeats the interleaving for about half a second and returns the time of
+// one frame in nanoseconds.
+static double Measure(const std::function<void()>& interleave)
+{
+	interleave();
+
+	double budget = 0.5 * GetScale();
+	int frames = 0;
+	Stopwatch stopwatch;
+	do
+	{
+		for (int i = 0; i < 100; ++i)
+		{
+			interleave();
+		}
+		frames += 100;
+	} while (stopwatch.GetSeconds() < budget);
+
+	return stopwatch.GetSeconds() * 1e9 / frames;
+}
+
+static void Compare(AVSampleFormat format, int channels)
+{
+	int sampleSize = av_get_bytes_per_sample(format);
+	std::vector<std::vector<uint8_t>> planes(channels, std::vector<uint8_t>(FrameSamples * sampleSize, 0x11));
+	const uint8_t* srcData[8];
+	for (int c = 0; c < channels; ++c)
+	{
+		srcData[c] = planes[c].data();
+	}
+
+	std::vector<uint8_t> output(FrameSamples * channels * sampleSize);
+	uint8_t* dstData = output.data();
+
+	AudioInterleaveFunction interleave = GetAudioInterleave(format, channels);
+	double fast = Measure([&]
+	{
+		interleave(srcData, dstData, FrameSamples);
+	});
+
+	SwrContext* swrCtx = nullptr;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+	AVChannelLayout layout;
+	av_channel_layout_default(&layout, channels);
+	swr_alloc_set_opts2(&swrCtx, &layout, av_get_packed_sample_fmt(format), 48000, &layout, format, 48000, 0, nullptr);
+#else
+	int64_t layout = av_get_default_channel_layout(channels);
+	swrCtx = swr_alloc_set_opts(nullptr, layout, av_get_packed_sample_fmt(format), 48000, layout, format, 48000, 0, nullptr);
+#endif
+	if (!swrCtx || swr_init(swrCtx) < 0)
+	{
+		fprintf(stderr, "cannot create the resampler\n");
+		swr_free(&swrCtx);
+		return;
+	}
+
+	double resampled = Measure([&]
+	{
+		swr_convert(swrCtx, &dstData, FrameSamples, srcData, FrameSamples);
+	});
+	swr_free(&swrCtx);
+
+	// Read once and written once
+	double bytes = 2.0 * output.size();
+	printf("%-4s %d channels %8.0f ns %7.2f GB/s fast %8.0f ns %7.2f GB/s swr_convert %6.1fx\n",
+		av_get_sample_fmt_name(format),
+		channels,
+		fast,
+		bytes / fast,
+		resampled,
+		bytes / resampled,
+		resampled / fast);
+}
+
+// Usage: AudioInterleaveBenchmark [scalar|sse2|avx2]
+// The kernels are picked once per process, start it once per instruction set
+// to compare them.
+int main(int argc, char* argv[])
+{
+	const char* kernel = "best";
+	if (argc > 1)
+	{
+		int forced = strcmp(argv[1], "avx2") == 0 ? AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_AVX2
+			: strcmp(argv[1], "sse2") == 0 ? AV_CPU_FLAG_SSE2
+			: 0;
+		if ((av_get_cpu_flags() & forced) != forced)
+		{
+			fprintf(stderr, "%s is not supported\n", argv[1]);
+			return 1;
+		}
+
+		av_force_cpu_flags(forced);
+		kernel = argv[1];
+	}
+
+	printf("%s kernels, %d samples per frame\n", kernel, FrameSamples);
+
+	for (AVSampleFormat format : { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16P })
+	{
+		for (int channels : { 2, 6, 8 })
+		{
+			Compare(format, channels);
+		}
+	}
+
+	return 0;
+}
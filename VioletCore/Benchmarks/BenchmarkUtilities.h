@@ -0,0 +1,64 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The timing helpers shared by the benchmarks.
+* File Name: BenchmarkUtilities.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <vector>
+
+namespace FFmpegInterop
+{
+	namespace Benchmarks
+	{
+		// Measures the wall clock time since it was created or restarted.
+		class Stopwatch
+		{
+		public:
+			Stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+
+			void Restart() { m_start = std::chrono::steady_clock::now(); }
+
+			double GetSeconds() const
+			{
+				return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+			}
+
+			double GetMicroseconds() const { return GetSeconds() * 1e6; }
+
+		private:
+			std::chrono::steady_clock::time_point m_start;
+		};
+
+		// The value below which the given fraction of the samples lie.
+		inline double Percentile(std::vector<double> samples, double fraction)
+		{
+			if (samples.empty())
+			{
+				return 0;
+			}
+
+			std::sort(samples.begin(), samples.end());
+			size_t index = static_cast<size_t>(fraction * (samples.size() - 1) + 0.5);
+			return samples[std::min(index, samples.size() - 1)];
+		}
+
+		// Scales the iteration counts, e.g. BENCHMARK_SCALE=0.1 for a quick run.
+		inline double GetScale()
+		{
+			const char* scale = getenv("BENCHMARK_SCALE");
+			double result = scale ? atof(scale) : 1.0;
+			return result > 0 ? result : 1.0;
+		}
+
+		inline int Scaled(int count)
+		{
+			return std::max(1, static_cast<int>(count * GetScale()));
+		}
+	}
+}
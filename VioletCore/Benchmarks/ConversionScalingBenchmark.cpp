@@ -0,0 +1,175 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Video frame conversion time by the number of band threads.
+* File Name: ConversionScalingBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "PixelConversion.h"
+#include "ThreadPool.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+
+static const int FrameWidth = 3840;
+static const int FrameHeight = 2160;
+
+// A picture in one buffer with the default line sizes.
+struct Picture
+{
+	Picture(AVPixelFormat format, int width, int height)
+		: buffer(av_image_get_buffer_size(format, width, height, 64) + 64, 0x40)
+	{
+		av_image_fill_arrays(data, linesize, buffer.data(), format, width, height, 64);
+	}
+
+	std::vector<uint8_t> buffer;
+	uint8_t* data[4];
+	int linesize[4];
+};
+
+// Converts frames of one format the way the video provider does: in bands
+// on a thread pool if CanConvertInBands or the fast path allows it,
+// otherwise with one sws_scale.
+class BandConverter
+{
+public:
+	BandConverter(AVPixelFormat srcFormat, AVPixelFormat dstFormat, int threads)
+		: m_srcFormat(srcFormat)
+		, m_dstFormat(dstFormat)
+		, m_convert(GetPixelConversion(srcFormat, dstFormat))
+		, m_bands(m_convert || CanConvertInBands(srcFormat, dstFormat) ? threads : 1)
+		, m_pool(threads - 1)
+	{
+		for (int band = 0; !m_convert && band < m_bands; ++band)
+		{
+			int sliceY, sliceHeight;
+			GetBand(band, sliceY, sliceHeight);
+			m_swsCtx.push_back(sws_getContext(FrameWidth, sliceHeight, srcFormat, FrameWidth, sliceHeight, dstFormat, SWS_BICUBIC, nullptr, nullptr, nullptr));
+		}
+	}
+
+	~BandConverter()
+	{
+		for (auto swsCtx : m_swsCtx)
+		{
+			sws_freeContext(swsCtx);
+		}
+	}
+
+	int GetBands() const { return m_bands; }
+
+	void Convert(const Picture& source, Picture& target)
+	{
+		const AVPixFmtDescriptor* sourceDescriptor = av_pix_fmt_desc_get(m_srcFormat);
+		const AVPixFmtDescriptor* targetDescriptor = av_pix_fmt_desc_get(m_dstFormat);
+
+		m_pool.ParallelFor(m_bands, [&](int band)
+		{
+			int sliceY, sliceHeight;
+			GetBand(band, sliceY, sliceHeight);
+
+			if (m_convert)
+			{
+				m_convert(source.data, source.linesize, target.data, target.linesize, FrameWidth, sliceY, sliceHeight);
+				return;
+			}
+
+			const uint8_t* sourceData[4];
+			uint8_t* targetData[4];
+			for (int plane = 0; plane < 4; ++plane)
+			{
+				int sourceShift = plane == 1 || plane == 2 ? sourceDescriptor->log2_chroma_h : 0;
+				int targetShift = plane == 1 || plane == 2 ? targetDescriptor->log2_chroma_h : 0;
+				sourceData[plane] = source.data[plane] ? source.data[plane] + (sliceY >> sourceShift) * source.linesize[plane] : nullptr;
+				targetData[plane] = target.data[plane] ? target.data[plane] + (sliceY >> targetShift) * target.linesize[plane] : nullptr;
+			}
+
+			sws_scale(m_swsCtx[band], sourceData, source.linesize, 0, sliceHeight, targetData, target.linesize);
+		});
+	}
+
+private:
+	void GetBand(int band, int& sliceY, int& sliceHeight) const
+	{
+		int bandHeight = FFALIGN(FrameHeight / m_bands, 2);
+		sliceY = band * bandHeight;
+		sliceHeight = band == m_bands - 1 ? FrameHeight - sliceY : bandHeight;
+	}
+
+	AVPixelFormat m_srcFormat;
+	AVPixelFormat m_dstFormat;
+	PixelConversionFunction m_convert;
+	int m_bands;
+	ThreadPool m_pool;
+	std::vector<SwsContext*> m_swsCtx;
+};
+
+static void Measure(AVPixelFormat srcFormat, AVPixelFormat dstFormat, const std::vector<int>& threadCounts)
+{
+	Picture source(srcFormat, FrameWidth, FrameHeight);
+	Picture target(dstFormat, FrameWidth, FrameHeight);
+
+	const char* path = GetPixelConversion(srcFormat, dstFormat) ? "fast path"
+		: CanConvertInBands(srcFormat, dstFormat) ? "sws_scale in bands"
+		: "sws_scale at once";
+	printf("%s to %s, %s\n", av_pix_fmt_desc_get(srcFormat)->name, av_pix_fmt_desc_get(dstFormat)->name, path);
+
+	double single = 0;
+	for (int threads : threadCounts)
+	{
+		BandConverter converter(srcFormat, dstFormat, threads);
+		converter.Convert(source, target);
+
+		double budget = 0.5 * GetScale();
+		int frames = 0;
+		Stopwatch stopwatch;
+		do
+		{
+			converter.Convert(source, target);
+			++frames;
+		} while (stopwatch.GetSeconds() < budget || frames < 3);
+
+		double milliseconds = stopwatch.GetSeconds() * 1000.0 / frames;
+		if (single == 0)
+		{
+			single = milliseconds;
+		}
+
+		printf("  %2d threads %2d bands %9.3f ms/frame %6.2fx\n", threads, converter.GetBands(), milliseconds, single / milliseconds);
+	}
+}
+
+int main()
+{
+	std::vector<int> threadCounts;
+	int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	for (int threads = 1; threads < cores; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(cores);
+
+	printf("%dx%d frames\n", FrameWidth, FrameHeight);
+
+	Measure(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, threadCounts);
+	Measure(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE, threadCounts);
+	Measure(AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE, threadCounts);
+
+	// These stay on one thread, bands would leave seams
+	Measure(AV_PIX_FMT_YUV422P, AV_PIX_FMT_NV12, threadCounts);
+	Measure(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_NV12, threadCounts);
+
+	return 0;
+}
@@ -0,0 +1,266 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Sample pull latency with and without decoding ahead.
+* File Name: DecodeAheadBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+#include "BenchmarkUtilities.h"
+#include "FFmpegDemuxer.h"
+#include "TestMedia.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+// The player asks for a frame every FrameInterval. Decoding a frame costs
+// less than that on average, but keyframes cost several intervals.
+static const std::chrono::microseconds FrameInterval(8000);
+static const int DeltaFrameCost = 3000;
+static const int KeyframeCost = 20000;
+static const int KeyframeInterval = 12;
+
+static std::vector<TestStreamSpec> GetStreams()
+{
+	return
+	{
+		{ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, { 1, 1000 }, 8, KeyframeInterval, 5000, 30000 },
+	};
+}
+
+// The decoder: takes the next packet and spends its decode time on it.
+class SimulatedDecoder
+{
+public:
+	explicit SimulatedDecoder(FFmpegDemuxer& demuxer)
+		: m_demuxer(demuxer)
+		, m_random(4711)
+	{
+	}
+
+	// Return value:
+	//   false at the end of the stream.
+	bool DecodeNextSample()
+	{
+		AVPacket* avPacket;
+		if (m_demuxer.ReadPacket(0, &avPacket) < 0)
+		{
+			return false;
+		}
+
+		// +-25% around the nominal cost, like frames of varying complexity
+		int cost = (avPacket->flags & AV_PKT_FLAG_KEY) ? KeyframeCost : DeltaFrameCost;
+		std::uniform_int_distribution<int> jitter(cost * 3 / 4, cost * 5 / 4);
+		std::this_thread::sleep_for(std::chrono::microseconds(jitter(m_random)));
+
+		m_demuxer.ReleasePacket(avPacket);
+		return true;
+	}
+
+private:
+	FFmpegDemuxer& m_demuxer;
+	std::mt19937 m_random;
+};
+
+// The decode-ahead worker of MediaSampleProvider: keeps up to depth samples
+// ready, the requests only take them. A depth of 0 decodes on request.
+class DecodeAhead
+{
+public:
+	DecodeAhead(SimulatedDecoder& decoder, size_t depth)
+		: m_decoder(decoder)
+		, m_depth(depth)
+		, m_ready(0)
+		, m_ended(false)
+		, m_stop(false)
+		, m_underruns(0)
+	{
+		if (m_depth > 0)
+		{
+			m_thread = std::thread(&DecodeAhead::Loop, this);
+		}
+	}
+
+	~DecodeAhead()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_sampleConsumed.notify_one();
+
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+		}
+	}
+
+	// Return value:
+	//   false at the end of the stream.
+	bool GetNextSample()
+	{
+		if (m_depth == 0)
+		{
+			return m_decoder.DecodeNextSample();
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_ready == 0 && !m_ended)
+		{
+			++m_underruns;
+			m_sampleReady.wait(lock, [this] { return m_ready > 0 || m_ended; });
+		}
+
+		if (m_ready == 0)
+		{
+			return false;
+		}
+
+		--m_ready;
+		lock.unlock();
+
+		m_sampleConsumed.notify_one();
+		return true;
+	}
+
+	uint64_t GetUnderruns() const { return m_underruns; }
+
+private:
+	void Loop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		while (true)
+		{
+			m_sampleConsumed.wait(lock, [this] { return m_stop || (!m_ended && m_ready < m_depth); });
+			if (m_stop)
+			{
+				break;
+			}
+
+			lock.unlock();
+			bool decoded = m_decoder.DecodeNextSample();
+			lock.lock();
+
+			if (decoded)
+			{
+				++m_ready;
+			}
+			else
+			{
+				m_ended = true;
+			}
+
+			m_sampleReady.notify_one();
+		}
+	}
+
+	SimulatedDecoder& m_decoder;
+	size_t m_depth;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_sampleConsumed;
+	std::condition_variable m_sampleReady;
+	size_t m_ready;
+	bool m_ended;
+	bool m_stop;
+	uint64_t m_underruns;
+};
+
+// Pulls frames at the frame rate and reports how long every pull took.
+static void Measure(const std::string& path, size_t depth)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return;
+	}
+
+	std::vector<double> latencies;
+	uint64_t underruns;
+	int late = 0;
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 32, 16 * 1024 * 1024);
+		demuxer.EnableStream(0);
+		demuxer.Start();
+
+		SimulatedDecoder decoder(demuxer);
+		DecodeAhead decodeAhead(decoder, depth);
+
+		// Playback starts once the first frame is there, like after a seek.
+		decodeAhead.GetNextSample();
+		auto deadline = std::chrono::steady_clock::now();
+
+		while (true)
+		{
+			deadline += FrameInterval;
+			std::this_thread::sleep_until(deadline);
+
+			Stopwatch stopwatch;
+			if (!decodeAhead.GetNextSample())
+			{
+				break;
+			}
+			latencies.push_back(stopwatch.GetMicroseconds());
+
+			// A frame which arrives after the next one is due is a dropped
+			// frame, the player catches up from there.
+			auto now = std::chrono::steady_clock::now();
+			if (now > deadline + FrameInterval)
+			{
+				++late;
+				deadline = now;
+			}
+		}
+
+		underruns = decodeAhead.GetUnderruns();
+		demuxer.Stop();
+	}
+
+	avformat_close_input(&avFormatCtx);
+
+	printf("depth %2zu %8.0f us p50 %8.0f us p90 %8.0f us p99 %8.0f us max %6llu underruns %6d late of %zu frames\n",
+		depth,
+		Percentile(latencies, 0.5),
+		Percentile(latencies, 0.9),
+		Percentile(latencies, 0.99),
+		Percentile(latencies, 1.0),
+		static_cast<unsigned long long>(underruns),
+		late,
+		latencies.size());
+}
+
+int main()
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::string path = GetTemporaryPath("DecodeAheadBenchmark.nut");
+	TestMediaInfo info;
+	if (WriteTestMedia(path, "nut", GetStreams(), Scaled(10), info) < 0)
+	{
+		fprintf(stderr, "cannot write %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("frame interval %lld us, delta frame %d us, keyframe %d us every %d frames\n",
+		static_cast<long long>(FrameInterval.count()), DeltaFrameCost, KeyframeCost, KeyframeInterval);
+
+	// Depth 0 decodes on the requesting thread, which is what happens with
+	// DecodeAheadSamples = 0.
+	for (size_t depth : { 0, 1, 2, 4, 8 })
+	{
+		Measure(path, depth);
+	}
+
+	remove(path.c_str());
+
+	return 0;
+}
@@ -0,0 +1,237 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Decoding frame rate per codec, resolution and decoder threads.
+* File Name: DecoderThreadingBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "DecoderThreading.h"
+#include "TestMedia.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+struct ThreadConfig
+{
+	const char* name;
+	int type;
+	int count;
+};
+
+struct DecodeResult
+{
+	double framesPerSecond;
+	double firstFrameMilliseconds;
+	// Packets sent before the first frame came out, what frame threads hold back
+	int delayFrames;
+};
+
+// Decodes the clip from a newly opened decoder, the way a seek or a new
+// stream does, until half a second has passed.
+// Return value:
+//   false if the decoder could not be opened.
+static bool Decode(const TestClip& clip, const ThreadConfig& config, DecodeResult& result)
+{
+	const AVCodec* avCodec = avcodec_find_decoder(clip.codecpar->codec_id);
+	if (!avCodec)
+	{
+		return false;
+	}
+
+	double budget = 0.5 * GetScale();
+	int frames = 0;
+	std::vector<double> firstFrameTimes;
+	result.delayFrames = 0;
+
+	AVFrame* avFrame = av_frame_alloc();
+	Stopwatch total;
+	do
+	{
+		AVCodecContext* avCodecCtx = avcodec_alloc_context3(avCodec);
+		avcodec_parameters_to_context(avCodecCtx, clip.codecpar);
+		avCodecCtx->thread_type = config.type;
+		avCodecCtx->thread_count = config.count;
+		if (avcodec_open2(avCodecCtx, avCodec, nullptr) < 0)
+		{
+			avcodec_free_context(&avCodecCtx);
+			av_frame_free(&avFrame);
+			return false;
+		}
+
+		Stopwatch firstFrame;
+		bool gotFrame = false;
+		int sent = 0;
+		for (size_t i = 0; i <= clip.packets.size(); ++i)
+		{
+			avcodec_send_packet(avCodecCtx, i < clip.packets.size() ? clip.packets[i] : nullptr);
+			++sent;
+
+			while (avcodec_receive_frame(avCodecCtx, avFrame) >= 0)
+			{
+				if (!gotFrame)
+				{
+					gotFrame = true;
+					firstFrameTimes.push_back(firstFrame.GetSeconds() * 1000.0);
+					result.delayFrames = sent - 1;
+				}
+
+				++frames;
+				av_frame_unref(avFrame);
+			}
+		}
+
+		avcodec_free_context(&avCodecCtx);
+	} while (total.GetSeconds() < budget);
+
+	result.framesPerSecond = frames / total.GetSeconds();
+	result.firstFrameMilliseconds = Percentile(firstFrameTimes, 0.5);
+
+	av_frame_free(&avFrame);
+	return true;
+}
+
+// Decodes the clip with every thread configuration and with the one
+// ChooseDecoderThreads picks for a file, which is marked.
+static void MeasureClip(const char* name, const TestClip& clip)
+{
+	int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+	if (hardwareThreads > 16)
+	{
+		hardwareThreads = 16;
+	}
+
+	DecoderThreadingInput input = {};
+	input.mediaType = AVMEDIA_TYPE_VIDEO;
+	input.codecId = clip.codecpar->codec_id;
+	input.profile = clip.codecpar->profile;
+	input.width = clip.codecpar->width;
+	input.height = clip.codecpar->height;
+	input.frameRate = clip.frameRate.num > 0 && clip.frameRate.den > 0 ? av_q2d(clip.frameRate) : 0;
+	input.lowLatency = false;
+	input.hardwareThreads = std::thread::hardware_concurrency();
+	DecoderThreads chosen = ChooseDecoderThreads(input);
+
+	const ThreadConfig candidates[] =
+	{
+		{ "one thread", 0, 1 },
+		{ "slice", FF_THREAD_SLICE, 2 },
+		{ "slice", FF_THREAD_SLICE, hardwareThreads },
+		{ "frame", FF_THREAD_FRAME, hardwareThreads },
+		{ "frame+slice", FF_THREAD_FRAME | FF_THREAD_SLICE, 4 },
+		{ "frame+slice", FF_THREAD_FRAME | FF_THREAD_SLICE, hardwareThreads },
+	};
+
+	// Without the ones which come down to the same, on few cores
+	std::vector<ThreadConfig> configs;
+	for (const ThreadConfig& candidate : candidates)
+	{
+		bool duplicate = std::any_of(configs.begin(), configs.end(), [&](const ThreadConfig& config)
+		{
+			return config.type == candidate.type && config.count == candidate.count;
+		});
+
+		if ((candidate.type == 0 || candidate.count > 1) && !duplicate)
+		{
+			configs.push_back(candidate);
+		}
+	}
+
+	auto isChosen = [&](const ThreadConfig& config)
+	{
+		return config.type == chosen.type && config.count == chosen.count;
+	};
+
+	if (std::none_of(configs.begin(), configs.end(), isChosen))
+	{
+		configs.push_back({ chosen.type & FF_THREAD_FRAME ? "frame+slice" : chosen.type ? "slice" : "one thread", chosen.type, chosen.count });
+	}
+
+	printf("%s %s %dx%d %.2f fps, %zu frames\n",
+		name,
+		avcodec_get_name(clip.codecpar->codec_id),
+		clip.codecpar->width,
+		clip.codecpar->height,
+		input.frameRate,
+		clip.packets.size());
+
+	for (const ThreadConfig& config : configs)
+	{
+		DecodeResult result;
+		if (!Decode(clip, config, result))
+		{
+			printf("  %-12s %2d threads: cannot decode\n", config.name, config.count);
+			continue;
+		}
+
+		printf("  %-12s %2d threads %9.1f frames/s %8.2f ms first frame %3d frames delay%s\n",
+			config.name,
+			config.count,
+			result.framesPerSecond,
+			result.firstFrameMilliseconds,
+			result.delayFrames,
+			isChosen(config) ? "  <- chosen" : "");
+	}
+}
+
+// Usage: DecoderThreadingBenchmark [file ...]
+// Without files it writes MPEG-2 clips from 360p to 4K, a codec with slice
+// and frame threads. Pass clips of other codecs, e.g. H.264, HEVC, VP9 and
+// AV1 at several resolutions, for the full matrix the thresholds of
+// ChooseDecoderThreads come from.
+int main(int argc, char* argv[])
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+	if (argc > 1)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			TestClip clip;
+			if (ReadTestClip(argv[i], clip) < 0)
+			{
+				fprintf(stderr, "cannot read the video of %s\n", argv[i]);
+				continue;
+			}
+
+			MeasureClip(argv[i], clip);
+			FreeTestClip(clip);
+		}
+
+		return 0;
+	}
+
+	const int sizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	for (auto& size : sizes)
+	{
+		std::string path = GetTemporaryPath("DecoderThreadingBenchmark.nut");
+		std::vector<TestVideoSegment> segments = { { size[0], size[1], 30 } };
+		TestClip clip;
+		if (WriteVideoTestMedia(path, "nut", segments, { 30, 1 }, AV_CODEC_ID_MPEG2VIDEO) < 0 || ReadTestClip(path, clip) < 0)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			remove(path.c_str());
+			return 1;
+		}
+
+		MeasureClip("generated", clip);
+		FreeTestClip(clip);
+		remove(path.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Bytes read and demuxer CPU time with unused streams discarded.
+* File Name: DemuxBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <stdio.h>
+#include <thread>
+
+#include "BenchmarkUtilities.h"
+#include "FFmpegDemuxer.h"
+#include "TestMedia.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+static const int AudioTracks = 4;
+static const int SubtitleTracks = 4;
+
+// A movie with several audio languages and subtitle tracks, of which a
+// player uses one video and one audio stream.
+static std::vector<TestStreamSpec> GetStreams()
+{
+	std::vector<TestStreamSpec> streams;
+	streams.push_back({ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, { 1, 1000 }, 40, 12, 10000, 60000 });
+	for (int i = 0; i < AudioTracks; ++i)
+	{
+		streams.push_back({ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, { 1, 1000 }, 32, 1, 1500, 2000 });
+	}
+	for (int i = 0; i < SubtitleTracks; ++i)
+	{
+		streams.push_back({ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_TEXT, { 1, 1000 }, 2000, 1, 20, 100 });
+	}
+
+	return streams;
+}
+
+// Demuxes the whole file with the given streams enabled, every stream has
+// its own consumer thread.
+static void Measure(const char* name, const std::string& path, const std::vector<int>& enabledStreams)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return;
+	}
+
+	Stopwatch stopwatch;
+	DemuxerStatistics statistics;
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 32, 16 * 1024 * 1024);
+		for (int streamIndex : enabledStreams)
+		{
+			demuxer.EnableStream(streamIndex);
+		}
+		demuxer.Start();
+
+		std::vector<std::thread> consumers;
+		for (int streamIndex : enabledStreams)
+		{
+			consumers.emplace_back([&demuxer, streamIndex]
+			{
+				AVPacket* avPacket;
+				while (demuxer.ReadPacket(streamIndex, &avPacket) >= 0)
+				{
+					demuxer.ReleasePacket(avPacket);
+				}
+			});
+		}
+
+		for (auto& consumer : consumers)
+		{
+			consumer.join();
+		}
+
+		demuxer.Stop();
+		statistics = demuxer.GetStatistics();
+	}
+
+	printf("%-22s %8.1f MB read %8llu packets %8.1f ms demuxer CPU %8.1f ms av_read_frame %8.1f ms total\n",
+		name,
+		statistics.bytesRead / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(statistics.packetsRead),
+		statistics.cpuTime / 1000.0,
+		statistics.readTime / 1000.0,
+		stopwatch.GetSeconds() * 1000.0);
+
+	avformat_close_input(&avFormatCtx);
+}
+
+int main(int argc, char* argv[])
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	// A real file may be given, its first video and audio stream are used.
+	std::string path;
+	bool temporary = argc < 2;
+	if (temporary)
+	{
+		path = GetTemporaryPath("DemuxBenchmark.mkv");
+		TestMediaInfo info;
+		if (WriteTestMedia(path, "matroska", GetStreams(), Scaled(600), info) < 0)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			return 1;
+		}
+	}
+	else
+	{
+		path = argv[1];
+	}
+
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return 1;
+	}
+
+	std::vector<int> allStreams;
+	std::vector<int> selectedStreams;
+	int video = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+	int audio = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+	{
+		allStreams.push_back(i);
+		if (static_cast<int>(i) == video || static_cast<int>(i) == audio)
+		{
+			selectedStreams.push_back(i);
+		}
+	}
+	avformat_close_input(&avFormatCtx);
+
+	// Reading every stream is what the reader did before the unused streams
+	// were discarded in the demuxer.
+	Measure("all streams", path, allStreams);
+	Measure("video and audio only", path, selectedStreams);
+
+	if (temporary)
+	{
+		remove(path.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Video conversion cost around frame size switches.
+* File Name: FormatChangeBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <stdio.h>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "BufferPool.h"
+#include "PixelConversion.h"
+#include "TestMedia.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+// Frames which wait for the renderer while the next ones are converted.
+static const size_t FramesInFlight = 4;
+
+// The output buffers kept per converter, VideoBufferPoolDepth of the config.
+static const unsigned int BufferPoolDepth = 5;
+
+// The converter of one frame size and format, set up like the one of the
+// video provider: a scaler context, the fast path if there is one, and a
+// pool of NV12 output buffers.
+struct Converter
+{
+	int width;
+	int height;
+	AVPixelFormat format;
+	SwsContext* swsCtx;
+	PixelConversionFunction convert;
+	BufferPool* bufferPool;
+	int lineSize[4];
+};
+
+// The last maxConverters converters, the current one first.
+class ConverterCache
+{
+public:
+	explicit ConverterCache(size_t maxConverters)
+		: m_maxConverters(maxConverters)
+		, m_created(0)
+	{
+	}
+
+	~ConverterCache()
+	{
+		for (auto converter : m_converters)
+		{
+			Free(converter);
+		}
+	}
+
+	Converter* Get(const AVFrame* avFrame)
+	{
+		auto format = static_cast<AVPixelFormat>(avFrame->format);
+		auto entry = std::find_if(m_converters.begin(), m_converters.end(), [&](Converter* converter)
+		{
+			return converter->width == avFrame->width && converter->height == avFrame->height && converter->format == format;
+		});
+
+		Converter* result;
+		if (entry != m_converters.end())
+		{
+			result = *entry;
+			m_converters.erase(entry);
+		}
+		else
+		{
+			if (m_converters.size() >= m_maxConverters)
+			{
+				Free(m_converters.back());
+				m_converters.pop_back();
+			}
+
+			result = Create(avFrame->width, avFrame->height, format);
+		}
+
+		m_converters.insert(m_converters.begin(), result);
+		return result;
+	}
+
+	int GetCreated() const { return m_created; }
+
+private:
+	Converter* Create(int width, int height, AVPixelFormat format)
+	{
+		auto converter = new Converter();
+		converter->width = width;
+		converter->height = height;
+		converter->format = format;
+		converter->swsCtx = sws_getContext(width, height, format, width, height, AV_PIX_FMT_NV12, SWS_BICUBIC, nullptr, nullptr, nullptr);
+		converter->convert = GetPixelConversion(format, AV_PIX_FMT_NV12);
+		av_image_fill_linesizes(converter->lineSize, AV_PIX_FMT_NV12, width);
+		converter->bufferPool = new BufferPool(av_image_get_buffer_size(AV_PIX_FMT_NV12, width, height, 1), BufferPoolDepth);
+
+		++m_created;
+		return converter;
+	}
+
+	static void Free(Converter* converter)
+	{
+		sws_freeContext(converter->swsCtx);
+		converter->bufferPool->Close();
+		delete converter;
+	}
+
+	size_t m_maxConverters;
+	std::vector<Converter*> m_converters;
+	int m_created;
+};
+
+// Decodes the clip and converts every frame, only the conversion is timed:
+// the converter lookup or creation, the output buffer and the pixels.
+static void Measure(const std::string& path, size_t maxConverters)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return;
+	}
+
+	const AVCodec* avCodec = avcodec_find_decoder(avFormatCtx->streams[0]->codecpar->codec_id);
+	AVCodecContext* avCodecCtx = avcodec_alloc_context3(avCodec);
+	avcodec_parameters_to_context(avCodecCtx, avFormatCtx->streams[0]->codecpar);
+	if (avcodec_open2(avCodecCtx, avCodec, nullptr) < 0)
+	{
+		fprintf(stderr, "cannot decode %s\n", path.c_str());
+		avcodec_free_context(&avCodecCtx);
+		avformat_close_input(&avFormatCtx);
+		return;
+	}
+
+	AVPacket* avPacket = av_packet_alloc();
+	AVFrame* avFrame = av_frame_alloc();
+
+	std::vector<double> switchTimes;
+	std::vector<double> frameTimes;
+	int created;
+	{
+		ConverterCache converters(maxConverters);
+		std::deque<AVBufferRef*> inFlight;
+		int width = 0;
+		int height = 0;
+
+		while (av_read_frame(avFormatCtx, avPacket) >= 0)
+		{
+			int ret = avcodec_send_packet(avCodecCtx, avPacket);
+			av_packet_unref(avPacket);
+
+			while (ret >= 0 && avcodec_receive_frame(avCodecCtx, avFrame) >= 0)
+			{
+				Stopwatch stopwatch;
+
+				Converter* converter = converters.Get(avFrame);
+				AVBufferRef* buffer = converter->bufferPool->Acquire();
+				if (!buffer)
+				{
+					fprintf(stderr, "out of memory\n");
+					av_frame_unref(avFrame);
+					break;
+				}
+
+				uint8_t* data[4];
+				av_image_fill_pointers(data, AV_PIX_FMT_NV12, avFrame->height, buffer->data, converter->lineSize);
+				if (converter->convert)
+				{
+					converter->convert(avFrame->data, avFrame->linesize, data, converter->lineSize, avFrame->width, 0, avFrame->height);
+				}
+				else
+				{
+					sws_scale(converter->swsCtx, avFrame->data, avFrame->linesize, 0, avFrame->height, data, converter->lineSize);
+				}
+
+				double milliseconds = stopwatch.GetSeconds() * 1000.0;
+				bool switched = avFrame->width != width || avFrame->height != height;
+				(switched ? switchTimes : frameTimes).push_back(milliseconds);
+				width = avFrame->width;
+				height = avFrame->height;
+
+				inFlight.push_back(buffer);
+				if (inFlight.size() > FramesInFlight)
+				{
+					av_buffer_unref(&inFlight.front());
+					inFlight.pop_front();
+				}
+
+				av_frame_unref(avFrame);
+			}
+		}
+
+		for (auto buffer : inFlight)
+		{
+			av_buffer_unref(&buffer);
+		}
+
+		created = converters.GetCreated();
+	}
+
+	av_frame_free(&avFrame);
+	av_packet_free(&avPacket);
+	avcodec_free_context(&avCodecCtx);
+	avformat_close_input(&avFormatCtx);
+
+	printf("%zu converters kept: %3d created, %3zu switches %8.3f ms p50 %8.3f ms max, %4zu other frames %8.3f ms p50 %8.3f ms max\n",
+		maxConverters,
+		created,
+		switchTimes.size(),
+		Percentile(switchTimes, 0.5),
+		Percentile(switchTimes, 1.0),
+		frameTimes.size(),
+		Percentile(frameTimes, 0.5),
+		Percentile(frameTimes, 1.0));
+}
+
+int main()
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	// An adaptive stream which keeps switching between three renditions.
+	std::vector<TestVideoSegment> segments;
+	const int sizes[][2] = { { 1920, 1080 }, { 1280, 720 }, { 640, 360 }, { 1280, 720 } };
+	int switches = std::max(4, Scaled(24));
+	for (int i = 0; i < switches; ++i)
+	{
+		segments.push_back({ sizes[i % 4][0], sizes[i % 4][1], 8 });
+	}
+
+	std::string path = GetTemporaryPath("FormatChangeBenchmark.nut");
+	if (WriteVideoTestMedia(path, "nut", segments, { 25, 1 }) < 0)
+	{
+		fprintf(stderr, "cannot write %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("%d segments of 8 frames, 1080p, 720p, 360p, 720p, ...\n", switches);
+
+	// One converter is what a cache without reuse does, every switch sets
+	// up the scaler and output buffers again.
+	Measure(path, 1);
+	Measure(path, 4);
+
+	remove(path.c_str());
+
+	return 0;
+}
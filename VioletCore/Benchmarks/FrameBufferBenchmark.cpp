@@ -0,0 +1,112 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Frame buffer bandwidth with per-frame allocation and a pool.
+* File Name: FrameBufferBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <deque>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "BenchmarkUtilities.h"
+#include "FrameBufferPool.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+
+// An NV12 frame in the contiguous layout of the video provider.
+static const int FrameWidth = 3840;
+static const int FrameHeight = 2160;
+static const int FrameSize = FrameWidth * FrameHeight * 3 / 2 + 64;
+
+// Frames which wait for the renderer while the decoder fills the next ones.
+static const size_t FramesInFlight = 4;
+
+// The decoder writes every byte of the frame, the renderer reads it.
+static uint64_t DecodeAndRender(AVBufferRef* buffer, int frame)
+{
+	memset(buffer->data, frame & 0xff, FrameSize);
+
+	uint64_t sum = 0;
+	const uint64_t* words = reinterpret_cast<const uint64_t*>(buffer->data);
+	for (size_t i = 0; i < FrameSize / sizeof(uint64_t); ++i)
+	{
+		sum += words[i];
+	}
+
+	return sum;
+}
+
+static void Measure(const char* name, int frames, const std::function<AVBufferRef*()>& getBuffer)
+{
+	std::deque<AVBufferRef*> inFlight;
+	uint64_t checksum = 0;
+
+	rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	Stopwatch stopwatch;
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		AVBufferRef* buffer = getBuffer();
+		if (!buffer)
+		{
+			fprintf(stderr, "out of memory\n");
+			break;
+		}
+
+		checksum += DecodeAndRender(buffer, frame);
+
+		inFlight.push_back(buffer);
+		if (inFlight.size() > FramesInFlight)
+		{
+			av_buffer_unref(&inFlight.front());
+			inFlight.pop_front();
+		}
+	}
+
+	for (auto buffer : inFlight)
+	{
+		av_buffer_unref(&buffer);
+	}
+
+	double seconds = stopwatch.GetSeconds();
+	rusage after;
+	getrusage(RUSAGE_SELF, &after);
+
+	// Written once and read once per frame
+	double bytes = 2.0 * FrameSize * frames;
+	printf("%-20s %8.1f frames/s %8.2f GB/s %10ld minor faults %8.1f faults/frame (checksum %llx)\n",
+		name,
+		frames / seconds,
+		bytes / seconds / 1e9,
+		after.ru_minflt - before.ru_minflt,
+		static_cast<double>(after.ru_minflt - before.ru_minflt) / frames,
+		static_cast<unsigned long long>(checksum));
+}
+
+int main()
+{
+	int frames = Scaled(600);
+
+	printf("%dx%d NV12, %.1f MB per frame, %zu frames in flight\n",
+		FrameWidth, FrameHeight, FrameSize / (1024.0 * 1024.0), FramesInFlight);
+
+	// What get_buffer2 did before, every frame is a fresh allocation which
+	// the OS maps in page by page.
+	Measure("av_buffer_alloc", frames, []
+	{
+		return av_buffer_alloc(FrameSize);
+	});
+
+	FrameBufferPool pool;
+	Measure("FrameBufferPool", frames, [&pool]
+	{
+		return pool.Get(FrameSize);
+	});
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Page faults and throughput of the memory-mapped file backend.
+* File Name: MappedFileBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "MappedFileBackend.h"
+#include "TestMedia.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+// The AVIO buffer size the reader uses by default.
+static const int ReadSize = 16 * 1024;
+
+// Drops the clean pages of the file from the page cache, so that every run
+// starts cold. Pages which are still mapped stay.
+static void EvictFromPageCache(const std::string& path)
+{
+	int file = open(path.c_str(), O_RDONLY);
+	if (file >= 0)
+	{
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+	}
+}
+
+// Reads the file front to back.
+static int64_t ReadForward(StreamBackend& backend, int64_t size)
+{
+	std::vector<uint8_t> buffer(ReadSize);
+	int64_t total = 0;
+	int ret;
+	while (total < size && (ret = backend.Read(buffer.data(), ReadSize)) > 0)
+	{
+		total += ret;
+	}
+
+	return total;
+}
+
+// Reverse playback: seeks back a GOP at a time from the end and reads the
+// GOP forward.
+static int64_t ReadBackward(StreamBackend& backend, int64_t size)
+{
+	const int64_t GopSize = 2 * 1024 * 1024;
+
+	std::vector<uint8_t> buffer(ReadSize);
+	int64_t total = 0;
+	for (int64_t position = size - GopSize; position >= 0; position -= GopSize)
+	{
+		backend.Seek(position);
+		for (int64_t read = 0; read < GopSize; read += ReadSize)
+		{
+			int ret = backend.Read(buffer.data(), ReadSize);
+			if (ret <= 0)
+			{
+				break;
+			}
+			total += ret;
+		}
+	}
+
+	return total;
+}
+
+static void Measure(const char* name, const std::string& path, StreamBackend* backend, const std::function<int64_t(StreamBackend&, int64_t)>& pattern)
+{
+	std::unique_ptr<StreamBackend> owner(backend);
+	if (!backend)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return;
+	}
+
+	rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	Stopwatch stopwatch;
+
+	int64_t bytes = pattern(*backend, backend->GetSize());
+
+	double seconds = stopwatch.GetSeconds();
+	rusage after;
+	getrusage(RUSAGE_SELF, &after);
+
+	printf("%-28s %8.1f MB/s %8ld minor faults %6ld major faults\n",
+		name,
+		bytes / (1024.0 * 1024.0) / seconds,
+		after.ru_minflt - before.ru_minflt,
+		after.ru_majflt - before.ru_majflt);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string path;
+	bool temporary = argc < 2;
+	if (temporary)
+	{
+		path = GetTemporaryPath("MappedFileBenchmark.bin");
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			return 1;
+		}
+
+		std::vector<uint8_t> chunk(1024 * 1024);
+		for (int i = 0; i < Scaled(512); ++i)
+		{
+			for (size_t j = 0; j < chunk.size(); ++j)
+			{
+				chunk[j] = static_cast<uint8_t>(i + j);
+			}
+			fwrite(chunk.data(), 1, chunk.size(), file);
+		}
+		fclose(file);
+	}
+	else
+	{
+		path = argv[1];
+	}
+
+	struct Pattern
+	{
+		const char* name;
+		int64_t (*read)(StreamBackend&, int64_t);
+	};
+
+	const Pattern patterns[] =
+	{
+		{ "forward", ReadForward },
+		{ "backward", ReadBackward },
+	};
+
+	for (auto& pattern : patterns)
+	{
+		std::string fileName = std::string(pattern.name) + ", FileStreamBackend";
+		std::string mappedName = std::string(pattern.name) + ", MappedFileBackend";
+
+		EvictFromPageCache(path);
+		Measure(fileName.c_str(), path, FileStreamBackend::Open(path.c_str()), pattern.read);
+
+		EvictFromPageCache(path);
+		Measure(mappedName.c_str(), path, MappedFileBackend::Open(path.c_str()), pattern.read);
+	}
+
+	if (temporary)
+	{
+		remove(path.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Push/pop throughput of the packet queue.
+* File Name: PacketQueueBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <stdio.h>
+#include <thread>
+
+#include "BenchmarkUtilities.h"
+#include "PacketQueue.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+
+// The queue the sample providers used before, a std::queue behind a lock.
+class LockedQueue
+{
+public:
+	explicit LockedQueue(size_t capacity) : m_capacity(capacity) {}
+
+	bool Push(AVPacket* avPacket)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_queue.size() >= m_capacity)
+		{
+			return false;
+		}
+
+		m_queue.push(avPacket);
+		return true;
+	}
+
+	AVPacket* Pop()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_queue.empty())
+		{
+			return nullptr;
+		}
+
+		AVPacket* result = m_queue.front();
+		m_queue.pop();
+		return result;
+	}
+
+private:
+	std::mutex m_mutex;
+	std::queue<AVPacket*> m_queue;
+	size_t m_capacity;
+};
+
+// Push and pop on one thread, the cost of the operations themselves.
+template<class Queue>
+static double SingleThread(Queue& queue, std::vector<AVPacket*>& packets, int iterations)
+{
+	Stopwatch stopwatch;
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (AVPacket* avPacket : packets)
+		{
+			queue.Push(avPacket);
+		}
+		for (size_t j = 0; j < packets.size(); ++j)
+		{
+			queue.Pop();
+		}
+	}
+
+	return stopwatch.GetSeconds() * 1e9 / (2.0 * iterations * packets.size());
+}
+
+// A demuxer thread pushes, the calling thread pops, both spin when the
+// queue is full or empty.
+template<class Queue>
+static double TwoThreads(Queue& queue, std::vector<AVPacket*>& packets, int count)
+{
+	Stopwatch stopwatch;
+
+	std::thread demuxer([&]
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			while (!queue.Push(packets[i % packets.size()]))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	for (int i = 0; i < count; )
+	{
+		if (queue.Pop())
+		{
+			++i;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	demuxer.join();
+
+	return count / stopwatch.GetSeconds() / 1e6;
+}
+
+int main()
+{
+	const size_t Capacity = 64;
+	const int Iterations = Scaled(200000);
+	const int Count = Scaled(20000000);
+
+	// The queues only store the pointers, the packets are never freed by
+	// them in this benchmark.
+	PacketPool pool;
+	std::vector<AVPacket*> packets;
+	for (size_t i = 0; i < Capacity; ++i)
+	{
+		packets.push_back(pool.Acquire());
+		packets.back()->size = 1000;
+	}
+
+	std::vector<AVPacket*> batch(packets.begin(), packets.begin() + 16);
+
+	{
+		PacketQueue queue(Capacity, pool);
+		LockedQueue lockedQueue(Capacity);
+		printf("single thread, ns per operation: PacketQueue %.2f, locked std::queue %.2f\n",
+			SingleThread(queue, batch, Iterations), SingleThread(lockedQueue, batch, Iterations));
+	}
+
+	{
+		PacketQueue queue(Capacity, pool);
+		LockedQueue lockedQueue(Capacity);
+		printf("demuxer and consumer thread, Mpackets/s: PacketQueue %.2f, locked std::queue %.2f\n",
+			TwoThreads(queue, packets, Count), TwoThreads(lockedQueue, packets, Count));
+	}
+
+	for (AVPacket* avPacket : packets)
+	{
+		pool.Release(avPacket);
+	}
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The fast pixel format conversions against sws_scale.
+* File Name: PixelConversionBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "PixelConversion.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+
+// A picture in one buffer with the default line sizes.
+struct Picture
+{
+	Picture(AVPixelFormat format, int width, int height)
+		: buffer(av_image_get_buffer_size(format, width, height, 64) + 64, 0x80)
+	{
+		av_image_fill_arrays(data, linesize, buffer.data(), format, width, height, 64);
+	}
+
+	std::vector<uint8_t> buffer;
+	uint8_t* data[4];
+	int linesize[4];
+};
+
+// Repeats the conversion for about half a second and returns the time of
+// one frame in milliseconds.
+static double Measure(const std::function<void()>& convert)
+{
+	convert();
+
+	double budget = 0.5 * GetScale();
+	int frames = 0;
+	Stopwatch stopwatch;
+	do
+	{
+		convert();
+		++frames;
+	} while (stopwatch.GetSeconds() < budget || frames < 3);
+
+	return stopwatch.GetSeconds() * 1000.0 / frames;
+}
+
+static void Compare(AVPixelFormat srcFormat, AVPixelFormat dstFormat, int width, int height)
+{
+	Picture source(srcFormat, width, height);
+	Picture target(dstFormat, width, height);
+
+	PixelConversionFunction convert = GetPixelConversion(srcFormat, dstFormat);
+	double fast = Measure([&]
+	{
+		convert(source.data, source.linesize, target.data, target.linesize, width, 0, height);
+	});
+
+	SwsContext* swsCtx = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BICUBIC, nullptr, nullptr, nullptr);
+	double scaled = Measure([&]
+	{
+		sws_scale(swsCtx, source.data, source.linesize, 0, height, target.data, target.linesize);
+	});
+	sws_freeContext(swsCtx);
+
+	// Read once and written once
+	double bytes = 2.0 * av_image_get_buffer_size(dstFormat, width, height, 1);
+	printf("%-12s to %-8s %5dx%-5d %8.3f ms %8.2f GB/s fast %8.3f ms %8.2f GB/s sws_scale %6.1fx\n",
+		av_pix_fmt_desc_get(srcFormat)->name,
+		av_pix_fmt_desc_get(dstFormat)->name,
+		width,
+		height,
+		fast,
+		bytes / fast / 1e6,
+		scaled,
+		bytes / scaled / 1e6,
+		scaled / fast);
+}
+
+// The cost of a 10 bit frame for both outputs of the video provider: P010
+// on the fast path, or NV12 through sws_scale with ForceNv12Output.
+static void CompareOutputs(int width, int height)
+{
+	Picture source(AV_PIX_FMT_YUV420P10LE, width, height);
+	Picture p010(AV_PIX_FMT_P010LE, width, height);
+	Picture nv12(AV_PIX_FMT_NV12, width, height);
+
+	PixelConversionFunction convert = GetPixelConversion(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE);
+	double p010Time = Measure([&]
+	{
+		convert(source.data, source.linesize, p010.data, p010.linesize, width, 0, height);
+	});
+
+	SwsContext* swsCtx = sws_getContext(width, height, AV_PIX_FMT_YUV420P10LE, width, height, AV_PIX_FMT_NV12, SWS_BICUBIC, nullptr, nullptr, nullptr);
+	double nv12Time = Measure([&]
+	{
+		sws_scale(swsCtx, source.data, source.linesize, 0, height, nv12.data, nv12.linesize);
+	});
+	sws_freeContext(swsCtx);
+
+	printf("yuv420p10le  %5dx%-5d to P010 %8.3f ms/frame %6.1f MB/frame, to NV12 %8.3f ms/frame %6.1f MB/frame\n",
+		width,
+		height,
+		p010Time,
+		av_image_get_buffer_size(AV_PIX_FMT_P010LE, width, height, 1) / 1e6,
+		nv12Time,
+		av_image_get_buffer_size(AV_PIX_FMT_NV12, width, height, 1) / 1e6);
+}
+
+// Usage: PixelConversionBenchmark [scalar|sse2|avx2]
+// The kernels are picked once per process, start it once per instruction set
+// to compare them.
+int main(int argc, char* argv[])
+{
+	const char* kernel = "best";
+	if (argc > 1)
+	{
+		int forced = strcmp(argv[1], "avx2") == 0 ? AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_AVX2
+			: strcmp(argv[1], "sse2") == 0 ? AV_CPU_FLAG_SSE2
+			: 0;
+		if ((av_get_cpu_flags() & forced) != forced)
+		{
+			fprintf(stderr, "%s is not supported\n", argv[1]);
+			return 1;
+		}
+
+		av_force_cpu_flags(forced);
+		kernel = argv[1];
+	}
+
+	printf("%s kernels\n", kernel);
+
+	const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (auto& size : sizes)
+	{
+		Compare(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, size[0], size[1]);
+		Compare(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE, size[0], size[1]);
+	}
+
+	CompareOutputs(3840, 2160);
+
+	return 0;
+}
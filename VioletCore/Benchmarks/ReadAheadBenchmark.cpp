@@ -0,0 +1,151 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Throughput of the read-ahead layer over a POSIX file backend.
+* File Name: ReadAheadBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+#include "BenchmarkUtilities.h"
+#include "ReadAheadStream.h"
+#include "TestMedia.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+// The AVIO buffer size the reader uses by default.
+static const int StreamBufferSize = 16 * 1024;
+
+// Adds a fixed latency to every read of the wrapped backend, like a network
+// share or a slow disk.
+class SlowBackend : public StreamBackend
+{
+public:
+	SlowBackend(StreamBackend* backend, int latency)
+		: m_backend(backend)
+		, m_latency(latency)
+	{
+	}
+
+	virtual int Read(uint8_t* buffer, int size) override
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(m_latency));
+		return m_backend->Read(buffer, size);
+	}
+
+	virtual int64_t Seek(int64_t position) override { return m_backend->Seek(position); }
+	virtual int64_t GetSize() override { return m_backend->GetSize(); }
+
+private:
+	std::unique_ptr<StreamBackend> m_backend;
+	int m_latency;
+};
+
+// Busy for the given time, like the demuxer parsing the data it read.
+static void Parse(double microseconds)
+{
+	Stopwatch stopwatch;
+	while (stopwatch.GetMicroseconds() < microseconds)
+	{
+	}
+}
+
+// Reads the whole file in AVIO sized pieces and returns MB/s.
+static double Measure(const std::string& path, int latency, double parseTime, size_t blockSize, unsigned int blockCount)
+{
+	StreamBackend* backend = FileStreamBackend::Open(path.c_str());
+	if (!backend)
+	{
+		return 0;
+	}
+
+	ReadAheadStream stream(latency > 0 ? new SlowBackend(backend, latency) : backend, blockSize, blockCount);
+	std::vector<uint8_t> buffer(StreamBufferSize);
+
+	Stopwatch stopwatch;
+	int64_t total = 0;
+	int ret;
+	while ((ret = stream.Read(buffer.data(), StreamBufferSize)) > 0)
+	{
+		total += ret;
+		Parse(parseTime);
+	}
+
+	return total / (1024.0 * 1024.0) / stopwatch.GetSeconds();
+}
+
+int main(int argc, char* argv[])
+{
+	// A file on a cold disk may be given, the generated one is most likely
+	// in the page cache.
+	std::string path;
+	bool temporary = argc < 2;
+	if (temporary)
+	{
+		path = GetTemporaryPath("ReadAheadBenchmark.bin");
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			return 1;
+		}
+
+		std::mt19937 random(1);
+		std::vector<uint32_t> chunk(1024 * 1024 / 4);
+		for (int i = 0; i < Scaled(256); ++i)
+		{
+			for (auto& value : chunk)
+			{
+				value = random();
+			}
+			fwrite(chunk.data(), 1, chunk.size() * 4, file);
+		}
+		fclose(file);
+	}
+	else
+	{
+		path = argv[1];
+	}
+
+	struct Scenario
+	{
+		const char* name;
+		int latency;
+		double parseTime;
+	};
+
+	// Parsing 16 KiB takes about 10 us for a high bitrate file.
+	const Scenario scenarios[] =
+	{
+		{ "local file", 0, 10 },
+		{ "200 us per read", 200, 10 },
+		{ "2 ms per read", 2000, 10 },
+	};
+
+	const size_t blockSizes[] = { 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024 };
+
+	for (auto& scenario : scenarios)
+	{
+		printf("%s, MB/s:\n", scenario.name);
+		printf("  synchronous 16 KiB reads %8.1f\n", Measure(path, scenario.latency, scenario.parseTime, 0, 0));
+		for (size_t blockSize : blockSizes)
+		{
+			for (unsigned int blockCount = 2; blockCount <= 3; ++blockCount)
+			{
+				printf("  %u x %zu MiB blocks       %8.1f\n", blockCount, blockSize / (1024 * 1024),
+					Measure(path, scenario.latency, scenario.parseTime, blockSize, blockCount));
+			}
+		}
+	}
+
+	if (temporary)
+	{
+		remove(path.c_str());
+	}
+
+	return 0;
+}
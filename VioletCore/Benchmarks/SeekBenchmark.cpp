@@ -0,0 +1,171 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Seek latency with and without the keyframe seek index.
+* File Name: SeekBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+#include "BenchmarkUtilities.h"
+#include "FFmpegDemuxer.h"
+#include "KeyframeScanner.h"
+#include "TestMedia.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+static std::vector<TestStreamSpec> GetStreams()
+{
+	return
+	{
+		{ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, { 1, 90000 }, 3600, 50, 5000, 60000 },
+		{ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_MP3, { 1, 90000 }, 2160, 1, 300, 500 },
+	};
+}
+
+// The first and last time stamp of the stream, from reading the file once.
+static bool GetTimeRange(const std::string& path, int streamIndex, int64_t& first, int64_t& last)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		return false;
+	}
+
+	first = AV_NOPTS_VALUE;
+	last = AV_NOPTS_VALUE;
+	AVPacket* avPacket = av_packet_alloc();
+	while (av_read_frame(avFormatCtx, avPacket) >= 0)
+	{
+		int64_t timestamp = avPacket->pts != AV_NOPTS_VALUE ? avPacket->pts : avPacket->dts;
+		if (avPacket->stream_index == streamIndex && timestamp != AV_NOPTS_VALUE)
+		{
+			first = first == AV_NOPTS_VALUE ? timestamp : std::min(first, timestamp);
+			last = last == AV_NOPTS_VALUE ? timestamp : std::max(last, timestamp);
+		}
+		av_packet_unref(avPacket);
+	}
+
+	av_packet_free(&avPacket);
+	avformat_close_input(&avFormatCtx);
+
+	return first != AV_NOPTS_VALUE && last > first;
+}
+
+// Seeks to random positions and reads the first packet of the stream after
+// each one, the latency a scrub sees from the demuxer.
+static void Measure(const char* name, const std::string& path, int streamIndex, int64_t first, int64_t last, SeekIndex* seekIndex)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	std::vector<double> latencies;
+	DemuxerStatistics statistics;
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 16, 16 * 1024 * 1024);
+		demuxer.SetSeekIndex(seekIndex);
+		demuxer.EnableStream(streamIndex);
+		demuxer.Start();
+
+		std::mt19937 random(7);
+		for (int i = 0; i < Scaled(200); ++i)
+		{
+			int64_t target = std::uniform_int_distribution<int64_t>(first, last)(random);
+
+			Stopwatch stopwatch;
+			demuxer.Seek(streamIndex, target, AVSEEK_FLAG_BACKWARD);
+			AVPacket* avPacket;
+			if (demuxer.ReadPacket(streamIndex, &avPacket) >= 0)
+			{
+				demuxer.ReleasePacket(avPacket);
+			}
+			latencies.push_back(stopwatch.GetMicroseconds() / 1000.0);
+		}
+
+		demuxer.Stop();
+		statistics = demuxer.GetStatistics();
+	}
+
+	printf("%-16s seek to first packet, ms: median %7.2f  90%% %7.2f  max %7.2f  (%llu of %llu seeks indexed)\n",
+		name,
+		Percentile(latencies, 0.5),
+		Percentile(latencies, 0.9),
+		Percentile(latencies, 1.0),
+		static_cast<unsigned long long>(statistics.indexedSeeks),
+		static_cast<unsigned long long>(statistics.seeks));
+
+	avformat_close_input(&avFormatCtx);
+}
+
+int main(int argc, char* argv[])
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	// The index pays off on long recordings without a usable index of their
+	// own (raw TS, broken cues), pass one for meaningful numbers.
+	std::string path;
+	bool temporary = argc < 2;
+	if (temporary)
+	{
+		path = GetTemporaryPath("SeekBenchmark.ts");
+		TestMediaInfo info;
+		if (WriteTestMedia(path, "mpegts", GetStreams(), Scaled(1800), info) < 0)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			return 1;
+		}
+	}
+	else
+	{
+		path = argv[1];
+	}
+
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		fprintf(stderr, "cannot open %s\n", path.c_str());
+		return 1;
+	}
+
+	int streamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+	if (streamIndex < 0)
+	{
+		streamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+	}
+	printf("format %s, byte seeks %s\n", avFormatCtx->iformat->name, FFmpegDemuxer::CanSeekToBytes(avFormatCtx->iformat) ? "allowed" : "not allowed");
+	avformat_close_input(&avFormatCtx);
+
+	int64_t first, last;
+	if (streamIndex < 0 || !GetTimeRange(path, streamIndex, first, last))
+	{
+		fprintf(stderr, "no time stamps in %s\n", path.c_str());
+		return 1;
+	}
+
+	Measure("without index", path, streamIndex, first, last, nullptr);
+
+	SeekIndex seekIndex;
+	KeyframeScanner scanner(FileStreamBackend::Open(path.c_str()), nullptr, &seekIndex, streamIndex);
+	scanner.Start();
+	while (!scanner.IsFinished())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	printf("background scan: %llu keyframes in %.1f ms\n", static_cast<unsigned long long>(scanner.GetKeyframeCount()), scanner.GetScanTime() / 1000.0);
+
+	Measure("with index", path, streamIndex, first, last, &seekIndex);
+
+	if (temporary)
+	{
+		remove(path.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,288 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Slice threaded decoding of 1 to 16 streams on the threads of
+*              every decoder and on the shared thread pool.
+* File Name: SliceThreadingBenchmark.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkUtilities.h"
+#include "DecoderThreading.h"
+#include "TestMedia.h"
+#include "ThreadPool.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Benchmarks;
+using namespace FFmpegInterop::Tests;
+
+enum class SliceMode
+{
+	// No slice threads, every stream decodes on its own thread only
+	OneThread,
+	// The slice threads FFmpeg starts for every codec context
+	OwnThreads,
+	// The same contexts, with execute on the shared pool
+	SharedPool,
+};
+
+static const char* GetModeName(SliceMode mode)
+{
+	return mode == SliceMode::OneThread ? "one thread" : mode == SliceMode::OwnThreads ? "own" : "shared";
+}
+
+// The threads of this process, or -1 where /proc is not there.
+static int GetProcessThreads()
+{
+	FILE* status = fopen("/proc/self/status", "r");
+	if (!status)
+	{
+		return -1;
+	}
+
+	int threads = -1;
+	char line[256];
+	while (fgets(line, sizeof(line), status))
+	{
+		if (strncmp(line, "Threads:", 8) == 0)
+		{
+			threads = atoi(line + 8);
+			break;
+		}
+	}
+
+	fclose(status);
+	return threads;
+}
+
+// One stream: a decoder opened like the media source opens it, whose
+// execute calls are counted, so the numbers show whether the codec split
+// its frames into slice jobs at all.
+class StreamDecoder
+{
+public:
+	StreamDecoder(const TestClip& clip, int threadCount, SliceMode mode)
+		: m_clip(clip)
+		, m_codecCtx(nullptr)
+		, m_execute(nullptr)
+		, m_jobs(0)
+	{
+		const AVCodec* avCodec = avcodec_find_decoder(clip.codecpar->codec_id);
+		m_codecCtx = avCodec ? avcodec_alloc_context3(avCodec) : nullptr;
+		if (!m_codecCtx)
+		{
+			return;
+		}
+
+		avcodec_parameters_to_context(m_codecCtx, clip.codecpar);
+		m_codecCtx->thread_type = FF_THREAD_SLICE;
+		m_codecCtx->thread_count = mode == SliceMode::OneThread ? 1 : threadCount;
+		if (avcodec_open2(m_codecCtx, avCodec, nullptr) < 0)
+		{
+			avcodec_free_context(&m_codecCtx);
+			return;
+		}
+
+		if (mode == SliceMode::SharedPool)
+		{
+			UseSharedSliceThreads(m_codecCtx);
+		}
+
+		m_execute = m_codecCtx->execute;
+		m_codecCtx->opaque = this;
+		m_codecCtx->execute = CountingExecute;
+	}
+
+	~StreamDecoder()
+	{
+		avcodec_free_context(&m_codecCtx);
+	}
+
+	bool IsOpen() const { return m_codecCtx != nullptr; }
+
+	uint64_t GetJobs() const { return m_jobs; }
+
+	// Decodes the clip once and adds the time of every frame, from sending
+	// its packet to receiving it.
+	int DecodeClip(AVFrame* avFrame, std::vector<double>& frameTimes)
+	{
+		int frames = 0;
+		for (size_t i = 0; i <= m_clip.packets.size(); ++i)
+		{
+			Stopwatch stopwatch;
+			avcodec_send_packet(m_codecCtx, i < m_clip.packets.size() ? m_clip.packets[i] : nullptr);
+			while (avcodec_receive_frame(m_codecCtx, avFrame) >= 0)
+			{
+				frameTimes.push_back(stopwatch.GetSeconds() * 1000.0);
+				++frames;
+				av_frame_unref(avFrame);
+			}
+		}
+
+		avcodec_flush_buffers(m_codecCtx);
+		return frames;
+	}
+
+private:
+	static int CountingExecute(AVCodecContext* codecCtx, int (*func)(AVCodecContext* c2, void* arg), void* arg, int* ret, int count, int size)
+	{
+		auto decoder = static_cast<StreamDecoder*>(codecCtx->opaque);
+		decoder->m_jobs += count;
+		return decoder->m_execute(codecCtx, func, arg, ret, count, size);
+	}
+
+	const TestClip& m_clip;
+	AVCodecContext* m_codecCtx;
+	int (*m_execute)(AVCodecContext* c, int (*func)(AVCodecContext* c2, void* arg), void* arg, int* ret, int count, int size);
+	std::atomic<uint64_t> m_jobs;
+};
+
+// Decodes the clip over and over on every stream at once and reports the
+// frame rate of all streams, the frame times, the threads of the process
+// and the context switches per frame.
+static void Measure(const TestClip& clip, int streams, SliceMode mode)
+{
+	DecoderThreadingInput input = {};
+	input.mediaType = AVMEDIA_TYPE_VIDEO;
+	input.codecId = clip.codecpar->codec_id;
+	input.width = clip.codecpar->width;
+	input.height = clip.codecpar->height;
+	input.lowLatency = true;
+	input.hardwareThreads = std::thread::hardware_concurrency();
+	DecoderThreads threads = ChooseDecoderThreads(input);
+
+	// The shared pool exists before any decoder, like in the media source
+	ThreadPool::GetShared();
+
+	std::vector<std::unique_ptr<StreamDecoder>> decoders;
+	for (int i = 0; i < streams; ++i)
+	{
+		decoders.emplace_back(new StreamDecoder(clip, threads.count, mode));
+		if (!decoders.back()->IsOpen())
+		{
+			fprintf(stderr, "cannot open the decoder\n");
+			return;
+		}
+	}
+
+	// Besides the stream threads, which are started below
+	int processThreads = GetProcessThreads();
+
+	double seconds = 1.0 * GetScale();
+	std::atomic<uint64_t> frames(0);
+	std::vector<std::vector<double>> frameTimes(streams);
+	std::vector<std::thread> streamThreads;
+
+	rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	Stopwatch total;
+
+	for (int i = 0; i < streams; ++i)
+	{
+		streamThreads.emplace_back([&, i]
+		{
+			AVFrame* avFrame = av_frame_alloc();
+			while (total.GetSeconds() < seconds)
+			{
+				frames += decoders[i]->DecodeClip(avFrame, frameTimes[i]);
+			}
+			av_frame_free(&avFrame);
+		});
+	}
+
+	for (auto& thread : streamThreads)
+	{
+		thread.join();
+	}
+
+	double elapsed = total.GetSeconds();
+	rusage after;
+	getrusage(RUSAGE_SELF, &after);
+
+	std::vector<double> allTimes;
+	uint64_t jobs = 0;
+	for (int i = 0; i < streams; ++i)
+	{
+		allTimes.insert(allTimes.end(), frameTimes[i].begin(), frameTimes[i].end());
+		jobs += decoders[i]->GetJobs();
+	}
+
+	long voluntary = after.ru_nvcsw - before.ru_nvcsw;
+	long involuntary = after.ru_nivcsw - before.ru_nivcsw;
+	double frameCount = frames > 0 ? static_cast<double>(frames) : 1.0;
+	printf("%2d streams %-10s %4d threads %8.1f frames/s %7.2f ms p50 %7.2f ms p99 %6.1f jobs/frame %7.2f switches/frame (%ld voluntary, %ld involuntary)\n",
+		streams,
+		GetModeName(mode),
+		processThreads,
+		frames / elapsed,
+		Percentile(allTimes, 0.5),
+		Percentile(allTimes, 0.99),
+		jobs / frameCount,
+		(voluntary + involuntary) / frameCount,
+		voluntary,
+		involuntary);
+}
+
+// Usage: SliceThreadingBenchmark [file]
+// Without a file it writes a 1080p MPEG-2 clip, whose decoder runs its
+// slices through execute. With a file of a codec which uses execute2 or
+// frame threads instead, the shared pool takes no jobs, see jobs/frame.
+int main(int argc, char* argv[])
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::string path = argc > 1 ? argv[1] : GetTemporaryPath("SliceThreadingBenchmark.nut");
+	if (argc <= 1)
+	{
+		std::vector<TestVideoSegment> segments = { { 1920, 1080, 30 } };
+		if (WriteVideoTestMedia(path, "nut", segments, { 30, 1 }, AV_CODEC_ID_MPEG2VIDEO) < 0)
+		{
+			fprintf(stderr, "cannot write %s\n", path.c_str());
+			return 1;
+		}
+	}
+
+	TestClip clip;
+	int ret = ReadTestClip(path, clip);
+	if (argc <= 1)
+	{
+		remove(path.c_str());
+	}
+
+	if (ret < 0)
+	{
+		fprintf(stderr, "cannot read the video of %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("%u cores, %s %dx%d, %zu frames\n",
+		std::thread::hardware_concurrency(),
+		avcodec_get_name(clip.codecpar->codec_id),
+		clip.codecpar->width,
+		clip.codecpar->height,
+		clip.packets.size());
+
+	for (int streams : { 1, 2, 4, 8, 16 })
+	{
+		for (SliceMode mode : { SliceMode::OneThread, SliceMode::OwnThreads, SliceMode::SharedPool })
+		{
+			Measure(clip, streams, mode);
+		}
+	}
+
+	FreeTestClip(clip);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of fixed-size output buffers.
+* File Name: BufferPool.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "BufferPool.h"
+
+using namespace FFmpegInterop;
+
+BufferPool::BufferPool(int bufferSize, unsigned int depth)
+	: m_bufferSize(bufferSize)
+	, m_depth(depth)
+	, m_buffersInUse(0)
+	, m_allocations(0)
+	, m_closed(false)
+{
+}
+
+BufferPool::~BufferPool()
+{
+	for (auto data : m_idleBuffers)
+	{
+		av_free(data);
+	}
+}
+
+AVBufferRef* BufferPool::Acquire()
+{
+	uint8_t* data = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_idleBuffers.empty())
+		{
+			data = m_idleBuffers.back();
+			m_idleBuffers.pop_back();
+		}
+	}
+
+	bool allocated = !data;
+	if (allocated)
+	{
+		data = static_cast<uint8_t*>(av_malloc(m_bufferSize));
+		if (!data)
+		{
+			return nullptr;
+		}
+	}
+
+	AVBufferRef* buffer = av_buffer_create(data, m_bufferSize, ReturnBuffer, this, 0);
+	if (!buffer)
+	{
+		av_free(data);
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_buffersInUse++;
+	if (allocated)
+	{
+		m_allocations++;
+	}
+
+	return buffer;
+}
+
+void BufferPool::Close()
+{
+	bool unused;
+	std::vector<uint8_t*> idleBuffers;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		idleBuffers.swap(m_idleBuffers);
+		unused = m_buffersInUse == 0;
+	}
+
+	for (auto data : idleBuffers)
+	{
+		av_free(data);
+	}
+
+	if (unused)
+	{
+		delete this;
+	}
+}
+
+unsigned int BufferPool::GetBuffersInUse()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_buffersInUse;
+}
+
+unsigned int BufferPool::GetIdleBuffers()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<unsigned int>(m_idleBuffers.size());
+}
+
+uint64_t BufferPool::GetAllocations()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_allocations;
+}
+
+void BufferPool::ReturnBuffer(void* opaque, uint8_t* data)
+{
+	auto pool = static_cast<BufferPool*>(opaque);
+	bool keep, unused;
+	{
+		std::lock_guard<std::mutex> lock(pool->m_mutex);
+		pool->m_buffersInUse--;
+		keep = !pool->m_closed && pool->m_idleBuffers.size() < pool->m_depth;
+		if (keep)
+		{
+			pool->m_idleBuffers.push_back(data);
+		}
+		unused = pool->m_closed && pool->m_buffersInUse == 0;
+	}
+
+	if (!keep)
+	{
+		av_free(data);
+	}
+
+	if (unused)
+	{
+		delete pool;
+	}
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of fixed-size output buffers.
+* File Name: BufferPool.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// Hands out buffers of one size as AVBufferRefs. When the last reference
+	// to a buffer is released, from any thread, it goes back to the pool if
+	// fewer than the depth of the pool are idle, and is freed otherwise. The
+	// pool grows on demand, so a consumer which holds many buffers is never
+	// blocked.
+	//
+	// The owner does not delete the pool but calls Close, the pool deletes
+	// itself once all buffers are back.
+	class BufferPool
+	{
+	public:
+		BufferPool(int bufferSize, unsigned int depth);
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		// Returns a buffer, or nullptr if out of memory.
+		AVBufferRef* Acquire();
+
+		// Frees the idle buffers and gives up the reference of the owner.
+		void Close();
+
+		int GetBufferSize() const { return m_bufferSize; }
+
+		// The number of buffers held by consumers.
+		unsigned int GetBuffersInUse();
+
+		// The number of buffers waiting for reuse.
+		unsigned int GetIdleBuffers();
+
+		// The number of buffers the pool had to allocate.
+		uint64_t GetAllocations();
+
+	private:
+		~BufferPool();
+
+		static void ReturnBuffer(void* opaque, uint8_t* data);
+
+		std::mutex m_mutex;
+		std::vector<uint8_t*> m_idleBuffers;
+
+		int m_bufferSize;
+		unsigned int m_depth;
+		unsigned int m_buffersInUse;
+		uint64_t m_allocations;
+		bool m_closed;
+	};
+}
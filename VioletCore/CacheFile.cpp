@@ -0,0 +1,174 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Reading and writing the small binary files of the on-disk caches.
+* File Name: CacheFile.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CacheFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+using namespace FFmpegInterop;
+
+namespace
+{
+#ifdef _WIN32
+	std::wstring ToWidePath(const std::string& path)
+	{
+		int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+		if (length <= 0)
+		{
+			return std::wstring();
+		}
+
+		std::wstring widePath(length, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+		widePath.resize(length - 1);
+
+		return widePath;
+	}
+#endif
+
+	FILE* OpenFile(const std::string& path, bool write)
+	{
+		FILE* file = nullptr;
+
+#ifdef _WIN32
+		_wfopen_s(&file, ToWidePath(path).c_str(), write ? L"wb" : L"rb");
+#else
+		file = fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+
+		return file;
+	}
+
+	bool ReplaceFile(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		return MoveFileExW(ToWidePath(from).c_str(), ToWidePath(to).c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	void RemoveFile(const std::string& path)
+	{
+#ifdef _WIN32
+		_wremove(ToWidePath(path).c_str());
+#else
+		remove(path.c_str());
+#endif
+	}
+}
+
+int FFmpegInterop::ReadCacheFile(const std::string& path, std::vector<uint8_t>& content)
+{
+	FILE* file = OpenFile(path, false);
+	if (!file)
+	{
+		return AVERROR(ENOENT);
+	}
+
+	content.clear();
+
+	uint8_t chunk[4096];
+	size_t bytesRead;
+	while ((bytesRead = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		content.insert(content.end(), chunk, chunk + bytesRead);
+	}
+
+	bool failed = ferror(file) != 0;
+	fclose(file);
+
+	return failed ? AVERROR(EIO) : 0;
+}
+
+int FFmpegInterop::WriteCacheFile(const std::string& path, const std::vector<uint8_t>& content)
+{
+	std::string temporaryPath = path + ".tmp";
+
+	FILE* file = OpenFile(temporaryPath, true);
+	if (!file)
+	{
+		return AVERROR(EIO);
+	}
+
+	bool written = fwrite(content.data(), 1, content.size(), file) == content.size();
+	written = fclose(file) == 0 && written;
+
+	if (!written || !ReplaceFile(temporaryPath, path))
+	{
+		RemoveFile(temporaryPath);
+		return AVERROR(EIO);
+	}
+
+	return 0;
+}
+
+void FFmpegInterop::WriteCacheUInt(std::vector<uint8_t>& buffer, uint64_t value)
+{
+	do
+	{
+		uint8_t byte = value & 0x7f;
+		value >>= 7;
+		buffer.push_back(value ? byte | 0x80 : byte);
+	} while (value);
+}
+
+void FFmpegInterop::WriteCacheInt(std::vector<uint8_t>& buffer, int64_t value)
+{
+	WriteCacheUInt(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void FFmpegInterop::WriteCacheBytes(std::vector<uint8_t>& buffer, const uint8_t* data, size_t size)
+{
+	buffer.insert(buffer.end(), data, data + size);
+}
+
+bool FFmpegInterop::ReadCacheUInt(const std::vector<uint8_t>& buffer, size_t& offset, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && offset < buffer.size(); shift += 7)
+	{
+		uint8_t byte = buffer[offset++];
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FFmpegInterop::ReadCacheInt(const std::vector<uint8_t>& buffer, size_t& offset, int64_t& value)
+{
+	uint64_t encoded;
+	if (!ReadCacheUInt(buffer, offset, encoded))
+	{
+		return false;
+	}
+
+	value = static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+	return true;
+}
+
+bool FFmpegInterop::ReadCacheBytes(const std::vector<uint8_t>& buffer, size_t& offset, uint8_t* data, size_t size)
+{
+	if (size > buffer.size() - offset)
+	{
+		return false;
+	}
+
+	memcpy(data, buffer.data() + offset, size);
+	offset += size;
+
+	return true;
+}
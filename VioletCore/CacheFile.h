@@ -0,0 +1,38 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Reading and writing the small binary files of the on-disk caches.
+* File Name: CacheFile.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// Reads the whole file with the given UTF-8 path.
+	// Return value:
+	//   0 if successful, otherwise a negative AVERROR code.
+	int ReadCacheFile(const std::string& path, std::vector<uint8_t>& content);
+
+	// Replaces the file with the given UTF-8 path. The content goes to a
+	// temporary file first, so that a crash never leaves a torn file behind.
+	// Return value:
+	//   0 if successful, otherwise a negative AVERROR code.
+	int WriteCacheFile(const std::string& path, const std::vector<uint8_t>& content);
+
+	// LEB128 varints, signed values are zigzag encoded.
+	void WriteCacheUInt(std::vector<uint8_t>& buffer, uint64_t value);
+	void WriteCacheInt(std::vector<uint8_t>& buffer, int64_t value);
+	void WriteCacheBytes(std::vector<uint8_t>& buffer, const uint8_t* data, size_t size);
+
+	// The read functions advance the offset and return false if the buffer
+	// ends too early.
+	bool ReadCacheUInt(const std::vector<uint8_t>& buffer, size_t& offset, uint64_t& value);
+	bool ReadCacheInt(const std::vector<uint8_t>& buffer, size_t& offset, int64_t& value);
+	bool ReadCacheBytes(const std::vector<uint8_t>& buffer, size_t& offset, uint8_t* data, size_t size);
+}
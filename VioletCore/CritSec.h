@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Windows.h>
+#include "LockStatistics.h"
 
 //////////////////////////////////////////////////////////////////////////
 //  CritSec
@@ -62,3 +63,13 @@ public:
 		m_pCriticalSection->Unlock();
 	}
 };
+
+
+//////////////////////////////////////////////////////////////////////////
+//  TimedAutoLock
+//  Description: An AutoLock which adds its wait and hold time to the
+//               statistics of the lock. Default constructed it locks
+//               nothing until Lock is called.
+//////////////////////////////////////////////////////////////////////////
+
+typedef FFmpegInterop::TimedLock<CritSec> TimedAutoLock;
@@ -0,0 +1,102 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: How the decoders spread their work across threads.
+* File Name: DecoderThreading.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "DecoderThreading.h"
+#include "ThreadPool.h"
+
+using namespace FFmpegInterop;
+
+// Runs the jobs of execute, each with its own element of arg. The jobs are
+// independent, so they may run in any order and on fewer threads.
+static int ExecuteShared(AVCodecContext* codecCtx, int (*func)(AVCodecContext* c2, void* arg), void* arg, int* ret, int count, int size)
+{
+	ThreadPool::GetShared().ParallelFor(count, codecCtx->thread_count, [&](int index, int)
+	{
+		int result = func(codecCtx, static_cast<uint8_t*>(arg) + static_cast<size_t>(index) * size);
+		if (ret)
+		{
+			ret[index] = result;
+		}
+	});
+
+	return 0;
+}
+
+DecoderThreads FFmpegInterop::ChooseDecoderThreads(const DecoderThreadingInput& input)
+{
+	DecoderThreads threads = { 0, 1 };
+
+	if (input.mediaType != AVMEDIA_TYPE_VIDEO || input.hardwareThreads <= 1)
+	{
+		return threads;
+	}
+
+	int hardwareThreads = static_cast<int>(input.hardwareThreads);
+
+	// FFmpeg warns about more threads than this, they do not scale further
+	const int maxThreads = 16;
+	if (hardwareThreads > maxThreads)
+	{
+		hardwareThreads = maxThreads;
+	}
+
+	if (input.lowLatency)
+	{
+		threads.type = FF_THREAD_SLICE;
+		threads.count = hardwareThreads;
+		return threads;
+	}
+
+	// The load relative to 1080p30 H.264
+	double frameRate = input.frameRate > 0 ? input.frameRate : 30;
+	double load = input.width * static_cast<double>(input.height) * frameRate / (1920.0 * 1080.0 * 30.0);
+
+	if (input.codecId == AV_CODEC_ID_HEVC || input.codecId == AV_CODEC_ID_VP9 || input.codecId == AV_CODEC_ID_AV1)
+	{
+		load *= 2;
+	}
+
+	if ((input.codecId == AV_CODEC_ID_H264 && (input.profile == FF_PROFILE_H264_HIGH_10 || input.profile == FF_PROFILE_H264_HIGH_422 || input.profile == FF_PROFILE_H264_HIGH_444_PREDICTIVE))
+		|| (input.codecId == AV_CODEC_ID_HEVC && (input.profile == FF_PROFILE_HEVC_MAIN_10 || input.profile == FF_PROFILE_HEVC_REXT)))
+	{
+		load *= 1.5;
+	}
+
+	if (load < 0.5)
+	{
+		threads.type = FF_THREAD_SLICE;
+		threads.count = hardwareThreads < 2 ? hardwareThreads : 2;
+		return threads;
+	}
+
+	// Four threads per 1080p30 leave headroom for decoding ahead and seeking
+	int count = static_cast<int>(load * 4 + 0.5);
+	threads.type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	threads.count = count < 2 ? 2 : count > hardwareThreads ? hardwareThreads : count;
+
+	return threads;
+}
+
+bool FFmpegInterop::UseSharedSliceThreads(AVCodecContext* codecCtx)
+{
+	// Frame threads run whole frames on threads of FFmpeg, and their copies
+	// of the context were made while it was opened
+	if (!(codecCtx->active_thread_type & FF_THREAD_SLICE) || codecCtx->thread_count <= 1)
+	{
+		return false;
+	}
+
+	// execute2 stays with the slice threads of FFmpeg. Its callers expect
+	// every job below the thread count on a thread of its own, with the job
+	// number as the thread number: VP8 rows wait for the row of the previous
+	// job and derive their motion vector bounds from the thread number, HEVC
+	// wavefront rows wait for the row above. The shared pool may run fewer
+	// jobs at once, in any slot, which deadlocks or decodes wrongly.
+	codecCtx->execute = ExecuteShared;
+
+	return true;
+}
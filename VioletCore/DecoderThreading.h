@@ -0,0 +1,55 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: How the decoders spread their work across threads.
+* File Name: DecoderThreading.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// What the threading of a decoder is chosen from
+	struct DecoderThreadingInput
+	{
+		AVMediaType mediaType;
+		AVCodecID codecId;
+		int profile;
+		int width;
+		int height;
+		// 0 when the frame rate is not known
+		double frameRate;
+		// The source is live, so frames must not be held back by frame threads
+		bool lowLatency;
+		unsigned int hardwareThreads;
+	};
+
+	struct DecoderThreads
+	{
+		// FF_THREAD_FRAME and FF_THREAD_SLICE flags, 0 for no threads
+		int type;
+		int count;
+	};
+
+	// Picks thread type and count for a decoder. Audio decodes on one
+	// thread. Live video uses slice threads only. Other video uses frame
+	// threads once it is heavier than 720p30 H.264, with more threads
+	// for higher pixel rates, HEVC, VP9, AV1 and high bit depth or 4:4:4
+	// profiles. Lighter video uses slice threads only, because frame
+	// threads add a frame of latency and a frame of memory per thread.
+	DecoderThreads ChooseDecoderThreads(const DecoderThreadingInput& input);
+
+	// Replaces the execute callback of an opened codec context which decodes
+	// slice threaded, so its independent slice jobs run on the shared
+	// ThreadPool together with those of all other decoders and the video
+	// conversion. execute2, whose jobs wait for each other, keeps the slice
+	// threads of FFmpeg. Returns false and changes nothing for other
+	// contexts.
+	//
+	// The slice threads FFmpeg started while opening the context remain and
+	// wait while execute runs on the pool. This limits how many slice jobs
+	// of all decoders run at once, not how many threads exist.
+	bool UseSharedSliceThreads(AVCodecContext* codecCtx);
+}
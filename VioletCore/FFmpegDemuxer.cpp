@@ -0,0 +1,691 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The background demuxer which feeds the per-stream packet queues.
+* File Name: FFmpegDemuxer.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <string>
+
+#include "FFmpegDemuxer.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	// The CPU time of the calling thread in microseconds.
+	uint64_t GetThreadCpuTime()
+	{
+#ifdef _WIN32
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+		if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+		{
+			return 0;
+		}
+
+		ULARGE_INTEGER kernel = { kernelTime.dwLowDateTime, kernelTime.dwHighDateTime };
+		ULARGE_INTEGER user = { userTime.dwLowDateTime, userTime.dwHighDateTime };
+		return (kernel.QuadPart + user.QuadPart) / 10;
+#else
+		timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+		{
+			return 0;
+		}
+
+		return static_cast<uint64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+	}
+
+	bool IsSparseStream(const AVStream* avStream)
+	{
+		AVMediaType type = avStream->codecpar->codec_type;
+		return (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+			|| (avStream->disposition & AV_DISPOSITION_ATTACHED_PIC) != 0;
+	}
+}
+
+FFmpegDemuxer::FFmpegDemuxer(AVFormatContext* avFormatCtx, unsigned int readAheadPackets, size_t memoryBudget)
+	: m_pAvFormatCtx(avFormatCtx)
+	, m_readAheadPackets(readAheadPackets > 0 ? readAheadPackets : 1)
+	, m_memoryBudget(memoryBudget)
+	, m_pSeekIndex(nullptr)
+	, m_lastKeyframes(avFormatCtx->nb_streams, AV_NOPTS_VALUE)
+	, m_waitingConsumers(0)
+	, m_demuxerWaiting(false)
+	, m_packetsRead(0)
+	, m_packetsDropped(0)
+	, m_readTime(0)
+	, m_cpuTime(0)
+	, m_seeks(0)
+	, m_indexedSeeks(0)
+	, m_seekTime(0)
+	, m_readResult(0)
+	, m_stop(false)
+{
+	// Leave room for some read-ahead beyond the target before packets have
+	// to go to the overflow list.
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+	{
+		m_streams.emplace_back(new StreamState(m_readAheadPackets * 2, m_packetPool));
+		m_streams.back()->sparse = IsSparseStream(avFormatCtx->streams[i]);
+
+		// Nothing is enabled yet, don't even read the data of the streams
+		// until they are.
+		avFormatCtx->streams[i]->discard = AVDISCARD_ALL;
+	}
+}
+
+FFmpegDemuxer::~FFmpegDemuxer()
+{
+	Stop();
+
+	for (auto& stream : m_streams)
+	{
+		ClearStream(*stream);
+	}
+}
+
+void FFmpegDemuxer::Start()
+{
+	if (!m_thread.joinable())
+	{
+		m_stop = false;
+		m_thread = std::thread(&FFmpegDemuxer::DemuxLoop, this);
+	}
+}
+
+void FFmpegDemuxer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_waitMutex);
+		m_stop = true;
+	}
+	m_readAheadRequired.notify_all();
+	m_packetAvailable.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void FFmpegDemuxer::SetSeekIndex(SeekIndex* seekIndex)
+{
+	std::lock_guard<std::mutex> formatLock(m_formatMutex);
+	m_pSeekIndex = seekIndex;
+}
+
+void FFmpegDemuxer::EnableStream(int streamIndex)
+{
+	if (IsValidStream(streamIndex))
+	{
+		{
+			std::lock_guard<std::mutex> formatLock(m_formatMutex);
+			m_pAvFormatCtx->streams[streamIndex]->discard = AVDISCARD_DEFAULT;
+			m_streams[streamIndex]->enabled = true;
+		}
+
+		WakeDemuxer();
+	}
+}
+
+void FFmpegDemuxer::DisableStream(int streamIndex)
+{
+	if (IsValidStream(streamIndex))
+	{
+		StreamState& stream = *m_streams[streamIndex];
+
+		{
+			std::lock_guard<std::mutex> formatLock(m_formatMutex);
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			m_pAvFormatCtx->streams[streamIndex]->discard = AVDISCARD_ALL;
+			stream.enabled = false;
+			ClearStream(stream);
+		}
+
+		m_packetAvailable.notify_all();
+		m_readAheadRequired.notify_one();
+	}
+}
+
+int FFmpegDemuxer::ReadPacket(int streamIndex, AVPacket** avPacket)
+{
+	*avPacket = nullptr;
+
+	if (!IsValidStream(streamIndex))
+	{
+		return AVERROR(EINVAL);
+	}
+
+	StreamState& stream = *m_streams[streamIndex];
+
+	AVPacket* packet = stream.queue.Pop();
+	if (!packet && stream.enabled && m_thread.joinable())
+	{
+		std::unique_lock<std::mutex> lock(m_waitMutex);
+
+		// Let the demuxer know that somebody is starving, so that it keeps
+		// reading even if the other queues are full.
+		++m_waitingConsumers;
+		stream.waiting = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_readAheadRequired.notify_one();
+
+		m_packetAvailable.wait(lock, [&]
+		{
+			return !stream.queue.IsEmpty()
+				|| (m_readResult < 0 && stream.overflowCount == 0)
+				|| m_stop
+				|| !stream.enabled;
+		});
+
+		stream.waiting = false;
+		--m_waitingConsumers;
+		lock.unlock();
+
+		packet = stream.queue.Pop();
+	}
+
+	if (!packet)
+	{
+		return m_readResult < 0 ? m_readResult.load() : AVERROR_EOF;
+	}
+
+	*avPacket = packet;
+	WakeDemuxer();
+
+	return 0;
+}
+
+AVPacket* FFmpegDemuxer::PopPacket(int streamIndex)
+{
+	AVPacket* result = nullptr;
+
+	if (IsValidStream(streamIndex))
+	{
+		result = m_streams[streamIndex]->queue.Pop();
+		if (result)
+		{
+			WakeDemuxer();
+		}
+	}
+
+	return result;
+}
+
+void FFmpegDemuxer::ReleasePacket(AVPacket* avPacket)
+{
+	m_packetPool.Release(avPacket);
+}
+
+void FFmpegDemuxer::FlushStream(int streamIndex)
+{
+	if (IsValidStream(streamIndex))
+	{
+		{
+			std::lock_guard<std::mutex> formatLock(m_formatMutex);
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			ClearStream(*m_streams[streamIndex]);
+		}
+
+		m_readAheadRequired.notify_one();
+	}
+}
+
+int FFmpegDemuxer::Seek(int streamIndex, int64_t timestamp, int flags)
+{
+	int ret;
+
+	{
+		// The demuxer thread does not touch the format context and does not
+		// queue any packet while we hold the format lock.
+		std::lock_guard<std::mutex> formatLock(m_formatMutex);
+
+		int64_t seekStart = av_gettime_relative();
+
+		// The packets read to check an indexed seek
+		std::vector<AVPacket*> packets;
+
+		ret = -1;
+		if (flags == AVSEEK_FLAG_BACKWARD)
+		{
+			ret = SeekWithIndex(streamIndex, timestamp, packets);
+		}
+		if (ret < 0)
+		{
+			ret = av_seek_frame(m_pAvFormatCtx, streamIndex, timestamp, flags);
+		}
+
+		++m_seeks;
+		m_seekTime += av_gettime_relative() - seekStart;
+
+		if (ret >= 0)
+		{
+			// The next keyframes are not adjacent to the previous ones
+			std::fill(m_lastKeyframes.begin(), m_lastKeyframes.end(), AV_NOPTS_VALUE);
+
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			for (auto& stream : m_streams)
+			{
+				ClearStream(*stream);
+			}
+			m_readResult = 0;
+
+			for (AVPacket* avPacket : packets)
+			{
+				IndexPacket(avPacket);
+				QueuePacket(*m_streams[avPacket->stream_index], avPacket);
+			}
+		}
+	}
+
+	m_readAheadRequired.notify_one();
+
+	return ret;
+}
+
+void FFmpegDemuxer::DemuxLoop()
+{
+	AVPacket* avPacket = nullptr;
+	// Continue the count of an earlier run, if the demuxer was restarted.
+	uint64_t cpuStart = GetThreadCpuTime() - m_cpuTime;
+
+	auto hasWork = [this]
+	{
+		return m_stop || HasPendingOverflow() || (m_readResult == 0 && NeedsMorePackets());
+	};
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_waitMutex);
+
+			m_demuxerWaiting = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (!hasWork())
+			{
+				m_cpuTime = GetThreadCpuTime() - cpuStart;
+				m_readAheadRequired.wait(lock, hasWork);
+			}
+
+			m_demuxerWaiting = false;
+
+			if (m_stop)
+			{
+				break;
+			}
+		}
+
+		std::lock_guard<std::mutex> formatLock(m_formatMutex);
+
+		if (DrainOverflow())
+		{
+			WakeConsumers();
+		}
+
+		if (m_readResult != 0 || !NeedsMorePackets())
+		{
+			continue;
+		}
+
+		int ret = 0;
+		if (!avPacket)
+		{
+			avPacket = m_packetPool.Acquire();
+			if (!avPacket)
+			{
+				ret = AVERROR(ENOMEM);
+			}
+		}
+
+		if (ret == 0)
+		{
+			int64_t readStart = av_gettime_relative();
+			ret = av_read_frame(m_pAvFormatCtx, avPacket);
+			m_readTime += av_gettime_relative() - readStart;
+		}
+
+		if (ret < 0)
+		{
+			// End of file or read error. The consumers will drain their
+			// decoders, the demuxer sleeps until the next seek.
+			av_log(nullptr, ret == AVERROR_EOF ? AV_LOG_VERBOSE : AV_LOG_WARNING, "Demuxer stopped reading: %d\n", ret);
+			m_readResult = ret;
+		}
+		else if (IsValidStream(avPacket->stream_index) && m_streams[avPacket->stream_index]->enabled)
+		{
+			++m_packetsRead;
+			IndexPacket(avPacket);
+			QueuePacket(*m_streams[avPacket->stream_index], avPacket);
+			avPacket = nullptr;
+		}
+		else
+		{
+			// Not every demuxer honors AVDISCARD_ALL, recycle the packet.
+			++m_packetsRead;
+			++m_packetsDropped;
+			av_packet_unref(avPacket);
+			continue;
+		}
+
+		WakeConsumers();
+	}
+
+	m_packetPool.Release(avPacket);
+	m_cpuTime = GetThreadCpuTime() - cpuStart;
+}
+
+void FFmpegDemuxer::QueuePacket(StreamState& stream, AVPacket* avPacket)
+{
+	// Keep the order: once something is parked, everything after it must be
+	// parked as well.
+	if (!stream.overflow.empty() || !stream.queue.Push(avPacket))
+	{
+		stream.overflow.push_back(avPacket);
+		stream.overflowCount = stream.overflow.size();
+		stream.overflowBytes += avPacket->size;
+	}
+
+	size_t packets = stream.queue.GetCount() + stream.overflowCount;
+	size_t bytes = stream.queue.GetBytes() + stream.overflowBytes;
+	if (packets > stream.maxPackets)
+	{
+		stream.maxPackets = packets;
+	}
+	if (bytes > stream.maxBytes)
+	{
+		stream.maxBytes = bytes;
+	}
+}
+
+void FFmpegDemuxer::IndexPacket(AVPacket* avPacket)
+{
+	if (m_pSeekIndex && (avPacket->flags & AV_PKT_FLAG_KEY))
+	{
+		int64_t timestamp = avPacket->pts != AV_NOPTS_VALUE ? avPacket->pts : avPacket->dts;
+		if (timestamp != AV_NOPTS_VALUE)
+		{
+			int64_t& lastKeyframe = m_lastKeyframes[avPacket->stream_index];
+			m_pSeekIndex->AddKeyframe(avPacket->stream_index, timestamp, avPacket->pos, lastKeyframe);
+			lastKeyframe = timestamp;
+		}
+	}
+}
+
+int FFmpegDemuxer::SeekWithIndex(int streamIndex, int64_t timestamp, std::vector<AVPacket*>& packets)
+{
+	// Enough for the other streams interleaved before the keyframe
+	const int MaxPackets = 256;
+
+	if (!m_pSeekIndex || !IsValidStream(streamIndex) || !CanSeekToBytes(m_pAvFormatCtx->iformat))
+	{
+		return -1;
+	}
+
+	int64_t keyframeTimestamp, keyframePosition;
+	if (!m_pSeekIndex->FindKeyframe(streamIndex, timestamp, keyframeTimestamp, keyframePosition))
+	{
+		return -1;
+	}
+
+	int ret = av_seek_frame(m_pAvFormatCtx, streamIndex, keyframePosition, AVSEEK_FLAG_BYTE);
+
+	// Read up to the first packet of the stream, it must be the keyframe.
+	bool found = false;
+	while (ret >= 0 && !found && static_cast<int>(packets.size()) < MaxPackets)
+	{
+		AVPacket* avPacket = m_packetPool.Acquire();
+		if (!avPacket)
+		{
+			ret = AVERROR(ENOMEM);
+			break;
+		}
+
+		ret = av_read_frame(m_pAvFormatCtx, avPacket);
+		if (ret < 0)
+		{
+			m_packetPool.Release(avPacket);
+			break;
+		}
+
+		++m_packetsRead;
+
+		if (avPacket->stream_index == streamIndex)
+		{
+			int64_t packetTimestamp = avPacket->pts != AV_NOPTS_VALUE ? avPacket->pts : avPacket->dts;
+			if (packetTimestamp != keyframeTimestamp || !(avPacket->flags & AV_PKT_FLAG_KEY))
+			{
+				ret = -1;
+			}
+			found = true;
+		}
+
+		if (IsValidStream(avPacket->stream_index) && m_streams[avPacket->stream_index]->enabled)
+		{
+			packets.push_back(avPacket);
+		}
+		else
+		{
+			++m_packetsDropped;
+			m_packetPool.Release(avPacket);
+		}
+	}
+
+	if (ret < 0 || !found)
+	{
+		// Landed somewhere else, the caller seeks by time stamp instead.
+		for (AVPacket* avPacket : packets)
+		{
+			m_packetPool.Release(avPacket);
+		}
+		packets.clear();
+
+		return -1;
+	}
+
+	++m_indexedSeeks;
+
+	return ret;
+}
+
+bool FFmpegDemuxer::CanSeekToBytes(const AVInputFormat* format)
+{
+	static const char* const formats[] =
+	{
+		"mpegts", "mpeg", "mpegvideo", "h264", "hevc", "m4v", "vc1", "cavsvideo",
+		"aac", "mp3", "ac3", "eac3", "dts", "truehd", "mlp",
+	};
+
+	if (!format || !format->name || (format->flags & AVFMT_NO_BYTE_SEEK))
+	{
+		return false;
+	}
+
+	// The name may be a comma separated list of short names.
+	std::string names = format->name;
+	size_t start = 0;
+	while (start <= names.size())
+	{
+		size_t end = names.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = names.size();
+		}
+
+		std::string name = names.substr(start, end - start);
+		for (const char* candidate : formats)
+		{
+			if (name == candidate)
+			{
+				return true;
+			}
+		}
+
+		start = end + 1;
+	}
+
+	return false;
+}
+
+bool FFmpegDemuxer::DrainOverflow()
+{
+	bool drained = false;
+
+	for (auto& stream : m_streams)
+	{
+		while (!stream->overflow.empty() && stream->queue.Push(stream->overflow.front()))
+		{
+			stream->overflowBytes -= stream->overflow.front()->size;
+			stream->overflow.pop_front();
+			stream->overflowCount = stream->overflow.size();
+			drained = true;
+		}
+	}
+
+	return drained;
+}
+
+void FFmpegDemuxer::ClearStream(StreamState& stream)
+{
+	stream.queue.Clear();
+
+	for (auto avPacket : stream.overflow)
+	{
+		m_packetPool.Release(avPacket);
+	}
+	stream.overflow.clear();
+	stream.overflowCount = 0;
+	stream.overflowBytes = 0;
+}
+
+PacketQueueStatistics FFmpegDemuxer::GetQueueStatistics(int streamIndex) const
+{
+	PacketQueueStatistics result = {};
+
+	if (IsValidStream(streamIndex))
+	{
+		const StreamState& stream = *m_streams[streamIndex];
+		result.packets = stream.queue.GetCount() + stream.overflowCount;
+		result.bytes = stream.queue.GetBytes() + stream.overflowBytes;
+		result.maxPackets = stream.maxPackets;
+		result.maxBytes = stream.maxBytes;
+	}
+
+	return result;
+}
+
+size_t FFmpegDemuxer::GetQueuedBytes() const
+{
+	size_t result = 0;
+
+	for (auto& stream : m_streams)
+	{
+		result += stream->queue.GetBytes() + stream->overflowBytes;
+	}
+
+	return result;
+}
+
+DemuxerStatistics FFmpegDemuxer::GetStatistics() const
+{
+	DemuxerStatistics result = {};
+
+	result.packetsRead = m_packetsRead;
+	result.packetsDropped = m_packetsDropped;
+	result.readTime = m_readTime;
+	result.cpuTime = m_cpuTime;
+	result.seeks = m_seeks;
+	result.indexedSeeks = m_indexedSeeks;
+	result.seekTime = m_seekTime;
+
+	// Racy read of a plain counter, good enough for statistics.
+	if (m_pAvFormatCtx->pb)
+	{
+		result.bytesRead = m_pAvFormatCtx->pb->bytes_read;
+	}
+
+	return result;
+}
+
+bool FFmpegDemuxer::IsValidStream(int streamIndex) const
+{
+	return streamIndex >= 0 && streamIndex < static_cast<int>(m_streams.size());
+}
+
+bool FFmpegDemuxer::HasPendingOverflow() const
+{
+	for (auto& stream : m_streams)
+	{
+		if (stream->overflowCount > 0 && stream->queue.GetCount() < stream->queue.GetCapacity())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FFmpegDemuxer::NeedsMorePackets() const
+{
+	if (m_waitingConsumers > 0)
+	{
+		// Only until the starving consumer has a packet. It may not have
+		// woken up yet, reading on would run past the budget meanwhile.
+		for (auto& stream : m_streams)
+		{
+			if (stream->waiting && stream->queue.IsEmpty())
+			{
+				return true;
+			}
+		}
+	}
+
+	if (m_memoryBudget > 0 && GetQueuedBytes() >= m_memoryBudget)
+	{
+		// Pause until the consumers caught up.
+		return false;
+	}
+
+	for (auto& stream : m_streams)
+	{
+		if (stream->enabled && !stream->sparse && stream->queue.GetCount() + stream->overflowCount < m_readAheadPackets)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FFmpegDemuxer::WakeConsumers()
+{
+	// Pairs with the fence in ReadPacket, either the consumer sees the new
+	// packet or we see the consumer waiting.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_waitingConsumers > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_waitMutex);
+		m_packetAvailable.notify_all();
+	}
+}
+
+void FFmpegDemuxer::WakeDemuxer()
+{
+	// Pairs with the fence in DemuxLoop, either the demuxer sees the free
+	// slot or we see the demuxer waiting.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_demuxerWaiting)
+	{
+		std::lock_guard<std::mutex> lock(m_waitMutex);
+		m_readAheadRequired.notify_one();
+	}
+}
@@ -0,0 +1,245 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The background demuxer which feeds the per-stream packet queues.
+* File Name: FFmpegDemuxer.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+#include "PacketPool.h"
+#include "PacketQueue.h"
+#include "SeekIndex.h"
+
+namespace FFmpegInterop
+{
+	// The fill level of a stream's packet queue.
+	struct PacketQueueStatistics
+	{
+		size_t packets;
+		size_t bytes;
+
+		// The highest values seen since the demuxer was created.
+		size_t maxPackets;
+		size_t maxBytes;
+	};
+
+	// What the demuxer thread did so far.
+	struct DemuxerStatistics
+	{
+		uint64_t packetsRead;
+
+		// Packets which were read but belonged to no enabled stream.
+		uint64_t packetsDropped;
+
+		// Bytes the I/O context has read, or 0 if the format has no I/O
+		// context.
+		uint64_t bytesRead;
+
+		// Time spent inside av_read_frame, in microseconds.
+		uint64_t readTime;
+
+		// CPU time used by the demuxer thread, in microseconds. Updated
+		// whenever the thread goes to sleep.
+		uint64_t cpuTime;
+
+		uint64_t seeks;
+
+		// Seeks which jumped to a byte position from the seek index.
+		uint64_t indexedSeeks;
+
+		// Time spent inside av_seek_frame, in microseconds.
+		uint64_t seekTime;
+	};
+
+	// Runs av_read_frame on a dedicated thread ahead of consumption and
+	// distributes the packets to one queue per enabled stream, so that the
+	// sample request path only ever pops packets which were already demuxed.
+	//
+	// The demuxer reads ahead until every enabled stream has at least
+	// ReadAheadPackets packets queued or the packets of all streams together
+	// reach the memory budget, whatever comes first. Sparse streams
+	// (subtitles, data, attached pictures) are left out of the first check,
+	// they may not have a packet for minutes and would hold the demuxer up
+	// until the budget is full. It always keeps reading
+	// while a consumer is waiting for a packet, so the budget may be exceeded
+	// on badly interleaved files rather than stalling playback.
+	//
+	// Streams which are not enabled are marked with AVDISCARD_ALL, so that
+	// demuxers which support it skip their data instead of reading and
+	// parsing it.
+	//
+	// Every stream has its own lock-free SPSC queue with the demuxer thread as
+	// the producer, so there must be only one consumer per stream at a time.
+	// If a queue is full while another stream is starving, the demuxer parks
+	// the packets in an overflow list which only the demuxer thread touches.
+	class FFmpegDemuxer
+	{
+	public:
+		FFmpegDemuxer(AVFormatContext* avFormatCtx, unsigned int readAheadPackets, size_t memoryBudget);
+		~FFmpegDemuxer();
+
+		FFmpegDemuxer(const FFmpegDemuxer&) = delete;
+		FFmpegDemuxer& operator=(const FFmpegDemuxer&) = delete;
+
+		// Starts the demuxer thread.
+		void Start();
+
+		// Stops the demuxer thread and waits until it has exited.
+		void Stop();
+
+		// Records the keyframes of the demuxed packets in the index and uses
+		// it for seeks. Call before Start, the index must outlive the demuxer.
+		void SetSeekIndex(SeekIndex* seekIndex);
+
+		// Starts demuxing and queueing the packets of the stream.
+		void EnableStream(int streamIndex);
+
+		// Stops demuxing the stream and frees the queued packets. Like
+		// FlushStream, only safe once the stream's consumer has stopped.
+		void DisableStream(int streamIndex);
+
+		// Waits until a packet of the stream is available and returns it. The
+		// caller takes the ownership of the packet and should hand it back
+		// with ReleasePacket.
+		// Return value:
+		//   0 if successful, AVERROR_EOF or the demuxer error if there are no
+		//   more packets for the stream.
+		int ReadPacket(int streamIndex, AVPacket** avPacket);
+
+		// Returns the next queued packet of the stream without waiting, or 
+		// nullptr if there is none.
+		AVPacket* PopPacket(int streamIndex);
+
+		// Returns a packet to the packet pool. nullptr is ignored.
+		void ReleasePacket(AVPacket* avPacket);
+
+		// Frees all queued packets of the stream. Popping is the consumer's
+		// end of the SPSC queue, so this is only safe once the stream's
+		// consumer has stopped and no ReadPacket or PopPacket of the stream
+		// is running.
+		void FlushStream(int streamIndex);
+
+		// Pauses the demuxer, performs av_seek_frame, drops every queued
+		// packet and resumes demuxing from the new position. Backward seeks
+		// jump straight to the byte position of the keyframe if the seek
+		// index knows it and CanSeekToBytes allows it for the format. The
+		// first packet of the stream after the jump must be that keyframe,
+		// otherwise the seek is repeated by time stamp. The consumers of all
+		// streams must have stopped, like for FlushStream.
+		// Return value:
+		//   The return value of av_seek_frame.
+		int Seek(int streamIndex, int64_t timestamp, int flags);
+
+		// Whether the format finds the next packet from any byte position,
+		// so that a byte seek to an indexed keyframe lands on it: MPEG-TS,
+		// MPEG-PS and raw elementary streams. Containers like Matroska, AVI
+		// or Ogg keep state which only their own seek restores.
+		static bool CanSeekToBytes(const AVInputFormat* format);
+
+		const PacketPool& GetPacketPool() const { return m_packetPool; }
+
+		PacketQueueStatistics GetQueueStatistics(int streamIndex) const;
+
+		// The payload size of the queued packets of all streams.
+		size_t GetQueuedBytes() const;
+
+		DemuxerStatistics GetStatistics() const;
+
+	private:
+		struct StreamState
+		{
+			StreamState(size_t queueCapacity, PacketPool& pool)
+				: queue(queueCapacity, pool)
+				, overflowCount(0)
+				, overflowBytes(0)
+				, maxPackets(0)
+				, maxBytes(0)
+				, enabled(false)
+				, waiting(false)
+				, sparse(false)
+			{
+			}
+
+			PacketQueue queue;
+
+			// Only touched with the format lock held.
+			std::deque<AVPacket*> overflow;
+			std::atomic<size_t> overflowCount;
+			std::atomic<size_t> overflowBytes;
+
+			// High-water marks, only written by the demuxer thread.
+			std::atomic<size_t> maxPackets;
+			std::atomic<size_t> maxBytes;
+
+			std::atomic<bool> enabled;
+
+			// Set while the consumer sleeps in ReadPacket.
+			std::atomic<bool> waiting;
+
+			// The stream has packets only now and then, if at all.
+			bool sparse;
+		};
+
+		void DemuxLoop();
+		void QueuePacket(StreamState& stream, AVPacket* avPacket);
+		void IndexPacket(AVPacket* avPacket);
+		int SeekWithIndex(int streamIndex, int64_t timestamp, std::vector<AVPacket*>& packets);
+		bool DrainOverflow();
+		// Pops every packet of the queue, so the stream's consumer must have
+		// stopped. Call with the format lock held.
+		void ClearStream(StreamState& stream);
+		bool IsValidStream(int streamIndex) const;
+		bool HasPendingOverflow() const;
+		bool NeedsMorePackets() const;
+		void WakeConsumers();
+		void WakeDemuxer();
+
+		AVFormatContext* m_pAvFormatCtx;
+		unsigned int m_readAheadPackets;
+		size_t m_memoryBudget;
+
+		// Declared before the streams, their queues return packets to it.
+		PacketPool m_packetPool;
+		std::vector<std::unique_ptr<StreamState>> m_streams;
+
+		SeekIndex* m_pSeekIndex;
+
+		// The time stamp of the last keyframe read on every stream since the
+		// last seek, only touched with the format lock held.
+		std::vector<int64_t> m_lastKeyframes;
+
+		std::thread m_thread;
+
+		// Held while the format context is read or seeked and while the
+		// overflow lists are modified. Acquire it before m_waitMutex.
+		std::mutex m_formatMutex;
+
+		// Only used for sleeping, the queues are lock-free.
+		std::mutex m_waitMutex;
+		std::condition_variable m_packetAvailable;
+		std::condition_variable m_readAheadRequired;
+		std::atomic<int> m_waitingConsumers;
+		std::atomic<bool> m_demuxerWaiting;
+
+		std::atomic<uint64_t> m_packetsRead;
+		std::atomic<uint64_t> m_packetsDropped;
+		std::atomic<uint64_t> m_readTime;
+		std::atomic<uint64_t> m_cpuTime;
+		std::atomic<uint64_t> m_seeks;
+		std::atomic<uint64_t> m_indexedSeeks;
+		std::atomic<uint64_t> m_seekTime;
+
+		std::atomic<int> m_readResult;
+		std::atomic<bool> m_stop;
+	};
+}
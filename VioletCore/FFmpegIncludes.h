@@ -0,0 +1,32 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The FFmpeg headers used by the portable (non C++/CX) sources.
+* File Name: FFmpegIncludes.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+// The portable sources do not use the precompiled header, so the warnings
+// which are suppressed in pch.h need to be suppressed here too.
+#if _MSC_VER >= 1200
+#pragma warning(push)
+#pragma warning(disable:4819)
+#pragma warning(disable:4244)
+#endif
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/log.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+#if _MSC_VER >= 1200
+#pragma warning(pop)
+#endif
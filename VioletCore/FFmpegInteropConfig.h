@@ -13,17 +13,126 @@ namespace FFmpegInterop
 			MaxAudioThreads = 2;
 
 			StreamBufferSize = 16384;
+			ReadAheadBlockSize = 1024 * 1024;
+			ReadAheadBlockCount = 3;
+
+			ReadAheadPackets = 64;
+			DecodeAheadSamples = 0;
+			ConversionThreads = 0;
+			ShareSliceThreads = true;
+			VideoBufferPoolDepth = 4;
+			AudioBufferPoolDepth = 16;
+			PacketQueueMemoryBudget = 64 * 1024 * 1024;
+
+			EnableSeekIndex = true;
+			ScanKeyframes = true;
+			EnableProbeCache = true;
+			DeferSampleRequests = false;
+			DropLateFrames = false;
 
 			FFmpegOptions = ref new PropertySet();
 		};
 
 		property unsigned int SkipErrors;
 
+		// The upper limit of the decoder threads, 0 means no limit
 		property unsigned int MaxVideoThreads;
 		property unsigned int MaxAudioThreads;
 
+		// The FF_THREAD_FRAME and FF_THREAD_SLICE flags the decoders use. 0
+		// picks them per stream from codec, resolution, frame rate and profile.
+		// With flags set the decoders use one thread per core.
+		property unsigned int VideoThreadType;
+		property unsigned int AudioThreadType;
+
+		// Decodes video with slice threads only, as for live sources, so no
+		// frames are held back by frame threads
+		property bool LowLatencyDecoding;
+
+		// When video decoding falls behind playback, late frames are dropped
+		// before they are converted. The further behind it is, the more the
+		// decoder leaves out, up to skipping to the next keyframe. Full
+		// quality returns once decoding caught up.
+		property bool DropLateFrames;
+
 		property unsigned int StreamBufferSize;
 
+		// Size and number of the blocks which are read ahead on a background
+		// thread for streams opened with CreateFromStream. A block count of 0
+		// reads synchronously.
+		property unsigned int ReadAheadBlockSize;
+		property unsigned int ReadAheadBlockCount;
+
+		// The number of packets the demuxer thread reads ahead for every
+		// enabled stream.
+		property unsigned int ReadAheadPackets;
+
+		// The maximum number of bytes the demuxer keeps queued for all streams
+		// together before it pauses, 0 means no limit.
+		property unsigned int PacketQueueMemoryBudget;
+
+		// The number of samples a worker thread decodes and converts ahead of
+		// the sample requests for every enabled stream which supports it, 0
+		// decodes on request.
+		property unsigned int DecodeAheadSamples;
+
+		// The number of threads large video frames are converted with, 0 uses
+		// all cores.
+		property unsigned int ConversionThreads;
+
+		// Runs the independent slices of slice threaded decoders on the
+		// threads the conversion uses, which are shared by all media sources,
+		// so the slices of many streams do not compete for the cores at once.
+		// Every decoder still starts its own threads when it is opened. They
+		// keep the jobs which wait for each other, like VP8 and HEVC wavefront
+		// rows, and the frames of frame threaded decoders.
+		property bool ShareSliceThreads;
+
+		// The number of converted video frame buffers kept for reuse after
+		// their samples are released. More buffers are allocated while the
+		// samples are held, the ones beyond this depth are freed again.
+		property unsigned int VideoBufferPoolDepth;
+
+		// The same for the buffers of the audio samples, the renderer holds
+		// more of them because they are short.
+		property unsigned int AudioBufferPoolDepth;
+
+		// Video with more than 8 bits per component is output as P010. Set
+		// this for renderers which only take NV12, the frames are then
+		// converted to 8 bits.
+		property bool ForceNv12Output;
+
+		// Video frames larger than this are scaled down during the conversion,
+		// 0 means no limit. Decoders which support it decode them at a lower
+		// resolution already, which needs the size before the file is opened.
+		// SetMaximumOutputSize changes the limit of one opened file only.
+		property unsigned int MaxVideoWidth;
+		property unsigned int MaxVideoHeight;
+
+		// Folder of the on-disk caches, the local cache folder of the app if
+		// not set.
+		property Platform::String^ CacheFolder;
+
+		// Records the keyframes of local files and streams during playback
+		// and keeps them in the cache folder, so that later seeks can jump
+		// straight to their byte positions.
+		property bool EnableSeekIndex;
+
+		// Fills an empty seek index of a format which supports byte seeks
+		// (MPEG-TS, MPEG-PS, raw streams) with a scan of the whole file on a
+		// background thread, so that seeks can use it in the first session.
+		property bool ScanKeyframes;
+
+		// Keeps the stream parameters found by avformat_find_stream_info of
+		// local files and streams in the cache folder, so that reopening them
+		// only needs a short probe.
+		property bool EnableProbeCache;
+
+		// Takes a deferral for every sample request and produces the sample on
+		// a thread of the media source, so the thread of the MediaStreamSource
+		// never waits for demuxing, decoding or conversion.
+		property bool DeferSampleRequests;
+
 		property PropertySet^ FFmpegOptions;
 	};
 }
\ No newline at end of file
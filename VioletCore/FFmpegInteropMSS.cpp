@@ -21,6 +21,8 @@
 #include "UncompressedAudioSampleProvider.h"
 #include "UncompressedVideoSampleProvider.h"
 #include "CritSec.h"
+#include "DecoderThreading.h"
+#include "MappedFileBackend.h"
 
 using namespace concurrency;
 using namespace FFmpegInterop;
@@ -34,12 +36,118 @@ static int FileStreamRead(void* ptr, uint8_t* buf, int bufSize);
 static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence);
 static int lock_manager(void **mtx, enum AVLockOp op);
 
+namespace
+{
+	// Reads from the IStream created over the IRandomAccessStream. Credit to
+	// Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+	class ComStreamBackend : public StreamBackend
+	{
+	public:
+		ComStreamBackend(IStream* stream)
+			: m_pStream(stream)
+		{
+			m_pStream->AddRef();
+		}
+
+		virtual ~ComStreamBackend()
+		{
+			m_pStream->Release();
+		}
+
+		virtual int Read(uint8_t* buffer, int size) override
+		{
+			ULONG bytesRead = 0;
+			HRESULT hr = m_pStream->Read(buffer, size, &bytesRead);
+			if (FAILED(hr))
+			{
+				return AVERROR(EIO);
+			}
+
+			return static_cast<int>(bytesRead);
+		}
+
+		virtual int64_t Seek(int64_t position) override
+		{
+			LARGE_INTEGER in;
+			in.QuadPart = position;
+			ULARGE_INTEGER out = { 0 };
+
+			if (FAILED(m_pStream->Seek(in, STREAM_SEEK_SET, &out)))
+			{
+				return AVERROR(EIO);
+			}
+
+			return static_cast<int64_t>(out.QuadPart);
+		}
+
+		virtual int64_t GetSize() override
+		{
+			STATSTG status;
+			if (FAILED(m_pStream->Stat(&status, STATFLAG_NONAME)))
+			{
+				return AVERROR(ENOSYS);
+			}
+
+			return static_cast<int64_t>(status.cbSize.QuadPart);
+		}
+
+		virtual int64_t GetModifiedTime() override
+		{
+			STATSTG status;
+			if (FAILED(m_pStream->Stat(&status, STATFLAG_NONAME)))
+			{
+				return 0;
+			}
+
+			return (static_cast<int64_t>(status.mtime.dwHighDateTime) << 32) | status.mtime.dwLowDateTime;
+		}
+
+	private:
+		IStream* m_pStream;
+	};
+
+	// Returns true if FFmpeg would open the URI with its file protocol, and
+	// the path of the file in that case.
+	bool GetLocalFilePath(const std::string& uri, std::string& path)
+	{
+		size_t colon = uri.find(':');
+
+		// No scheme at all, or a drive letter
+		if (colon == std::string::npos || colon == 1)
+		{
+			path = uri;
+			return true;
+		}
+
+		if (uri.compare(0, colon, "file") == 0)
+		{
+			path = uri.substr(colon + 1);
+			return true;
+		}
+
+		// A colon which does not end a scheme is part of the path
+		for (size_t i = 0; i < colon; i++)
+		{
+			char c = uri[i];
+			if (!isalnum(static_cast<unsigned char>(c)) && c != '+' && c != '-' && c != '.')
+			{
+				path = uri;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
 // Flag for ffmpeg global setup
 static bool isRegistered = false;
 
 // Initialize an FFmpegInteropObject
 FFmpegInteropMSS::FFmpegInteropMSS(FFmpegInteropConfig^ interopConfig)
 	: config(interopConfig)
+	, maxVideoWidth(interopConfig->MaxVideoWidth)
+	, maxVideoHeight(interopConfig->MaxVideoHeight)
 	, isFirstSeek(true)
 {
 	if (!isRegistered)
@@ -70,15 +178,58 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 
 	if (m_pReader != nullptr)
 	{
+		// The demuxer thread must not touch the format context anymore
+		m_pReader->Stop();
 		m_pReader = nullptr;
 	}
 
+	// Completes the deferred requests which are still queued
+	if (samplePipeline != nullptr)
+	{
+		samplePipeline->Stop();
+		delete samplePipeline;
+		samplePipeline = nullptr;
+	}
+
+	// Nobody must decode anymore when the sample providers go away. Taking
+	// the stream lock waits for a sample request which is still running.
+	for each (auto stream in sampleProviders)
+	{
+		if (stream != nullptr)
+		{
+			TimedAutoLock streamLock(stream->m_sampleLock, stream->m_sampleLockStatistics);
+			stream->StopDecodeAhead();
+		}
+	}
+
 	sampleProviders.clear();
 	audioStreams.clear();
 
 	avformat_close_input(&avFormatCtx);
 	av_free(avIOCtx);
 	av_dict_free(&avDict);
+
+	// Stop scanning before the index goes away
+	delete keyframeScanner;
+	keyframeScanner = nullptr;
+	delete keyframeScanBackend;
+	keyframeScanBackend = nullptr;
+
+	if (seekIndex != nullptr)
+	{
+		// Keep the keyframes found during this session for the next one
+		if (seekIndex->IsModified() && !seekIndexPath.empty())
+		{
+			seekIndex->Save(seekIndexPath, fileIdentity);
+		}
+
+		delete seekIndex;
+		seekIndex = nullptr;
+	}
+
+	// Stops the read-ahead thread
+	delete fileStreamReader;
+	fileStreamReader = nullptr;
 	
 	if (fileStreamData != nullptr)
 	{
@@ -90,8 +241,10 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFromStream(IRandomAccessStream^ stream, FFmpegInteropConfig^ config, MediaStreamSource^ mss)
 {
+	int64_t openStart = av_gettime_relative();
 	auto interopMSS = ref new FFmpegInteropMSS(config);
 	auto hr = interopMSS->CreateMediaStreamSource(stream, mss);
+	interopMSS->openTime = av_gettime_relative() - openStart;
 	if (!SUCCEEDED(hr))
 	{
 		throw ref new Exception(hr, "Failed to open media.");
@@ -101,8 +254,10 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFromStream(IRandomAccessStream^ stream
 
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFromUri(String^ uri, FFmpegInteropConfig^ config)
 {
+	int64_t openStart = av_gettime_relative();
 	auto interopMSS = ref new FFmpegInteropMSS(config);
 	auto hr = interopMSS->CreateMediaStreamSource(uri);
+	interopMSS->openTime = av_gettime_relative() - openStart;
 	if (!SUCCEEDED(hr))
 	{
 		throw ref new Exception(hr, "Failed to open media.");
@@ -110,6 +265,21 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFromUri(String^ uri, FFmpegInteropConf
 	return interopMSS;
 }
 
+void FFmpegInteropMSS::SetMaximumOutputSize(unsigned int width, unsigned int height)
+{
+	// The config may be shared with other instances, so the limit is kept here
+	TimedAutoLock lock(csGuard, guardStatistics);
+
+	maxVideoWidth = width;
+	maxVideoHeight = height;
+
+	auto videoProvider = dynamic_cast<UncompressedVideoSampleProvider^>(videoStream);
+	if (videoProvider != nullptr)
+	{
+		videoProvider->SetMaximumOutputSize(static_cast<int>(width), static_cast<int>(height));
+	}
+}
+
 MediaStreamSource^ FFmpegInteropMSS::GetMediaStreamSource()
 {
 	return mss;
@@ -118,7 +288,7 @@ MediaStreamSource^ FFmpegInteropMSS::GetMediaStreamSource()
 HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri)
 {
 	HRESULT hr = S_OK;
-	const char* charStr = nullptr;
+	std::string uriA;
 	if (!uri)
 	{
 		hr = E_INVALIDARG;
@@ -141,12 +311,43 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri)
 
 	if (SUCCEEDED(hr))
 	{
-		std::wstring uriW(uri->Begin());
-		std::string uriA(uriW.begin(), uriW.end());
-		charStr = uriA.c_str();
+		uriA = M2MakeUTF8String(uri);
+
+		// Local files are mapped into memory and read through custom IO, FFmpeg's own protocols handle everything else
+		std::string localPath;
+		if (GetLocalFilePath(uriA, localPath))
+		{
+			unsigned int readAheadBlockCount = 0;
+			StreamBackend* backend = MappedFileBackend::Open(localPath.c_str());
+			if (backend == nullptr)
+			{
+				// The file does not fit into the address space, read it in blocks instead
+				backend = FileStreamBackend::Open(localPath.c_str());
+				readAheadBlockCount = config->ReadAheadBlockCount;
+			}
+
+			if (backend != nullptr && config->EnableSeekIndex && config->ScanKeyframes)
+			{
+				// The keyframe scan reads the file on its own, without disturbing the playback position
+				keyframeScanBackend = FileStreamBackend::Open(localPath.c_str());
+			}
 
+			if (backend != nullptr)
+			{
+				hr = CreateCustomIOContext(backend, readAheadBlockCount);
+				if (SUCCEEDED(hr))
+				{
+					avFormatCtx->pb = avIOCtx;
+					avFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+				}
+			}
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
 		// Open media in the given URI using the specified options
-		if (avformat_open_input(&avFormatCtx, charStr, NULL, &avDict) < 0)
+		if (avformat_open_input(&avFormatCtx, uriA.c_str(), NULL, &avDict) < 0)
 		{
 			hr = E_FAIL; // Error opening file
 		}
@@ -183,24 +384,27 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, M
 		hr = CreateStreamOverRandomAccessStream(reinterpret_cast<IUnknown*>(stream), IID_PPV_ARGS(&fileStreamData));
 	}
 
-	if (SUCCEEDED(hr))
+	if (SUCCEEDED(hr) && config->EnableSeekIndex && config->ScanKeyframes)
 	{
-		// Setup FFmpeg custom IO to access file as stream. This is necessary when accessing any file outside of app installation directory and appdata folder.
-		// Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
-		fileStreamBuffer = (unsigned char*)av_malloc(config->StreamBufferSize);
-		if (fileStreamBuffer == nullptr)
+		// The keyframe scan reads a clone of the stream, without disturbing the playback position
+		try
 		{
-			hr = E_OUTOFMEMORY;
+			IStream* scanStream = nullptr;
+			if (SUCCEEDED(CreateStreamOverRandomAccessStream(reinterpret_cast<IUnknown*>(stream->CloneStream()), IID_PPV_ARGS(&scanStream))))
+			{
+				keyframeScanBackend = new ComStreamBackend(scanStream);
+				scanStream->Release();
+			}
+		}
+		catch (Exception^)
+		{
+			DebugMessage(L"The stream cannot be cloned for the keyframe scan\n");
 		}
 	}
 
 	if (SUCCEEDED(hr))
 	{
-		avIOCtx = avio_alloc_context(fileStreamBuffer, config->StreamBufferSize, 0, fileStreamData, FileStreamRead, 0, FileStreamSeek);
-		if (avIOCtx == nullptr)
-		{
-			hr = E_OUTOFMEMORY;
-		}
+		hr = CreateCustomIOContext(new ComStreamBackend(fileStreamData), config->ReadAheadBlockCount);
 	}
 
 	if (SUCCEEDED(hr))
@@ -248,27 +452,114 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, M
 	return hr;
 }
 
+HRESULT FFmpegInteropMSS::CreateCustomIOContext(StreamBackend* backend, unsigned int readAheadBlockCount)
+{
+	HRESULT hr = S_OK;
+
+	// Identify the content for the on-disk caches before the read-ahead thread takes over the backend
+	if (fileIdentity.Compute(backend) < 0)
+	{
+		DebugMessage(L"Could not identify the media file\n");
+	}
+
+	// Serve the AVIO callbacks from blocks which are read ahead on a background thread. The reader owns the backend.
+	fileStreamReader = new ReadAheadStream(backend, config->ReadAheadBlockSize, readAheadBlockCount);
+
+	// Setup FFmpeg custom IO to access file as stream. This is necessary when accessing any file outside of app installation directory and appdata folder.
+	// Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+	fileStreamBuffer = (unsigned char*)av_malloc(config->StreamBufferSize);
+	if (fileStreamBuffer == nullptr)
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avIOCtx = avio_alloc_context(fileStreamBuffer, config->StreamBufferSize, 0, fileStreamReader, FileStreamRead, 0, FileStreamSeek);
+		if (avIOCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	return hr;
+}
+
+std::string FFmpegInteropMSS::GetCacheFilePath(const char* extension)
+{
+	String^ folder = config->CacheFolder;
+	if (folder == nullptr || folder->IsEmpty())
+	{
+		try
+		{
+			folder = Windows::Storage::ApplicationData::Current->LocalCacheFolder->Path;
+		}
+		catch (Exception^)
+		{
+			// Not running in an app container, there is no default folder
+			return std::string();
+		}
+	}
+
+	return M2MakeUTF8String(folder) + "\\" + fileIdentity.GetKey() + extension;
+}
+
 HRESULT FFmpegInteropMSS::InitFFmpegContext()
 {
 	HRESULT hr = S_OK;
+	ProbeCache probeCache;
+	std::string probeCachePath;
+
+	if (config->EnableProbeCache && fileIdentity.IsValid())
+	{
+		// With the parameters of an earlier session, probing only has to confirm them
+		probeCachePath = GetCacheFilePath(".probe");
+		if (!probeCachePath.empty() && probeCache.Load(probeCachePath, fileIdentity) >= 0)
+		{
+			probeCacheHit = probeCache.Apply(avFormatCtx);
+		}
+	}
 
 	if (SUCCEEDED(hr))
 	{
+		int64_t probeStart = av_gettime_relative();
 		if (avformat_find_stream_info(avFormatCtx, NULL) < 0)
 		{
 			hr = E_FAIL; // Error finding info
 		}
+		probeTime = av_gettime_relative() - probeStart;
+	}
+
+	if (SUCCEEDED(hr) && !probeCacheHit && !probeCachePath.empty())
+	{
+		probeCache.Capture(avFormatCtx);
+		if (probeCache.Save(probeCachePath, fileIdentity) < 0)
+		{
+			DebugMessage(L"Could not write the probe cache\n");
+		}
 	}
 
 	if (SUCCEEDED(hr))
 	{
-		m_pReader = ref new FFmpegReader(avFormatCtx, &sampleProviders);
+		m_pReader = ref new FFmpegReader(avFormatCtx, config);
 		if (m_pReader == nullptr)
 		{
 			hr = E_OUTOFMEMORY;
 		}
 	}
 
+	if (SUCCEEDED(hr) && config->EnableSeekIndex && fileIdentity.IsValid())
+	{
+		// Start with the keyframes of earlier sessions, if there are any
+		seekIndex = new SeekIndex();
+		seekIndexPath = GetCacheFilePath(".seekindex");
+		if (!seekIndexPath.empty())
+		{
+			seekIndex->Load(seekIndexPath, fileIdentity);
+		}
+		m_pReader->SetSeekIndex(seekIndex);
+	}
+
 	auto audioStrInfos = ref new Vector<AudioStreamInfo^>();
 	auto subtitleStrInfos = ref new Vector<SubtitleStreamInfo^>();
 
@@ -405,6 +696,24 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext()
 		startingRequestedToken = mss->Starting += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceStartingEventArgs ^>(this, &FFmpegInteropMSS::OnStarting);
 		sampleRequestedToken = mss->SampleRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSampleRequestedEventArgs ^>(this, &FFmpegInteropMSS::OnSampleRequested);
 		switchStreamRequestedToken = mss->SwitchStreamsRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSwitchStreamsRequestedEventArgs ^>(this, &FFmpegInteropMSS::OnSwitchStreamsRequested);
+
+		// One lane for audio and one for video, so they are produced in parallel
+		if (config->DeferSampleRequests)
+		{
+			samplePipeline = new SamplePipeline(2);
+		}
+
+		// Without the keyframes of an earlier session, find them all in the background so that seeks can use the index right away
+		if (seekIndex != nullptr && keyframeScanBackend != nullptr && seekIndex->GetKeyframeCount() == 0 && FFmpegDemuxer::CanSeekToBytes(avFormatCtx->iformat))
+		{
+			int scanStreamIndex = videoStream ? videoStream->StreamIndex : currentAudioStream->StreamIndex;
+			keyframeScanner = new KeyframeScanner(keyframeScanBackend, avFormatCtx->iformat, seekIndex, scanStreamIndex);
+			keyframeScanBackend = nullptr;
+			keyframeScanner->Start();
+		}
+
+		// Start reading ahead for the enabled streams
+		m_pReader->Start();
 	}
 
 	return hr;
@@ -448,13 +757,7 @@ MediaSampleProvider^ FFmpegInteropMSS::CreateAudioStream(AVStream * avStream, in
 					avAudioCodecCtx->request_sample_fmt = AV_SAMPLE_FMT_FLT;
 				}
 
-				// enable multi threading
-				unsigned threads = this->m_NumberOfHardwareThreads;
-				if (threads > 0)
-				{
-					avAudioCodecCtx->thread_count = config->MaxAudioThreads == 0 ? threads : min(threads, config->MaxAudioThreads);
-					avAudioCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
-				}
+				SetDecoderThreads(avStream, avAudioCodecCtx);
 
 				if (avcodec_open2(avAudioCodecCtx, avAudioCodec, NULL) < 0)
 				{
@@ -462,6 +765,11 @@ MediaSampleProvider^ FFmpegInteropMSS::CreateAudioStream(AVStream * avStream, in
 				}
 				else
 				{
+					if (config->ShareSliceThreads)
+					{
+						UseSharedSliceThreads(avAudioCodecCtx);
+					}
+
 					// Detect audio format and create audio stream descriptor accordingly
 					audioStream = CreateAudioSampleProvider(avStream, avAudioCodecCtx, index);
 				}
@@ -511,12 +819,21 @@ MediaSampleProvider^ FFmpegInteropMSS::CreateVideoStream(AVStream * avStream, in
 
 		if (SUCCEEDED(hr))
 		{
-			// enable multi threading
-			unsigned threads = this->m_NumberOfHardwareThreads;
-			if (threads > 0)
+			SetDecoderThreads(avStream, avVideoCodecCtx);
+
+			// Decode at the lowest resolution which is still at least the maximum output size, the rest is scaled
+			int maxWidth = static_cast<int>(maxVideoWidth);
+			int maxHeight = static_cast<int>(maxVideoHeight);
+			if (maxWidth > 0 || maxHeight > 0)
 			{
-				avVideoCodecCtx->thread_count = config->MaxVideoThreads == 0 ? threads : min(threads, config->MaxVideoThreads);
-				avVideoCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+				int lowres = 0;
+				while (lowres < avVideoCodec->max_lowres
+					&& (avVideoCodecCtx->width >> (lowres + 1)) >= maxWidth
+					&& (avVideoCodecCtx->height >> (lowres + 1)) >= maxHeight)
+				{
+					lowres++;
+				}
+				avVideoCodecCtx->lowres = lowres;
 			}
 
 			if (avcodec_open2(avVideoCodecCtx, avVideoCodec, NULL) < 0)
@@ -525,6 +842,11 @@ MediaSampleProvider^ FFmpegInteropMSS::CreateVideoStream(AVStream * avStream, in
 			}
 			else
 			{
+				if (config->ShareSliceThreads)
+				{
+					UseSharedSliceThreads(avVideoCodecCtx);
+				}
+
 				// Detect video format and create video stream descriptor accordingly
 				result = CreateVideoSampleProvider(avStream, avVideoCodecCtx, index);
 			}
@@ -540,6 +862,46 @@ MediaSampleProvider^ FFmpegInteropMSS::CreateVideoStream(AVStream * avStream, in
 	return result;
 }
 
+void FFmpegInteropMSS::SetDecoderThreads(AVStream* avStream, AVCodecContext* avCodecCtx)
+{
+	bool isVideo = avCodecCtx->codec_type == AVMEDIA_TYPE_VIDEO;
+	unsigned int threadType = isVideo ? config->VideoThreadType : config->AudioThreadType;
+	unsigned int maxThreads = isVideo ? config->MaxVideoThreads : config->MaxAudioThreads;
+
+	DecoderThreads threads;
+	if (threadType != 0)
+	{
+		threads.type = static_cast<int>(threadType);
+		threads.count = static_cast<int>(this->m_NumberOfHardwareThreads);
+	}
+	else
+	{
+		DecoderThreadingInput input = {};
+		input.mediaType = avCodecCtx->codec_type;
+		input.codecId = avCodecCtx->codec_id;
+		input.profile = avCodecCtx->profile;
+		input.width = avCodecCtx->width;
+		input.height = avCodecCtx->height;
+		input.frameRate = avStream->avg_frame_rate.num > 0 && avStream->avg_frame_rate.den > 0 ? av_q2d(avStream->avg_frame_rate) : 0;
+		// Live sources have no duration
+		input.lowLatency = config->LowLatencyDecoding || avFormatCtx->duration == AV_NOPTS_VALUE;
+		input.hardwareThreads = this->m_NumberOfHardwareThreads;
+
+		threads = ChooseDecoderThreads(input);
+	}
+
+	if (maxThreads > 0 && threads.count > static_cast<int>(maxThreads))
+	{
+		threads.count = static_cast<int>(maxThreads);
+	}
+
+	if (threads.count > 0)
+	{
+		avCodecCtx->thread_count = threads.count;
+		avCodecCtx->thread_type = threads.type;
+	}
+}
+
 MediaSampleProvider^ FFmpegInteropMSS::CreateAudioSampleProvider(AVStream* avStream, AVCodecContext* avAudioCodecCtx, int index)
 {
 	UNREFERENCED_PARAMETER(avStream);
@@ -599,8 +961,16 @@ HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
 
 void FFmpegInteropMSS::OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args)
 {
+	TimedAutoLock lock(csGuard, guardStatistics);
+
 	MediaStreamSourceStartingRequest^ request = args->Request;
 
+	// Deferred requests for the old position are completed before the seek
+	if (samplePipeline != nullptr)
+	{
+		samplePipeline->WaitIdle();
+	}
+
 	// Perform seek operation when MediaStreamSource received seek event from MediaElement
 	if (request->StartPosition && request->StartPosition->Value.Duration <= mediaDuration.Duration && (!isFirstSeek || request->StartPosition->Value.Duration > 0))
 	{
@@ -626,32 +996,71 @@ void FFmpegInteropMSS::OnStarting(MediaStreamSource ^sender, MediaStreamSourceSt
 
 void FFmpegInteropMSS::OnSampleRequested(Windows::Media::Core::MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args)
 {
-	this->csGuard.Lock();
+	MediaSampleProvider^ stream = nullptr;
 
-	if (mss != nullptr)
+	// The shared lock is only held to pick the stream, so audio and video
+	// samples are decoded in parallel
 	{
-		if (currentAudioStream && args->Request->StreamDescriptor == currentAudioStream->StreamDescriptor)
+		TimedAutoLock lock(csGuard, guardStatistics);
+
+		if (mss != nullptr)
 		{
-			args->Request->Sample = currentAudioStream->GetNextSample();
+			if (currentAudioStream && args->Request->StreamDescriptor == currentAudioStream->StreamDescriptor)
+			{
+				stream = currentAudioStream;
+			}
+			else if (videoStream && args->Request->StreamDescriptor == videoStream->StreamDescriptor)
+			{
+				stream = videoStream;
+			}
 		}
-		else if (videoStream && args->Request->StreamDescriptor == videoStream->StreamDescriptor)
+	}
+
+	if (stream != nullptr && samplePipeline != nullptr)
+	{
+		auto request = args->Request;
+		auto deferral = request->GetDeferral();
+
+		bool submitted = samplePipeline->Submit(stream == videoStream ? 1 : 0, [stream, request, deferral](bool canceled)
 		{
-			args->Request->Sample = videoStream->GetNextSample();
-		}
-		else
+			if (!canceled)
+			{
+				TimedAutoLock streamLock(stream->m_sampleLock, stream->m_sampleLockStatistics);
+				request->Sample = stream->GetNextSample();
+			}
+			else
+			{
+				request->Sample = nullptr;
+			}
+
+			deferral->Complete();
+		});
+
+		// The pipeline only refuses jobs while the media source is destroyed
+		if (!submitted)
 		{
-			args->Request->Sample = nullptr;
+			request->Sample = nullptr;
+			deferral->Complete();
 		}
 	}
-
-	this->csGuard.Unlock();
+	else if (stream != nullptr)
+	{
+		TimedAutoLock streamLock(stream->m_sampleLock, stream->m_sampleLockStatistics);
+		args->Request->Sample = stream->GetNextSample();
+	}
+	else
+	{
+		args->Request->Sample = nullptr;
+	}
 }
 
 void FFmpegInteropMSS::OnSwitchStreamsRequested(MediaStreamSource ^ sender, MediaStreamSourceSwitchStreamsRequestedEventArgs ^ args)
 {
-	this->csGuard.Lock();
+	TimedAutoLock lock(csGuard, guardStatistics);
+
 	if (currentAudioStream && args->Request->OldStreamDescriptor == currentAudioStream->StreamDescriptor)
 	{
+		TimedAutoLock streamLock(currentAudioStream->m_sampleLock, currentAudioStream->m_sampleLockStatistics);
 		currentAudioStream->DisableStream();
 		currentAudioStream = nullptr;
 	}
@@ -659,11 +1068,11 @@ void FFmpegInteropMSS::OnSwitchStreamsRequested(MediaStreamSource ^ sender, Medi
 	{
 		if (stream->StreamDescriptor == args->Request->NewStreamDescriptor)
 		{
+			TimedAutoLock streamLock(stream->m_sampleLock, stream->m_sampleLockStatistics);
 			currentAudioStream = stream;
 			currentAudioStream->EnableStream();
 		}
 	}
-	this->csGuard.Unlock();
 }
 
 HRESULT FFmpegInteropMSS::Seek(TimeSpan position)
@@ -679,7 +1088,31 @@ HRESULT FFmpegInteropMSS::Seek(TimeSpan position)
 		auto correctedPosition = position.Duration + (avFormatCtx->start_time * 10);
 		int64_t seekTarget = static_cast<int64_t>(correctedPosition / (av_q2d(avFormatCtx->streams[streamIndex]->time_base) * 10000000));
 
-		if (av_seek_frame(avFormatCtx, streamIndex, seekTarget, AVSEEK_FLAG_BACKWARD) < 0)
+		// Sample requests must not decode while the streams are seeked. The
+		// caller holds csGuard, so the stream locks are always taken after it.
+		TimedAutoLock audioLock;
+		TimedAutoLock videoLock;
+		if (currentAudioStream != nullptr)
+		{
+			audioLock.Lock(currentAudioStream->m_sampleLock, currentAudioStream->m_sampleLockStatistics);
+		}
+		if (videoStream != nullptr)
+		{
+			videoLock.Lock(videoStream->m_sampleLock, videoStream->m_sampleLockStatistics);
+		}
+
+		// The decode-ahead workers must not consume the packets of the new position before the decoders are flushed
+		if (currentAudioStream != nullptr)
+		{
+			currentAudioStream->StopDecodeAhead();
+		}
+		if (videoStream != nullptr)
+		{
+			videoStream->StopDecodeAhead();
+		}
+
+		// The reader pauses the demuxer thread and drops all queued packets
+		if (m_pReader->Seek(streamIndex, seekTarget, AVSEEK_FLAG_BACKWARD) < 0)
 		{
 			hr = E_FAIL;
 			DebugMessage(L" - ### Error while seeking\n");
@@ -707,54 +1140,16 @@ HRESULT FFmpegInteropMSS::Seek(TimeSpan position)
 	return hr;
 }
 
-// Static function to read file stream and pass data to FFmpeg. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+// Static function to pass file stream data to FFmpeg. The data comes from the read-ahead blocks.
 static int FileStreamRead(void* ptr, uint8_t* buf, int bufSize)
 {
-	IStream* pStream = reinterpret_cast<IStream*>(ptr);
-	ULONG bytesRead = 0;
-	HRESULT hr = pStream->Read(buf, bufSize, &bytesRead);
-
-	if (FAILED(hr))
-	{
-		return -1;
-	}
-
-	// If we succeed but don't have any bytes, assume end of file
-	if (bytesRead == 0)
-	{
-		return AVERROR_EOF;  // Let FFmpeg know that we have reached eof
-	}
-
-	return bytesRead;
+	return ReadAheadStream::ReadCallback(ptr, buf, bufSize);
 }
 
-// Static function to seek in file stream. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+// Static function to seek in file stream. Only drops the read-ahead if the target is outside of the buffered window.
 static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence)
 {
-	IStream* pStream = reinterpret_cast<IStream*>(ptr);
-	if (whence == AVSEEK_SIZE)
-	{
-		// get stream size
-		STATSTG status;
-		if (FAILED(pStream->Stat(&status, STATFLAG_NONAME)))
-		{
-			return -1;
-		}
-		return status.cbSize.QuadPart;
-	}
-	else
-	{
-		LARGE_INTEGER in;
-		in.QuadPart = pos;
-		ULARGE_INTEGER out = { 0 };
-
-		if (FAILED(pStream->Seek(in, whence, &out)))
-		{
-			return -1;
-		}
-
-		return out.QuadPart; // Return the new position:
-	}
+	return ReadAheadStream::SeekCallback(ptr, pos, whence);
 }
 
 static int lock_manager(void **mtx, enum AVLockOp op)
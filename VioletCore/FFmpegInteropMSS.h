@@ -21,7 +21,13 @@
 #include <mutex>
 #include <pplawait.h>
 #include "FFmpegReader.h"
+#include "KeyframeScanner.h"
+#include "MediaFileIdentity.h"
 #include "MediaSampleProvider.h"
+#include "ProbeCache.h"
+#include "ReadAheadStream.h"
+#include "SamplePipeline.h"
+#include "SeekIndex.h"
 #include "StreamInfo.h"
 
 using namespace Platform;
@@ -48,6 +54,11 @@ namespace FFmpegInterop
 		MediaStreamSource^ GetMediaStreamSource();
 		virtual ~FFmpegInteropMSS();
 
+		// Scales video frames larger than this down before they are handed
+		// out, 0 means no limit. Starts at MaxVideoWidth and MaxVideoHeight
+		// of the config, which are not changed.
+		void SetMaximumOutputSize(unsigned int width, unsigned int height);
+
 		// Properties
 
 		property TimeSpan Duration
@@ -73,8 +84,112 @@ namespace FFmpegInterop
 			IVectorView<SubtitleStreamInfo^>^ get() { return subtitleStreamInfos; }
 		}
 
-	internal:
-		int ReadPacket();
+		// Number of demuxed packets served from the packet pool
+		property uint64 PacketPoolHits
+		{
+			uint64 get() { return m_pReader ? m_pReader->PacketPoolHits : 0; }
+		}
+
+		// Number of demuxed packets which needed a new allocation
+		property uint64 PacketPoolMisses
+		{
+			uint64 get() { return m_pReader ? m_pReader->PacketPoolMisses : 0; }
+		}
+
+		// Number of packets read by the demuxer, including dropped ones
+		property uint64 DemuxerPacketsRead
+		{
+			uint64 get() { return m_pReader ? m_pReader->GetStatistics().packetsRead : 0; }
+		}
+
+		// Number of packets read for streams which were not enabled
+		property uint64 DemuxerPacketsDropped
+		{
+			uint64 get() { return m_pReader ? m_pReader->GetStatistics().packetsDropped : 0; }
+		}
+
+		// Number of bytes read from the media by the demuxer
+		property uint64 DemuxerBytesRead
+		{
+			uint64 get() { return m_pReader ? m_pReader->GetStatistics().bytesRead : 0; }
+		}
+
+		// Time the demuxer thread spent in av_read_frame
+		property TimeSpan DemuxerReadTime
+		{
+			TimeSpan get() { return { m_pReader ? LONGLONG(m_pReader->GetStatistics().readTime * 10) : 0 }; }
+		}
+
+		// CPU time used by the demuxer thread
+		property TimeSpan DemuxerCpuTime
+		{
+			TimeSpan get() { return { m_pReader ? LONGLONG(m_pReader->GetStatistics().cpuTime * 10) : 0 }; }
+		}
+
+		// Number of seeks performed by the demuxer
+		property uint64 DemuxerSeeks
+		{
+			uint64 get() { return m_pReader ? m_pReader->GetStatistics().seeks : 0; }
+		}
+
+		// Number of seeks which jumped to a byte position from the seek index
+		property uint64 DemuxerIndexedSeeks
+		{
+			uint64 get() { return m_pReader ? m_pReader->GetStatistics().indexedSeeks : 0; }
+		}
+
+		// Time the demuxer spent in av_seek_frame
+		property TimeSpan DemuxerSeekTime
+		{
+			TimeSpan get() { return { m_pReader ? LONGLONG(m_pReader->GetStatistics().seekTime * 10) : 0 }; }
+		}
+
+		// Time it took to open the media, from the creation of the object up to
+		// a ready MediaStreamSource
+		property TimeSpan OpenTime
+		{
+			TimeSpan get() { return { LONGLONG(openTime * 10) }; }
+		}
+
+		// Time spent in avformat_find_stream_info while opening the media
+		property TimeSpan ProbeTime
+		{
+			TimeSpan get() { return { LONGLONG(probeTime * 10) }; }
+		}
+
+		// Whether the stream parameters came from the probe cache
+		property bool ProbeCacheHit
+		{
+			bool get() { return probeCacheHit; }
+		}
+
+		// Number of keyframes in the seek index
+		property uint64 SeekIndexKeyframes
+		{
+			uint64 get() { return seekIndex ? seekIndex->GetKeyframeCount() : 0; }
+		}
+
+		// Number of deferred sample requests completed, and the sum of the time
+		// from the request to its completion
+		property uint64 DeferredSamples
+		{
+			uint64 get() { return samplePipeline ? samplePipeline->GetCompletedJobs() : 0; }
+		}
+		property TimeSpan DeferredSampleLatency
+		{
+			TimeSpan get() { return { samplePipeline ? LONGLONG(samplePipeline->GetTotalLatency() * 10) : 0 }; }
+		}
+
+		// Time the media source events waited for the shared lock, and held it.
+		// Sample decoding runs under the lock of its stream instead.
+		property TimeSpan GuardLockWaitTime
+		{
+			TimeSpan get() { return { guardStatistics.waitTime.load() }; }
+		}
+		property TimeSpan GuardLockHoldTime
+		{
+			TimeSpan get() { return { guardStatistics.holdTime.load() }; }
+		}
 
 	private:
 		FFmpegInteropMSS(FFmpegInteropConfig^ config);
@@ -83,9 +198,12 @@ namespace FFmpegInterop
 		
 		HRESULT CreateMediaStreamSource(IRandomAccessStream^ stream, MediaStreamSource^ MSS);
 		HRESULT CreateMediaStreamSource(String^ uri);
+		HRESULT CreateCustomIOContext(StreamBackend* backend, unsigned int readAheadBlockCount);
 		HRESULT InitFFmpegContext();
+		std::string GetCacheFilePath(const char* extension);
 		MediaSampleProvider^ CreateAudioStream(AVStream * avStream, int index);
 		MediaSampleProvider^ CreateVideoStream(AVStream * avStream, int index);
+		void SetDecoderThreads(AVStream* avStream, AVCodecContext* avCodecCtx);
 		MediaSampleProvider^ CreateAudioSampleProvider(AVStream * avStream, AVCodecContext* avCodecCtx, int index);
 		MediaSampleProvider^ CreateVideoSampleProvider(AVStream * avStream, AVCodecContext* avCodecCtx, int index);
 		HRESULT ParseOptions(PropertySet^ ffmpegOptions);
@@ -106,6 +224,8 @@ namespace FFmpegInterop
 
 	private:
 		FFmpegInteropConfig ^ config;
+		unsigned int maxVideoWidth;
+		unsigned int maxVideoHeight;
 		std::vector<MediaSampleProvider^> sampleProviders;
 		std::vector<MediaSampleProvider^> audioStreams;
 		MediaSampleProvider^ videoStream;
@@ -116,13 +236,24 @@ namespace FFmpegInterop
 		IVectorView<SubtitleStreamInfo^>^ subtitleStreamInfos;
 
 		CritSec csGuard;
+		LockStatistics guardStatistics;
 
 		String^ videoCodecName;
 		String^ audioCodecName;
 		TimeSpan mediaDuration;
 		IStream* fileStreamData;
+		ReadAheadStream* fileStreamReader;
 		unsigned char* fileStreamBuffer;
 		FFmpegReader^ m_pReader;
+		MediaFileIdentity fileIdentity;
+		SeekIndex* seekIndex;
+		StreamBackend* keyframeScanBackend;
+		KeyframeScanner* keyframeScanner;
+		SamplePipeline* samplePipeline;
+		std::string seekIndexPath;
+		int64_t openTime;
+		int64_t probeTime;
+		bool probeCacheHit;
 		bool isFirstSeek;
 	};
 }
@@ -21,50 +21,78 @@
 
 using namespace FFmpegInterop;
 
-FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx, std::vector<MediaSampleProvider^>* initProviders)
-	: m_pAvFormatCtx(avFormatCtx)
-	, sampleProviders(initProviders)
+FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx, FFmpegInteropConfig^ config)
+	: m_pDemuxer(new FFmpegDemuxer(avFormatCtx, config->ReadAheadPackets, config->PacketQueueMemoryBudget))
 {
 }
 
 FFmpegReader::~FFmpegReader()
 {
+	delete m_pDemuxer;
 }
 
-// Read the next packet from the stream and push it into the appropriate
-// sample provider
-int FFmpegReader::ReadPacket()
+// Start demuxing on the background thread
+void FFmpegReader::Start()
 {
-	int ret;
-	AVPacket *avPacket = av_packet_alloc();
-	if (!avPacket)
-	{
-		return E_OUTOFMEMORY;
-	}
-
-	ret = av_read_frame(m_pAvFormatCtx, avPacket);
-	if (ret < 0)
-	{
-		av_packet_free(&avPacket);
-		return ret;
-	}
-
-	if (avPacket->stream_index > static_cast<int>(sampleProviders->size()) || avPacket->stream_index < 0)
-	{
-		av_packet_free(&avPacket);
-		return E_FAIL;
-	}
-
-	MediaSampleProvider^ provider = sampleProviders->at(avPacket->stream_index);
-	if (provider)
-	{
-		provider->QueuePacket(avPacket);
-	}
-	else
-	{
-		DebugMessage(L"Ignoring unused stream\n");
-		av_packet_free(&avPacket);
-	}
-
-	return ret;
+	m_pDemuxer->Start();
+}
+
+// Stop the background thread, must be called before the format context is
+// closed
+void FFmpegReader::Stop()
+{
+	m_pDemuxer->Stop();
+}
+
+// Wait for the next packet of the given stream. The packets are read by the
+// demuxer thread, so this only blocks when the read-ahead ran dry.
+int FFmpegReader::ReadPacket(int streamIndex, AVPacket** avPacket)
+{
+	return m_pDemuxer->ReadPacket(streamIndex, avPacket);
+}
+
+AVPacket* FFmpegReader::PopPacket(int streamIndex)
+{
+	return m_pDemuxer->PopPacket(streamIndex);
+}
+
+// Hand a packet returned by ReadPacket or PopPacket back to the packet pool
+void FFmpegReader::ReleasePacket(AVPacket* avPacket)
+{
+	m_pDemuxer->ReleasePacket(avPacket);
+}
+
+void FFmpegReader::FlushStream(int streamIndex)
+{
+	m_pDemuxer->FlushStream(streamIndex);
+}
+
+void FFmpegReader::EnableStream(int streamIndex)
+{
+	m_pDemuxer->EnableStream(streamIndex);
+}
+
+void FFmpegReader::DisableStream(int streamIndex)
+{
+	m_pDemuxer->DisableStream(streamIndex);
+}
+
+PacketQueueStatistics FFmpegReader::GetQueueStatistics(int streamIndex)
+{
+	return m_pDemuxer->GetQueueStatistics(streamIndex);
+}
+
+DemuxerStatistics FFmpegReader::GetStatistics()
+{
+	return m_pDemuxer->GetStatistics();
+}
+
+void FFmpegReader::SetSeekIndex(SeekIndex* seekIndex)
+{
+	m_pDemuxer->SetSeekIndex(seekIndex);
+}
+
+int FFmpegReader::Seek(int streamIndex, int64_t timestamp, int flags)
+{
+	return m_pDemuxer->Seek(streamIndex, timestamp, flags);
 }
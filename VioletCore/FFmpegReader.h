@@ -18,7 +18,8 @@
 
 #pragma once
 
-#include "MediaSampleProvider.h"
+#include "FFmpegInteropConfig.h"
+#include "FFmpegDemuxer.h"
 
 namespace FFmpegInterop
 {
@@ -27,13 +28,34 @@ namespace FFmpegInterop
 	{
 	public:
 		virtual ~FFmpegReader();
-		int ReadPacket();
 
 	internal:
-		FFmpegReader(AVFormatContext* avFormatCtx, std::vector<MediaSampleProvider^>* sampleProviders);
+		FFmpegReader(AVFormatContext* avFormatCtx, FFmpegInteropConfig^ config);
+
+		void Start();
+		void Stop();
+		void SetSeekIndex(SeekIndex* seekIndex);
+		int ReadPacket(int streamIndex, AVPacket** avPacket);
+		AVPacket* PopPacket(int streamIndex);
+		void ReleasePacket(AVPacket* avPacket);
+		void FlushStream(int streamIndex);
+		void EnableStream(int streamIndex);
+		void DisableStream(int streamIndex);
+		int Seek(int streamIndex, int64_t timestamp, int flags);
+		PacketQueueStatistics GetQueueStatistics(int streamIndex);
+		DemuxerStatistics GetStatistics();
+
+		property uint64_t PacketPoolHits
+		{
+			uint64_t get() { return m_pDemuxer->GetPacketPool().GetHitCount(); }
+		}
+
+		property uint64_t PacketPoolMisses
+		{
+			uint64_t get() { return m_pDemuxer->GetPacketPool().GetMissCount(); }
+		}
 
 	private:
-		AVFormatContext* m_pAvFormatCtx;
-		std::vector<MediaSampleProvider^>* sampleProviders;
+		FFmpegDemuxer* m_pDemuxer;
 	};
 }
@@ -0,0 +1,46 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of decoder frame buffers.
+* File Name: FrameBufferPool.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "FrameBufferPool.h"
+
+using namespace FFmpegInterop;
+
+FrameBufferPool::FrameBufferPool()
+	: m_pool(nullptr)
+	, m_bufferSize(0)
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+	// Frames which are still out keep the pool alive until they are released
+	av_buffer_pool_uninit(&m_pool);
+}
+
+AVBufferRef* FrameBufferPool::Get(int size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_pool || m_bufferSize != size)
+	{
+		av_buffer_pool_uninit(&m_pool);
+		m_pool = av_buffer_pool_init(size, av_buffer_alloc);
+		m_bufferSize = m_pool ? size : 0;
+		if (!m_pool)
+		{
+			return nullptr;
+		}
+	}
+
+	return av_buffer_pool_get(m_pool);
+}
+
+int FrameBufferPool::GetBufferSize()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bufferSize;
+}
@@ -0,0 +1,45 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of decoder frame buffers.
+* File Name: FrameBufferPool.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <mutex>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// Hands out frame buffers of one size from an AVBufferPool, so that a
+	// decoder does not allocate and free a whole frame for every picture.
+	// Large allocations come straight from the OS and fault in every page on
+	// first touch, a recycled buffer is already mapped.
+	//
+	// The pool is recreated when the requested size changes, e.g. after a
+	// resolution switch. Buffers of the old size are freed once the last
+	// frame using them is released. Buffers may be requested from any
+	// thread, like frame threads calling get_buffer2.
+	class FrameBufferPool
+	{
+	public:
+		FrameBufferPool();
+		~FrameBufferPool();
+
+		FrameBufferPool(const FrameBufferPool&) = delete;
+		FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+		// Returns a buffer of the given size, or nullptr if out of memory.
+		AVBufferRef* Get(int size);
+
+		// The size of the buffers in the current pool, 0 if there is none.
+		int GetBufferSize();
+
+	private:
+		std::mutex m_mutex;
+		AVBufferPool* m_pool;
+		int m_bufferSize;
+	};
+}
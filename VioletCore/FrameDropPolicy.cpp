@@ -0,0 +1,109 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Decides what a late video stream leaves out to catch up.
+* File Name: FrameDropPolicy.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "FFmpegIncludes.h"
+#include "FrameDropPolicy.h"
+
+using namespace FFmpegInterop;
+
+// Non-reference frames are skipped beyond two frames, but at least beyond this
+static const int64_t MinDropLateness = 500000;
+static const int64_t DropLateFramesLateness = 2000000;
+static const int64_t SkipToKeyframeLateness = 10000000;
+
+FrameDropPolicy::FrameDropPolicy()
+{
+	Reset();
+}
+
+void FrameDropPolicy::Reset()
+{
+	m_level = DropNone;
+	m_skipRequested = false;
+	m_resumePosition = INT64_MIN;
+}
+
+void FrameDropPolicy::OnDeliver(int64_t position, int64_t lateness, int64_t frameDuration)
+{
+	Level current = GetLevel();
+	Level level = GetLevelForLateness(lateness, frameDuration);
+	if (level > current || (level < current && GetLevelForLateness(lateness * 2, frameDuration) < current))
+	{
+		m_level = level;
+		current = level;
+	}
+
+	// Samples decoded before the last skip ended do not tell whether it
+	// caught up
+	if (current == SkipToKeyframe && position >= m_resumePosition)
+	{
+		m_resumePosition = INT64_MAX;
+		m_skipRequested = true;
+	}
+}
+
+FrameDropPolicy::Level FrameDropPolicy::GetLevel() const
+{
+	return static_cast<Level>(m_level.load());
+}
+
+bool FrameDropPolicy::ShouldDrop(bool isKeyframe, int64_t lateness) const
+{
+	// Keyframes are kept, so the picture still moves on while far behind
+	return GetLevel() >= DropLateFrames && !isKeyframe && lateness > 0;
+}
+
+bool FrameDropPolicy::TakeSkipRequest()
+{
+	return m_skipRequested.exchange(false);
+}
+
+void FrameDropPolicy::OnSkipEnd(int64_t position)
+{
+	m_resumePosition = position;
+}
+
+FrameDropPolicy::Level FrameDropPolicy::GetLevelForLateness(int64_t lateness, int64_t frameDuration)
+{
+	int64_t dropLateness = 2 * frameDuration > MinDropLateness ? 2 * frameDuration : MinDropLateness;
+
+	if (lateness > SkipToKeyframeLateness)
+	{
+		return SkipToKeyframe;
+	}
+	else if (lateness > DropLateFramesLateness)
+	{
+		return DropLateFrames;
+	}
+	else if (lateness > dropLateness)
+	{
+		return SkipNonReferenceFrames;
+	}
+
+	return DropNone;
+}
+
+AVDiscard FrameDropPolicy::GetSkipFrame(Level level)
+{
+	// The decoder knows which frames are referenced, the picture type does
+	// not tell, e.g. for B frames which other B frames refer to
+	return level >= SkipNonReferenceFrames ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+AVDiscard FrameDropPolicy::GetSkipLoopFilter(Level level)
+{
+	return level == SkipToKeyframe ? AVDISCARD_ALL : level == DropLateFrames ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+}
+
+bool FrameDropPolicy::IsKeyframe(const AVFrame* avFrame)
+{
+#ifdef AV_FRAME_FLAG_KEY
+	return (avFrame->flags & AV_FRAME_FLAG_KEY) != 0;
+#else
+	return avFrame->key_frame != 0;
+#endif
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Decides what a late video stream leaves out to catch up.
+* File Name: FrameDropPolicy.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// The level is judged from the lateness of the samples when they are
+	// handed out, on the thread which delivers them. A decode-ahead worker
+	// reads it, applies the decoder settings and skips to the next keyframe
+	// when asked to. All times are in 100 ns units.
+	class FrameDropPolicy
+	{
+	public:
+		// What is left out, each level includes the ones before it
+		enum Level
+		{
+			DropNone,
+			// Later than two frames, but at least 50 ms. Frames no other frame
+			// refers to are not decoded.
+			SkipNonReferenceFrames,
+			// Later than 200 ms. Only keyframes are deblocked, and late frames
+			// other than keyframes are not converted.
+			DropLateFrames,
+			// Later than 1 s. No frame is deblocked and decoding skips to the
+			// next keyframe.
+			SkipToKeyframe
+		};
+
+		FrameDropPolicy();
+
+		// Back to full quality, call when seeking
+		void Reset();
+
+		// Call with every delivered sample. The level rises right away, but
+		// only falls once the lateness is below half of the threshold of the
+		// current level, so it does not flip at every frame. At
+		// SkipToKeyframe, every sample decoded after the last skip which is
+		// still that late asks for another skip.
+		void OnDeliver(int64_t position, int64_t lateness, int64_t frameDuration);
+
+		Level GetLevel() const;
+
+		// Whether a decoded frame is left out instead of converted
+		bool ShouldDrop(bool isKeyframe, int64_t lateness) const;
+
+		// True once for every skip to the next keyframe which was asked for
+		bool TakeSkipRequest();
+
+		// Call with the position of the keyframe decoding resumed at
+		void OnSkipEnd(int64_t position);
+
+		// The level for a lateness, without the hysteresis
+		static Level GetLevelForLateness(int64_t lateness, int64_t frameDuration);
+
+		// The skip_frame and skip_loop_filter of the decoder at a level
+		static AVDiscard GetSkipFrame(Level level);
+		static AVDiscard GetSkipLoopFilter(Level level);
+
+		static bool IsKeyframe(const AVFrame* avFrame);
+
+	private:
+		std::atomic<int> m_level;
+		std::atomic<bool> m_skipRequested;
+		// INT64_MAX from the request of a skip until it ended
+		std::atomic<int64_t> m_resumePosition;
+	};
+}
@@ -0,0 +1,135 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Fills the seek index from a background scan of the whole file.
+* File Name: KeyframeScanner.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "KeyframeScanner.h"
+
+using namespace FFmpegInterop;
+
+KeyframeScanner::KeyframeScanner(StreamBackend* backend, const AVInputFormat* format, SeekIndex* seekIndex, int streamIndex)
+	: m_stream(new ReadAheadStream(backend, 0, 0))
+	, m_format(format)
+	, m_pSeekIndex(seekIndex)
+	, m_streamIndex(streamIndex)
+	, m_cancel(false)
+	, m_finished(false)
+	, m_result(0)
+	, m_keyframes(0)
+	, m_scanTime(0)
+{
+}
+
+KeyframeScanner::~KeyframeScanner()
+{
+	Cancel();
+}
+
+void KeyframeScanner::Start()
+{
+	if (!m_thread.joinable() && !m_finished)
+	{
+		m_thread = std::thread(&KeyframeScanner::ScanLoop, this);
+	}
+}
+
+void KeyframeScanner::Cancel()
+{
+	m_cancel = true;
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void KeyframeScanner::ScanLoop()
+{
+	m_result = Scan();
+	m_finished = true;
+}
+
+int KeyframeScanner::Scan()
+{
+	int64_t scanStart = av_gettime_relative();
+
+	// The synchronous reads of the stream go straight to the backend.
+	unsigned char* buffer = static_cast<unsigned char*>(av_malloc(BufferSize));
+	AVIOContext* avIOCtx = buffer ? avio_alloc_context(buffer, BufferSize, 0, m_stream.get(), ReadAheadStream::ReadCallback, nullptr, ReadAheadStream::SeekCallback) : nullptr;
+	AVFormatContext* avFormatCtx = avIOCtx ? avformat_alloc_context() : nullptr;
+	if (!avFormatCtx)
+	{
+		if (avIOCtx)
+		{
+			avio_context_free(&avIOCtx);
+		}
+		av_free(buffer);
+		return AVERROR(ENOMEM);
+	}
+
+	avFormatCtx->pb = avIOCtx;
+	avFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	// Frees the format context on failure.
+	int ret = avformat_open_input(&avFormatCtx, "", const_cast<AVInputFormat*>(m_format), nullptr);
+	if (ret >= 0 && (m_streamIndex < 0 || m_streamIndex >= static_cast<int>(avFormatCtx->nb_streams)))
+	{
+		ret = AVERROR_STREAM_NOT_FOUND;
+	}
+
+	AVPacket* avPacket = ret >= 0 ? av_packet_alloc() : nullptr;
+	if (ret >= 0 && !avPacket)
+	{
+		ret = AVERROR(ENOMEM);
+	}
+
+	if (ret >= 0)
+	{
+		for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+		{
+			avFormatCtx->streams[i]->discard = static_cast<int>(i) == m_streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+		}
+
+		// The keyframes follow each other without a seek in between, every
+		// entry is linked to the one before.
+		int64_t previousTimestamp = AV_NOPTS_VALUE;
+		while (!m_cancel && (ret = av_read_frame(avFormatCtx, avPacket)) >= 0)
+		{
+			if (avPacket->stream_index == m_streamIndex && (avPacket->flags & AV_PKT_FLAG_KEY))
+			{
+				int64_t timestamp = avPacket->pts != AV_NOPTS_VALUE ? avPacket->pts : avPacket->dts;
+				if (timestamp != AV_NOPTS_VALUE)
+				{
+					m_pSeekIndex->AddKeyframe(m_streamIndex, timestamp, avPacket->pos, previousTimestamp);
+					previousTimestamp = timestamp;
+					++m_keyframes;
+				}
+			}
+
+			av_packet_unref(avPacket);
+			m_scanTime = av_gettime_relative() - scanStart;
+		}
+
+		if (ret == AVERROR_EOF)
+		{
+			ret = 0;
+		}
+		else if (m_cancel)
+		{
+			ret = AVERROR_EXIT;
+		}
+	}
+
+	av_packet_free(&avPacket);
+	avformat_close_input(&avFormatCtx);
+
+	// Custom I/O is left to us.
+	av_freep(&avIOCtx->buffer);
+	avio_context_free(&avIOCtx);
+
+	m_scanTime = av_gettime_relative() - scanStart;
+
+	return ret;
+}
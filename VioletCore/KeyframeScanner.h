@@ -0,0 +1,73 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Fills the seek index from a background scan of the whole file.
+* File Name: KeyframeScanner.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "FFmpegIncludes.h"
+#include "ReadAheadStream.h"
+#include "SeekIndex.h"
+
+namespace FFmpegInterop
+{
+	// Demuxes a second instance of the media file on a background thread and
+	// records every keyframe of one stream in the seek index, so that seeks
+	// can use the index before playback has passed their target. Only the
+	// packets of that stream are kept, the others are discarded.
+	class KeyframeScanner
+	{
+	public:
+		// Takes the ownership of the backend, which must read the same file
+		// as the player. The format is the one the player detected, or
+		// nullptr to probe it again. The index must outlive the scanner.
+		KeyframeScanner(StreamBackend* backend, const AVInputFormat* format, SeekIndex* seekIndex, int streamIndex);
+
+		// Cancels the scan and waits for the thread.
+		~KeyframeScanner();
+
+		KeyframeScanner(const KeyframeScanner&) = delete;
+		KeyframeScanner& operator=(const KeyframeScanner&) = delete;
+
+		void Start();
+
+		// Stops the scan at the next packet and waits for the thread.
+		void Cancel();
+
+		bool IsFinished() const { return m_finished; }
+
+		// Return value:
+		//   0 if the whole file was scanned, otherwise a negative AVERROR
+		//   code. Only meaningful once the scan is finished.
+		int GetResult() const { return m_result; }
+
+		uint64_t GetKeyframeCount() const { return m_keyframes; }
+
+		// Wall clock time of the scan so far, in microseconds.
+		int64_t GetScanTime() const { return m_scanTime; }
+
+	private:
+		static const int BufferSize = 64 * 1024;
+
+		void ScanLoop();
+		int Scan();
+
+		std::unique_ptr<ReadAheadStream> m_stream;
+		const AVInputFormat* m_format;
+		SeekIndex* m_pSeekIndex;
+		int m_streamIndex;
+
+		std::thread m_thread;
+		std::atomic<bool> m_cancel;
+		std::atomic<bool> m_finished;
+		std::atomic<int> m_result;
+		std::atomic<uint64_t> m_keyframes;
+		std::atomic<int64_t> m_scanTime;
+	};
+}
@@ -0,0 +1,90 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: How long a lock was waited for and held.
+* File Name: LockStatistics.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace FFmpegInterop
+{
+	// Sums up how long a lock was waited for and held, in 100 ns units like
+	// TimeSpan.
+	struct LockStatistics
+	{
+		std::atomic<long long> waitTime;
+		std::atomic<long long> holdTime;
+		std::atomic<unsigned long long> acquisitions;
+
+		LockStatistics()
+			: waitTime(0)
+			, holdTime(0)
+			, acquisitions(0)
+		{
+		}
+
+		static long long Now()
+		{
+			typedef std::chrono::duration<long long, std::ratio<1, 10000000>> Ticks;
+			return std::chrono::duration_cast<Ticks>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	};
+
+	// Holds a lock with Lock and Unlock methods, like CritSec, and adds its
+	// wait and hold time to the statistics of the lock. Constructed without
+	// a lock it holds none until Lock is called, for locks which are only
+	// taken under a condition.
+	template <class Lockable>
+	class TimedLock
+	{
+	public:
+		TimedLock()
+			: m_pLock(nullptr)
+			, m_pStatistics(nullptr)
+			, m_acquired(0)
+		{
+		}
+
+		TimedLock(Lockable& lock, LockStatistics& statistics)
+			: TimedLock()
+		{
+			Lock(lock, statistics);
+		}
+
+		~TimedLock()
+		{
+			if (m_pLock)
+			{
+				m_pStatistics->holdTime += LockStatistics::Now() - m_acquired;
+				m_pLock->Unlock();
+			}
+		}
+
+		// Only once per TimedLock
+		void Lock(Lockable& lock, LockStatistics& statistics)
+		{
+			long long start = LockStatistics::Now();
+			lock.Lock();
+			m_acquired = LockStatistics::Now();
+
+			m_pLock = &lock;
+			m_pStatistics = &statistics;
+			m_pStatistics->waitTime += m_acquired - start;
+			m_pStatistics->acquisitions++;
+		}
+
+		bool OwnsLock() const { return m_pLock != nullptr; }
+
+	private:
+		TimedLock(const TimedLock&) = delete;
+		TimedLock& operator=(const TimedLock&) = delete;
+
+		Lockable* m_pLock;
+		LockStatistics* m_pStatistics;
+		long long m_acquired;
+	};
+}
@@ -0,0 +1,321 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The memory-mapped local file backend for the custom AVIO layer.
+* File Name: MappedFileBackend.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+
+#include "MappedFileBackend.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <string>
+#else
+#include <atomic>
+#include <fcntl.h>
+#include <mutex>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace FFmpegInterop;
+
+namespace
+{
+#ifndef _WIN32
+	// Where a guarded copy on this thread continues after a SIGBUS, or
+	// nullptr if the thread is not copying from a mapping.
+	thread_local sigjmp_buf* t_copyJump = nullptr;
+
+	struct sigaction g_previousSigbusAction;
+	std::once_flag g_sigbusHandlerInstalled;
+
+	void OnSigbus(int signalNumber, siginfo_t* info, void* context)
+	{
+		if (t_copyJump)
+		{
+			siglongjmp(*t_copyJump, 1);
+		}
+
+		// Not caused by us, let the handler which was there before deal with
+		// it. The default action takes effect when the faulting instruction
+		// runs again after we return.
+		if (g_previousSigbusAction.sa_flags & SA_SIGINFO)
+		{
+			g_previousSigbusAction.sa_sigaction(signalNumber, info, context);
+		}
+		else if (g_previousSigbusAction.sa_handler == SIG_DFL || g_previousSigbusAction.sa_handler == SIG_IGN)
+		{
+			signal(SIGBUS, SIG_DFL);
+		}
+		else
+		{
+			g_previousSigbusAction.sa_handler(signalNumber);
+		}
+	}
+
+	void InstallSigbusHandler()
+	{
+		struct sigaction action = {};
+		action.sa_sigaction = OnSigbus;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGBUS, &action, &g_previousSigbusAction);
+	}
+#endif
+
+	// Copies from the mapping, which faults if the page cannot be read.
+	// Return value:
+	//   false if reading the mapped file failed.
+	bool CopyFromMapping(uint8_t* destination, const uint8_t* source, size_t size)
+	{
+#ifdef _WIN32
+		__try
+		{
+			memcpy(destination, source, size);
+		}
+		__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+		{
+			return false;
+		}
+
+		return true;
+#else
+		sigjmp_buf jump;
+		if (sigsetjmp(jump, 1) != 0)
+		{
+			t_copyJump = nullptr;
+			return false;
+		}
+
+		t_copyJump = &jump;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		memcpy(destination, source, size);
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		t_copyJump = nullptr;
+
+		return true;
+#endif
+	}
+}
+
+MappedFileBackend* MappedFileBackend::Open(const char* path)
+{
+#ifdef _WIN32
+	int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+	if (length <= 0)
+	{
+		return nullptr;
+	}
+
+	std::wstring widePath(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], length);
+
+	HANDLE file = CreateFile2(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+	FILETIME writeTime = {};
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && GetFileTime(file, nullptr, nullptr, &writeTime) && fileSize.QuadPart > 0 && static_cast<uint64_t>(fileSize.QuadPart) <= SIZE_MAX)
+	{
+		mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+	}
+
+	// The mapping keeps the file open.
+	CloseHandle(file);
+
+	if (!mapping)
+	{
+		return nullptr;
+	}
+
+	void* data = MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0);
+	if (!data)
+	{
+		CloseHandle(mapping);
+		return nullptr;
+	}
+
+	int64_t modifiedTime = (static_cast<int64_t>(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime;
+
+	return new MappedFileBackend(static_cast<const uint8_t*>(data), fileSize.QuadPart, modifiedTime, mapping);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return nullptr;
+	}
+
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size > 0 && static_cast<uint64_t>(status.st_size) <= SIZE_MAX)
+	{
+		data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+
+	// The mapping keeps the file open.
+	close(file);
+
+	if (data == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	std::call_once(g_sigbusHandlerInstalled, InstallSigbusHandler);
+
+	return new MappedFileBackend(static_cast<const uint8_t*>(data), status.st_size, static_cast<int64_t>(status.st_mtime), nullptr);
+#endif
+}
+
+MappedFileBackend::MappedFileBackend(const uint8_t* data, int64_t size, int64_t modifiedTime, void* mapping)
+	: m_data(data)
+	, m_size(size)
+	, m_modifiedTime(modifiedTime)
+	, m_position(0)
+	, m_prefetchEnd(0)
+	, m_backward(false)
+	, m_lastSeekBackward(false)
+	, m_seekPosition(0)
+	, m_mapping(mapping)
+{
+	SetBackward(false);
+	Prefetch(0, PrefetchWindow);
+}
+
+MappedFileBackend::~MappedFileBackend()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+#else
+	munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+#endif
+}
+
+int MappedFileBackend::Read(uint8_t* buffer, int size)
+{
+	if (m_position >= m_size)
+	{
+		return 0;
+	}
+
+	int64_t bytesToCopy = m_size - m_position;
+	if (bytesToCopy > size)
+	{
+		bytesToCopy = size;
+	}
+
+	if (m_backward && m_position - m_seekPosition > static_cast<int64_t>(PrefetchWindow))
+	{
+		// Read on for a whole window, playing forward again.
+		SetBackward(false);
+	}
+
+	// Keep one window ahead of sequential reads. Reverse playback reads
+	// short runs from the window around the last seek.
+	if (!m_backward && m_position + bytesToCopy + static_cast<int64_t>(PrefetchWindow) / 2 > m_prefetchEnd)
+	{
+		Prefetch(m_prefetchEnd, PrefetchWindow);
+	}
+
+	if (!CopyFromMapping(buffer, m_data + m_position, static_cast<size_t>(bytesToCopy)))
+	{
+		return AVERROR(EIO);
+	}
+
+	m_position += bytesToCopy;
+
+	return static_cast<int>(bytesToCopy);
+}
+
+int64_t MappedFileBackend::Seek(int64_t position)
+{
+	if (position < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// Two backward seeks in a row look like reverse playback, a forward seek
+	// ends it.
+	bool backward = position < m_position;
+	if (backward != m_backward && (!backward || m_lastSeekBackward))
+	{
+		SetBackward(backward);
+	}
+	m_lastSeekBackward = backward;
+
+	if (m_backward)
+	{
+		// The next seek goes further back, the reads until then continue
+		// from the target.
+		int64_t start = position > static_cast<int64_t>(PrefetchWindow) ? position - PrefetchWindow : 0;
+		Prefetch(start, static_cast<size_t>(position - start) + PrefetchWindow / 2);
+	}
+	else if (position < m_prefetchEnd - static_cast<int64_t>(PrefetchWindow) || position > m_prefetchEnd)
+	{
+		// Jumped out of the prefetched range, start over at the target.
+		Prefetch(position, PrefetchWindow);
+	}
+
+	m_position = position;
+	m_seekPosition = position;
+
+	return position;
+}
+
+int64_t MappedFileBackend::GetSize()
+{
+	return m_size;
+}
+
+int64_t MappedFileBackend::GetModifiedTime()
+{
+	return m_modifiedTime;
+}
+
+void MappedFileBackend::Prefetch(int64_t position, size_t size)
+{
+	if (position >= m_size)
+	{
+		return;
+	}
+
+	if (static_cast<int64_t>(size) > m_size - position)
+	{
+		size = static_cast<size_t>(m_size - position);
+	}
+
+	m_prefetchEnd = position + size;
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t*>(m_data + position);
+	range.NumberOfBytes = size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants a page aligned address.
+	size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t alignment = static_cast<size_t>(position) % pageSize;
+	madvise(const_cast<uint8_t*>(m_data + position - alignment), size + alignment, MADV_WILLNEED);
+#endif
+}
+
+void MappedFileBackend::SetBackward(bool backward)
+{
+	m_backward = backward;
+
+#ifndef _WIN32
+	// The kernel read-ahead only goes forward, reading backwards it would
+	// page in data which is thrown away before it is used.
+	madvise(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size), backward ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The memory-mapped local file backend for the custom AVIO layer.
+* File Name: MappedFileBackend.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include "StreamBackend.h"
+
+namespace FFmpegInterop
+{
+	// Maps a whole local file into memory. Reading is a memcpy from the
+	// mapping and the size is known up front. The pages ahead of the read
+	// position are requested from the OS in windows of PrefetchWindow bytes,
+	// following sequential reads and jumping along with seeks.
+	//
+	// Repeated backward seeks, as in reverse playback, switch the prefetch to
+	// the window before the seek target and turn off the kernel read-ahead,
+	// until a forward seek or a window of forward reads switches it back.
+	//
+	// An I/O error while paging in the file (a removed drive, a truncated
+	// file) makes Read fail with AVERROR(EIO) instead of crashing. On POSIX
+	// this installs a SIGBUS handler, which passes on signals it did not
+	// cause to the handler installed before.
+	class MappedFileBackend : public StreamBackend
+	{
+	public:
+		// Maps the file with the given UTF-8 path.
+		// Return value:
+		//   The backend, or nullptr if the file could not be mapped, e.g.
+		//   because it does not fit into the address space.
+		static MappedFileBackend* Open(const char* path);
+
+		virtual ~MappedFileBackend();
+
+		virtual int Read(uint8_t* buffer, int size) override;
+		virtual int64_t Seek(int64_t position) override;
+		virtual int64_t GetSize() override;
+		virtual int64_t GetModifiedTime() override;
+
+	private:
+		static const size_t PrefetchWindow = 4 * 1024 * 1024;
+
+		MappedFileBackend(const uint8_t* data, int64_t size, int64_t modifiedTime, void* mapping);
+
+		// Asks the OS to page in the given range of the file.
+		void Prefetch(int64_t position, size_t size);
+
+		// Switches the read-ahead between forward and reverse playback.
+		void SetBackward(bool backward);
+
+		const uint8_t* m_data;
+		int64_t m_size;
+		int64_t m_modifiedTime;
+		int64_t m_position;
+
+		// The end of the range which was prefetched last.
+		int64_t m_prefetchEnd;
+
+		// Whether the seeks step backwards through the file, and whether the
+		// last seek went backwards.
+		bool m_backward;
+		bool m_lastSeekBackward;
+
+		// The target of the last seek.
+		int64_t m_seekPosition;
+
+		// The file mapping handle on Windows, unused elsewhere.
+		void* m_mapping;
+	};
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The identity of a media file, used as the key of on-disk caches.
+* File Name: MediaFileIdentity.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <vector>
+
+#include "MediaFileIdentity.h"
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+	const uint64_t FnvPrime = 1099511628211ULL;
+
+	// 64 bit FNV-1a
+	uint64_t Hash(uint64_t hash, const uint8_t* data, size_t size)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= FnvPrime;
+		}
+
+		return hash;
+	}
+
+	uint64_t Hash(uint64_t hash, int64_t value)
+	{
+		uint8_t bytes[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8));
+		}
+
+		return Hash(hash, bytes, sizeof(bytes));
+	}
+
+	// Reads until the buffer is full or the stream ends.
+	int ReadFully(StreamBackend* backend, uint8_t* buffer, int size)
+	{
+		int total = 0;
+		while (total < size)
+		{
+			int ret = backend->Read(buffer + total, size - total);
+			if (ret < 0)
+			{
+				return ret;
+			}
+			if (ret == 0)
+			{
+				break;
+			}
+			total += ret;
+		}
+
+		return total;
+	}
+}
+
+int MediaFileIdentity::Compute(StreamBackend* backend)
+{
+	int64_t streamSize = backend->GetSize();
+	if (streamSize <= 0)
+	{
+		size = 0;
+		return streamSize < 0 ? static_cast<int>(streamSize) : AVERROR(EINVAL);
+	}
+
+	size = streamSize;
+	modifiedTime = backend->GetModifiedTime();
+	hash = FnvOffsetBasis;
+
+	std::vector<uint8_t> buffer(HashedBytes);
+	int64_t tailOffset = size > HashedBytes ? size - HashedBytes : 0;
+
+	int ret = static_cast<int>(backend->Seek(0));
+	if (ret >= 0)
+	{
+		ret = ReadFully(backend, buffer.data(), HashedBytes);
+	}
+	if (ret >= 0)
+	{
+		hash = Hash(hash, buffer.data(), ret);
+
+		if (tailOffset > ret)
+		{
+			ret = backend->Seek(tailOffset) < 0 ? AVERROR(EIO) : ReadFully(backend, buffer.data(), HashedBytes);
+			if (ret >= 0)
+			{
+				hash = Hash(hash, buffer.data(), ret);
+			}
+		}
+	}
+
+	if (backend->Seek(0) < 0 && ret >= 0)
+	{
+		ret = AVERROR(EIO);
+	}
+
+	if (ret < 0)
+	{
+		size = 0;
+		return ret;
+	}
+
+	return 0;
+}
+
+std::string MediaFileIdentity::GetKey() const
+{
+	uint64_t key = Hash(Hash(Hash(FnvOffsetBasis, size), modifiedTime), static_cast<int64_t>(hash));
+
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(key));
+
+	return text;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The identity of a media file, used as the key of on-disk caches.
+* File Name: MediaFileIdentity.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+
+#include "StreamBackend.h"
+
+namespace FFmpegInterop
+{
+	// Identifies the content of a media file without reading all of it: the
+	// size, the modification time if the backend knows it, and a hash of the
+	// first and the last HashedBytes bytes.
+	struct MediaFileIdentity
+	{
+		static const int HashedBytes = 64 * 1024;
+
+		int64_t size;
+		int64_t modifiedTime;
+		uint64_t hash;
+
+		MediaFileIdentity()
+			: size(0)
+			, modifiedTime(0)
+			, hash(0)
+		{
+		}
+
+		// Reads the head and the tail of the backend and leaves the position
+		// at the start.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int Compute(StreamBackend* backend);
+
+		bool IsValid() const { return size > 0; }
+
+		// Returns a file name friendly key which changes with every field.
+		std::string GetKey() const;
+
+		bool operator==(const MediaFileIdentity& other) const
+		{
+			return size == other.size && modifiedTime == other.modifiedTime && hash == other.hash;
+		}
+
+		bool operator!=(const MediaFileIdentity& other) const
+		{
+			return !(*this == other);
+		}
+	};
+}
@@ -35,6 +35,9 @@ MediaSampleProvider::MediaSampleProvider(
 	, m_pAvStream(m_pAvFormatCtx->streams[m_streamIndex])
 	, m_config(config)
 	, m_streamIndex(streamIndex)
+	, m_stopDecodeAhead(false)
+	, m_decodeAheadEnded(false)
+	, m_decodeAheadUnderruns(0)
 {
 	DebugMessage(L"MediaSampleProvider\n");
 
@@ -95,6 +98,8 @@ MediaSampleProvider::~MediaSampleProvider()
 {
 	DebugMessage(L"~MediaSampleProvider\n");
 
+	StopDecodeAhead();
+
 	avcodec_close(m_pAvCodecCtx);
 	avcodec_free_context(&m_pAvCodecCtx);
 }
@@ -108,31 +113,26 @@ MediaStreamSample^ MediaSampleProvider::GetNextSample()
 	MediaStreamSample^ sample;
 	if (m_isEnabled)
 	{
-		IBuffer^ buffer = nullptr;
-		LONGLONG pts = 0;
-		LONGLONG dur = 0;
-
-		hr = CreateNextSampleBuffer(&buffer, pts, dur);
+		if (m_config->DecodeAheadSamples > 0 && CanDecodeAhead())
+		{
+			StartDecodeAhead();
+			hr = DequeueSample(&sample);
+		}
+		else
+		{
+			hr = DecodeNextSample(&sample);
+		}
 
 		if (hr == S_OK)
 		{
-			pts = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * pts) - m_startOffset;
-			dur = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * dur);
-
-			sample = MediaStreamSample::CreateFromBuffer(buffer, { pts });
-			sample->Duration = { dur };
-			sample->Discontinuous = m_isDiscontinuous;
-
-			hr = SetSampleProperties(sample);
-
-			m_isDiscontinuous = false;
+			OnDeliverSample(sample);
 		}
 		else if (hr == S_FALSE)
 		{
 			DebugMessage(L"End of stream reached.\n");
 			DisableStream();
 		}
-		else
+		else if (FAILED(hr))
 		{
 			DebugMessage(L"Error reading next packet.\n");
 			DisableStream();
@@ -142,24 +142,131 @@ MediaStreamSample^ MediaSampleProvider::GetNextSample()
 	return sample;
 }
 
-HRESULT MediaSampleProvider::GetNextPacket(AVPacket** avPacket, LONGLONG & packetPts, LONGLONG & packetDuration)
+HRESULT MediaSampleProvider::DecodeNextSample(MediaStreamSample^* pSample)
 {
-	HRESULT hr = S_OK;
+	IBuffer^ buffer = nullptr;
+	LONGLONG pts = 0;
+	LONGLONG dur = 0;
+
+	HRESULT hr = CreateNextSampleBuffer(&buffer, pts, dur);
 
-	// Continue reading until there is an appropriate packet in the stream
-	while (m_packetQueue.empty())
+	if (hr == S_OK)
+	{
+		pts = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * pts) - m_startOffset;
+		dur = LONGLONG(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * dur);
+
+		auto sample = MediaStreamSample::CreateFromBuffer(buffer, { pts });
+		sample->Duration = { dur };
+		sample->Discontinuous = m_isDiscontinuous;
+
+		// The sample is delivered even if some extended properties could not be set
+		SetSampleProperties(sample);
+
+		m_isDiscontinuous = false;
+		*pSample = sample;
+	}
+
+	return hr;
+}
+
+HRESULT MediaSampleProvider::DequeueSample(MediaStreamSample^* pSample)
+{
+	std::unique_lock<std::mutex> lock(m_decodeAheadMutex);
+
+	if (m_readySamples.empty())
+	{
+		// The worker did not keep up, this sample arrives as late as without it
+		++m_decodeAheadUnderruns;
+		m_sampleReady.wait(lock, [this] { return !m_readySamples.empty(); });
+	}
+
+	ReadySample ready = m_readySamples.front();
+	m_readySamples.pop_front();
+	lock.unlock();
+
+	m_sampleConsumed.notify_one();
+
+	*pSample = ready.sample;
+	return ready.hr;
+}
+
+void MediaSampleProvider::StartDecodeAhead()
+{
+	if (!m_decodeAheadThread.joinable())
+	{
+		m_stopDecodeAhead = false;
+		m_decodeAheadEnded = false;
+		m_decodeAheadThread = std::thread(&MediaSampleProvider::DecodeAheadLoop, this);
+	}
+}
+
+void MediaSampleProvider::StopDecodeAhead()
+{
+	if (m_decodeAheadThread.joinable())
 	{
-		if (m_pReader->ReadPacket() < 0)
 		{
-			DebugMessage(L"GetNextSample reaching EOF\n");
+			std::lock_guard<std::mutex> lock(m_decodeAheadMutex);
+			m_stopDecodeAhead = true;
+		}
+		m_sampleConsumed.notify_one();
+
+		// Waits until the sample which is being decoded is done
+		m_decodeAheadThread.join();
+	}
+
+	m_readySamples.clear();
+}
+
+void MediaSampleProvider::DecodeAheadLoop()
+{
+	std::unique_lock<std::mutex> lock(m_decodeAheadMutex);
+
+	while (true)
+	{
+		m_sampleConsumed.wait(lock, [this]
+		{
+			return m_stopDecodeAhead || (!m_decodeAheadEnded && m_readySamples.size() < m_config->DecodeAheadSamples);
+		});
+
+		if (m_stopDecodeAhead)
+		{
+			break;
+		}
+
+		// The worker is the only user of the decoder until it is stopped
+		lock.unlock();
+		MediaStreamSample^ sample;
+		HRESULT hr = DecodeNextSample(&sample);
+		lock.lock();
+
+		if (m_stopDecodeAhead)
+		{
+			// The sample belongs to the position before the seek
 			break;
 		}
+
+		ReadySample ready = { sample, hr };
+		m_readySamples.push_back(ready);
+		m_decodeAheadEnded = hr != S_OK;
+
+		m_sampleReady.notify_one();
 	}
+}
 
-	if (!m_packetQueue.empty())
+HRESULT MediaSampleProvider::GetNextPacket(AVPacket** avPacket, LONGLONG & packetPts, LONGLONG & packetDuration)
+{
+	HRESULT hr = S_OK;
+
+	// Wait for the demuxer thread to deliver a packet of this stream
+	AVPacket* packet = nullptr;
+	if (m_pReader->ReadPacket(m_streamIndex, &packet) < 0)
+	{
+		DebugMessage(L"GetNextSample reaching EOF\n");
+	}
+
+	if (packet)
 	{
 		// read next packet and set pts values
-		auto packet = PopPacket();
 		*avPacket = packet;
 
 		packetDuration = packet->duration;
@@ -184,56 +291,57 @@ HRESULT MediaSampleProvider::GetNextPacket(AVPacket** avPacket, LONGLONG & packe
 	return hr;
 }
 
-
-void MediaSampleProvider::QueuePacket(AVPacket *packet)
-{
-	DebugMessage(L" - QueuePacket\n");
-
-	if (m_isEnabled)
-	{
-		m_packetQueue.push(packet);
-	}
-	else
-	{
-		av_packet_free(&packet);
-	}
-}
-
 AVPacket* MediaSampleProvider::PopPacket()
 {
 	DebugMessage(L" - PopPacket\n");
-	AVPacket* result = NULL;
 
-	if (!m_packetQueue.empty())
-	{
-		result = m_packetQueue.front();
-		m_packetQueue.pop();
-	}
-
-	return result;
+	return m_pReader->PopPacket(m_streamIndex);
 }
 
 void MediaSampleProvider::Flush()
 {
 	DebugMessage(L"Flush\n");
-	while (!m_packetQueue.empty())
-	{
-		AVPacket *avPacket = PopPacket();
-		av_packet_free(&avPacket);
-	}
+	StopDecodeAhead();
+	m_pReader->FlushStream(m_streamIndex);
 	avcodec_flush_buffers(m_pAvCodecCtx);
 	m_isDiscontinuous = true;
 }
 
+uint64 MediaSampleProvider::QueuedPackets::get()
+{
+	return m_pReader->GetQueueStatistics(m_streamIndex).packets;
+}
+
+uint64 MediaSampleProvider::QueuedBytes::get()
+{
+	return m_pReader->GetQueueStatistics(m_streamIndex).bytes;
+}
+
+uint64 MediaSampleProvider::QueueHighWaterPackets::get()
+{
+	return m_pReader->GetQueueStatistics(m_streamIndex).maxPackets;
+}
+
+uint64 MediaSampleProvider::QueueHighWaterBytes::get()
+{
+	return m_pReader->GetQueueStatistics(m_streamIndex).maxBytes;
+}
+
 void MediaSampleProvider::EnableStream()
 {
 	DebugMessage(L"EnableStream\n");
 	m_isEnabled = true;
+	m_pReader->EnableStream(m_streamIndex);
 }
 
 void MediaSampleProvider::DisableStream()
 {
 	DebugMessage(L"DisableStream\n");
+	// The worker must be gone before the queue is cleared, it is the
+	// stream's only consumer. A worker waiting for a packet is woken by the
+	// demuxer, which keeps reading while a consumer waits.
+	StopDecodeAhead();
+	m_pReader->DisableStream(m_streamIndex);
 	Flush();
 	m_isEnabled = false;
 }
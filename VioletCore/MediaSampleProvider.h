@@ -17,7 +17,12 @@
 //*****************************************************************************
 
 #pragma once
-#include <queue>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "CritSec.h"
 #include "FFmpegInteropConfig.h"
 
 extern "C"
@@ -55,6 +60,29 @@ namespace FFmpegInterop
 			bool get() { return m_isEnabled; }
 		}
 
+		// Fill level of the packet queue of this stream, and the highest fill
+		// level seen so far
+		property uint64 QueuedPackets { uint64 get(); }
+		property uint64 QueuedBytes { uint64 get(); }
+		property uint64 QueueHighWaterPackets { uint64 get(); }
+		property uint64 QueueHighWaterBytes { uint64 get(); }
+
+		// Time sample requests waited for the lock of this stream, and held it
+		property TimeSpan SampleLockWaitTime
+		{
+			TimeSpan get() { return { m_sampleLockStatistics.waitTime.load() }; }
+		}
+		property TimeSpan SampleLockHoldTime
+		{
+			TimeSpan get() { return { m_sampleLockStatistics.holdTime.load() }; }
+		}
+
+		// Number of samples which had to wait for the decode-ahead worker
+		property uint64 DecodeAheadUnderruns
+		{
+			uint64 get() { return m_decodeAheadUnderruns.load(); }
+		}
+
 		property Platform::String^ Name;
 		property Platform::String^ Language;
 		property Platform::String^ CodecName;
@@ -62,14 +90,23 @@ namespace FFmpegInterop
 	internal:
 		virtual HRESULT Initialize();
 		virtual HRESULT AllocateResources();
-		void QueuePacket(AVPacket *packet);
 		AVPacket* PopPacket();
 		HRESULT GetNextPacket(AVPacket** avPacket, LONGLONG & packetPts, LONGLONG & packetDuration);
 		virtual HRESULT CreateNextSampleBuffer(IBuffer^* pBuffer, int64_t& samplePts, int64_t& sampleDuration) = 0;
 		virtual IMediaStreamDescriptor^ CreateStreamDescriptor() = 0;
 		virtual HRESULT SetSampleProperties(MediaStreamSample^ sample) { return S_OK; }; // can be overridded for setting extended properties
+		// Called on the requesting thread right before the sample is handed out,
+		// which is later than SetSampleProperties with decode-ahead
+		virtual void OnDeliverSample(MediaStreamSample^ sample) { }
 		void EnableStream();
 		void DisableStream();
+		// Whether samples can be created ahead of time, i.e. they do not share
+		// any buffer with later samples
+		virtual bool CanDecodeAhead() { return false; }
+		// Stops the decode-ahead worker and drops the samples it decoded. It is
+		// started again by the next GetNextSample. Call before seeking, so that
+		// the worker does not consume the packets of the new position.
+		void StopDecodeAhead();
 		virtual void SetCommonVideoEncodingProperties(VideoEncodingProperties^ videoEncodingProperties);
 
 	protected private:
@@ -81,11 +118,39 @@ namespace FFmpegInterop
 			int streamIndex);
 
 	private:
-		std::queue<AVPacket*> m_packetQueue;
+		struct ReadySample
+		{
+			MediaStreamSample^ sample;
+			HRESULT hr;
+		};
+
+		HRESULT DecodeNextSample(MediaStreamSample^* pSample);
+		HRESULT DequeueSample(MediaStreamSample^* pSample);
+		void StartDecodeAhead();
+		void DecodeAheadLoop();
+
 		int64 m_nextPacketPts;
 		IMediaStreamDescriptor^ m_streamDescriptor;
 
+		// The decode-ahead worker keeps up to DecodeAheadSamples samples ready.
+		// Once it produced the end of the stream or an error, it waits until
+		// it is stopped.
+		std::thread m_decodeAheadThread;
+		std::mutex m_decodeAheadMutex;
+		std::condition_variable m_sampleConsumed;
+		std::condition_variable m_sampleReady;
+		std::deque<ReadySample> m_readySamples;
+		bool m_stopDecodeAhead;
+		bool m_decodeAheadEnded;
+		// Counted by the requesting thread, read from any thread
+		std::atomic<uint64> m_decodeAheadUnderruns;
+
 	internal:
+		// Held while a sample is decoded, and while the stream is seeked,
+		// switched or destroyed. Requests for other streams do not wait for it.
+		CritSec m_sampleLock;
+		LockStatistics m_sampleLockStatistics;
+
 		// The FFmpeg context. Because they are complex types
 		// we declare them as internal so they don't get exposed
 		// externally
@@ -0,0 +1,53 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of AVPacket structures.
+* File Name: PacketPool.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "PacketPool.h"
+
+using namespace FFmpegInterop;
+
+PacketPool::PacketPool()
+	: m_hits(0)
+	, m_misses(0)
+{
+}
+
+PacketPool::~PacketPool()
+{
+	for (auto avPacket : m_freePackets)
+	{
+		av_packet_free(&avPacket);
+	}
+}
+
+AVPacket* PacketPool::Acquire()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_freePackets.empty())
+		{
+			AVPacket* result = m_freePackets.back();
+			m_freePackets.pop_back();
+			++m_hits;
+			return result;
+		}
+	}
+
+	++m_misses;
+	return av_packet_alloc();
+}
+
+void PacketPool::Release(AVPacket* avPacket)
+{
+	if (avPacket)
+	{
+		// Drop the payload outside of the lock.
+		av_packet_unref(avPacket);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freePackets.push_back(avPacket);
+	}
+}
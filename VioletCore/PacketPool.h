@@ -0,0 +1,49 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The recycling pool of AVPacket structures.
+* File Name: PacketPool.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// Recycles AVPacket structures so that steady-state demuxing does not 
+	// allocate and free one per packet. Packets are handed out unreferenced
+	// and taken back from any thread.
+	class PacketPool
+	{
+	public:
+		PacketPool();
+		~PacketPool();
+
+		PacketPool(const PacketPool&) = delete;
+		PacketPool& operator=(const PacketPool&) = delete;
+
+		// Returns an empty packet, or nullptr if out of memory.
+		AVPacket* Acquire();
+
+		// Unreferences the packet and keeps it for reuse. nullptr is ignored.
+		void Release(AVPacket* avPacket);
+
+		// The number of Acquire calls served from the pool.
+		uint64_t GetHitCount() const { return m_hits; }
+
+		// The number of Acquire calls which had to allocate a packet.
+		uint64_t GetMissCount() const { return m_misses; }
+
+	private:
+		std::mutex m_mutex;
+		std::vector<AVPacket*> m_freePackets;
+
+		std::atomic<uint64_t> m_hits;
+		std::atomic<uint64_t> m_misses;
+	};
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The FIFO of demuxed packets which belong to one stream.
+* File Name: PacketQueue.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "PacketQueue.h"
+
+using namespace FFmpegInterop;
+
+PacketQueue::PacketQueue(size_t capacity, PacketPool& pool)
+	: m_head(0)
+	, m_poppedBytes(0)
+	, m_cachedTail(0)
+	, m_tail(0)
+	, m_pushedBytes(0)
+	, m_cachedHead(0)
+	, m_pool(pool)
+{
+	size_t size = 2;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	m_mask = size - 1;
+	m_slots = new AVPacket*[size];
+}
+
+PacketQueue::~PacketQueue()
+{
+	Clear();
+	delete[] m_slots;
+}
+
+bool PacketQueue::Push(AVPacket* avPacket)
+{
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+
+	if (tail - m_cachedHead > m_mask)
+	{
+		// Looks full, refresh our copy of the consumer position.
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		if (tail - m_cachedHead > m_mask)
+		{
+			return false;
+		}
+	}
+
+	m_slots[tail & m_mask] = avPacket;
+	m_pushedBytes.store(m_pushedBytes.load(std::memory_order_relaxed) + avPacket->size, std::memory_order_release);
+	m_tail.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+AVPacket* PacketQueue::Pop()
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+
+	if (head == m_cachedTail)
+	{
+		// Looks empty, refresh our copy of the producer position.
+		m_cachedTail = m_tail.load(std::memory_order_acquire);
+		if (head == m_cachedTail)
+		{
+			return nullptr;
+		}
+	}
+
+	AVPacket* result = m_slots[head & m_mask];
+	m_poppedBytes.store(m_poppedBytes.load(std::memory_order_relaxed) + result->size, std::memory_order_release);
+	m_head.store(head + 1, std::memory_order_release);
+
+	return result;
+}
+
+void PacketQueue::Clear()
+{
+	AVPacket* avPacket;
+	while ((avPacket = Pop()) != nullptr)
+	{
+		m_pool.Release(avPacket);
+	}
+}
+
+bool PacketQueue::IsEmpty() const
+{
+	return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+}
+
+size_t PacketQueue::GetCount() const
+{
+	// Load the head first, the tail never falls behind it.
+	size_t head = m_head.load(std::memory_order_acquire);
+	size_t tail = m_tail.load(std::memory_order_acquire);
+	return tail - head;
+}
+
+size_t PacketQueue::GetBytes() const
+{
+	// Load the popped bytes first, the pushed bytes never fall behind them.
+	size_t popped = m_poppedBytes.load(std::memory_order_acquire);
+	size_t pushed = m_pushedBytes.load(std::memory_order_acquire);
+	return pushed - popped;
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The FIFO of demuxed packets which belong to one stream.
+* File Name: PacketQueue.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+
+#include "FFmpegIncludes.h"
+#include "PacketPool.h"
+
+namespace FFmpegInterop
+{
+	// A bounded lock-free single-producer/single-consumer ring of demuxed
+	// packets. Push must only be called by the producer (the demuxer thread),
+	// Pop and Clear only by the consumer. The capacity is rounded up to a
+	// power of two.
+	//
+	// The queue owns the packets it contains and returns them to the pool when
+	// it is cleared or destroyed.
+	class PacketQueue
+	{
+	public:
+		PacketQueue(size_t capacity, PacketPool& pool);
+		~PacketQueue();
+
+		PacketQueue(const PacketQueue&) = delete;
+		PacketQueue& operator=(const PacketQueue&) = delete;
+
+		// Appends a packet and takes the ownership of it.
+		// Return value:
+		//   false if the queue is full, the caller keeps the ownership then.
+		bool Push(AVPacket* avPacket);
+
+		// Removes the oldest packet and returns it, or nullptr if the queue is
+		// empty. The caller takes the ownership of the returned packet.
+		AVPacket* Pop();
+
+		// Returns all packets in the queue to the pool.
+		void Clear();
+
+		bool IsEmpty() const;
+		size_t GetCount() const;
+
+		// The payload size of all packets in the queue.
+		size_t GetBytes() const;
+		size_t GetCapacity() const { return m_mask + 1; }
+
+	private:
+		static const size_t CacheLineSize = 64;
+
+		char m_padding0[CacheLineSize];
+
+		// Written by the consumer only.
+		std::atomic<size_t> m_head;
+		std::atomic<size_t> m_poppedBytes;
+		size_t m_cachedTail;
+		char m_padding1[CacheLineSize];
+
+		// Written by the producer only.
+		std::atomic<size_t> m_tail;
+		std::atomic<size_t> m_pushedBytes;
+		size_t m_cachedHead;
+		char m_padding2[CacheLineSize];
+
+		size_t m_mask;
+		AVPacket** m_slots;
+		PacketPool& m_pool;
+	};
+}
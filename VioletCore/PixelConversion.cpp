@@ -0,0 +1,312 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The pixel format conversions which bypass swscale.
+* File Name: PixelConversion.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+
+#include "PixelConversion.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXEL_CONVERSION_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC accepts the intrinsics of any instruction set, GCC and Clang need the
+// target on the function.
+#if defined(PIXEL_CONVERSION_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	typedef void (*InterleaveFunction)(const uint8_t* u, const uint8_t* v, uint8_t* uv, int count);
+
+	void InterleaveScalar(const uint8_t* u, const uint8_t* v, uint8_t* uv, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			uv[2 * i] = u[i];
+			uv[2 * i + 1] = v[i];
+		}
+	}
+
+#ifdef PIXEL_CONVERSION_X86
+	void InterleaveSse2(const uint8_t* u, const uint8_t* v, uint8_t* uv, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i u16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + i));
+			__m128i v16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i), _mm_unpacklo_epi8(u16, v16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i + 16), _mm_unpackhi_epi8(u16, v16));
+		}
+
+		InterleaveScalar(u + i, v + i, uv + 2 * i, count - i);
+	}
+
+	TARGET_AVX2 void InterleaveAvx2(const uint8_t* u, const uint8_t* v, uint8_t* uv, int count)
+	{
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i u32 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + i));
+			__m256i v32 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+
+			// The unpacks work within the 128 bit lanes, put the lanes back in order
+			__m256i low = _mm256_unpacklo_epi8(u32, v32);
+			__m256i high = _mm256_unpackhi_epi8(u32, v32);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * i), _mm256_permute2x128_si256(low, high, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * i + 32), _mm256_permute2x128_si256(low, high, 0x31));
+		}
+
+		InterleaveSse2(u + i, v + i, uv + 2 * i, count - i);
+	}
+#endif
+
+	// P010 keeps the 10 bit samples in the high bits of 16 bit words
+	const int P010Shift = 6;
+
+	typedef void (*ShiftFunction)(const uint16_t* src, uint16_t* dst, int count);
+	typedef void (*InterleaveShiftFunction)(const uint16_t* u, const uint16_t* v, uint16_t* uv, int count);
+
+	void ShiftScalar(const uint16_t* src, uint16_t* dst, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			dst[i] = static_cast<uint16_t>(src[i] << P010Shift);
+		}
+	}
+
+	void InterleaveShiftScalar(const uint16_t* u, const uint16_t* v, uint16_t* uv, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			uv[2 * i] = static_cast<uint16_t>(u[i] << P010Shift);
+			uv[2 * i + 1] = static_cast<uint16_t>(v[i] << P010Shift);
+		}
+	}
+
+#ifdef PIXEL_CONVERSION_X86
+	void ShiftSse2(const uint16_t* src, uint16_t* dst, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i s8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_slli_epi16(s8, P010Shift));
+		}
+
+		ShiftScalar(src + i, dst + i, count - i);
+	}
+
+	void InterleaveShiftSse2(const uint16_t* u, const uint16_t* v, uint16_t* uv, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i u8 = _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(u + i)), P010Shift);
+			__m128i v8 = _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)), P010Shift);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i), _mm_unpacklo_epi16(u8, v8));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i + 8), _mm_unpackhi_epi16(u8, v8));
+		}
+
+		InterleaveShiftScalar(u + i, v + i, uv + 2 * i, count - i);
+	}
+
+	TARGET_AVX2 void ShiftAvx2(const uint16_t* src, uint16_t* dst, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i s16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_slli_epi16(s16, P010Shift));
+		}
+
+		ShiftSse2(src + i, dst + i, count - i);
+	}
+
+	TARGET_AVX2 void InterleaveShiftAvx2(const uint16_t* u, const uint16_t* v, uint16_t* uv, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i u16 = _mm256_slli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + i)), P010Shift);
+			__m256i v16 = _mm256_slli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)), P010Shift);
+
+			// The unpacks work within the 128 bit lanes, put the lanes back in order
+			__m256i low = _mm256_unpacklo_epi16(u16, v16);
+			__m256i high = _mm256_unpackhi_epi16(u16, v16);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * i), _mm256_permute2x128_si256(low, high, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * i + 16), _mm256_permute2x128_si256(low, high, 0x31));
+		}
+
+		InterleaveShiftSse2(u + i, v + i, uv + 2 * i, count - i);
+	}
+#endif
+
+	struct P010Kernels
+	{
+		ShiftFunction shift;
+		InterleaveShiftFunction interleaveShift;
+	};
+
+	P010Kernels SelectP010Kernels()
+	{
+		P010Kernels kernels = { ShiftScalar, InterleaveShiftScalar };
+#ifdef PIXEL_CONVERSION_X86
+		int cpuFlags = av_get_cpu_flags();
+		if (cpuFlags & AV_CPU_FLAG_AVX2)
+		{
+			kernels.shift = ShiftAvx2;
+			kernels.interleaveShift = InterleaveShiftAvx2;
+		}
+		else if (cpuFlags & AV_CPU_FLAG_SSE2)
+		{
+			kernels.shift = ShiftSse2;
+			kernels.interleaveShift = InterleaveShiftSse2;
+		}
+#endif
+		return kernels;
+	}
+
+	InterleaveFunction SelectInterleave()
+	{
+#ifdef PIXEL_CONVERSION_X86
+		int cpuFlags = av_get_cpu_flags();
+		if (cpuFlags & AV_CPU_FLAG_AVX2)
+		{
+			return InterleaveAvx2;
+		}
+		if (cpuFlags & AV_CPU_FLAG_SSE2)
+		{
+			return InterleaveSse2;
+		}
+#endif
+		return InterleaveScalar;
+	}
+}
+
+void FFmpegInterop::ConvertYuv420pToNv12(
+	const uint8_t* const srcData[4],
+	const int srcLinesize[4],
+	uint8_t* const dstData[4],
+	const int dstLinesize[4],
+	int width,
+	int sliceY,
+	int sliceHeight)
+{
+	// Thread safe initialization, every thread would pick the same function anyway
+	static const InterleaveFunction interleave = SelectInterleave();
+
+	for (int y = sliceY; y < sliceY + sliceHeight; ++y)
+	{
+		memcpy(dstData[0] + y * dstLinesize[0], srcData[0] + y * srcLinesize[0], width);
+	}
+
+	int chromaWidth = (width + 1) / 2;
+	int chromaEnd = (sliceY + sliceHeight + 1) / 2;
+	for (int y = sliceY / 2; y < chromaEnd; ++y)
+	{
+		interleave(
+			srcData[1] + y * srcLinesize[1],
+			srcData[2] + y * srcLinesize[2],
+			dstData[1] + y * dstLinesize[1],
+			chromaWidth);
+	}
+}
+
+PixelConversionFunction FFmpegInterop::GetPixelConversion(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+{
+	if ((srcFormat == AV_PIX_FMT_YUV420P || srcFormat == AV_PIX_FMT_YUVJ420P) && dstFormat == AV_PIX_FMT_NV12)
+	{
+		return ConvertYuv420pToNv12;
+	}
+
+	if (srcFormat == AV_PIX_FMT_YUV420P10LE && dstFormat == AV_PIX_FMT_P010LE)
+	{
+		return ConvertYuv420p10ToP010;
+	}
+
+	return nullptr;
+}
+
+void FFmpegInterop::ConvertYuv420p10ToP010(
+	const uint8_t* const srcData[4],
+	const int srcLinesize[4],
+	uint8_t* const dstData[4],
+	const int dstLinesize[4],
+	int width,
+	int sliceY,
+	int sliceHeight)
+{
+	static const P010Kernels kernels = SelectP010Kernels();
+
+	for (int y = sliceY; y < sliceY + sliceHeight; ++y)
+	{
+		kernels.shift(
+			reinterpret_cast<const uint16_t*>(srcData[0] + y * srcLinesize[0]),
+			reinterpret_cast<uint16_t*>(dstData[0] + y * dstLinesize[0]),
+			width);
+	}
+
+	int chromaWidth = (width + 1) / 2;
+	int chromaEnd = (sliceY + sliceHeight + 1) / 2;
+	for (int y = sliceY / 2; y < chromaEnd; ++y)
+	{
+		kernels.interleaveShift(
+			reinterpret_cast<const uint16_t*>(srcData[1] + y * srcLinesize[1]),
+			reinterpret_cast<const uint16_t*>(srcData[2] + y * srcLinesize[2]),
+			reinterpret_cast<uint16_t*>(dstData[1] + y * dstLinesize[1]),
+			chromaWidth);
+	}
+}
+
+bool FFmpegInterop::CanConvertInBands(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+{
+	auto source = av_pix_fmt_desc_get(srcFormat);
+	auto target = av_pix_fmt_desc_get(dstFormat);
+	return source != nullptr
+		&& target != nullptr
+		&& !(source->flags & AV_PIX_FMT_FLAG_HWACCEL)
+		&& source->log2_chroma_w == target->log2_chroma_w
+		&& source->log2_chroma_h == target->log2_chroma_h
+		&& source->comp[0].depth <= target->comp[0].depth;
+}
+
+int FFmpegInterop::GetPlaneSizes(AVPixelFormat format, int height, const int lineSize[4], int planeSize[4])
+{
+	auto descriptor = av_pix_fmt_desc_get(format);
+	if (descriptor == nullptr || height <= 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// Rounded up, the last chroma row covers the last luma row of an odd height
+	int chromaHeight = -((-height) >> descriptor->log2_chroma_h);
+
+	int size = 0;
+	for (int plane = 0; plane < 4; ++plane)
+	{
+		int rows = plane == 1 || plane == 2 ? chromaHeight : height;
+		planeSize[plane] = lineSize[plane] * rows;
+		size += planeSize[plane];
+	}
+
+	return size;
+}
+
+bool FFmpegInterop::IsHighBitDepthFormat(AVPixelFormat format)
+{
+	auto descriptor = av_pix_fmt_desc_get(format);
+	return descriptor != nullptr
+		&& !(descriptor->flags & AV_PIX_FMT_FLAG_HWACCEL)
+		&& descriptor->comp[0].depth > 8;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The pixel format conversions which bypass swscale.
+* File Name: PixelConversion.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// The signature of the conversions below.
+	typedef void (*PixelConversionFunction)(
+		const uint8_t* const srcData[4],
+		const int srcLinesize[4],
+		uint8_t* const dstData[4],
+		const int dstLinesize[4],
+		int width,
+		int sliceY,
+		int sliceHeight);
+
+	// Returns the conversion between the pixel formats, or nullptr if there
+	// is none and sws_scale has to be used.
+	PixelConversionFunction GetPixelConversion(AVPixelFormat srcFormat, AVPixelFormat dstFormat);
+
+	// Converts an 8 bit 4:2:0 planar picture (YUV420P or YUVJ420P) to NV12.
+	// The luma plane is copied, the chroma planes are interleaved. For
+	// YUV420P the result is bit exact with sws_scale at the same size.
+	//
+	// The values are never changed, so YUVJ420P stays full range and the
+	// output must be flagged as full range NV12. sws_scale compresses
+	// YUVJ420P to limited range unless both ranges are set to full with
+	// sws_setColorspaceDetails, only then the results are the same.
+	//
+	// The interleaving kernel is picked once with av_get_cpu_flags: AVX2,
+	// SSE2, or the scalar fallback.
+	//
+	// Only the luma rows from sliceY to sliceY + sliceHeight are converted,
+	// so that slices can be converted in parallel. sliceY must be even.
+	void ConvertYuv420pToNv12(
+		const uint8_t* const srcData[4],
+		const int srcLinesize[4],
+		uint8_t* const dstData[4],
+		const int dstLinesize[4],
+		int width,
+		int sliceY,
+		int sliceHeight);
+
+	// Converts a 10 bit 4:2:0 planar little endian picture (YUV420P10LE) to
+	// P010. The samples are moved to the high bits, and the chroma planes
+	// are interleaved. The result is bit exact with sws_scale at the same
+	// size, the kernels are picked like the ones of ConvertYuv420pToNv12.
+	//
+	// Only the luma rows from sliceY to sliceY + sliceHeight are converted.
+	// sliceY must be even.
+	void ConvertYuv420p10ToP010(
+		const uint8_t* const srcData[4],
+		const int srcLinesize[4],
+		uint8_t* const dstData[4],
+		const int dstLinesize[4],
+		int width,
+		int sliceY,
+		int sliceHeight);
+
+	// Whether sws_scale gives the same result when the picture is converted
+	// in horizontal bands, each like a picture of its own, as when it is
+	// converted at once. Only the luma rows are moved and the chroma rows
+	// are never filtered across: the subsampling is the same and the bit
+	// depth is not reduced, which swscale would dither by the row position.
+	// Chroma resampled vertically, like 4:2:2 or 4:4:4 to 4:2:0, gets seams
+	// at the band borders.
+	bool CanConvertInBands(AVPixelFormat srcFormat, AVPixelFormat dstFormat);
+
+	// Fills the sizes of the planes of a picture with the given line sizes and
+	// returns the size of the buffer which holds them one after another. The
+	// chroma planes of 4:2:0 pictures have (height + 1) / 2 rows, which the
+	// conversions and sws_scale write also for odd heights.
+	// Return value:
+	//   The buffer size, or a negative AVERROR code for an unknown format.
+	int GetPlaneSizes(AVPixelFormat format, int height, const int lineSize[4], int planeSize[4]);
+
+	// Whether the pixel format has more than 8 bits per component, so that
+	// its precision is kept by P010 but not by NV12.
+	bool IsHighBitDepthFormat(AVPixelFormat format);
+}
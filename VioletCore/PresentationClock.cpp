@@ -0,0 +1,135 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Estimates the playback position from the sample requests.
+* File Name: PresentationClock.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "FFmpegIncludes.h"
+#include "PresentationClock.h"
+
+using namespace FFmpegInterop;
+
+// A gap of this length, or of four frames if they are longer, is a pause
+static const int64_t MinPauseTime = 2500000;
+
+// Used while the samples do not carry a duration
+static const int64_t DefaultFrameDuration = 400000;
+
+PresentationClock::PresentationClock()
+	: m_pauses(0)
+{
+	Reset();
+}
+
+void PresentationClock::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_started = false;
+	m_anchorPosition = 0;
+	m_anchorTime = 0;
+	m_lastDelivery = 0;
+	m_lastRequest = 0;
+	m_frameDuration = 0;
+	m_rendererWaited = false;
+}
+
+void PresentationClock::OnRequest()
+{
+	OnRequest(Now());
+}
+
+void PresentationClock::OnRequest(int64_t now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_started)
+	{
+		return;
+	}
+
+	int64_t idle = now - m_lastDelivery;
+	int64_t frameDuration = GetFrameDuration();
+
+	int64_t pauseTime = 4 * frameDuration > MinPauseTime ? 4 * frameDuration : MinPauseTime;
+	if (idle > pauseTime)
+	{
+		// Playback stood still, apart from the frame the renderer showed meanwhile
+		m_anchorTime += idle - frameDuration;
+		m_pauses++;
+	}
+
+	// The renderer only waits when it has enough samples buffered
+	m_rendererWaited = idle > frameDuration / 2;
+	m_lastRequest = now;
+}
+
+void PresentationClock::OnDeliver(int64_t position, int64_t duration)
+{
+	OnDeliver(position, duration, Now());
+}
+
+void PresentationClock::OnDeliver(int64_t position, int64_t duration, int64_t now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_started)
+	{
+		m_started = true;
+		m_anchorPosition = position;
+		m_anchorTime = now;
+	}
+	else if (m_rendererWaited && GetPosition(m_lastRequest) > position)
+	{
+		// The estimate ran ahead, e.g. because playback started after the
+		// renderer buffered the first samples
+		m_anchorTime += GetPosition(m_lastRequest) - position;
+	}
+
+	m_lastDelivery = now;
+	m_rendererWaited = false;
+	if (duration > 0)
+	{
+		m_frameDuration = duration;
+	}
+}
+
+bool PresentationClock::GetLateness(int64_t position, int64_t& lateness)
+{
+	return GetLateness(position, Now(), lateness);
+}
+
+bool PresentationClock::GetLateness(int64_t position, int64_t now, int64_t& lateness)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_started)
+	{
+		return false;
+	}
+
+	lateness = GetPosition(now) - position;
+	return true;
+}
+
+uint64_t PresentationClock::GetPauses()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pauses;
+}
+
+int64_t PresentationClock::Now()
+{
+	return av_gettime_relative() * 10;
+}
+
+int64_t PresentationClock::GetPosition(int64_t now) const
+{
+	return m_anchorPosition + (now - m_anchorTime);
+}
+
+int64_t PresentationClock::GetFrameDuration() const
+{
+	return m_frameDuration > 0 ? m_frameDuration : DefaultFrameDuration;
+}
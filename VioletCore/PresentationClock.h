@@ -0,0 +1,66 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Estimates the playback position from the sample requests.
+* File Name: PresentationClock.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+namespace FFmpegInterop
+{
+	// The media source does not tell where playback is, so the position is
+	// estimated from the wall clock, starting at the first delivered sample.
+	// A long gap between the delivery of a sample and the next request means
+	// playback was paused, the gap is not counted. When the renderer had to
+	// wait before it asked for the next sample, that sample was not late, so
+	// the estimate is pulled back to it. All times are in 100 ns units.
+	//
+	// The overloads which take the current time are for tests, the others
+	// read it from Now.
+	class PresentationClock
+	{
+	public:
+		PresentationClock();
+
+		// Forgets the position, call when seeking
+		void Reset();
+
+		// Call when a sample is requested, before it is produced
+		void OnRequest();
+		void OnRequest(int64_t now);
+
+		// Call when the sample is handed out
+		void OnDeliver(int64_t position, int64_t duration);
+		void OnDeliver(int64_t position, int64_t duration, int64_t now);
+
+		// How far the sample position is behind the estimated playback
+		// position, negative when it is ahead. False while no sample was
+		// delivered since the last reset.
+		bool GetLateness(int64_t position, int64_t& lateness);
+		bool GetLateness(int64_t position, int64_t now, int64_t& lateness);
+
+		// Number of pauses which were detected
+		uint64_t GetPauses();
+
+		// The monotonic wall clock
+		static int64_t Now();
+
+	private:
+		int64_t GetPosition(int64_t now) const;
+		int64_t GetFrameDuration() const;
+
+		std::mutex m_mutex;
+		bool m_started;
+		int64_t m_anchorPosition;
+		int64_t m_anchorTime;
+		int64_t m_lastDelivery;
+		int64_t m_lastRequest;
+		int64_t m_frameDuration;
+		bool m_rendererWaited;
+		uint64_t m_pauses;
+	};
+}
@@ -0,0 +1,338 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The on-disk cache of the stream parameters found by probing.
+* File Name: ProbeCache.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+
+#include "CacheFile.h"
+#include "ProbeCache.h"
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	// The cache file starts with the magic, the version and the file
+	// identity, followed by the format level fields, the number of streams
+	// and for every stream its fields and its extradata.
+	const uint64_t CacheMagic = 0x42505356; // "VSPB"
+	const uint64_t CacheVersion = 1;
+
+	// Extradata beyond this size is not cached, the file is probed instead.
+	const uint64_t MaxExtradataSize = 1024 * 1024;
+}
+
+ProbeCache::ProbeCache()
+	: m_startTime(AV_NOPTS_VALUE)
+	, m_duration(AV_NOPTS_VALUE)
+	, m_bitRate(0)
+{
+}
+
+template <typename Parameters, typename Visitor>
+void ProbeCache::VisitFields(Parameters& parameters, Visitor visit)
+{
+	visit(parameters.codecType);
+	visit(parameters.codecId);
+	visit(parameters.codecTag);
+	visit(parameters.format);
+	visit(parameters.bitRate);
+	visit(parameters.bitsPerCodedSample);
+	visit(parameters.bitsPerRawSample);
+	visit(parameters.profile);
+	visit(parameters.level);
+	visit(parameters.width);
+	visit(parameters.height);
+	visit(parameters.sampleAspectRatioNum);
+	visit(parameters.sampleAspectRatioDen);
+	visit(parameters.fieldOrder);
+	visit(parameters.colorRange);
+	visit(parameters.colorPrimaries);
+	visit(parameters.colorTrc);
+	visit(parameters.colorSpace);
+	visit(parameters.chromaLocation);
+	visit(parameters.videoDelay);
+	visit(parameters.channelLayout);
+	visit(parameters.channels);
+	visit(parameters.sampleRate);
+	visit(parameters.blockAlign);
+	visit(parameters.frameSize);
+	visit(parameters.initialPadding);
+	visit(parameters.trailingPadding);
+	visit(parameters.seekPreroll);
+	visit(parameters.timeBaseNum);
+	visit(parameters.timeBaseDen);
+	visit(parameters.avgFrameRateNum);
+	visit(parameters.avgFrameRateDen);
+	visit(parameters.realFrameRateNum);
+	visit(parameters.realFrameRateDen);
+	visit(parameters.startTime);
+	visit(parameters.duration);
+}
+
+void ProbeCache::Capture(const AVFormatContext* avFormatCtx)
+{
+	m_streams.clear();
+	m_startTime = avFormatCtx->start_time;
+	m_duration = avFormatCtx->duration;
+	m_bitRate = avFormatCtx->bit_rate;
+
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+	{
+		const AVStream* avStream = avFormatCtx->streams[i];
+		const AVCodecParameters* codecpar = avStream->codecpar;
+
+		StreamParameters parameters;
+		parameters.codecType = codecpar->codec_type;
+		parameters.codecId = codecpar->codec_id;
+		parameters.codecTag = codecpar->codec_tag;
+		parameters.format = codecpar->format;
+		parameters.bitRate = codecpar->bit_rate;
+		parameters.bitsPerCodedSample = codecpar->bits_per_coded_sample;
+		parameters.bitsPerRawSample = codecpar->bits_per_raw_sample;
+		parameters.profile = codecpar->profile;
+		parameters.level = codecpar->level;
+		parameters.width = codecpar->width;
+		parameters.height = codecpar->height;
+		parameters.sampleAspectRatioNum = codecpar->sample_aspect_ratio.num;
+		parameters.sampleAspectRatioDen = codecpar->sample_aspect_ratio.den;
+		parameters.fieldOrder = codecpar->field_order;
+		parameters.colorRange = codecpar->color_range;
+		parameters.colorPrimaries = codecpar->color_primaries;
+		parameters.colorTrc = codecpar->color_trc;
+		parameters.colorSpace = codecpar->color_space;
+		parameters.chromaLocation = codecpar->chroma_location;
+		parameters.videoDelay = codecpar->video_delay;
+		parameters.channelLayout = static_cast<int64_t>(codecpar->channel_layout);
+		parameters.channels = codecpar->channels;
+		parameters.sampleRate = codecpar->sample_rate;
+		parameters.blockAlign = codecpar->block_align;
+		parameters.frameSize = codecpar->frame_size;
+		parameters.initialPadding = codecpar->initial_padding;
+		parameters.trailingPadding = codecpar->trailing_padding;
+		parameters.seekPreroll = codecpar->seek_preroll;
+		parameters.timeBaseNum = avStream->time_base.num;
+		parameters.timeBaseDen = avStream->time_base.den;
+		parameters.avgFrameRateNum = avStream->avg_frame_rate.num;
+		parameters.avgFrameRateDen = avStream->avg_frame_rate.den;
+		parameters.realFrameRateNum = avStream->r_frame_rate.num;
+		parameters.realFrameRateDen = avStream->r_frame_rate.den;
+		parameters.startTime = avStream->start_time;
+		parameters.duration = avStream->duration;
+
+		if (codecpar->extradata && codecpar->extradata_size > 0)
+		{
+			parameters.extradata.assign(codecpar->extradata, codecpar->extradata + codecpar->extradata_size);
+		}
+
+		m_streams.push_back(std::move(parameters));
+	}
+}
+
+bool ProbeCache::Apply(AVFormatContext* avFormatCtx) const
+{
+	if (m_streams.empty() || m_streams.size() != avFormatCtx->nb_streams)
+	{
+		return false;
+	}
+
+	// The demuxer already knows the type, codec and time base of every
+	// stream after opening, they have to be the same.
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+	{
+		const AVStream* avStream = avFormatCtx->streams[i];
+		const StreamParameters& parameters = m_streams[i];
+
+		if (avStream->codecpar->codec_type != parameters.codecType
+			|| avStream->codecpar->codec_id != parameters.codecId
+			|| avStream->time_base.num != parameters.timeBaseNum
+			|| avStream->time_base.den != parameters.timeBaseDen)
+		{
+			return false;
+		}
+	}
+
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; ++i)
+	{
+		AVStream* avStream = avFormatCtx->streams[i];
+		AVCodecParameters* codecpar = avStream->codecpar;
+		const StreamParameters& parameters = m_streams[i];
+
+		if (!parameters.extradata.empty())
+		{
+			uint8_t* extradata = static_cast<uint8_t*>(av_mallocz(parameters.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+			if (!extradata)
+			{
+				return false;
+			}
+
+			memcpy(extradata, parameters.extradata.data(), parameters.extradata.size());
+			av_freep(&codecpar->extradata);
+			codecpar->extradata = extradata;
+			codecpar->extradata_size = static_cast<int>(parameters.extradata.size());
+		}
+
+		codecpar->codec_tag = static_cast<uint32_t>(parameters.codecTag);
+		codecpar->format = static_cast<int>(parameters.format);
+		codecpar->bit_rate = parameters.bitRate;
+		codecpar->bits_per_coded_sample = static_cast<int>(parameters.bitsPerCodedSample);
+		codecpar->bits_per_raw_sample = static_cast<int>(parameters.bitsPerRawSample);
+		codecpar->profile = static_cast<int>(parameters.profile);
+		codecpar->level = static_cast<int>(parameters.level);
+		codecpar->width = static_cast<int>(parameters.width);
+		codecpar->height = static_cast<int>(parameters.height);
+		codecpar->sample_aspect_ratio.num = static_cast<int>(parameters.sampleAspectRatioNum);
+		codecpar->sample_aspect_ratio.den = static_cast<int>(parameters.sampleAspectRatioDen);
+		codecpar->field_order = static_cast<decltype(codecpar->field_order)>(parameters.fieldOrder);
+		codecpar->color_range = static_cast<decltype(codecpar->color_range)>(parameters.colorRange);
+		codecpar->color_primaries = static_cast<decltype(codecpar->color_primaries)>(parameters.colorPrimaries);
+		codecpar->color_trc = static_cast<decltype(codecpar->color_trc)>(parameters.colorTrc);
+		codecpar->color_space = static_cast<decltype(codecpar->color_space)>(parameters.colorSpace);
+		codecpar->chroma_location = static_cast<decltype(codecpar->chroma_location)>(parameters.chromaLocation);
+		codecpar->video_delay = static_cast<int>(parameters.videoDelay);
+		codecpar->channel_layout = static_cast<uint64_t>(parameters.channelLayout);
+		codecpar->channels = static_cast<int>(parameters.channels);
+		codecpar->sample_rate = static_cast<int>(parameters.sampleRate);
+		codecpar->block_align = static_cast<int>(parameters.blockAlign);
+		codecpar->frame_size = static_cast<int>(parameters.frameSize);
+		codecpar->initial_padding = static_cast<int>(parameters.initialPadding);
+		codecpar->trailing_padding = static_cast<int>(parameters.trailingPadding);
+		codecpar->seek_preroll = static_cast<int>(parameters.seekPreroll);
+
+		avStream->avg_frame_rate.num = static_cast<int>(parameters.avgFrameRateNum);
+		avStream->avg_frame_rate.den = static_cast<int>(parameters.avgFrameRateDen);
+		avStream->r_frame_rate.num = static_cast<int>(parameters.realFrameRateNum);
+		avStream->r_frame_rate.den = static_cast<int>(parameters.realFrameRateDen);
+
+		if (avStream->start_time == AV_NOPTS_VALUE)
+		{
+			avStream->start_time = parameters.startTime;
+		}
+		if (avStream->duration == AV_NOPTS_VALUE)
+		{
+			avStream->duration = parameters.duration;
+		}
+	}
+
+	if (avFormatCtx->start_time == AV_NOPTS_VALUE)
+	{
+		avFormatCtx->start_time = m_startTime;
+	}
+	if (avFormatCtx->duration == AV_NOPTS_VALUE)
+	{
+		avFormatCtx->duration = m_duration;
+	}
+	if (avFormatCtx->bit_rate <= 0)
+	{
+		avFormatCtx->bit_rate = m_bitRate;
+	}
+
+	// Everything is known, probing only has to confirm it. The frame rates
+	// are known as well, so there is no need to count frames for them.
+	if (avFormatCtx->probesize <= 0 || avFormatCtx->probesize > ShrunkProbeSize)
+	{
+		avFormatCtx->probesize = ShrunkProbeSize;
+	}
+	if (avFormatCtx->max_analyze_duration <= 0 || avFormatCtx->max_analyze_duration > ShrunkAnalyzeDuration)
+	{
+		avFormatCtx->max_analyze_duration = ShrunkAnalyzeDuration;
+	}
+	avFormatCtx->fps_probe_size = 0;
+
+	return true;
+}
+
+int ProbeCache::Load(const std::string& path, const MediaFileIdentity& identity)
+{
+	std::vector<uint8_t> buffer;
+	int ret = ReadCacheFile(path, buffer);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	size_t offset = 0;
+	uint64_t magic, version, streamCount;
+	int64_t size, modifiedTime, hash, startTime, duration, bitRate;
+	if (!ReadCacheUInt(buffer, offset, magic) || magic != CacheMagic
+		|| !ReadCacheUInt(buffer, offset, version) || version != CacheVersion
+		|| !ReadCacheInt(buffer, offset, size) || size != identity.size
+		|| !ReadCacheInt(buffer, offset, modifiedTime) || modifiedTime != identity.modifiedTime
+		|| !ReadCacheInt(buffer, offset, hash) || static_cast<uint64_t>(hash) != identity.hash
+		|| !ReadCacheInt(buffer, offset, startTime)
+		|| !ReadCacheInt(buffer, offset, duration)
+		|| !ReadCacheInt(buffer, offset, bitRate)
+		|| !ReadCacheUInt(buffer, offset, streamCount))
+	{
+		return AVERROR_INVALIDDATA;
+	}
+
+	std::vector<StreamParameters> streams;
+
+	for (uint64_t i = 0; i < streamCount; ++i)
+	{
+		StreamParameters parameters;
+
+		bool valid = true;
+		VisitFields(parameters, [&](int64_t& value)
+		{
+			valid = valid && ReadCacheInt(buffer, offset, value);
+		});
+
+		uint64_t extradataSize;
+		if (!valid || !ReadCacheUInt(buffer, offset, extradataSize) || extradataSize > MaxExtradataSize)
+		{
+			return AVERROR_INVALIDDATA;
+		}
+
+		parameters.extradata.resize(static_cast<size_t>(extradataSize));
+		if (!ReadCacheBytes(buffer, offset, parameters.extradata.data(), parameters.extradata.size()))
+		{
+			return AVERROR_INVALIDDATA;
+		}
+
+		streams.push_back(std::move(parameters));
+	}
+
+	m_streams.swap(streams);
+	m_startTime = startTime;
+	m_duration = duration;
+	m_bitRate = bitRate;
+
+	return 0;
+}
+
+int ProbeCache::Save(const std::string& path, const MediaFileIdentity& identity) const
+{
+	std::vector<uint8_t> buffer;
+
+	WriteCacheUInt(buffer, CacheMagic);
+	WriteCacheUInt(buffer, CacheVersion);
+	WriteCacheInt(buffer, identity.size);
+	WriteCacheInt(buffer, identity.modifiedTime);
+	WriteCacheInt(buffer, static_cast<int64_t>(identity.hash));
+	WriteCacheInt(buffer, m_startTime);
+	WriteCacheInt(buffer, m_duration);
+	WriteCacheInt(buffer, m_bitRate);
+	WriteCacheUInt(buffer, m_streams.size());
+
+	for (auto& stream : m_streams)
+	{
+		if (stream.extradata.size() > MaxExtradataSize)
+		{
+			return AVERROR(EINVAL);
+		}
+
+		VisitFields(stream, [&](const int64_t& value)
+		{
+			WriteCacheInt(buffer, value);
+		});
+
+		WriteCacheUInt(buffer, stream.extradata.size());
+		WriteCacheBytes(buffer, stream.extradata.data(), stream.extradata.size());
+	}
+
+	return WriteCacheFile(path, buffer);
+}
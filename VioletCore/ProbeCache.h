@@ -0,0 +1,110 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The on-disk cache of the stream parameters found by probing.
+* File Name: ProbeCache.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+#include "MediaFileIdentity.h"
+
+namespace FFmpegInterop
+{
+	// The result of avformat_find_stream_info for one media file: the codec
+	// parameters, time bases, frame rates and durations of all streams.
+	//
+	// Applying it to a freshly opened format context fills in everything the
+	// probing would find, so that avformat_find_stream_info has nothing left
+	// to decode and can run with a much smaller probe size and analyze
+	// duration.
+	class ProbeCache
+	{
+	public:
+		// Upper bounds of probesize and max_analyze_duration after the cache
+		// was applied.
+		static const int64_t ShrunkProbeSize = 256 * 1024;
+		static const int64_t ShrunkAnalyzeDuration = AV_TIME_BASE / 4;
+
+		ProbeCache();
+
+		// Takes the parameters of the probed format context.
+		void Capture(const AVFormatContext* avFormatCtx);
+
+		// Applies the parameters to a format context which was just opened and
+		// shrinks its probing limits.
+		// Return value:
+		//   true if the cache matches the streams of the format context and
+		//   was applied, false if the format context was left untouched.
+		bool Apply(AVFormatContext* avFormatCtx) const;
+
+		// Replaces the content with the cache file if it belongs to the given
+		// file identity.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int Load(const std::string& path, const MediaFileIdentity& identity);
+
+		// Writes the parameters to the cache file.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int Save(const std::string& path, const MediaFileIdentity& identity) const;
+
+		bool IsEmpty() const { return m_streams.empty(); }
+
+	private:
+		struct StreamParameters
+		{
+			int64_t codecType;
+			int64_t codecId;
+			int64_t codecTag;
+			int64_t format;
+			int64_t bitRate;
+			int64_t bitsPerCodedSample;
+			int64_t bitsPerRawSample;
+			int64_t profile;
+			int64_t level;
+			int64_t width;
+			int64_t height;
+			int64_t sampleAspectRatioNum;
+			int64_t sampleAspectRatioDen;
+			int64_t fieldOrder;
+			int64_t colorRange;
+			int64_t colorPrimaries;
+			int64_t colorTrc;
+			int64_t colorSpace;
+			int64_t chromaLocation;
+			int64_t videoDelay;
+			int64_t channelLayout;
+			int64_t channels;
+			int64_t sampleRate;
+			int64_t blockAlign;
+			int64_t frameSize;
+			int64_t initialPadding;
+			int64_t trailingPadding;
+			int64_t seekPreroll;
+			int64_t timeBaseNum;
+			int64_t timeBaseDen;
+			int64_t avgFrameRateNum;
+			int64_t avgFrameRateDen;
+			int64_t realFrameRateNum;
+			int64_t realFrameRateDen;
+			int64_t startTime;
+			int64_t duration;
+			std::vector<uint8_t> extradata;
+		};
+
+		// Calls the visitor with every numeric field, in the order of the
+		// cache file.
+		template <typename Parameters, typename Visitor>
+		static void VisitFields(Parameters& parameters, Visitor visit);
+
+		std::vector<StreamParameters> m_streams;
+		int64_t m_startTime;
+		int64_t m_duration;
+		int64_t m_bitRate;
+	};
+}
@@ -0,0 +1,280 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The asynchronous read-ahead layer under the custom AVIO context.
+* File Name: ReadAheadStream.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+
+#include "ReadAheadStream.h"
+
+using namespace FFmpegInterop;
+
+ReadAheadStream::ReadAheadStream(StreamBackend* backend, size_t blockSize, unsigned int blockCount)
+	: m_backend(backend)
+	, m_size(backend->GetSize())
+	, m_blockSize(blockSize > 0 ? blockSize : 1024 * 1024)
+	, m_backendPosition(0)
+	, m_blocks(blockCount)
+	, m_firstBlock(0)
+	, m_filledBlocks(0)
+	, m_position(0)
+	, m_fetchPosition(0)
+	, m_generation(0)
+	, m_fetchResult(0)
+	, m_stop(false)
+{
+	if (!m_blocks.empty())
+	{
+		for (auto& block : m_blocks)
+		{
+			block.data.resize(m_blockSize);
+			block.offset = 0;
+			block.size = 0;
+		}
+
+		m_thread = std::thread(&ReadAheadStream::PrefetchLoop, this);
+	}
+}
+
+ReadAheadStream::~ReadAheadStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_blockFreed.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+int ReadAheadStream::Read(uint8_t* buffer, int size)
+{
+	if (m_blocks.empty())
+	{
+		// No read-ahead, read synchronously.
+		if (m_backendPosition != m_position)
+		{
+			int64_t ret = m_backend->Seek(m_position);
+			if (ret < 0)
+			{
+				return static_cast<int>(ret);
+			}
+			m_backendPosition = m_position;
+		}
+
+		int ret = m_backend->Read(buffer, size);
+		if (ret > 0)
+		{
+			m_backendPosition += ret;
+			m_position += ret;
+		}
+		return ret == 0 ? AVERROR_EOF : ret;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		if (m_filledBlocks > 0)
+		{
+			Block& block = m_blocks[m_firstBlock];
+
+			if (m_position >= block.offset && m_position < block.offset + static_cast<int64_t>(block.size))
+			{
+				size_t blockOffset = static_cast<size_t>(m_position - block.offset);
+				size_t bytesToCopy = block.size - blockOffset;
+				if (bytesToCopy > static_cast<size_t>(size))
+				{
+					bytesToCopy = size;
+				}
+
+				memcpy(buffer, block.data.data() + blockOffset, bytesToCopy);
+				m_position += bytesToCopy;
+
+				if (blockOffset + bytesToCopy == block.size)
+				{
+					// Consumed, hand the block back to the prefetch thread.
+					m_firstBlock = (m_firstBlock + 1) % m_blocks.size();
+					--m_filledBlocks;
+					m_blockFreed.notify_one();
+				}
+
+				return static_cast<int>(bytesToCopy);
+			}
+			else if (m_position >= block.offset + static_cast<int64_t>(block.size))
+			{
+				// Skipped over by a forward seek.
+				m_firstBlock = (m_firstBlock + 1) % m_blocks.size();
+				--m_filledBlocks;
+				m_blockFreed.notify_one();
+			}
+			else
+			{
+				Restart(m_position);
+			}
+		}
+		else if (m_fetchPosition != m_position)
+		{
+			Restart(m_position);
+		}
+		else if (m_fetchResult < 0)
+		{
+			return m_fetchResult;
+		}
+		else
+		{
+			m_blockFilled.wait(lock);
+		}
+	}
+}
+
+int64_t ReadAheadStream::Seek(int64_t offset, int whence)
+{
+	whence &= ~AVSEEK_FORCE;
+
+	if (whence == AVSEEK_SIZE)
+	{
+		return m_size;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	int64_t position;
+	switch (whence)
+	{
+	case SEEK_SET:
+		position = offset;
+		break;
+	case SEEK_CUR:
+		position = m_position + offset;
+		break;
+	case SEEK_END:
+		if (m_size < 0)
+		{
+			return m_size;
+		}
+		position = m_size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (position < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// Keep the read-ahead if the target is in the buffered window or right 
+	// where the prefetch thread is reading next. Read drops the blocks which
+	// were skipped over.
+	int64_t windowStart = m_filledBlocks > 0 ? m_blocks[m_firstBlock].offset : m_fetchPosition;
+	if (!m_blocks.empty() && (position < windowStart || position > m_fetchPosition))
+	{
+		Restart(position);
+	}
+
+	m_position = position;
+
+	return position;
+}
+
+int ReadAheadStream::ReadCallback(void* opaque, uint8_t* buffer, int size)
+{
+	return static_cast<ReadAheadStream*>(opaque)->Read(buffer, size);
+}
+
+int64_t ReadAheadStream::SeekCallback(void* opaque, int64_t offset, int whence)
+{
+	return static_cast<ReadAheadStream*>(opaque)->Seek(offset, whence);
+}
+
+void ReadAheadStream::PrefetchLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		m_blockFreed.wait(lock, [this]
+		{
+			return m_stop || (m_fetchResult == 0 && m_filledBlocks < m_blocks.size());
+		});
+
+		if (m_stop)
+		{
+			break;
+		}
+
+		// Fill the slot after the last filled block without holding the lock,
+		// the reading thread never touches free slots.
+		Block& block = m_blocks[(m_firstBlock + m_filledBlocks) % m_blocks.size()];
+		int64_t fetchPosition = m_fetchPosition;
+		uint64_t generation = m_generation;
+
+		lock.unlock();
+
+		int ret = 0;
+		if (m_backendPosition != fetchPosition)
+		{
+			int64_t seekResult = m_backend->Seek(fetchPosition);
+			ret = seekResult < 0 ? static_cast<int>(seekResult) : 0;
+			m_backendPosition = seekResult < 0 ? -1 : fetchPosition;
+		}
+
+		size_t filled = 0;
+		while (ret >= 0 && filled < m_blockSize)
+		{
+			ret = m_backend->Read(block.data.data() + filled, static_cast<int>(m_blockSize - filled));
+			if (ret > 0)
+			{
+				filled += ret;
+				m_backendPosition += ret;
+			}
+			else if (ret == 0)
+			{
+				break;
+			}
+		}
+
+		lock.lock();
+
+		if (generation != m_generation)
+		{
+			// The read-ahead was dropped while we were reading.
+			continue;
+		}
+
+		if (filled > 0)
+		{
+			block.offset = fetchPosition;
+			block.size = filled;
+			++m_filledBlocks;
+			m_fetchPosition += filled;
+		}
+
+		if (ret < 0)
+		{
+			m_fetchResult = ret;
+		}
+		else if (filled < m_blockSize)
+		{
+			m_fetchResult = AVERROR_EOF;
+		}
+
+		m_blockFilled.notify_one();
+	}
+}
+
+void ReadAheadStream::Restart(int64_t position)
+{
+	++m_generation;
+	m_firstBlock = 0;
+	m_filledBlocks = 0;
+	m_fetchPosition = position;
+	m_fetchResult = 0;
+	m_blockFreed.notify_one();
+}
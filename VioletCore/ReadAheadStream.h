@@ -0,0 +1,91 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The asynchronous read-ahead layer under the custom AVIO context.
+* File Name: ReadAheadStream.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+#include "StreamBackend.h"
+
+namespace FFmpegInterop
+{
+	// Serves the AVIO read and seek callbacks from memory. A background thread
+	// reads large blocks from the backend ahead of the current position into
+	// a ring of blocks (double or triple buffering), so FFmpeg never waits
+	// for small synchronous reads as long as the backend keeps up.
+	//
+	// A seek only drops the read-ahead if the target lies outside of the
+	// buffered window. With a block count of 0 the backend is used directly.
+	class ReadAheadStream
+	{
+	public:
+		// Takes the ownership of the backend.
+		ReadAheadStream(StreamBackend* backend, size_t blockSize, unsigned int blockCount);
+		~ReadAheadStream();
+
+		ReadAheadStream(const ReadAheadStream&) = delete;
+		ReadAheadStream& operator=(const ReadAheadStream&) = delete;
+
+		// Same semantic as the read_packet callback of avio_alloc_context.
+		int Read(uint8_t* buffer, int size);
+
+		// Same semantic as the seek callback of avio_alloc_context.
+		int64_t Seek(int64_t offset, int whence);
+
+		// Callbacks for avio_alloc_context, the opaque is the ReadAheadStream.
+		static int ReadCallback(void* opaque, uint8_t* buffer, int size);
+		static int64_t SeekCallback(void* opaque, int64_t offset, int whence);
+
+	private:
+		struct Block
+		{
+			std::vector<uint8_t> data;
+			int64_t offset;
+			size_t size;
+		};
+
+		void PrefetchLoop();
+		void Restart(int64_t position);
+
+		std::unique_ptr<StreamBackend> m_backend;
+		int64_t m_size;
+		size_t m_blockSize;
+
+		// Only touched by the reading thread, or by the prefetch thread if 
+		// there is one.
+		int64_t m_backendPosition;
+
+		// The filled blocks are m_blocks[m_firstBlock] and the following 
+		// m_filledBlocks - 1 blocks, in file order and without gaps.
+		std::vector<Block> m_blocks;
+		size_t m_firstBlock;
+		size_t m_filledBlocks;
+
+		// The position FFmpeg reads from next.
+		int64_t m_position;
+
+		// The position the prefetch thread reads from next.
+		int64_t m_fetchPosition;
+
+		// Incremented whenever the read-ahead is dropped, so that the prefetch
+		// thread can tell whether the block it just read is still wanted.
+		uint64_t m_generation;
+
+		int m_fetchResult;
+		bool m_stop;
+
+		std::mutex m_mutex;
+		std::condition_variable m_blockFilled;
+		std::condition_variable m_blockFreed;
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Produces deferred samples on threads owned by the media source.
+* File Name: SamplePipeline.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <chrono>
+
+#include "SamplePipeline.h"
+
+using namespace FFmpegInterop;
+
+static int64_t Microseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SamplePipeline::SamplePipeline(int laneCount)
+	: m_stop(false)
+	, m_completedJobs(0)
+	, m_canceledJobs(0)
+	, m_queueHighWater(0)
+	, m_totalLatency(0)
+{
+	for (int i = 0; i < laneCount; ++i)
+	{
+		m_lanes.emplace_back(new Lane());
+		m_lanes.back()->running = false;
+	}
+
+	// The lanes are complete before any thread looks at them
+	for (auto& lane : m_lanes)
+	{
+		lane->thread = std::thread(&SamplePipeline::LaneLoop, this, std::ref(*lane));
+	}
+}
+
+SamplePipeline::~SamplePipeline()
+{
+	Stop();
+}
+
+bool SamplePipeline::Submit(int lane, Job job)
+{
+	if (lane < 0 || lane >= static_cast<int>(m_lanes.size()))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_stop)
+		{
+			return false;
+		}
+
+		auto& jobs = m_lanes[lane]->jobs;
+		jobs.push_back({ std::move(job), Microseconds() });
+
+		if (jobs.size() > m_queueHighWater)
+		{
+			m_queueHighWater = jobs.size();
+		}
+	}
+	m_jobAvailable.notify_all();
+
+	return true;
+}
+
+void SamplePipeline::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]
+	{
+		for (auto& lane : m_lanes)
+		{
+			if (lane->running || !lane->jobs.empty())
+			{
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+void SamplePipeline::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (auto& lane : m_lanes)
+	{
+		if (lane->thread.joinable())
+		{
+			lane->thread.join();
+		}
+	}
+}
+
+uint64_t SamplePipeline::GetCompletedJobs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_completedJobs;
+}
+
+uint64_t SamplePipeline::GetCanceledJobs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_canceledJobs;
+}
+
+size_t SamplePipeline::GetQueueHighWater() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queueHighWater;
+}
+
+int64_t SamplePipeline::GetTotalLatency() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totalLatency;
+}
+
+void SamplePipeline::LaneLoop(Lane& lane)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		m_jobAvailable.wait(lock, [&] { return m_stop || !lane.jobs.empty(); });
+
+		if (lane.jobs.empty())
+		{
+			break;
+		}
+
+		// Jobs still queued when the pipeline stops only complete their request
+		bool canceled = m_stop;
+		auto queued = std::move(lane.jobs.front());
+		lane.jobs.pop_front();
+		lane.running = true;
+
+		lock.unlock();
+		queued.job(canceled);
+		int64_t latency = Microseconds() - queued.submitTime;
+		lock.lock();
+
+		lane.running = false;
+		if (canceled)
+		{
+			m_canceledJobs++;
+		}
+		else
+		{
+			m_completedJobs++;
+			m_totalLatency += latency;
+		}
+
+		m_idle.notify_all();
+	}
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Produces deferred samples on threads owned by the media source.
+* File Name: SamplePipeline.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FFmpegInterop
+{
+	// Runs the jobs of every lane in order on a thread of that lane, so the
+	// caller returns right away and lanes do not wait for each other. A job
+	// must complete its request in any case, it is told when it is only
+	// called because the pipeline stops.
+	class SamplePipeline
+	{
+	public:
+		typedef std::function<void(bool canceled)> Job;
+
+		explicit SamplePipeline(int laneCount);
+		~SamplePipeline();
+
+		SamplePipeline(const SamplePipeline&) = delete;
+		SamplePipeline& operator=(const SamplePipeline&) = delete;
+
+		// Queues the job on the lane, false when the pipeline is stopped
+		bool Submit(int lane, Job job);
+
+		// Waits until all jobs queued so far are done
+		void WaitIdle();
+
+		// Cancels the queued jobs, waits for the running ones and ends the threads
+		void Stop();
+
+		uint64_t GetCompletedJobs() const;
+		uint64_t GetCanceledJobs() const;
+		size_t GetQueueHighWater() const;
+
+		// Sum of the time from Submit to the end of the job, in microseconds
+		int64_t GetTotalLatency() const;
+
+	private:
+		struct QueuedJob
+		{
+			Job job;
+			int64_t submitTime;
+		};
+
+		struct Lane
+		{
+			std::thread thread;
+			std::deque<QueuedJob> jobs;
+			bool running;
+		};
+
+		void LaneLoop(Lane& lane);
+
+		std::vector<std::unique_ptr<Lane>> m_lanes;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::condition_variable m_idle;
+		bool m_stop;
+
+		uint64_t m_completedJobs;
+		uint64_t m_canceledJobs;
+		size_t m_queueHighWater;
+		int64_t m_totalLatency;
+	};
+}
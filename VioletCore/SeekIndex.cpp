@@ -0,0 +1,211 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The keyframe index which lets seeks jump to byte positions.
+* File Name: SeekIndex.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+
+#include "CacheFile.h"
+#include "SeekIndex.h"
+
+using namespace FFmpegInterop;
+
+namespace
+{
+	// The cache file starts with the magic and the version, followed by the
+	// file identity, the number of streams and for every stream its index,
+	// the number of keyframes and the keyframes. Keyframes are stored as
+	// deltas to the previous one, the linked flag takes the lowest bit of the
+	// position delta.
+	const uint64_t CacheMagic = 0x49534b56; // "VKSI"
+	const uint64_t CacheVersion = 1;
+}
+
+SeekIndex::SeekIndex()
+	: m_keyframeCount(0)
+	, m_modified(false)
+{
+}
+
+void SeekIndex::AddKeyframe(int streamIndex, int64_t timestamp, int64_t position, int64_t previousTimestamp)
+{
+	if (timestamp == AV_NOPTS_VALUE || position < 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	KeyframeList& keyframes = m_streams[streamIndex];
+
+	// Playback appends, only the first keyframes after a seek land in the
+	// middle.
+	auto it = keyframes.end();
+	if (!keyframes.empty() && keyframes.back().timestamp >= timestamp)
+	{
+		it = std::lower_bound(keyframes.begin(), keyframes.end(), timestamp, [](const Keyframe& keyframe, int64_t value)
+		{
+			return keyframe.timestamp < value;
+		});
+	}
+
+	if (it == keyframes.end() || it->timestamp != timestamp)
+	{
+		if (keyframes.size() >= MaxKeyframes)
+		{
+			return;
+		}
+
+		Keyframe keyframe = { timestamp, position, false };
+		it = keyframes.insert(it, keyframe);
+		++m_keyframeCount;
+		m_modified = true;
+	}
+
+	if (!it->linked && previousTimestamp != AV_NOPTS_VALUE && it != keyframes.begin() && (it - 1)->timestamp == previousTimestamp)
+	{
+		it->linked = true;
+		m_modified = true;
+	}
+}
+
+bool SeekIndex::FindKeyframe(int streamIndex, int64_t timestamp, int64_t& keyframeTimestamp, int64_t& keyframePosition) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto stream = m_streams.find(streamIndex);
+	if (stream == m_streams.end())
+	{
+		return false;
+	}
+
+	const KeyframeList& keyframes = stream->second;
+
+	// The first keyframe after the time stamp
+	auto next = std::upper_bound(keyframes.begin(), keyframes.end(), timestamp, [](int64_t value, const Keyframe& keyframe)
+	{
+		return value < keyframe.timestamp;
+	});
+
+	// Without a linked successor there might be an unknown keyframe closer
+	// to the time stamp.
+	if (next == keyframes.begin() || next == keyframes.end() || !next->linked)
+	{
+		return false;
+	}
+
+	keyframeTimestamp = (next - 1)->timestamp;
+	keyframePosition = (next - 1)->position;
+
+	return true;
+}
+
+int SeekIndex::Load(const std::string& path, const MediaFileIdentity& identity)
+{
+	std::vector<uint8_t> buffer;
+	int ret = ReadCacheFile(path, buffer);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	size_t offset = 0;
+	uint64_t magic, version, streamCount;
+	int64_t size, modifiedTime, hash;
+	if (!ReadCacheUInt(buffer, offset, magic) || magic != CacheMagic
+		|| !ReadCacheUInt(buffer, offset, version) || version != CacheVersion
+		|| !ReadCacheInt(buffer, offset, size) || size != identity.size
+		|| !ReadCacheInt(buffer, offset, modifiedTime) || modifiedTime != identity.modifiedTime
+		|| !ReadCacheInt(buffer, offset, hash) || static_cast<uint64_t>(hash) != identity.hash
+		|| !ReadCacheUInt(buffer, offset, streamCount))
+	{
+		return AVERROR_INVALIDDATA;
+	}
+
+	std::map<int, KeyframeList> streams;
+	size_t keyframeCount = 0;
+
+	for (uint64_t i = 0; i < streamCount; ++i)
+	{
+		uint64_t streamIndex, count;
+		if (!ReadCacheUInt(buffer, offset, streamIndex) || !ReadCacheUInt(buffer, offset, count) || count > MaxKeyframes)
+		{
+			return AVERROR_INVALIDDATA;
+		}
+
+		KeyframeList& keyframes = streams[static_cast<int>(streamIndex)];
+		keyframes.reserve(static_cast<size_t>(count));
+
+		Keyframe keyframe = { 0, 0, false };
+		for (uint64_t j = 0; j < count; ++j)
+		{
+			int64_t timestampDelta, positionDelta;
+			if (!ReadCacheInt(buffer, offset, timestampDelta) || !ReadCacheInt(buffer, offset, positionDelta))
+			{
+				return AVERROR_INVALIDDATA;
+			}
+
+			keyframe.timestamp += timestampDelta;
+			keyframe.position += positionDelta >> 1;
+			keyframe.linked = (positionDelta & 1) != 0;
+			keyframes.push_back(keyframe);
+		}
+
+		keyframeCount += keyframes.size();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_streams.swap(streams);
+	m_keyframeCount = keyframeCount;
+	m_modified = false;
+
+	return 0;
+}
+
+int SeekIndex::Save(const std::string& path, const MediaFileIdentity& identity)
+{
+	std::vector<uint8_t> buffer;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		WriteCacheUInt(buffer, CacheMagic);
+		WriteCacheUInt(buffer, CacheVersion);
+		WriteCacheInt(buffer, identity.size);
+		WriteCacheInt(buffer, identity.modifiedTime);
+		WriteCacheInt(buffer, static_cast<int64_t>(identity.hash));
+		WriteCacheUInt(buffer, m_streams.size());
+
+		for (auto& stream : m_streams)
+		{
+			WriteCacheUInt(buffer, static_cast<uint64_t>(stream.first));
+			WriteCacheUInt(buffer, stream.second.size());
+
+			Keyframe previous = { 0, 0, false };
+			for (auto& keyframe : stream.second)
+			{
+				WriteCacheInt(buffer, keyframe.timestamp - previous.timestamp);
+				WriteCacheInt(buffer, (keyframe.position - previous.position) * 2 + (keyframe.linked ? 1 : 0));
+				previous = keyframe;
+			}
+		}
+
+		m_modified = false;
+	}
+
+	return WriteCacheFile(path, buffer);
+}
+
+bool SeekIndex::IsModified() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_modified;
+}
+
+size_t SeekIndex::GetKeyframeCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_keyframeCount;
+}
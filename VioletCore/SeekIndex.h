@@ -0,0 +1,85 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The keyframe index which lets seeks jump to byte positions.
+* File Name: SeekIndex.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+#include "MediaFileIdentity.h"
+
+namespace FFmpegInterop
+{
+	// The keyframes of a media file with their time stamps and byte
+	// positions, recorded while the file is demuxed and kept in a small
+	// on-disk cache between sessions.
+	//
+	// A keyframe is only used for a seek if the index knows that there is no
+	// other keyframe between it and the next indexed one, i.e. both were read
+	// one after the other without a seek in between. Everything else falls
+	// back to av_seek_frame with time stamps.
+	//
+	// All methods are thread safe.
+	class SeekIndex
+	{
+	public:
+		SeekIndex();
+
+		SeekIndex(const SeekIndex&) = delete;
+		SeekIndex& operator=(const SeekIndex&) = delete;
+
+		// Records a keyframe of the stream. previousTimestamp is the time
+		// stamp of the keyframe which was read right before it on the same
+		// stream, or AV_NOPTS_VALUE after a seek.
+		void AddKeyframe(int streamIndex, int64_t timestamp, int64_t position, int64_t previousTimestamp);
+
+		// Finds the last keyframe of the stream at or before the time stamp.
+		// Return value:
+		//   true if the keyframe is known to be the right one.
+		bool FindKeyframe(int streamIndex, int64_t timestamp, int64_t& keyframeTimestamp, int64_t& keyframePosition) const;
+
+		// Replaces the content with the cache file if it belongs to the given
+		// file identity.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int Load(const std::string& path, const MediaFileIdentity& identity);
+
+		// Writes the index to the cache file and clears the modified flag.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int Save(const std::string& path, const MediaFileIdentity& identity);
+
+		// true if keyframes were added since the last Load or Save.
+		bool IsModified() const;
+
+		size_t GetKeyframeCount() const;
+
+	private:
+		struct Keyframe
+		{
+			int64_t timestamp;
+			int64_t position;
+
+			// There is no keyframe between the previous entry and this one.
+			bool linked;
+		};
+
+		typedef std::vector<Keyframe> KeyframeList;
+
+		// Upper bound of the entries per stream, a keyframe per second of a
+		// whole day.
+		static const size_t MaxKeyframes = 24 * 60 * 60;
+
+		mutable std::mutex m_mutex;
+		std::map<int, KeyframeList> m_streams;
+		size_t m_keyframeCount;
+		bool m_modified;
+	};
+}
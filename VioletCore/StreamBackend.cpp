@@ -0,0 +1,98 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The byte stream interface used by the custom AVIO layer.
+* File Name: StreamBackend.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include "StreamBackend.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <string>
+#endif
+
+using namespace FFmpegInterop;
+
+FileStreamBackend* FileStreamBackend::Open(const char* path)
+{
+	FILE* file = nullptr;
+
+#ifdef _WIN32
+	int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+	if (length > 0)
+	{
+		std::wstring widePath(length, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], length);
+		_wfopen_s(&file, widePath.c_str(), L"rb");
+	}
+#else
+	file = fopen(path, "rb");
+#endif
+
+	return file ? new FileStreamBackend(file) : nullptr;
+}
+
+FileStreamBackend::FileStreamBackend(FILE* file)
+	: m_file(file)
+{
+}
+
+FileStreamBackend::~FileStreamBackend()
+{
+	fclose(m_file);
+}
+
+int FileStreamBackend::Read(uint8_t* buffer, int size)
+{
+	size_t bytesRead = fread(buffer, 1, size, m_file);
+	if (bytesRead == 0 && ferror(m_file))
+	{
+		return AVERROR(EIO);
+	}
+
+	return static_cast<int>(bytesRead);
+}
+
+int64_t FileStreamBackend::Seek(int64_t position)
+{
+#ifdef _WIN32
+	int ret = _fseeki64(m_file, position, SEEK_SET);
+#else
+	int ret = fseeko(m_file, position, SEEK_SET);
+#endif
+
+	return ret == 0 ? position : AVERROR(EIO);
+}
+
+int64_t FileStreamBackend::GetSize()
+{
+#ifdef _WIN32
+	int64_t position = _ftelli64(m_file);
+	_fseeki64(m_file, 0, SEEK_END);
+	int64_t size = _ftelli64(m_file);
+	_fseeki64(m_file, position, SEEK_SET);
+#else
+	int64_t position = ftello(m_file);
+	fseeko(m_file, 0, SEEK_END);
+	int64_t size = ftello(m_file);
+	fseeko(m_file, position, SEEK_SET);
+#endif
+
+	return size >= 0 ? size : AVERROR(EIO);
+}
+
+int64_t FileStreamBackend::GetModifiedTime()
+{
+#ifdef _WIN32
+	struct _stat64 status;
+	int ret = _fstat64(_fileno(m_file), &status);
+#else
+	struct stat status;
+	int ret = fstat(fileno(m_file), &status);
+#endif
+
+	return ret == 0 ? static_cast<int64_t>(status.st_mtime) : 0;
+}
@@ -0,0 +1,71 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The byte stream interface used by the custom AVIO layer.
+* File Name: StreamBackend.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	// A seekable source of bytes behind the custom AVIO context. A backend is
+	// only ever used by one thread at a time.
+	class StreamBackend
+	{
+	public:
+		virtual ~StreamBackend()
+		{
+		}
+
+		// Reads up to size bytes at the current position.
+		// Return value:
+		//   The number of bytes read, 0 at the end of the stream, or a
+		//   negative AVERROR code.
+		virtual int Read(uint8_t* buffer, int size) = 0;
+
+		// Moves the current position to the given absolute offset.
+		// Return value:
+		//   The new position, or a negative AVERROR code.
+		virtual int64_t Seek(int64_t position) = 0;
+
+		// Return value:
+		//   The size of the stream in bytes, or a negative AVERROR code if it
+		//   is not known.
+		virtual int64_t GetSize() = 0;
+
+		// Return value:
+		//   An opaque time stamp of the last modification of the stream, only
+		//   meant to be compared with earlier values, or 0 if it is not known.
+		virtual int64_t GetModifiedTime()
+		{
+			return 0;
+		}
+	};
+
+	// A backend which reads a local file with the C runtime.
+	class FileStreamBackend : public StreamBackend
+	{
+	public:
+		// Opens the file with the given UTF-8 path.
+		// Return value:
+		//   The backend, or nullptr if the file could not be opened.
+		static FileStreamBackend* Open(const char* path);
+
+		virtual ~FileStreamBackend();
+
+		virtual int Read(uint8_t* buffer, int size) override;
+		virtual int64_t Seek(int64_t position) override;
+		virtual int64_t GetSize() override;
+		virtual int64_t GetModifiedTime() override;
+
+	private:
+		explicit FileStreamBackend(FILE* file);
+
+		FILE* m_file;
+	};
+}
@@ -0,0 +1,187 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the audio interleaving against swresample.
+* File Name: AudioConversionTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "AudioConversion.h"
+#include "TestUtilities.h"
+
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// Written after the output, must be left alone.
+static const uint8_t GuardByte = 0x5a;
+static const int GuardSize = 64;
+
+// Creates a resampler which only interleaves: same rate and layout, the
+// packed variant of the planar format.
+static SwrContext* CreateInterleavingResampler(AVSampleFormat format, int channels)
+{
+	SwrContext* swrCtx = nullptr;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+	AVChannelLayout layout;
+	av_channel_layout_default(&layout, channels);
+	if (swr_alloc_set_opts2(&swrCtx, &layout, av_get_packed_sample_fmt(format), 48000, &layout, format, 48000, 0, nullptr) < 0)
+	{
+		return nullptr;
+	}
+#else
+	int64_t layout = av_get_default_channel_layout(channels);
+	swrCtx = swr_alloc_set_opts(nullptr, layout, av_get_packed_sample_fmt(format), 48000, layout, format, 48000, 0, nullptr);
+#endif
+
+	if (swrCtx && swr_init(swrCtx) < 0)
+	{
+		swr_free(&swrCtx);
+	}
+
+	return swrCtx;
+}
+
+// Interleaves random planes with the kernel and with swr_convert and
+// compares the bytes. The planes start one sample after an aligned address,
+// so the kernels see unaligned loads, and the sample counts cover the
+// vector loops, their tails and both together.
+static void TestAgainstSwresample(AVSampleFormat format, int channels)
+{
+	AudioInterleaveFunction interleave = GetAudioInterleave(format, channels);
+	CHECK(interleave != nullptr);
+
+	SwrContext* swrCtx = CreateInterleavingResampler(format, channels);
+	CHECK(swrCtx != nullptr);
+
+	if (!interleave || !swrCtx)
+	{
+		swr_free(&swrCtx);
+		return;
+	}
+
+	int sampleSize = av_get_bytes_per_sample(format);
+	std::mt19937 random(channels * 100 + format);
+
+	// Floats stay in the usual range, so no NaN payload can differ
+	std::uniform_real_distribution<float> floats(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> bytes(0, 255);
+
+	for (int samples : { 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 1024, 1031, 2048 })
+	{
+		std::vector<std::vector<uint8_t>> planes(channels, std::vector<uint8_t>((samples + 1) * sampleSize));
+		const uint8_t* srcData[8];
+		for (int c = 0; c < channels; ++c)
+		{
+			for (int i = 0; i < samples + 1; ++i)
+			{
+				uint8_t* sample = planes[c].data() + i * sampleSize;
+				if (format == AV_SAMPLE_FMT_FLTP)
+				{
+					float value = floats(random);
+					memcpy(sample, &value, sizeof(value));
+				}
+				else
+				{
+					for (int b = 0; b < sampleSize; ++b)
+					{
+						sample[b] = static_cast<uint8_t>(bytes(random));
+					}
+				}
+			}
+
+			srcData[c] = planes[c].data() + sampleSize;
+		}
+
+		int size = samples * channels * sampleSize;
+		std::vector<uint8_t> fast(size + GuardSize, GuardByte);
+		std::vector<uint8_t> resampled(size + GuardSize, GuardByte);
+
+		interleave(srcData, fast.data(), samples);
+
+		uint8_t* resampledData = resampled.data();
+		CHECK(swr_convert(swrCtx, &resampledData, samples, srcData, samples) == samples);
+
+		CHECK(memcmp(fast.data(), resampled.data(), size) == 0);
+		for (int i = size; i < size + GuardSize; ++i)
+		{
+			CHECK(fast[i] == GuardByte);
+		}
+	}
+
+	swr_free(&swrCtx);
+}
+
+static void TestSelection()
+{
+	for (AVSampleFormat format : { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P })
+	{
+		CHECK(GetAudioInterleave(format, 2) != nullptr);
+		CHECK(GetAudioInterleave(format, 6) != nullptr);
+		CHECK(GetAudioInterleave(format, 8) != nullptr);
+		CHECK(GetAudioInterleave(format, 1) == nullptr);
+		CHECK(GetAudioInterleave(format, 4) == nullptr);
+	}
+
+	// FLTP and S32P both move 32 bit words
+	CHECK(GetAudioInterleave(AV_SAMPLE_FMT_FLTP, 2) == GetAudioInterleave(AV_SAMPLE_FMT_S32P, 2));
+
+	CHECK(GetAudioInterleave(AV_SAMPLE_FMT_FLT, 2) == nullptr);
+	CHECK(GetAudioInterleave(AV_SAMPLE_FMT_S16, 2) == nullptr);
+	CHECK(GetAudioInterleave(AV_SAMPLE_FMT_U8P, 2) == nullptr);
+	CHECK(GetAudioInterleave(AV_SAMPLE_FMT_DBLP, 2) == nullptr);
+}
+
+// Usage: AudioConversionTest [scalar|sse2|avx2]
+// The kernels are picked once per process, so every instruction set needs a
+// run of its own. Without an argument the best one of the CPU is tested.
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		int cpuFlags = av_get_cpu_flags();
+		int forced = 0;
+		if (strcmp(argv[1], "sse2") == 0)
+		{
+			forced = AV_CPU_FLAG_SSE2;
+		}
+		else if (strcmp(argv[1], "avx2") == 0)
+		{
+			forced = AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_AVX2;
+		}
+		else if (strcmp(argv[1], "scalar") != 0)
+		{
+			fprintf(stderr, "unknown instruction set %s\n", argv[1]);
+			return 1;
+		}
+
+		if ((forced & cpuFlags) != forced)
+		{
+			printf("AudioConversionTest: %s is not supported, skipped\n", argv[1]);
+			return 0;
+		}
+
+		av_force_cpu_flags(forced);
+	}
+
+	TestSelection();
+	for (AVSampleFormat format : { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P })
+	{
+		for (int channels : { 2, 6, 8 })
+		{
+			TestAgainstSwresample(format, channels);
+		}
+	}
+
+	return TestResult("AudioConversionTest");
+}
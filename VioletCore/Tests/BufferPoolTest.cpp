@@ -0,0 +1,158 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the recycling pool of audio output buffers.
+* File Name: BufferPoolTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <deque>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "AudioConversion.h"
+#include "BufferPool.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// 1024 stereo samples of 16 bit, the frames of AAC
+static const int FrameSamples = 1024;
+static const int Channels = 2;
+static const int FrameSize = FrameSamples * Channels * 2;
+
+// Audio playback interleaves every frame into a buffer of the pool, the
+// renderer holds a few samples and releases the oldest one for every new
+// one. Once the pool holds as many buffers as the renderer, it allocates no
+// more.
+static void TestSteadyState()
+{
+	const unsigned int RendererSamples = 8;
+	const int Frames = 2000;
+
+	BufferPool* pool = new BufferPool(FrameSize, 16);
+	AudioInterleaveFunction interleave = GetAudioInterleave(AV_SAMPLE_FMT_S16P, Channels);
+	CHECK(interleave != nullptr);
+
+	std::vector<int16_t> left(FrameSamples, 1);
+	std::vector<int16_t> right(FrameSamples, 2);
+	const uint8_t* planes[] = { reinterpret_cast<uint8_t*>(left.data()), reinterpret_cast<uint8_t*>(right.data()) };
+
+	std::deque<AVBufferRef*> renderer;
+	for (int i = 0; i < Frames; ++i)
+	{
+		AVBufferRef* buffer = pool->Acquire();
+		CHECK(buffer != nullptr && buffer->size >= FrameSize);
+		if (!buffer)
+		{
+			break;
+		}
+
+		if (interleave)
+		{
+			interleave(planes, buffer->data, FrameSamples);
+		}
+		renderer.push_back(buffer);
+
+		if (renderer.size() > RendererSamples)
+		{
+			CHECK(reinterpret_cast<int16_t*>(renderer.front()->data)[1] == 2);
+			av_buffer_unref(&renderer.front());
+			renderer.pop_front();
+		}
+
+		if (i == RendererSamples * 2)
+		{
+			CHECK(pool->GetAllocations() == RendererSamples + 1);
+		}
+	}
+
+	CHECK(pool->GetAllocations() == RendererSamples + 1);
+	CHECK(pool->GetBuffersInUse() == RendererSamples);
+	CHECK(pool->GetIdleBuffers() == 1);
+
+	for (auto& buffer : renderer)
+	{
+		av_buffer_unref(&buffer);
+	}
+
+	CHECK(pool->GetBuffersInUse() == 0);
+	CHECK(pool->GetIdleBuffers() == RendererSamples + 1);
+	pool->Close();
+}
+
+// The pool keeps no more idle buffers than its depth, the rest are freed and
+// allocated again when they are needed.
+static void TestDepth()
+{
+	const unsigned int Depth = 4;
+	const int Held = 10;
+
+	BufferPool* pool = new BufferPool(FrameSize, Depth);
+	for (int round = 1; round <= 3; ++round)
+	{
+		std::vector<AVBufferRef*> buffers;
+		for (int i = 0; i < Held; ++i)
+		{
+			buffers.push_back(pool->Acquire());
+			CHECK(buffers.back() != nullptr);
+		}
+
+		for (auto& buffer : buffers)
+		{
+			av_buffer_unref(&buffer);
+		}
+
+		CHECK(pool->GetIdleBuffers() == Depth);
+		CHECK(pool->GetAllocations() == static_cast<uint64_t>(Held + (round - 1) * (Held - Depth)));
+	}
+
+	pool->Close();
+}
+
+// The renderer releases samples on its own thread, also after the provider
+// closed the pool, e.g. when the stream is switched. The buffers stay valid
+// until then.
+static void TestReleaseAfterClose()
+{
+	BufferPool* pool = new BufferPool(FrameSize, 16);
+
+	std::vector<AVBufferRef*> buffers;
+	for (int i = 0; i < 32; ++i)
+	{
+		AVBufferRef* buffer = pool->Acquire();
+		CHECK(buffer != nullptr);
+		if (buffer)
+		{
+			memset(buffer->data, i, FrameSize);
+			buffers.push_back(buffer);
+		}
+	}
+
+	std::thread renderer([&]
+	{
+		for (size_t i = 0; i < buffers.size() / 2; ++i)
+		{
+			av_buffer_unref(&buffers[i]);
+		}
+	});
+	renderer.join();
+
+	pool->Close();
+
+	for (size_t i = buffers.size() / 2; i < buffers.size(); ++i)
+	{
+		CHECK(buffers[i]->data[FrameSize - 1] == static_cast<uint8_t>(i));
+		av_buffer_unref(&buffers[i]);
+	}
+}
+
+int main()
+{
+	TestSteadyState();
+	TestDepth();
+	TestReleaseAfterClose();
+
+	return TestResult("BufferPoolTest");
+}
@@ -0,0 +1,128 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the decoder threads chosen per codec, size and rate.
+* File Name: DecoderThreadingTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <initializer_list>
+#include <stdio.h>
+
+#include "DecoderThreading.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static const int FrameAndSlice = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+struct ThreadingCase
+{
+	const char* name;
+	DecoderThreadingInput input;
+	int type;
+	int count;
+};
+
+// The load is the pixel rate relative to 1080p30 H.264, doubled for HEVC,
+// VP9 and AV1 and increased by half for high bit depth and 4:4:4 profiles.
+// Below 0.5, about 720p30 H.264, the video decodes slice threaded on two
+// threads, above it frame threaded on four threads per load.
+static const ThreadingCase Cases[] =
+{
+	{ "audio", { AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_AAC, 0, 0, 0, 0, false, 8 }, 0, 1 },
+	{ "live audio", { AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_OPUS, 0, 0, 0, 0, true, 8 }, 0, 1 },
+	{ "one hardware thread", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, 0, 3840, 2160, 60, false, 1 }, 0, 1 },
+	{ "live 1080p", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 30, true, 8 }, FF_THREAD_SLICE, 8 },
+	{ "live 4K HEVC", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, 0, 3840, 2160, 60, true, 4 }, FF_THREAD_SLICE, 4 },
+	{ "live beyond 16 threads", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 30, true, 32 }, FF_THREAD_SLICE, 16 },
+	{ "360p30 H.264", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 640, 360, 30, false, 8 }, FF_THREAD_SLICE, 2 },
+	{ "720p30 H.264", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1280, 720, 30, false, 8 }, FF_THREAD_SLICE, 2 },
+	{ "720p30 H.264 on two threads", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1280, 720, 30, false, 2 }, FF_THREAD_SLICE, 2 },
+	{ "720p60 H.264", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1280, 720, 60, false, 8 }, FrameAndSlice, 4 },
+	{ "1080p24 H.264", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 24, false, 8 }, FrameAndSlice, 3 },
+	{ "1080p30 H.264", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 30, false, 8 }, FrameAndSlice, 4 },
+	{ "1080p30 H.264 on two threads", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 30, false, 2 }, FrameAndSlice, 2 },
+	{ "1080p30 MPEG-4", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, 0, 1920, 1080, 30, false, 8 }, FrameAndSlice, 4 },
+	{ "4K30 H.264 beyond 16 threads", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 3840, 2160, 30, false, 32 }, FrameAndSlice, 16 },
+	{ "1080p without frame rate", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1920, 1080, 0, false, 8 }, FrameAndSlice, 4 },
+	{ "720p without frame rate", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, 0, 1280, 720, 0, false, 8 }, FF_THREAD_SLICE, 2 },
+	{ "360p30 AV1", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_AV1, 0, 640, 360, 30, false, 8 }, FF_THREAD_SLICE, 2 },
+	{ "540p30 VP9", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_VP9, 0, 960, 540, 30, false, 8 }, FrameAndSlice, 2 },
+	{ "720p30 HEVC", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, FF_PROFILE_HEVC_MAIN, 1280, 720, 30, false, 8 }, FrameAndSlice, 4 },
+	{ "4K30 HEVC", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, FF_PROFILE_HEVC_MAIN, 3840, 2160, 30, false, 64 }, FrameAndSlice, 16 },
+	{ "4K30 HEVC Main 10 on eight threads", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, FF_PROFILE_HEVC_MAIN_10, 3840, 2160, 30, false, 8 }, FrameAndSlice, 8 },
+	{ "1080p30 HEVC Main 10", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_HEVC, FF_PROFILE_HEVC_MAIN_10, 1920, 1080, 30, false, 16 }, FrameAndSlice, 12 },
+	{ "720p30 H.264 High", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, FF_PROFILE_H264_HIGH, 1280, 720, 30, false, 8 }, FF_THREAD_SLICE, 2 },
+	{ "720p30 H.264 High 10", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, FF_PROFILE_H264_HIGH_10, 1280, 720, 30, false, 8 }, FrameAndSlice, 3 },
+	{ "720p30 H.264 High 4:4:4", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_H264, FF_PROFILE_H264_HIGH_444_PREDICTIVE, 1280, 720, 30, false, 8 }, FrameAndSlice, 3 },
+	// The profile values of one codec mean nothing for another
+	{ "720p30 MPEG-4 with an H.264 profile", { AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, FF_PROFILE_H264_HIGH_10, 1280, 720, 30, false, 8 }, FF_THREAD_SLICE, 2 },
+};
+
+static void TestCases()
+{
+	for (const ThreadingCase& testCase : Cases)
+	{
+		DecoderThreads threads = ChooseDecoderThreads(testCase.input);
+		if (threads.type != testCase.type || threads.count != testCase.count)
+		{
+			fprintf(stderr, "%s: type %d count %d, expected type %d count %d\n", testCase.name, threads.type, threads.count, testCase.type, testCase.count);
+		}
+
+		CHECK(threads.type == testCase.type);
+		CHECK(threads.count == testCase.count);
+	}
+}
+
+// Whatever the input, audio and live video never get frame threads, and the
+// count stays within the hardware threads and the 16 FFmpeg supports.
+static void TestLimits()
+{
+	const AVCodecID codecs[] = { AV_CODEC_ID_H264, AV_CODEC_ID_HEVC, AV_CODEC_ID_VP9, AV_CODEC_ID_AV1, AV_CODEC_ID_MPEG2VIDEO };
+	const int sizes[][2] = { { 0, 0 }, { 320, 180 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+
+	for (AVMediaType mediaType : { AVMEDIA_TYPE_AUDIO, AVMEDIA_TYPE_VIDEO })
+	{
+		for (AVCodecID codecId : codecs)
+		{
+			for (auto& size : sizes)
+			{
+				for (double frameRate : { 0.0, 24.0, 60.0, 240.0 })
+				{
+					for (bool lowLatency : { false, true })
+					{
+						for (unsigned int hardwareThreads : { 0u, 1u, 2u, 3u, 8u, 64u })
+						{
+							DecoderThreadingInput input = { mediaType, codecId, 0, size[0], size[1], frameRate, lowLatency, hardwareThreads };
+							DecoderThreads threads = ChooseDecoderThreads(input);
+
+							unsigned int maxCount = hardwareThreads < 1 ? 1 : hardwareThreads > 16 ? 16 : hardwareThreads;
+							CHECK(threads.count >= 1);
+							CHECK(static_cast<unsigned int>(threads.count) <= maxCount);
+							CHECK((threads.type == 0) == (threads.count == 1));
+
+							if (mediaType == AVMEDIA_TYPE_AUDIO)
+							{
+								CHECK(threads.type == 0);
+							}
+
+							if (lowLatency)
+							{
+								CHECK(!(threads.type & FF_THREAD_FRAME));
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestCases();
+	TestLimits();
+
+	return TestResult("DecoderThreadingTest");
+}
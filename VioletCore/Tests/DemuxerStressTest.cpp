@@ -0,0 +1,560 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Stress test of the background demuxer and its packet queues.
+* File Name: DemuxerStressTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "FFmpegDemuxer.h"
+#include "KeyframeScanner.h"
+#include "TestMedia.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static const int VideoStream = 0;
+static const int AudioStream = 1;
+static const int SubtitleStream = 2;
+
+static const size_t MemoryBudget = 256 * 1024;
+static const int MaxVideoPacket = 30000;
+// How far the audio consumer may run ahead of the video consumer, one frame.
+static const int64_t AudioLead = 40;
+
+static std::vector<TestStreamSpec> GetStreams()
+{
+	return
+	{
+		{ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, { 1, 90000 }, 3600, 12, 2000, MaxVideoPacket },
+		{ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, { 1, 48000 }, 1024, 1, 500, 1500 },
+		{ AVMEDIA_TYPE_SUBTITLE, AV_CODEC_ID_TEXT, { 1, 1000 }, 5000, 1, 20, 100 },
+	};
+}
+
+// Reads packets of one stream and checks that they are the packets of the
+// file, in order and without gaps since the last seek or enable.
+class StreamConsumer
+{
+public:
+	StreamConsumer(FFmpegDemuxer& demuxer, const TestMediaInfo& info, int streamIndex)
+		: m_demuxer(demuxer)
+		, m_info(info)
+		, m_streamIndex(streamIndex)
+		, m_nextIndex(-1)
+		, m_packets(0)
+		, m_firstPts(AV_NOPTS_VALUE)
+		, m_time(0)
+		, m_ended(false)
+	{
+	}
+
+	// Expect any packet next, e.g. after a seek.
+	void Resync()
+	{
+		m_nextIndex = -1;
+	}
+
+	// Reads up to count packets, fewer at the end of the stream.
+	void Read(int count, bool contiguous = true)
+	{
+		for (int i = 0; i < count && !m_ended; ++i)
+		{
+			AVPacket* avPacket = nullptr;
+			int ret = m_demuxer.ReadPacket(m_streamIndex, &avPacket);
+			if (ret < 0)
+			{
+				CHECK(avPacket == nullptr);
+				m_ended = true;
+				break;
+			}
+
+			int index = GetTestPacketIndex(avPacket);
+			CHECK(index >= 0 && index < static_cast<int>(m_info.packets[m_streamIndex].size()));
+			CHECK(HasTestPayload(avPacket, m_streamIndex, index));
+			if (index >= 0 && index < static_cast<int>(m_info.packets[m_streamIndex].size()))
+			{
+				CHECK(avPacket->pts == m_info.packets[m_streamIndex][index].pts);
+				CHECK(avPacket->size == m_info.packets[m_streamIndex][index].size);
+			}
+
+			if (m_nextIndex >= 0)
+			{
+				if (contiguous)
+				{
+					CHECK(index == m_nextIndex);
+				}
+				else
+				{
+					CHECK(index >= m_nextIndex);
+				}
+			}
+			else if (m_packets == 0)
+			{
+				m_firstPts = avPacket->pts;
+			}
+
+			m_nextIndex = index + 1;
+			m_time = av_rescale_q(avPacket->pts, m_info.timeBases[m_streamIndex], { 1, 1000 });
+			++m_packets;
+			m_demuxer.ReleasePacket(avPacket);
+		}
+	}
+
+	void ReadToEnd(bool contiguous = true)
+	{
+		while (!m_ended)
+		{
+			Read(1000, contiguous);
+		}
+	}
+
+	// Starts counting again, e.g. after a seek.
+	void Reset()
+	{
+		m_nextIndex = -1;
+		m_packets = 0;
+		m_ended = false;
+	}
+
+	int GetNextIndex() const { return m_nextIndex; }
+	int GetPacketCount() const { return m_packets; }
+	int64_t GetFirstPts() const { return m_firstPts; }
+	int64_t GetTime() const { return m_time; }
+	bool HasEnded() const { return m_ended; }
+
+private:
+	FFmpegDemuxer& m_demuxer;
+	const TestMediaInfo& m_info;
+	int m_streamIndex;
+	int m_nextIndex;
+	int m_packets;
+	int64_t m_firstPts;
+	std::atomic<int64_t> m_time;
+	std::atomic<bool> m_ended;
+};
+
+// Packets which can be out of the pool at once: the queued ones, one per
+// consumer thread and the one the demuxer reads into.
+static uint64_t GetMaxPacketsInFlight(const FFmpegDemuxer& demuxer, int consumers)
+{
+	return demuxer.GetQueueStatistics(VideoStream).maxPackets + demuxer.GetQueueStatistics(AudioStream).maxPackets + consumers + 1;
+}
+
+// Every packet of the enabled streams arrives once and in order, while the
+// memory budget holds the read-ahead back.
+static void TestReadsAllPackets(const std::string& path, const TestMediaInfo& info)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 16, MemoryBudget);
+		demuxer.EnableStream(VideoStream);
+		demuxer.EnableStream(AudioStream);
+		demuxer.Start();
+
+		StreamConsumer video(demuxer, info, VideoStream);
+		StreamConsumer audio(demuxer, info, AudioStream);
+
+		// A slow video consumer lets the read-ahead run into the budget. The
+		// audio consumer keeps pace with it like a renderer would: a consumer
+		// which waits for packets overrides the budget, so an audio consumer
+		// far ahead would pull the whole video stream into memory.
+		std::thread videoThread([&]
+		{
+			while (!video.HasEnded())
+			{
+				video.Read(1);
+				if (video.GetPacketCount() % 64 == 0)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(2));
+					CHECK(demuxer.GetQueuedBytes() <= MemoryBudget + 2 * MaxVideoPacket);
+				}
+			}
+		});
+		std::thread audioThread([&]
+		{
+			while (!audio.HasEnded())
+			{
+				if (!video.HasEnded() && audio.GetTime() > video.GetTime() + AudioLead)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				audio.Read(1);
+			}
+		});
+
+		videoThread.join();
+		audioThread.join();
+
+		CHECK(video.GetPacketCount() == static_cast<int>(info.packets[VideoStream].size()));
+		CHECK(audio.GetPacketCount() == static_cast<int>(info.packets[AudioStream].size()));
+		CHECK(demuxer.GetQueueStatistics(SubtitleStream).maxPackets == 0);
+
+		DemuxerStatistics statistics = demuxer.GetStatistics();
+		CHECK(statistics.packetsRead >= info.packets[VideoStream].size() + info.packets[AudioStream].size());
+		CHECK(statistics.packetsRead - statistics.packetsDropped == info.packets[VideoStream].size() + info.packets[AudioStream].size());
+
+		// Held back by the budget, the demuxer reads into packets which the
+		// consumers gave back rather than into new ones
+		const PacketPool& pool = demuxer.GetPacketPool();
+		CHECK(pool.GetMissCount() <= GetMaxPacketsInFlight(demuxer, 2));
+		CHECK(pool.GetMissCount() < statistics.packetsRead / 10);
+	}
+
+	avformat_close_input(&avFormatCtx);
+}
+
+// Consumed packets go back to the pool, so it only allocates as many packets
+// as were out at once, however long playback goes on. The second pass over
+// the file is served from the pool.
+static void TestPacketReuse(const std::string& path, const TestMediaInfo& info)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 16, MemoryBudget);
+		demuxer.EnableStream(VideoStream);
+		demuxer.EnableStream(AudioStream);
+		demuxer.Start();
+
+		StreamConsumer video(demuxer, info, VideoStream);
+		StreamConsumer audio(demuxer, info, AudioStream);
+		const PacketPool& pool = demuxer.GetPacketPool();
+		uint64_t packets = info.packets[VideoStream].size() + info.packets[AudioStream].size();
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			if (pass > 0)
+			{
+				CHECK(demuxer.Seek(VideoStream, 0, AVSEEK_FLAG_BACKWARD) >= 0);
+				video.Reset();
+				audio.Reset();
+
+				// Brings the times of the consumers back to the start
+				video.Read(1);
+				audio.Read(1);
+			}
+
+			// One thread takes the packets of both streams in presentation
+			// order, like the renderers of a player do
+			while (!video.HasEnded() || !audio.HasEnded())
+			{
+				if (!audio.HasEnded() && (video.HasEnded() || audio.GetTime() <= video.GetTime()))
+				{
+					audio.Read(1);
+				}
+				else
+				{
+					video.Read(1);
+				}
+			}
+
+			CHECK(video.GetPacketCount() == static_cast<int>(info.packets[VideoStream].size()));
+			CHECK(audio.GetPacketCount() == static_cast<int>(info.packets[AudioStream].size()));
+			CHECK(pool.GetHitCount() + pool.GetMissCount() >= (pass + 1) * packets);
+			CHECK(pool.GetMissCount() <= GetMaxPacketsInFlight(demuxer, 1));
+		}
+
+		CHECK(pool.GetMissCount() < packets / 10);
+	}
+
+	avformat_close_input(&avFormatCtx);
+}
+
+// Consumers stop for every seek, as the sample providers do, and continue
+// without gaps from the new position. With a seek index, the seeks use it
+// if the format allows byte seeks.
+static void TestSeeks(const std::string& path, const TestMediaInfo& info, SeekIndex* seekIndex = nullptr)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 8, MemoryBudget);
+		demuxer.SetSeekIndex(seekIndex);
+		demuxer.EnableStream(VideoStream);
+		demuxer.EnableStream(AudioStream);
+		demuxer.Start();
+
+		StreamConsumer video(demuxer, info, VideoStream);
+		StreamConsumer audio(demuxer, info, AudioStream);
+
+		std::mt19937 random(42);
+		int64_t lastPts = info.packets[VideoStream].back().pts;
+		int64_t keyframeDistance = info.packets[VideoStream][12].pts;
+
+		for (int i = 0; i < 100; ++i)
+		{
+			int count = std::uniform_int_distribution<int>(0, 300)(random);
+			std::thread videoThread([&] { video.Read(count); });
+			std::thread audioThread([&] { audio.Read(count * 2); });
+			videoThread.join();
+			audioThread.join();
+
+			int64_t target = std::uniform_int_distribution<int64_t>(0, lastPts)(random);
+			int ret = demuxer.Seek(VideoStream, target, AVSEEK_FLAG_BACKWARD);
+			CHECK(ret >= 0);
+
+			video.Reset();
+			audio.Reset();
+
+			video.Read(1);
+			CHECK(video.GetPacketCount() == 1);
+			CHECK(video.GetFirstPts() <= target + keyframeDistance);
+		}
+
+		// The last seek reads on to the end
+		std::thread videoThread([&] { video.ReadToEnd(); });
+		std::thread audioThread([&] { audio.ReadToEnd(); });
+		videoThread.join();
+		audioThread.join();
+
+		CHECK(video.GetNextIndex() == static_cast<int>(info.packets[VideoStream].size()));
+
+		DemuxerStatistics statistics = demuxer.GetStatistics();
+		CHECK(statistics.seeks == 100);
+		if (!seekIndex || !FFmpegDemuxer::CanSeekToBytes(avFormatCtx->iformat))
+		{
+			CHECK(statistics.indexedSeeks == 0);
+		}
+		else
+		{
+			CHECK(statistics.indexedSeeks > 0);
+		}
+	}
+
+	avformat_close_input(&avFormatCtx);
+}
+
+// The background scan finds every keyframe of the stream, and the seeks
+// which use them land on the right packets.
+static void TestKeyframeScan(const std::string& path, const TestMediaInfo& info)
+{
+	{
+		// Canceled right away or finished, in any case without hanging.
+		SeekIndex seekIndex;
+		KeyframeScanner scanner(FileStreamBackend::Open(path.c_str()), nullptr, &seekIndex, VideoStream);
+		scanner.Start();
+		scanner.Cancel();
+		CHECK(scanner.GetResult() == 0 || scanner.GetResult() == AVERROR_EXIT);
+	}
+
+	SeekIndex seekIndex;
+	{
+		KeyframeScanner scanner(FileStreamBackend::Open(path.c_str()), nullptr, &seekIndex, VideoStream);
+		scanner.Start();
+		while (!scanner.IsFinished())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::vector<int64_t> keyframes;
+		for (auto& packet : info.packets[VideoStream])
+		{
+			if (packet.key)
+			{
+				keyframes.push_back(packet.pts);
+			}
+		}
+
+		CHECK(scanner.GetResult() == 0);
+		CHECK(scanner.GetKeyframeCount() == keyframes.size());
+		CHECK(seekIndex.GetKeyframeCount() == keyframes.size());
+
+		// Every keyframe but the last has a known successor.
+		for (size_t i = 0; i + 1 < keyframes.size(); ++i)
+		{
+			int64_t keyframeTimestamp = AV_NOPTS_VALUE;
+			int64_t keyframePosition = -1;
+			CHECK(seekIndex.FindKeyframe(VideoStream, keyframes[i + 1] - 1, keyframeTimestamp, keyframePosition));
+			CHECK(keyframeTimestamp == keyframes[i]);
+			CHECK(keyframePosition >= 0);
+		}
+	}
+
+	TestSeeks(path, info, &seekIndex);
+}
+
+// A consumer switches its own stream off and on while the other one reads.
+static void TestToggleStreams(const std::string& path, const TestMediaInfo& info)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	{
+		FFmpegDemuxer demuxer(avFormatCtx, 8, MemoryBudget);
+		demuxer.EnableStream(VideoStream);
+		demuxer.EnableStream(AudioStream);
+		demuxer.Start();
+
+		StreamConsumer video(demuxer, info, VideoStream);
+		StreamConsumer audio(demuxer, info, AudioStream);
+		StreamConsumer subtitles(demuxer, info, SubtitleStream);
+
+		std::thread videoThread([&] { video.ReadToEnd(); });
+		std::thread audioThread([&]
+		{
+			while (!audio.HasEnded())
+			{
+				// Packets are missing while the stream is off
+				audio.Read(100, false);
+				demuxer.DisableStream(AudioStream);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				demuxer.EnableStream(AudioStream);
+			}
+		});
+		std::thread subtitleThread([&]
+		{
+			demuxer.EnableStream(SubtitleStream);
+			subtitles.Read(3);
+			demuxer.DisableStream(SubtitleStream);
+		});
+
+		videoThread.join();
+		audioThread.join();
+		subtitleThread.join();
+
+		CHECK(video.GetPacketCount() == static_cast<int>(info.packets[VideoStream].size()));
+		CHECK(audio.GetPacketCount() > 0);
+	}
+
+	avformat_close_input(&avFormatCtx);
+}
+
+// Stopping the demuxer wakes consumers which wait for packets, and nothing
+// is leaked when it is destroyed with full queues.
+// An enabled subtitle stream with its packets seconds apart does not keep
+// the demuxer reading until the memory budget is full.
+static void TestSparseStream(const std::string& path, const TestMediaInfo& info)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	{
+		const size_t LargeBudget = 8 * 1024 * 1024;
+		const unsigned int ReadAheadPackets = 8;
+
+		FFmpegDemuxer demuxer(avFormatCtx, ReadAheadPackets, LargeBudget);
+		demuxer.EnableStream(VideoStream);
+		demuxer.EnableStream(AudioStream);
+		demuxer.EnableStream(SubtitleStream);
+		demuxer.Start();
+
+		// Wait until the demuxer has gone to sleep.
+		uint64_t packetsRead = 0;
+		for (int i = 0; i < 100; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			uint64_t current = demuxer.GetStatistics().packetsRead;
+			if (current > 0 && current == packetsRead)
+			{
+				break;
+			}
+			packetsRead = current;
+		}
+
+		CHECK(demuxer.GetQueueStatistics(VideoStream).packets >= ReadAheadPackets);
+		CHECK(demuxer.GetQueueStatistics(AudioStream).packets >= ReadAheadPackets);
+		CHECK(demuxer.GetQueuedBytes() < 2 * ReadAheadPackets * MaxVideoPacket);
+
+		// The subtitles still arrive when they are read.
+		StreamConsumer subtitles(demuxer, info, SubtitleStream);
+		subtitles.Read(1);
+		CHECK(subtitles.GetPacketCount() == 1);
+	}
+
+	avformat_close_input(&avFormatCtx);
+}
+
+static void TestStopWhileReading(const std::string& path, const TestMediaInfo& info)
+{
+	for (int i = 0; i < 20; ++i)
+	{
+		AVFormatContext* avFormatCtx = OpenTestMedia(path);
+		CHECK(avFormatCtx != nullptr);
+		if (!avFormatCtx)
+		{
+			return;
+		}
+
+		{
+			FFmpegDemuxer demuxer(avFormatCtx, 32, 0);
+			demuxer.EnableStream(VideoStream);
+			demuxer.EnableStream(AudioStream);
+			demuxer.EnableStream(SubtitleStream);
+			demuxer.Start();
+
+			StreamConsumer video(demuxer, info, VideoStream);
+			StreamConsumer subtitles(demuxer, info, SubtitleStream);
+
+			std::thread videoThread([&] { video.ReadToEnd(); });
+			std::thread subtitleThread([&] { subtitles.ReadToEnd(); });
+
+			std::this_thread::sleep_for(std::chrono::microseconds(200 * i));
+			demuxer.Stop();
+
+			videoThread.join();
+			subtitleThread.join();
+
+			CHECK(video.HasEnded());
+			CHECK(subtitles.HasEnded());
+		}
+
+		avformat_close_input(&avFormatCtx);
+	}
+}
+
+int main()
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::string path = GetTemporaryPath("DemuxerStressTest.nut");
+
+	TestMediaInfo info;
+	int ret = WriteTestMedia(path, "nut", GetStreams(), 60, info);
+	CHECK(ret >= 0);
+
+	if (ret >= 0)
+	{
+		TestReadsAllPackets(path, info);
+		TestPacketReuse(path, info);
+		TestSeeks(path, info);
+		TestKeyframeScan(path, info);
+		TestToggleStreams(path, info);
+		TestSparseStream(path, info);
+		TestStopWhileReading(path, info);
+	}
+
+	remove(path.c_str());
+
+	return TestResult("DemuxerStressTest");
+}
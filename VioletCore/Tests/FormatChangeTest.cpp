@@ -0,0 +1,211 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Decoding and converting a clip whose frame size changes.
+* File Name: FormatChangeTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "PixelConversion.h"
+#include "TestMedia.h"
+#include "TestUtilities.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// Sizes like those of an adaptive stream: up, down, to odd sizes which leave
+// a half chroma sample, and back to a size seen before.
+static const std::vector<TestVideoSegment> Segments =
+{
+	{ 640, 360, 5 },
+	{ 1280, 720, 5 },
+	{ 853, 481, 5 },
+	{ 640, 360, 5 },
+	{ 322, 182, 5 },
+};
+
+// Decodes all frames of the file and hands them to onFrame in order.
+// Return value:
+//   0 if successful, otherwise a negative AVERROR code.
+static int DecodeTestMedia(const std::string& path, const std::function<void(const AVFrame*)>& onFrame)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	if (!avFormatCtx)
+	{
+		return AVERROR(ENOENT);
+	}
+
+	const AVCodec* avCodec = avcodec_find_decoder(avFormatCtx->streams[0]->codecpar->codec_id);
+	AVCodecContext* avCodecCtx = avCodec ? avcodec_alloc_context3(avCodec) : nullptr;
+	AVPacket* avPacket = av_packet_alloc();
+	AVFrame* avFrame = av_frame_alloc();
+
+	int ret = avCodecCtx && avPacket && avFrame ? 0 : AVERROR(ENOMEM);
+	if (ret >= 0)
+	{
+		ret = avcodec_parameters_to_context(avCodecCtx, avFormatCtx->streams[0]->codecpar);
+	}
+	if (ret >= 0)
+	{
+		ret = avcodec_open2(avCodecCtx, avCodec, nullptr);
+	}
+
+	bool draining = false;
+	while (ret >= 0)
+	{
+		if (!draining)
+		{
+			ret = av_read_frame(avFormatCtx, avPacket);
+			if (ret == AVERROR_EOF)
+			{
+				draining = true;
+				ret = avcodec_send_packet(avCodecCtx, nullptr);
+			}
+			else if (ret >= 0)
+			{
+				ret = avcodec_send_packet(avCodecCtx, avPacket);
+				av_packet_unref(avPacket);
+			}
+		}
+
+		while (ret >= 0)
+		{
+			ret = avcodec_receive_frame(avCodecCtx, avFrame);
+			if (ret >= 0)
+			{
+				onFrame(avFrame);
+				av_frame_unref(avFrame);
+			}
+		}
+
+		if (ret == AVERROR(EAGAIN) && !draining)
+		{
+			ret = 0;
+		}
+	}
+
+	av_frame_free(&avFrame);
+	av_packet_free(&avPacket);
+	avcodec_free_context(&avCodecCtx);
+	avformat_close_input(&avFormatCtx);
+
+	return ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Every frame has the size of its segment and its own content, so no frame
+// of the previous size is returned after a switch and none is lost.
+static void TestSwitches(const std::string& path)
+{
+	std::vector<TestVideoSegment> expected;
+	for (auto& segment : Segments)
+	{
+		for (int i = 0; i < segment.frames; ++i)
+		{
+			expected.push_back(segment);
+		}
+	}
+
+	int frameIndex = 0;
+	int firstFormat = AV_PIX_FMT_NONE;
+	CHECK(DecodeTestMedia(path, [&](const AVFrame* avFrame)
+	{
+		if (frameIndex == 0)
+		{
+			firstFormat = avFrame->format;
+		}
+
+		CHECK(frameIndex < static_cast<int>(expected.size()));
+		if (frameIndex < static_cast<int>(expected.size()))
+		{
+			CHECK(avFrame->width == expected[frameIndex].width);
+			CHECK(avFrame->height == expected[frameIndex].height);
+		}
+		CHECK(avFrame->format == firstFormat);
+
+		// The frames are flat, which MJPEG codes almost without loss
+		int luma = avFrame->data[0][(avFrame->height / 2) * avFrame->linesize[0] + avFrame->width / 2];
+		CHECK(abs(luma - GetTestFrameLuma(frameIndex)) <= 2);
+
+		++frameIndex;
+	}) == 0);
+
+	CHECK(frameIndex == static_cast<int>(expected.size()));
+}
+
+// Every decoded frame converts to NV12 at its own size: the fast path in two
+// bands gives what sws_scale gives for the whole frame. The decoder outputs
+// full range 4:2:0, so both ranges of swscale are set to full.
+static void TestConversion(const std::string& path)
+{
+	int frames = 0;
+	CHECK(DecodeTestMedia(path, [&](const AVFrame* avFrame)
+	{
+		auto format = static_cast<AVPixelFormat>(avFrame->format);
+		int width = avFrame->width;
+		int height = avFrame->height;
+
+		PixelConversionFunction convert = GetPixelConversion(format, AV_PIX_FMT_NV12);
+		CHECK(convert != nullptr);
+		if (!convert)
+		{
+			return;
+		}
+
+		int size = av_image_get_buffer_size(AV_PIX_FMT_NV12, width, height, 1);
+		std::vector<uint8_t> fast(size, 0);
+		std::vector<uint8_t> scaled(size, 0);
+		uint8_t* fastData[4];
+		uint8_t* scaledData[4];
+		int linesize[4];
+		av_image_fill_arrays(fastData, linesize, fast.data(), AV_PIX_FMT_NV12, width, height, 1);
+		av_image_fill_arrays(scaledData, linesize, scaled.data(), AV_PIX_FMT_NV12, width, height, 1);
+
+		int bandHeight = FFALIGN(height / 2, 2);
+		convert(avFrame->data, avFrame->linesize, fastData, linesize, width, 0, bandHeight);
+		convert(avFrame->data, avFrame->linesize, fastData, linesize, width, bandHeight, height - bandHeight);
+
+		SwsContext* swsCtx = sws_getContext(width, height, format, width, height, AV_PIX_FMT_NV12, SWS_BICUBIC, nullptr, nullptr, nullptr);
+		CHECK(swsCtx != nullptr);
+		if (swsCtx)
+		{
+			const int* coefficients = sws_getCoefficients(SWS_CS_DEFAULT);
+			sws_setColorspaceDetails(swsCtx, coefficients, 1, coefficients, 1, 0, 1 << 16, 1 << 16);
+			sws_scale(swsCtx, avFrame->data, avFrame->linesize, 0, height, scaledData, linesize);
+			sws_freeContext(swsCtx);
+		}
+
+		CHECK(memcmp(fast.data(), scaled.data(), size) == 0);
+		++frames;
+	}) == 0);
+
+	CHECK(frames > 0);
+}
+
+int main()
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::string path = GetTemporaryPath("FormatChangeTest.nut");
+	int ret = WriteVideoTestMedia(path, "nut", Segments, { 25, 1 });
+	CHECK(ret == 0);
+	if (ret == 0)
+	{
+		TestSwitches(path);
+		TestConversion(path);
+	}
+
+	remove(path.c_str());
+
+	return TestResult("FormatChangeTest");
+}
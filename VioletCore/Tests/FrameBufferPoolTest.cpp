@@ -0,0 +1,126 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the recycling pool of decoder frame buffers.
+* File Name: FrameBufferPoolTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "FrameBufferPool.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// A released buffer comes back for the next frame of the same size.
+static void TestReuse()
+{
+	FrameBufferPool pool;
+	CHECK(pool.GetBufferSize() == 0);
+
+	AVBufferRef* first = pool.Get(4096);
+	CHECK(first != nullptr && first->size >= 4096);
+	CHECK(pool.GetBufferSize() == 4096);
+	uint8_t* data = first->data;
+	memset(first->data, 0x5a, 4096);
+	av_buffer_unref(&first);
+
+	AVBufferRef* second = pool.Get(4096);
+	CHECK(second != nullptr && second->data == data);
+
+	// The first one is still out, so the next one is another buffer.
+	AVBufferRef* third = pool.Get(4096);
+	CHECK(third != nullptr && third->data != data);
+
+	av_buffer_unref(&second);
+	av_buffer_unref(&third);
+}
+
+// A new frame size replaces the pool, the frames of the old size stay valid
+// until they are released, also after the pool itself is gone.
+static void TestSizeChange()
+{
+	AVBufferRef* small;
+	AVBufferRef* large;
+	{
+		FrameBufferPool pool;
+		small = pool.Get(1024);
+		CHECK(small != nullptr);
+		memset(small->data, 1, 1024);
+
+		large = pool.Get(8192);
+		CHECK(large != nullptr && large->size >= 8192);
+		CHECK(pool.GetBufferSize() == 8192);
+		memset(large->data, 2, 8192);
+
+		AVBufferRef* again = pool.Get(1024);
+		CHECK(again != nullptr && again->size >= 1024);
+		CHECK(pool.GetBufferSize() == 1024);
+		av_buffer_unref(&again);
+	}
+
+	CHECK(small->data[1023] == 1);
+	CHECK(large->data[8191] == 2);
+	av_buffer_unref(&small);
+	av_buffer_unref(&large);
+}
+
+// Frame threads request buffers concurrently, also while the size changes.
+static void TestConcurrent()
+{
+	const int Threads = 4;
+	const int Frames = 2000;
+
+	FrameBufferPool pool;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; ++t)
+	{
+		threads.emplace_back([&pool, t]
+		{
+			std::vector<AVBufferRef*> held;
+			for (int i = 0; i < Frames; ++i)
+			{
+				int size = (i / 500) % 2 ? 2048 : 1024;
+				AVBufferRef* buffer = pool.Get(size);
+				CHECK(buffer != nullptr && buffer->size >= size);
+				if (!buffer)
+				{
+					continue;
+				}
+
+				memset(buffer->data, t, size);
+				held.push_back(buffer);
+
+				// Keep a few frames, like samples waiting for the renderer.
+				if (held.size() > 3)
+				{
+					CHECK(held.front()->data[0] == t);
+					av_buffer_unref(&held.front());
+					held.erase(held.begin());
+				}
+			}
+
+			for (auto buffer : held)
+			{
+				av_buffer_unref(&buffer);
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+int main()
+{
+	TestReuse();
+	TestSizeChange();
+	TestConcurrent();
+
+	return TestResult("FrameBufferPoolTest");
+}
@@ -0,0 +1,267 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the playback position estimate and of what late video
+*              leaves out to catch up.
+* File Name: FrameDropPolicyTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <stdio.h>
+
+#include "FrameDropPolicy.h"
+#include "PresentationClock.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// 25 and 60 frames per second, in 100 ns units
+static const int64_t Frame25 = 400000;
+static const int64_t Frame60 = 166667;
+static const int64_t Millisecond = 10000;
+
+// Any start, the clock only uses differences
+static const int64_t Start = 123456789000;
+
+// Samples which are delivered right when they are shown are not late, ones
+// which take two frames to decode fall behind by a frame each.
+static void TestClockLateness()
+{
+	PresentationClock clock;
+	int64_t lateness = 0;
+	CHECK(!clock.GetLateness(0, Start, lateness));
+
+	// Nothing to estimate from before the first delivery
+	clock.OnRequest(Start);
+	clock.OnDeliver(0, Frame25, Start);
+	for (int i = 1; i <= 10; ++i)
+	{
+		int64_t now = Start + i * Frame25;
+		clock.OnRequest(now - Millisecond);
+		clock.OnDeliver(i * Frame25, Frame25, now);
+		CHECK(clock.GetLateness(i * Frame25, now, lateness));
+		CHECK(lateness == 0);
+	}
+
+	CHECK(clock.GetLateness(10 * Frame25, Start + 10 * Frame25 - 3 * Frame25, lateness));
+	CHECK(lateness == -3 * Frame25);
+	CHECK(clock.GetPauses() == 0);
+
+	clock.Reset();
+	CHECK(!clock.GetLateness(0, Start, lateness));
+
+	clock.OnDeliver(0, Frame25, Start);
+	for (int i = 1; i <= 5; ++i)
+	{
+		int64_t now = Start + 2 * i * Frame25;
+		clock.OnRequest(now - 2 * Frame25);
+		clock.OnDeliver(i * Frame25, Frame25, now);
+	}
+
+	CHECK(clock.GetLateness(5 * Frame25, Start + 10 * Frame25, lateness));
+	CHECK(lateness == 5 * Frame25);
+}
+
+// A long gap before the next request is a pause and does not count as time
+// played, apart from the frame shown meanwhile.
+static void TestClockPause()
+{
+	PresentationClock clock;
+	int64_t lateness = 0;
+
+	clock.OnDeliver(0, Frame25, Start);
+	int64_t resume = Start + 30000000;
+	clock.OnRequest(resume);
+	CHECK(clock.GetPauses() == 1);
+
+	clock.OnDeliver(Frame25, Frame25, resume + Millisecond);
+	CHECK(clock.GetLateness(Frame25, resume, lateness));
+	CHECK(lateness == 0);
+
+	// A gap below 2.5 s, and below four frames, is not a pause
+	clock.OnRequest(resume + 2 * Frame25);
+	clock.OnDeliver(2 * Frame25, Frame25, resume + 2 * Frame25);
+	CHECK(clock.GetPauses() == 1);
+
+	// Pauses are counted across seeks
+	clock.Reset();
+	CHECK(clock.GetPauses() == 1);
+}
+
+// When the renderer waited before it asked for a sample, that sample was in
+// time, so an estimate which ran ahead is pulled back to it.
+static void TestClockRendererWaited()
+{
+	PresentationClock clock;
+	int64_t lateness = 0;
+
+	// Playback started three frames after the first sample was delivered
+	clock.OnDeliver(0, Frame25, Start);
+	clock.OnRequest(Start + 3 * Frame25);
+	clock.OnDeliver(Frame25, Frame25, Start + 3 * Frame25);
+	CHECK(clock.GetLateness(Frame25, Start + 3 * Frame25, lateness));
+	CHECK(lateness == 0);
+
+	// Without the wait, the estimate stays, the sample is late
+	clock.OnRequest(Start + 3 * Frame25 + Millisecond);
+	clock.OnDeliver(2 * Frame25, Frame25, Start + 6 * Frame25);
+	CHECK(clock.GetLateness(2 * Frame25, Start + 6 * Frame25, lateness));
+	CHECK(lateness == 2 * Frame25);
+}
+
+// Two frames but at least 50 ms, 200 ms and 1 s.
+static void TestLevelThresholds()
+{
+	const int64_t Ms50 = 50 * Millisecond;
+	const int64_t Ms200 = 200 * Millisecond;
+	const int64_t Second = 1000 * Millisecond;
+
+	CHECK(FrameDropPolicy::GetLevelForLateness(-Second, Frame60) == FrameDropPolicy::DropNone);
+	CHECK(FrameDropPolicy::GetLevelForLateness(Ms50, Frame60) == FrameDropPolicy::DropNone);
+	CHECK(FrameDropPolicy::GetLevelForLateness(Ms50 + 1, Frame60) == FrameDropPolicy::SkipNonReferenceFrames);
+
+	// Two frames of 25 fps are 80 ms
+	CHECK(FrameDropPolicy::GetLevelForLateness(Ms50 + 1, Frame25) == FrameDropPolicy::DropNone);
+	CHECK(FrameDropPolicy::GetLevelForLateness(2 * Frame25, Frame25) == FrameDropPolicy::DropNone);
+	CHECK(FrameDropPolicy::GetLevelForLateness(2 * Frame25 + 1, Frame25) == FrameDropPolicy::SkipNonReferenceFrames);
+
+	CHECK(FrameDropPolicy::GetLevelForLateness(Ms200, Frame25) == FrameDropPolicy::SkipNonReferenceFrames);
+	CHECK(FrameDropPolicy::GetLevelForLateness(Ms200 + 1, Frame25) == FrameDropPolicy::DropLateFrames);
+	CHECK(FrameDropPolicy::GetLevelForLateness(Second, Frame25) == FrameDropPolicy::DropLateFrames);
+	CHECK(FrameDropPolicy::GetLevelForLateness(Second + 1, Frame25) == FrameDropPolicy::SkipToKeyframe);
+}
+
+// The level rises right away and falls below half of its threshold.
+static void TestLevelRecovery()
+{
+	FrameDropPolicy policy;
+	CHECK(policy.GetLevel() == FrameDropPolicy::DropNone);
+
+	struct Step
+	{
+		int64_t lateness;
+		FrameDropPolicy::Level level;
+	};
+
+	const Step steps[] =
+	{
+		{ 60 * Millisecond, FrameDropPolicy::SkipNonReferenceFrames },
+		{ 30 * Millisecond, FrameDropPolicy::SkipNonReferenceFrames },
+		{ 1500 * Millisecond, FrameDropPolicy::SkipToKeyframe },
+		{ 600 * Millisecond, FrameDropPolicy::SkipToKeyframe },
+		{ 400 * Millisecond, FrameDropPolicy::DropLateFrames },
+		{ 150 * Millisecond, FrameDropPolicy::DropLateFrames },
+		{ 90 * Millisecond, FrameDropPolicy::SkipNonReferenceFrames },
+		{ 26 * Millisecond, FrameDropPolicy::SkipNonReferenceFrames },
+		{ 20 * Millisecond, FrameDropPolicy::DropNone },
+		{ -1000 * Millisecond, FrameDropPolicy::DropNone },
+	};
+
+	int64_t position = 0;
+	for (const Step& step : steps)
+	{
+		policy.OnDeliver(position, step.lateness, Frame60);
+		position += Frame60;
+
+		if (policy.GetLevel() != step.level)
+		{
+			fprintf(stderr, "lateness %lld: level %d, expected %d\n", static_cast<long long>(step.lateness), policy.GetLevel(), step.level);
+		}
+		CHECK(policy.GetLevel() == step.level);
+	}
+
+	policy.OnDeliver(position, 300 * Millisecond, Frame60);
+	CHECK(policy.GetLevel() == FrameDropPolicy::DropLateFrames);
+	policy.Reset();
+	CHECK(policy.GetLevel() == FrameDropPolicy::DropNone);
+}
+
+// Decoded frames are only dropped from 200 ms on, and never keyframes or
+// frames which are in time. Below that the decoder skips the frames no other
+// frame refers to.
+static void TestDropDecisions()
+{
+	FrameDropPolicy policy;
+
+	policy.OnDeliver(0, 100 * Millisecond, Frame25);
+	CHECK(policy.GetLevel() == FrameDropPolicy::SkipNonReferenceFrames);
+	CHECK(!policy.ShouldDrop(false, 100 * Millisecond));
+
+	policy.OnDeliver(Frame25, 300 * Millisecond, Frame25);
+	CHECK(policy.GetLevel() == FrameDropPolicy::DropLateFrames);
+	CHECK(policy.ShouldDrop(false, 1));
+	CHECK(!policy.ShouldDrop(true, 300 * Millisecond));
+	CHECK(!policy.ShouldDrop(false, 0));
+	CHECK(!policy.ShouldDrop(false, -Frame25));
+
+	CHECK(FrameDropPolicy::GetSkipFrame(FrameDropPolicy::DropNone) == AVDISCARD_DEFAULT);
+	CHECK(FrameDropPolicy::GetSkipLoopFilter(FrameDropPolicy::DropNone) == AVDISCARD_DEFAULT);
+	CHECK(FrameDropPolicy::GetSkipFrame(FrameDropPolicy::SkipNonReferenceFrames) == AVDISCARD_NONREF);
+	CHECK(FrameDropPolicy::GetSkipLoopFilter(FrameDropPolicy::SkipNonReferenceFrames) == AVDISCARD_DEFAULT);
+	CHECK(FrameDropPolicy::GetSkipFrame(FrameDropPolicy::DropLateFrames) == AVDISCARD_NONREF);
+	CHECK(FrameDropPolicy::GetSkipLoopFilter(FrameDropPolicy::DropLateFrames) == AVDISCARD_NONKEY);
+	CHECK(FrameDropPolicy::GetSkipFrame(FrameDropPolicy::SkipToKeyframe) == AVDISCARD_NONREF);
+	CHECK(FrameDropPolicy::GetSkipLoopFilter(FrameDropPolicy::SkipToKeyframe) == AVDISCARD_ALL);
+
+	AVFrame* avFrame = av_frame_alloc();
+	CHECK(!FrameDropPolicy::IsKeyframe(avFrame));
+#ifdef AV_FRAME_FLAG_KEY
+	avFrame->flags |= AV_FRAME_FLAG_KEY;
+#else
+	avFrame->key_frame = 1;
+#endif
+	CHECK(FrameDropPolicy::IsKeyframe(avFrame));
+	av_frame_free(&avFrame);
+}
+
+// Beyond 1 s decoding skips to the next keyframe. Samples decoded ahead
+// before that keyframe do not ask for another skip, samples after it do
+// while they are still that late.
+static void TestSkipToKeyframe()
+{
+	FrameDropPolicy policy;
+	const int64_t Late = 1500 * Millisecond;
+
+	CHECK(!policy.TakeSkipRequest());
+	policy.OnDeliver(0, Late, Frame25);
+	CHECK(policy.GetLevel() == FrameDropPolicy::SkipToKeyframe);
+	CHECK(policy.TakeSkipRequest());
+	CHECK(!policy.TakeSkipRequest());
+
+	// Decoded before the skip, and the skip did not end yet
+	policy.OnDeliver(Frame25, Late, Frame25);
+	CHECK(!policy.TakeSkipRequest());
+
+	policy.OnSkipEnd(50 * Frame25);
+	policy.OnDeliver(2 * Frame25, Late, Frame25);
+	CHECK(!policy.TakeSkipRequest());
+
+	// The keyframe is still far behind
+	policy.OnDeliver(50 * Frame25, Late, Frame25);
+	CHECK(policy.TakeSkipRequest());
+
+	// The next skip caught up
+	policy.OnSkipEnd(100 * Frame25);
+	policy.OnDeliver(100 * Frame25, 100 * Millisecond, Frame25);
+	CHECK(!policy.TakeSkipRequest());
+	CHECK(policy.GetLevel() == FrameDropPolicy::SkipNonReferenceFrames);
+
+	// A seek forgets a pending request
+	policy.OnDeliver(101 * Frame25, Late, Frame25);
+	policy.Reset();
+	CHECK(!policy.TakeSkipRequest());
+	CHECK(policy.GetLevel() == FrameDropPolicy::DropNone);
+}
+
+int main()
+{
+	TestClockLateness();
+	TestClockPause();
+	TestClockRendererWaited();
+	TestLevelThresholds();
+	TestLevelRecovery();
+	TestDropDecisions();
+	TestSkipToKeyframe();
+
+	return TestResult("FrameDropPolicyTest");
+}
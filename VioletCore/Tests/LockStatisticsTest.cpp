@@ -0,0 +1,174 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the wait and hold times of the timed stream locks.
+* File Name: LockStatisticsTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "LockStatistics.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static const long long Millisecond = 10000;
+
+// Stands in for CritSec, whose Lock and Unlock calls it counts
+class TestLock
+{
+public:
+	TestLock()
+		: locks(0)
+		, unlocks(0)
+	{
+	}
+
+	void Lock()
+	{
+		m_mutex.lock();
+		locks++;
+	}
+
+	void Unlock()
+	{
+		unlocks++;
+		m_mutex.unlock();
+	}
+
+	std::atomic<int> locks;
+	std::atomic<int> unlocks;
+
+private:
+	std::mutex m_mutex;
+};
+
+// A stream of the media source, with its sample lock and the statistics of it
+struct TestStream
+{
+	TestLock sampleLock;
+	LockStatistics sampleLockStatistics;
+};
+
+// Holds the lock of a stream on another thread for a while, like a sample
+// request which decodes.
+static std::thread HoldLock(TestStream& stream, std::chrono::milliseconds duration, std::atomic<bool>& locked)
+{
+	return std::thread([&stream, duration, &locked]
+	{
+		TimedLock<TestLock> lock(stream.sampleLock, stream.sampleLockStatistics);
+		locked = true;
+		std::this_thread::sleep_for(duration);
+	});
+}
+
+// Who waits for a held lock sees it in the wait time, who holds it in the
+// hold time.
+static void TestWaitAndHoldTime()
+{
+	TestStream stream;
+	std::atomic<bool> locked(false);
+	std::thread holder = HoldLock(stream, std::chrono::milliseconds(100), locked);
+	while (!locked)
+	{
+		std::this_thread::yield();
+	}
+
+	{
+		TimedLock<TestLock> lock(stream.sampleLock, stream.sampleLockStatistics);
+		CHECK(lock.OwnsLock());
+	}
+
+	holder.join();
+
+	CHECK(stream.sampleLockStatistics.acquisitions == 2);
+	CHECK(stream.sampleLockStatistics.waitTime >= 50 * Millisecond);
+	CHECK(stream.sampleLockStatistics.holdTime >= 100 * Millisecond);
+	CHECK(stream.sampleLock.locks == 2);
+	CHECK(stream.sampleLock.unlocks == 2);
+}
+
+// Without a lock TimedLock neither locks nor unlocks anything, nor counts.
+static void TestDeferred()
+{
+	TestStream stream;
+	{
+		TimedLock<TestLock> lock;
+		CHECK(!lock.OwnsLock());
+	}
+
+	CHECK(stream.sampleLock.locks == 0);
+	CHECK(stream.sampleLock.unlocks == 0);
+
+	{
+		TimedLock<TestLock> lock;
+		lock.Lock(stream.sampleLock, stream.sampleLockStatistics);
+		CHECK(lock.OwnsLock());
+		CHECK(stream.sampleLock.locks == 1);
+		CHECK(stream.sampleLock.unlocks == 0);
+	}
+
+	CHECK(stream.sampleLock.unlocks == 1);
+	CHECK(stream.sampleLockStatistics.acquisitions == 1);
+}
+
+// Every stream has its own lock: a request which decodes video does not
+// hold up one for audio. A seek takes the locks of the streams there are,
+// like FFmpegInteropMSS::Seek, and waits for the request which decodes.
+static void TestStreamLockSplit()
+{
+	TestStream video;
+	TestStream audio;
+	std::atomic<bool> locked(false);
+	std::thread videoRequest = HoldLock(video, std::chrono::milliseconds(300), locked);
+	while (!locked)
+	{
+		std::this_thread::yield();
+	}
+
+	{
+		TimedLock<TestLock> audioRequest(audio.sampleLock, audio.sampleLockStatistics);
+	}
+
+	CHECK(video.sampleLock.unlocks == 0);
+	CHECK(audio.sampleLockStatistics.waitTime < 150 * Millisecond);
+
+	TestStream* currentAudioStream = nullptr;
+	TestStream* videoStream = &video;
+	{
+		TimedLock<TestLock> audioLock;
+		TimedLock<TestLock> videoLock;
+		if (currentAudioStream != nullptr)
+		{
+			audioLock.Lock(currentAudioStream->sampleLock, currentAudioStream->sampleLockStatistics);
+		}
+		if (videoStream != nullptr)
+		{
+			videoLock.Lock(videoStream->sampleLock, videoStream->sampleLockStatistics);
+		}
+
+		CHECK(!audioLock.OwnsLock());
+		CHECK(videoLock.OwnsLock());
+		CHECK(video.sampleLock.unlocks == 1);
+	}
+
+	videoRequest.join();
+
+	CHECK(audio.sampleLockStatistics.acquisitions == 1);
+	CHECK(video.sampleLockStatistics.acquisitions == 2);
+	CHECK(video.sampleLockStatistics.waitTime >= 100 * Millisecond);
+	CHECK(video.sampleLock.unlocks == 2);
+}
+
+int main()
+{
+	TestWaitAndHoldTime();
+	TestDeferred();
+	TestStreamLockSplit();
+
+	return TestResult("LockStatisticsTest");
+}
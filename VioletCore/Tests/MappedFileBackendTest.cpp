@@ -0,0 +1,143 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the memory-mapped file backend.
+* File Name: MappedFileBackendTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+#include "MappedFileBackend.h"
+#include "TestMedia.h"
+#include "TestUtilities.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static const size_t FileSize = 24 * 1024 * 1024 + 123;
+
+static std::vector<uint8_t> WriteTestFile(const std::string& path)
+{
+	std::vector<uint8_t> content(FileSize);
+	for (size_t i = 0; i < content.size(); ++i)
+	{
+		content[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	CHECK(file != nullptr);
+	if (file)
+	{
+		CHECK(fwrite(content.data(), 1, content.size(), file) == content.size());
+		fclose(file);
+	}
+
+	return content;
+}
+
+static bool ReadAt(MappedFileBackend& backend, const std::vector<uint8_t>& content, int64_t position, int size)
+{
+	std::vector<uint8_t> buffer(size);
+	if (backend.Seek(position) != position)
+	{
+		return false;
+	}
+
+	int total = 0;
+	while (total < size)
+	{
+		int ret = backend.Read(buffer.data() + total, size - total);
+		if (ret <= 0)
+		{
+			break;
+		}
+		total += ret;
+	}
+
+	int64_t expected = std::min<int64_t>(size, static_cast<int64_t>(content.size()) - position);
+	return total == expected && std::equal(buffer.begin(), buffer.begin() + total, content.begin() + static_cast<size_t>(position));
+}
+
+// Forward playback, reverse playback stepping back through the file and
+// random seeks all read the file content.
+static void TestReadPatterns(const std::string& path, const std::vector<uint8_t>& content)
+{
+	std::unique_ptr<MappedFileBackend> backend(MappedFileBackend::Open(path.c_str()));
+	CHECK(backend != nullptr);
+	if (!backend)
+	{
+		return;
+	}
+
+	CHECK(backend->GetSize() == static_cast<int64_t>(content.size()));
+
+	CHECK(ReadAt(*backend, content, 0, static_cast<int>(content.size())));
+
+	uint8_t byte;
+	CHECK(backend->Read(&byte, 1) == 0);
+
+	const int64_t Step = 1024 * 1024 + 17;
+	for (int64_t position = content.size() - Step; position > 0; position -= Step)
+	{
+		CHECK(ReadAt(*backend, content, position, 300 * 1024));
+	}
+
+	// Forward again, over more than a prefetch window.
+	CHECK(ReadAt(*backend, content, 1000, 12 * 1024 * 1024));
+
+	for (int i = 0; i < 100; ++i)
+	{
+		int64_t position = (static_cast<int64_t>(i) * 7919 * 4099) % content.size();
+		CHECK(ReadAt(*backend, content, position, 5000));
+	}
+}
+
+#ifndef _WIN32
+// A file which shrinks under the mapping makes Read fail instead of
+// crashing with SIGBUS.
+static void TestTruncatedFile(const std::string& path)
+{
+	std::unique_ptr<MappedFileBackend> backend(MappedFileBackend::Open(path.c_str()));
+	CHECK(backend != nullptr);
+	if (!backend)
+	{
+		return;
+	}
+
+	CHECK(truncate(path.c_str(), 4096) == 0);
+
+	std::vector<uint8_t> buffer(4096);
+	CHECK(backend->Read(buffer.data(), 4096) == 4096);
+
+	CHECK(backend->Seek(FileSize / 2) == static_cast<int64_t>(FileSize / 2));
+	CHECK(backend->Read(buffer.data(), 4096) == AVERROR(EIO));
+
+	// Still usable and failing the same way.
+	CHECK(backend->Seek(FileSize - 100) == static_cast<int64_t>(FileSize - 100));
+	CHECK(backend->Read(buffer.data(), 100) == AVERROR(EIO));
+	CHECK(backend->Seek(0) == 0);
+	CHECK(backend->Read(buffer.data(), 4096) == 4096);
+}
+#endif
+
+int main()
+{
+	std::string path = GetTemporaryPath("MappedFileBackendTest.bin");
+	std::vector<uint8_t> content = WriteTestFile(path);
+
+	TestReadPatterns(path, content);
+#ifndef _WIN32
+	TestTruncatedFile(path);
+#endif
+
+	remove(path.c_str());
+
+	return TestResult("MappedFileBackendTest");
+}
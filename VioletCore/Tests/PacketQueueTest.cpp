@@ -0,0 +1,245 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the lock-free packet queue.
+* File Name: PacketQueueTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <thread>
+#include <vector>
+
+#include "PacketQueue.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static AVPacket* CreatePacket(PacketPool& pool, int64_t pts, int size)
+{
+	AVPacket* avPacket = pool.Acquire();
+	CHECK(avPacket != nullptr);
+	if (avPacket)
+	{
+		avPacket->pts = pts;
+		avPacket->size = size;
+	}
+
+	return avPacket;
+}
+
+static void TestCapacity()
+{
+	PacketPool pool;
+
+	CHECK(PacketQueue(0, pool).GetCapacity() == 2);
+	CHECK(PacketQueue(1, pool).GetCapacity() == 2);
+	CHECK(PacketQueue(2, pool).GetCapacity() == 2);
+	CHECK(PacketQueue(5, pool).GetCapacity() == 8);
+	CHECK(PacketQueue(64, pool).GetCapacity() == 64);
+	CHECK(PacketQueue(65, pool).GetCapacity() == 128);
+}
+
+static void TestEmpty()
+{
+	PacketPool pool;
+	PacketQueue queue(4, pool);
+
+	CHECK(queue.IsEmpty());
+	CHECK(queue.GetCount() == 0);
+	CHECK(queue.GetBytes() == 0);
+	CHECK(queue.Pop() == nullptr);
+
+	// Drained back to empty, nothing left behind.
+	CHECK(queue.Push(CreatePacket(pool, 1, 10)));
+	AVPacket* avPacket = queue.Pop();
+	CHECK(avPacket != nullptr && avPacket->pts == 1);
+	pool.Release(avPacket);
+
+	CHECK(queue.IsEmpty());
+	CHECK(queue.GetBytes() == 0);
+	CHECK(queue.Pop() == nullptr);
+}
+
+static void TestFull()
+{
+	PacketPool pool;
+	PacketQueue queue(4, pool);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		CHECK(queue.Push(CreatePacket(pool, i, 100)));
+	}
+
+	CHECK(queue.GetCount() == 4);
+	CHECK(queue.GetBytes() == 400);
+
+	// A full queue refuses the packet, the caller still owns it.
+	AVPacket* rejected = CreatePacket(pool, 4, 100);
+	CHECK(!queue.Push(rejected));
+	CHECK(queue.GetCount() == 4);
+	CHECK(queue.GetBytes() == 400);
+
+	// One slot free again, the rejected packet fits and comes out last.
+	AVPacket* avPacket = queue.Pop();
+	CHECK(avPacket != nullptr && avPacket->pts == 0);
+	pool.Release(avPacket);
+	CHECK(queue.Push(rejected));
+	rejected = CreatePacket(pool, 5, 100);
+	CHECK(!queue.Push(rejected));
+	pool.Release(rejected);
+
+	for (int i = 1; i <= 4; ++i)
+	{
+		avPacket = queue.Pop();
+		CHECK(avPacket != nullptr && avPacket->pts == i);
+		pool.Release(avPacket);
+	}
+
+	CHECK(queue.IsEmpty());
+}
+
+// The indices run around the ring many times with every fill level.
+static void TestWrapAround()
+{
+	PacketPool pool;
+	PacketQueue queue(4, pool);
+
+	int64_t nextPush = 0;
+	int64_t nextPop = 0;
+	size_t bytes = 0;
+
+	for (int round = 0; round < 1000; ++round)
+	{
+		int pushes = 1 + round % 4;
+		for (int i = 0; i < pushes; ++i)
+		{
+			int size = static_cast<int>(nextPush % 7) + 1;
+			AVPacket* avPacket = CreatePacket(pool, nextPush, size);
+			if (!queue.Push(avPacket))
+			{
+				pool.Release(avPacket);
+				break;
+			}
+
+			++nextPush;
+			bytes += size;
+		}
+
+		CHECK(queue.GetCount() == static_cast<size_t>(nextPush - nextPop));
+		CHECK(queue.GetBytes() == bytes);
+
+		int pops = 1 + (round * 7) % 4;
+		for (int i = 0; i < pops; ++i)
+		{
+			AVPacket* avPacket = queue.Pop();
+			if (!avPacket)
+			{
+				CHECK(nextPop == nextPush);
+				break;
+			}
+
+			CHECK(avPacket->pts == nextPop);
+			bytes -= avPacket->size;
+			++nextPop;
+			pool.Release(avPacket);
+		}
+
+		CHECK(queue.GetCount() == static_cast<size_t>(nextPush - nextPop));
+		CHECK(queue.GetBytes() == bytes);
+	}
+
+	CHECK(nextPop > 1000);
+}
+
+// Clear and the destructor return the packets to the pool.
+static void TestClear()
+{
+	PacketPool pool;
+
+	{
+		PacketQueue queue(8, pool);
+		for (int i = 0; i < 6; ++i)
+		{
+			CHECK(queue.Push(CreatePacket(pool, i, 10)));
+		}
+
+		queue.Clear();
+		CHECK(queue.IsEmpty());
+		CHECK(queue.GetBytes() == 0);
+
+		for (int i = 0; i < 6; ++i)
+		{
+			CHECK(queue.Push(CreatePacket(pool, i, 10)));
+		}
+		CHECK(pool.GetMissCount() == 6);
+		CHECK(pool.GetHitCount() == 6);
+	}
+
+	for (int i = 0; i < 6; ++i)
+	{
+		pool.Release(CreatePacket(pool, i, 10));
+	}
+	CHECK(pool.GetMissCount() == 6);
+	CHECK(pool.GetHitCount() == 12);
+}
+
+// One producer and one consumer thread, the packets arrive complete and in
+// order while the queue is full and empty a lot of times.
+static void TestConcurrent()
+{
+	const int64_t Count = 200000;
+
+	PacketPool pool;
+	PacketQueue queue(16, pool);
+
+	std::thread producer([&]
+	{
+		for (int64_t i = 0; i < Count; ++i)
+		{
+			AVPacket* avPacket = CreatePacket(pool, i, static_cast<int>(i % 100));
+			while (!queue.Push(avPacket))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	int64_t next = 0;
+	while (next < Count)
+	{
+		AVPacket* avPacket = queue.Pop();
+		if (!avPacket)
+		{
+			CHECK(queue.GetCount() <= queue.GetCapacity());
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (avPacket->pts != next || avPacket->size != static_cast<int>(next % 100))
+		{
+			CHECK(avPacket->pts == next);
+			CHECK(avPacket->size == static_cast<int>(next % 100));
+			next = avPacket->pts;
+		}
+
+		++next;
+		pool.Release(avPacket);
+	}
+
+	producer.join();
+
+	CHECK(queue.IsEmpty());
+	CHECK(queue.GetBytes() == 0);
+}
+
+int main()
+{
+	TestCapacity();
+	TestEmpty();
+	TestFull();
+	TestWrapAround();
+	TestClear();
+	TestConcurrent();
+
+	return TestResult("PacketQueueTest");
+}
@@ -0,0 +1,396 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the pixel format conversions against swscale.
+* File Name: PixelConversionTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <initializer_list>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "PixelConversion.h"
+#include "TestUtilities.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// A picture with padded lines, filled with random values of the format's
+// bit depth.
+class TestPicture
+{
+public:
+	TestPicture(AVPixelFormat format, int width, int height, int padding, std::mt19937& random)
+		: m_format(format)
+		, m_width(width)
+		, m_height(height)
+	{
+		const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+		CHECK(av_image_fill_linesizes(m_linesize, format, width) >= 0);
+
+		int depth = descriptor->comp[0].depth;
+		int shift = descriptor->comp[0].shift;
+		std::uniform_int_distribution<int> values(0, (1 << depth) - 1);
+
+		for (int plane = 0; plane < 4; ++plane)
+		{
+			if (m_linesize[plane] == 0)
+			{
+				m_data[plane] = nullptr;
+				continue;
+			}
+
+			m_linesize[plane] += padding;
+			int rows = plane == 0 ? height : -((-height) >> descriptor->log2_chroma_h);
+			m_planes[plane].resize(static_cast<size_t>(m_linesize[plane]) * rows);
+
+			if (depth > 8)
+			{
+				uint16_t* words = reinterpret_cast<uint16_t*>(m_planes[plane].data());
+				for (size_t i = 0; i < m_planes[plane].size() / 2; ++i)
+				{
+					words[i] = static_cast<uint16_t>(values(random) << shift);
+				}
+			}
+			else
+			{
+				for (auto& value : m_planes[plane])
+				{
+					value = static_cast<uint8_t>(values(random));
+				}
+			}
+
+			m_data[plane] = m_planes[plane].data();
+		}
+	}
+
+	// The bytes of the picture without the line padding.
+	std::vector<uint8_t> GetContent() const
+	{
+		const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(m_format);
+		int linesize[4];
+		av_image_fill_linesizes(linesize, m_format, m_width);
+
+		std::vector<uint8_t> content;
+		for (int plane = 0; plane < 4 && m_data[plane]; ++plane)
+		{
+			int rows = plane == 0 ? m_height : -((-m_height) >> descriptor->log2_chroma_h);
+			for (int y = 0; y < rows; ++y)
+			{
+				const uint8_t* row = m_data[plane] + y * m_linesize[plane];
+				content.insert(content.end(), row, row + linesize[plane]);
+			}
+		}
+
+		return content;
+	}
+
+	uint8_t* const* GetData() { return m_data; }
+	const uint8_t* const* GetConstData() const { return m_data; }
+	const int* GetLinesize() const { return m_linesize; }
+
+private:
+	AVPixelFormat m_format;
+	int m_width;
+	int m_height;
+	std::vector<uint8_t> m_planes[4];
+	uint8_t* m_data[4];
+	int m_linesize[4];
+};
+
+// Converts with sws_scale like the video provider, optionally with full
+// range on both sides.
+static void ConvertWithSwscale(TestPicture& source, AVPixelFormat srcFormat, TestPicture& target, AVPixelFormat dstFormat, int width, int height, bool fullRange)
+{
+	SwsContext* swsCtx = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BICUBIC, nullptr, nullptr, nullptr);
+	CHECK(swsCtx != nullptr);
+	if (!swsCtx)
+	{
+		return;
+	}
+
+	if (fullRange)
+	{
+		const int* coefficients = sws_getCoefficients(SWS_CS_DEFAULT);
+		CHECK(sws_setColorspaceDetails(swsCtx, coefficients, 1, coefficients, 1, 0, 1 << 16, 1 << 16) >= 0);
+	}
+
+	CHECK(sws_scale(swsCtx, source.GetConstData(), source.GetLinesize(), 0, height, target.GetData(), target.GetLinesize()) == height);
+	sws_freeContext(swsCtx);
+}
+
+// The fast conversion matches sws_scale for all sizes, also odd ones, with
+// padded lines and converted in slices.
+static void TestAgainstSwscale(AVPixelFormat srcFormat, AVPixelFormat dstFormat, bool fullRange)
+{
+	PixelConversionFunction convert = GetPixelConversion(srcFormat, dstFormat);
+	CHECK(convert != nullptr);
+	if (!convert)
+	{
+		return;
+	}
+
+	std::mt19937 random(srcFormat * 100 + dstFormat);
+	const int widths[] = { 1, 2, 3, 15, 16, 17, 31, 32, 33, 63, 64, 65, 66, 97, 130, 255, 720, 1922 };
+	const int heights[] = { 1, 2, 3, 4, 7, 16, 33 };
+
+	int failures = 0;
+	for (int width : widths)
+	{
+		for (int height : heights)
+		{
+			TestPicture source(srcFormat, width, height, width % 3 * 32, random);
+			TestPicture expected(dstFormat, width, height, 0, random);
+			TestPicture whole(dstFormat, width, height, 64, random);
+			TestPicture sliced(dstFormat, width, height, 0, random);
+
+			ConvertWithSwscale(source, srcFormat, expected, dstFormat, width, height, fullRange);
+			convert(source.GetConstData(), source.GetLinesize(), whole.GetData(), whole.GetLinesize(), width, 0, height);
+
+			// Even slices of random heights, like the bands of the provider
+			for (int sliceY = 0; sliceY < height; )
+			{
+				int sliceHeight = std::min(height - sliceY, 2 * std::uniform_int_distribution<int>(1, 4)(random));
+				convert(source.GetConstData(), source.GetLinesize(), sliced.GetData(), sliced.GetLinesize(), width, sliceY, sliceHeight);
+				sliceY += sliceHeight;
+			}
+
+			std::vector<uint8_t> content = expected.GetContent();
+			if (whole.GetContent() != content || sliced.GetContent() != content)
+			{
+				// One report per format is enough to see what is wrong
+				if (failures++ == 0)
+				{
+					fprintf(stderr, "%s to %s differs from sws_scale at %dx%d\n",
+						av_pix_fmt_desc_get(srcFormat)->name, av_pix_fmt_desc_get(dstFormat)->name, width, height);
+				}
+			}
+		}
+	}
+
+	CHECK(failures == 0);
+}
+
+// YUVJ420P keeps its full range values, which is what the provider flags
+// as MFNominalRange_0_255.
+static void TestFullRangeKept()
+{
+	std::mt19937 random(1);
+	const int width = 66;
+	const int height = 10;
+
+	TestPicture source(AV_PIX_FMT_YUVJ420P, width, height, 0, random);
+	TestPicture target(AV_PIX_FMT_NV12, width, height, 0, random);
+
+	GetPixelConversion(AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_NV12)(source.GetConstData(), source.GetLinesize(), target.GetData(), target.GetLinesize(), width, 0, height);
+
+	bool kept = memcmp(target.GetConstData()[0], source.GetConstData()[0], width * height) == 0;
+	for (int y = 0; y < height / 2; ++y)
+	{
+		for (int x = 0; x < width / 2; ++x)
+		{
+			kept = kept
+				&& target.GetConstData()[1][y * target.GetLinesize()[1] + 2 * x] == source.GetConstData()[1][y * source.GetLinesize()[1] + x]
+				&& target.GetConstData()[1][y * target.GetLinesize()[1] + 2 * x + 1] == source.GetConstData()[2][y * source.GetLinesize()[2] + x];
+		}
+	}
+
+	CHECK(kept);
+}
+
+// Formats which may be converted in bands give the same picture with one
+// sws_scale per band as with one for the whole picture.
+static void TestBands(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+{
+	CHECK(CanConvertInBands(srcFormat, dstFormat));
+
+	std::mt19937 random(7);
+	const int width = 130;
+	const int height = 70;
+	const int bands = 3;
+	const AVPixFmtDescriptor* source = av_pix_fmt_desc_get(srcFormat);
+	const AVPixFmtDescriptor* target = av_pix_fmt_desc_get(dstFormat);
+
+	TestPicture picture(srcFormat, width, height, 0, random);
+	TestPicture whole(dstFormat, width, height, 0, random);
+	TestPicture banded(dstFormat, width, height, 0, random);
+
+	ConvertWithSwscale(picture, srcFormat, whole, dstFormat, width, height, false);
+
+	// Split like the video provider does
+	int bandHeight = FFALIGN(height / bands, 2);
+	for (int band = 0; band < bands; ++band)
+	{
+		int sliceY = band * bandHeight;
+		int sliceHeight = band == bands - 1 ? height - sliceY : bandHeight;
+
+		const uint8_t* sourceData[4];
+		uint8_t* bandData[4];
+		for (int plane = 0; plane < 4; ++plane)
+		{
+			int sourceShift = plane == 1 || plane == 2 ? source->log2_chroma_h : 0;
+			int targetShift = plane == 1 || plane == 2 ? target->log2_chroma_h : 0;
+			sourceData[plane] = picture.GetConstData()[plane] ? picture.GetConstData()[plane] + (sliceY >> sourceShift) * picture.GetLinesize()[plane] : nullptr;
+			bandData[plane] = banded.GetData()[plane] ? banded.GetData()[plane] + (sliceY >> targetShift) * banded.GetLinesize()[plane] : nullptr;
+		}
+
+		SwsContext* swsCtx = sws_getContext(width, sliceHeight, srcFormat, width, sliceHeight, dstFormat, SWS_BICUBIC, nullptr, nullptr, nullptr);
+		CHECK(swsCtx != nullptr);
+		if (swsCtx)
+		{
+			CHECK(sws_scale(swsCtx, sourceData, picture.GetLinesize(), 0, sliceHeight, bandData, banded.GetLinesize()) == sliceHeight);
+			sws_freeContext(swsCtx);
+		}
+	}
+
+	CHECK(whole.GetContent() == banded.GetContent());
+}
+
+// The output buffer is sized like CreateConverter of the video provider
+// does it, with the planes one after another, and must hold what the fast
+// path and sws_scale write for odd heights, a chroma row more than half of
+// the luma rows.
+static void TestOddHeightBuffer(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+{
+	const uint8_t guardByte = 0x5a;
+	const int guardSize = 4096;
+
+	std::mt19937 random(srcFormat * 100 + dstFormat + 1);
+	PixelConversionFunction convert = GetPixelConversion(srcFormat, dstFormat);
+	CHECK(convert != nullptr);
+
+	for (int height : { 1, 3, 481, 817 })
+	{
+		const int width = 1920;
+		TestPicture source(srcFormat, width, height, 0, random);
+
+		int lineSize[4];
+		int planeSize[4];
+		CHECK(av_image_fill_linesizes(lineSize, dstFormat, width) >= 0);
+		int size = GetPlaneSizes(dstFormat, height, lineSize, planeSize);
+		CHECK(size == av_image_get_buffer_size(dstFormat, width, height, 1));
+		if (size <= 0)
+		{
+			continue;
+		}
+
+		std::vector<uint8_t> fast(size + guardSize, guardByte);
+		std::vector<uint8_t> scaled(size + guardSize, guardByte);
+
+		// The plane pointers of ConvertFrame
+		uint8_t* fastData[4];
+		uint8_t* scaledData[4];
+		fastData[0] = fast.data();
+		scaledData[0] = scaled.data();
+		for (int plane = 1; plane < 4; ++plane)
+		{
+			fastData[plane] = planeSize[plane] > 0 ? fastData[plane - 1] + planeSize[plane - 1] : nullptr;
+			scaledData[plane] = planeSize[plane] > 0 ? scaledData[plane - 1] + planeSize[plane - 1] : nullptr;
+		}
+
+		// Two bands, the second one of odd height ends with the extra chroma row
+		if (convert)
+		{
+			int bandHeight = FFALIGN(height / 2, 2);
+			convert(source.GetConstData(), source.GetLinesize(), fastData, lineSize, width, 0, bandHeight);
+			convert(source.GetConstData(), source.GetLinesize(), fastData, lineSize, width, bandHeight, height - bandHeight);
+		}
+
+		SwsContext* swsCtx = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BICUBIC, nullptr, nullptr, nullptr);
+		CHECK(swsCtx != nullptr);
+		if (swsCtx)
+		{
+			CHECK(sws_scale(swsCtx, source.GetConstData(), source.GetLinesize(), 0, height, scaledData, lineSize) == height);
+			sws_freeContext(swsCtx);
+		}
+
+		CHECK(memcmp(fast.data(), scaled.data(), size) == 0);
+		CHECK(std::all_of(fast.begin() + size, fast.end(), [&](uint8_t value) { return value == guardByte; }));
+		CHECK(std::all_of(scaled.begin() + size, scaled.end(), [&](uint8_t value) { return value == guardByte; }));
+	}
+}
+
+static void TestBandRule()
+{
+	CHECK(CanConvertInBands(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12));
+	CHECK(CanConvertInBands(AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_NV12));
+	CHECK(CanConvertInBands(AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE));
+	CHECK(CanConvertInBands(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE));
+
+	// The chroma is resampled vertically
+	CHECK(!CanConvertInBands(AV_PIX_FMT_YUV422P, AV_PIX_FMT_NV12));
+	CHECK(!CanConvertInBands(AV_PIX_FMT_YUV444P, AV_PIX_FMT_NV12));
+	CHECK(!CanConvertInBands(AV_PIX_FMT_YUV422P10LE, AV_PIX_FMT_P010LE));
+
+	// Dithered to fewer bits
+	CHECK(!CanConvertInBands(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_NV12));
+	CHECK(!CanConvertInBands(AV_PIX_FMT_NONE, AV_PIX_FMT_NV12));
+}
+
+static void TestSelection()
+{
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12) == ConvertYuv420pToNv12);
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_NV12) == ConvertYuv420pToNv12);
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE) == ConvertYuv420p10ToP010);
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUV422P, AV_PIX_FMT_NV12) == nullptr);
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_NV12) == nullptr);
+	CHECK(GetPixelConversion(AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE) == nullptr);
+
+	CHECK(IsHighBitDepthFormat(AV_PIX_FMT_YUV420P10LE));
+	CHECK(!IsHighBitDepthFormat(AV_PIX_FMT_YUV420P));
+}
+
+// Usage: PixelConversionTest [scalar|sse2|avx2]
+// The kernels are picked once per process, so every instruction set needs a
+// run of its own. Without an argument the best one of the CPU is tested.
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		int cpuFlags = av_get_cpu_flags();
+		int forced = 0;
+		if (strcmp(argv[1], "sse2") == 0)
+		{
+			forced = AV_CPU_FLAG_SSE2;
+		}
+		else if (strcmp(argv[1], "avx2") == 0)
+		{
+			forced = AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_AVX2;
+		}
+		else if (strcmp(argv[1], "scalar") != 0)
+		{
+			fprintf(stderr, "unknown instruction set %s\n", argv[1]);
+			return 1;
+		}
+
+		if ((forced & cpuFlags) != forced)
+		{
+			printf("PixelConversionTest: %s is not supported, skipped\n", argv[1]);
+			return 0;
+		}
+
+		av_force_cpu_flags(forced);
+	}
+
+	TestSelection();
+	TestAgainstSwscale(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, false);
+	TestAgainstSwscale(AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_NV12, true);
+	TestAgainstSwscale(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE, false);
+	TestFullRangeKept();
+	TestBandRule();
+	TestBands(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12);
+	TestBands(AV_PIX_FMT_YUV420P, AV_PIX_FMT_P010LE);
+	TestBands(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE);
+	TestOddHeightBuffer(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12);
+	TestOddHeightBuffer(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE);
+
+	return TestResult("PixelConversionTest");
+}
@@ -0,0 +1,333 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the probe cache and its file identity checks.
+* File Name: ProbeCacheTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+#include "CacheFile.h"
+#include "ProbeCache.h"
+#include "StreamBackend.h"
+#include "TestMedia.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+static const int ProbedWidth = 1280;
+static const int ProbedHeight = 720;
+static const uint8_t ProbedExtradata[] = { 0x01, 0x64, 0x00, 0x1f, 0xff, 0xe1 };
+static const int64_t DefaultProbeSize = 5000000;
+
+static std::vector<TestStreamSpec> GetStreams()
+{
+	return
+	{
+		{ AVMEDIA_TYPE_VIDEO, AV_CODEC_ID_MPEG4, { 1, 90000 }, 3600, 12, 200, 2000 },
+		{ AVMEDIA_TYPE_AUDIO, AV_CODEC_ID_PCM_S16LE, { 1, 48000 }, 1024, 1, 100, 500 },
+	};
+}
+
+static MediaFileIdentity ComputeIdentity(const std::string& path)
+{
+	MediaFileIdentity identity;
+
+	std::unique_ptr<FileStreamBackend> backend(FileStreamBackend::Open(path.c_str()));
+	CHECK(backend != nullptr);
+	if (backend)
+	{
+		CHECK(identity.Compute(backend.get()) >= 0);
+	}
+
+	return identity;
+}
+
+// Opens the file and sets what avformat_find_stream_info would find on top
+// of what the demuxer knows after opening.
+static AVFormatContext* OpenProbed(const std::string& path)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (!avFormatCtx)
+	{
+		return nullptr;
+	}
+
+	AVCodecParameters* codecpar = avFormatCtx->streams[0]->codecpar;
+	codecpar->width = ProbedWidth;
+	codecpar->height = ProbedHeight;
+	codecpar->profile = 100;
+	codecpar->level = 31;
+	av_freep(&codecpar->extradata);
+	codecpar->extradata = static_cast<uint8_t*>(av_mallocz(sizeof(ProbedExtradata) + AV_INPUT_BUFFER_PADDING_SIZE));
+	memcpy(codecpar->extradata, ProbedExtradata, sizeof(ProbedExtradata));
+	codecpar->extradata_size = sizeof(ProbedExtradata);
+	avFormatCtx->streams[0]->avg_frame_rate = { 25, 1 };
+
+	return avFormatCtx;
+}
+
+// Whether the context still has the values of a freshly opened file.
+static bool IsUntouched(const AVFormatContext* avFormatCtx)
+{
+	const AVCodecParameters* codecpar = avFormatCtx->streams[0]->codecpar;
+	return codecpar->width != ProbedWidth
+		&& codecpar->extradata_size != sizeof(ProbedExtradata)
+		&& avFormatCtx->probesize == DefaultProbeSize;
+}
+
+static AVFormatContext* OpenUnprobed(const std::string& path)
+{
+	AVFormatContext* avFormatCtx = OpenTestMedia(path);
+	CHECK(avFormatCtx != nullptr);
+	if (avFormatCtx)
+	{
+		avFormatCtx->probesize = DefaultProbeSize;
+	}
+
+	return avFormatCtx;
+}
+
+static void TestRoundTrip(const std::string& mediaPath, const std::string& cachePath)
+{
+	MediaFileIdentity identity = ComputeIdentity(mediaPath);
+	CHECK(identity.IsValid());
+
+	AVFormatContext* probed = OpenProbed(mediaPath);
+	if (!probed)
+	{
+		return;
+	}
+
+	ProbeCache cache;
+	CHECK(cache.IsEmpty());
+	cache.Capture(probed);
+	CHECK(!cache.IsEmpty());
+	CHECK(cache.Save(cachePath, identity) >= 0);
+	avformat_close_input(&probed);
+
+	ProbeCache loaded;
+	CHECK(loaded.Load(cachePath, identity) >= 0);
+	CHECK(!loaded.IsEmpty());
+
+	AVFormatContext* avFormatCtx = OpenUnprobed(mediaPath);
+	if (!avFormatCtx)
+	{
+		return;
+	}
+
+	CHECK(loaded.Apply(avFormatCtx));
+
+	const AVCodecParameters* codecpar = avFormatCtx->streams[0]->codecpar;
+	CHECK(codecpar->width == ProbedWidth);
+	CHECK(codecpar->height == ProbedHeight);
+	CHECK(codecpar->profile == 100);
+	CHECK(codecpar->level == 31);
+	CHECK(codecpar->extradata_size == sizeof(ProbedExtradata));
+	CHECK(codecpar->extradata && memcmp(codecpar->extradata, ProbedExtradata, sizeof(ProbedExtradata)) == 0);
+	CHECK(avFormatCtx->streams[0]->avg_frame_rate.num == 25);
+	CHECK(avFormatCtx->streams[0]->avg_frame_rate.den == 1);
+	CHECK(avFormatCtx->probesize == ProbeCache::ShrunkProbeSize);
+	CHECK(avFormatCtx->max_analyze_duration == ProbeCache::ShrunkAnalyzeDuration);
+
+	avformat_close_input(&avFormatCtx);
+}
+
+// A cache written for another version of the file is refused by Load and
+// leaves the previous content alone.
+static void TestStaleIdentity(const std::string& mediaPath, const std::string& cachePath)
+{
+	MediaFileIdentity identity = ComputeIdentity(mediaPath);
+
+	MediaFileIdentity grown = identity;
+	grown.size += 1;
+	MediaFileIdentity touched = identity;
+	touched.modifiedTime += 1;
+	MediaFileIdentity edited = identity;
+	edited.hash ^= 1;
+
+	for (const MediaFileIdentity& stale : { grown, touched, edited })
+	{
+		ProbeCache cache;
+		CHECK(cache.Load(cachePath, stale) == AVERROR_INVALIDDATA);
+		CHECK(cache.IsEmpty());
+
+		AVFormatContext* avFormatCtx = OpenUnprobed(mediaPath);
+		if (avFormatCtx)
+		{
+			CHECK(!cache.Apply(avFormatCtx));
+			CHECK(IsUntouched(avFormatCtx));
+			avformat_close_input(&avFormatCtx);
+		}
+	}
+
+	ProbeCache cache;
+	CHECK(cache.Load(cachePath, identity) >= 0);
+	CHECK(cache.Load(cachePath, grown) == AVERROR_INVALIDDATA);
+	CHECK(!cache.IsEmpty());
+
+	// The file itself was rewritten with other content, so its identity
+	// moved away from the one in the cache.
+	std::string rewrittenPath = GetTemporaryPath("ProbeCacheTest-rewritten.nut");
+	TestMediaInfo info;
+	int ret = WriteTestMedia(rewrittenPath, "nut", GetStreams(), 3, info);
+	CHECK(ret >= 0);
+	if (ret >= 0)
+	{
+		MediaFileIdentity rewritten = ComputeIdentity(rewrittenPath);
+		CHECK(rewritten != identity);
+
+		ProbeCache other;
+		CHECK(other.Load(cachePath, rewritten) == AVERROR_INVALIDDATA);
+		CHECK(other.IsEmpty());
+	}
+
+	remove(rewrittenPath.c_str());
+}
+
+// A cache whose streams differ from the opened file is refused by Apply
+// before it changes anything.
+static void TestMismatchedStreams(const std::string& mediaPath, const std::string& cachePath, const MediaFileIdentity& identity)
+{
+	ProbeCache cache;
+	CHECK(cache.Load(cachePath, identity) >= 0);
+
+	AVFormatContext* reference = OpenUnprobed(mediaPath);
+	if (!reference)
+	{
+		return;
+	}
+
+	struct Variant
+	{
+		const char* name;
+		std::vector<TestStreamSpec> streams;
+	};
+
+	std::vector<TestStreamSpec> streams = GetStreams();
+
+	std::vector<Variant> variants;
+	variants.push_back({ "fewer", { streams[0] } });
+	variants.push_back({ "more", { streams[0], streams[1], streams[1] } });
+	variants.push_back({ "swapped", { streams[1], streams[0] } });
+
+	Variant codec = { "codec", streams };
+	codec.streams[0].codecId = AV_CODEC_ID_MPEG2VIDEO;
+	variants.push_back(codec);
+
+	Variant timeBase = { "timebase", streams };
+	timeBase.streams[1].timeBase = { 1, 44100 };
+	timeBase.streams[1].packetDuration = 941;
+	variants.push_back(timeBase);
+
+	for (auto& variant : variants)
+	{
+		std::string path = GetTemporaryPath((std::string("ProbeCacheTest-") + variant.name + ".nut").c_str());
+		TestMediaInfo info;
+		int ret = WriteTestMedia(path, "nut", variant.streams, 1, info);
+		CHECK(ret >= 0);
+
+		AVFormatContext* avFormatCtx = ret >= 0 ? OpenUnprobed(path) : nullptr;
+		if (avFormatCtx)
+		{
+			// The muxer may have picked other time bases than asked for, so
+			// the variant must really differ from the cached file.
+			bool differs = avFormatCtx->nb_streams != reference->nb_streams;
+			for (unsigned int i = 0; !differs && i < avFormatCtx->nb_streams; ++i)
+			{
+				const AVStream* avStream = avFormatCtx->streams[i];
+				const AVStream* referenceStream = reference->streams[i];
+				differs = avStream->codecpar->codec_type != referenceStream->codecpar->codec_type
+					|| avStream->codecpar->codec_id != referenceStream->codecpar->codec_id
+					|| av_cmp_q(avStream->time_base, referenceStream->time_base) != 0;
+			}
+			CHECK(differs);
+
+			CHECK(!cache.Apply(avFormatCtx));
+			CHECK(IsUntouched(avFormatCtx));
+
+			avformat_close_input(&avFormatCtx);
+		}
+
+		remove(path.c_str());
+	}
+
+	avformat_close_input(&reference);
+}
+
+// Damaged cache files are refused and never replace loaded content.
+static void TestCorruptFile(const std::string& mediaPath, const std::string& cachePath, const MediaFileIdentity& identity)
+{
+	std::vector<uint8_t> content;
+	CHECK(ReadCacheFile(cachePath, content) >= 0);
+	CHECK(content.size() > 16);
+
+	std::string corruptPath = GetTemporaryPath("ProbeCacheTest-corrupt.probe");
+
+	// The magic takes five bytes as a varint, the version follows.
+	std::vector<uint8_t> badMagic = content;
+	badMagic[0] ^= 0xff;
+	std::vector<uint8_t> badVersion = content;
+	badVersion[5] ^= 0x7f;
+
+	std::vector<std::vector<uint8_t>> damaged = { badMagic, badVersion, std::vector<uint8_t>() };
+	for (size_t size = 1; size < content.size(); size += 1 + size / 4)
+	{
+		damaged.push_back(std::vector<uint8_t>(content.begin(), content.begin() + size));
+	}
+
+	ProbeCache cache;
+	for (auto& file : damaged)
+	{
+		CHECK(WriteCacheFile(corruptPath, file) >= 0);
+		CHECK(cache.Load(corruptPath, identity) < 0);
+		CHECK(cache.IsEmpty());
+	}
+
+	CHECK(cache.Load(cachePath, identity) >= 0);
+	CHECK(cache.Load(corruptPath, identity) < 0);
+	CHECK(!cache.IsEmpty());
+
+	AVFormatContext* avFormatCtx = OpenUnprobed(mediaPath);
+	if (avFormatCtx)
+	{
+		CHECK(cache.Apply(avFormatCtx));
+		avformat_close_input(&avFormatCtx);
+	}
+
+	ProbeCache missing;
+	remove(corruptPath.c_str());
+	CHECK(missing.Load(corruptPath, identity) < 0);
+	CHECK(missing.IsEmpty());
+}
+
+int main()
+{
+	av_log_set_level(AV_LOG_ERROR);
+
+	std::string mediaPath = GetTemporaryPath("ProbeCacheTest.nut");
+	std::string cachePath = GetTemporaryPath("ProbeCacheTest.probe");
+
+	TestMediaInfo info;
+	int ret = WriteTestMedia(mediaPath, "nut", GetStreams(), 2, info);
+	CHECK(ret >= 0);
+
+	if (ret >= 0)
+	{
+		TestRoundTrip(mediaPath, cachePath);
+
+		MediaFileIdentity identity = ComputeIdentity(mediaPath);
+		TestStaleIdentity(mediaPath, cachePath);
+		TestMismatchedStreams(mediaPath, cachePath, identity);
+		TestCorruptFile(mediaPath, cachePath, identity);
+	}
+
+	remove(cachePath.c_str());
+	remove(mediaPath.c_str());
+
+	return TestResult("ProbeCacheTest");
+}
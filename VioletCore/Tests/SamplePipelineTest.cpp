@@ -0,0 +1,351 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Test of the sample pipeline under a simulated pull driver.
+* File Name: SamplePipelineTest.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "SamplePipeline.h"
+#include "TestUtilities.h"
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// Longer than any request may take, a request which is not completed by
+// then was lost.
+static const std::chrono::seconds CompletionTimeout(10);
+
+// The deferral of a sample request, which the media source must complete
+// exactly once, with a sample or without one.
+class Deferral
+{
+public:
+	Deferral()
+		: m_submitted(false)
+		, m_completions(0)
+		, m_sample(-1)
+	{
+	}
+
+	void Complete(int sample)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_completions++;
+			m_sample = sample;
+		}
+		m_completed.notify_all();
+	}
+
+	// Return value:
+	//   false if the deferral was not completed in time.
+	bool WaitCompleted()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_completed.wait_for(lock, CompletionTimeout, [this] { return m_completions > 0; });
+	}
+
+	int GetCompletions()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_completions;
+	}
+
+	int GetSample()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_sample;
+	}
+
+	// Set once Submit has returned true
+	std::atomic<bool> m_submitted;
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_completed;
+	int m_completions;
+	int m_sample;
+};
+
+// What OnSampleRequested does: submit a job which produces the sample and
+// completes the deferral, or complete it right away if the pipeline refuses
+// the job.
+class PullDriver
+{
+public:
+	explicit PullDriver(SamplePipeline& pipeline)
+		: m_pipeline(pipeline)
+		, m_acceptedJobs(0)
+	{
+	}
+
+	std::shared_ptr<Deferral> Request(int lane, std::atomic<int>& nextSample, int workMicroseconds)
+	{
+		auto deferral = std::make_shared<Deferral>();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_deferrals.push_back(deferral);
+		}
+
+		bool submitted = m_pipeline.Submit(lane, [deferral, &nextSample, workMicroseconds](bool canceled)
+		{
+			if (canceled)
+			{
+				deferral->Complete(-1);
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::microseconds(workMicroseconds));
+			deferral->Complete(nextSample++);
+		});
+
+		if (submitted)
+		{
+			deferral->m_submitted = true;
+			m_acceptedJobs++;
+		}
+		else
+		{
+			deferral->Complete(-1);
+		}
+
+		return deferral;
+	}
+
+	// The deferrals whose jobs were queued so far
+	std::vector<std::shared_ptr<Deferral>> GetSubmitted()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::shared_ptr<Deferral>> result;
+		for (auto& deferral : m_deferrals)
+		{
+			if (deferral->m_submitted)
+			{
+				result.push_back(deferral);
+			}
+		}
+		return result;
+	}
+
+	std::vector<std::shared_ptr<Deferral>> GetAll()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_deferrals;
+	}
+
+	uint64_t GetAcceptedJobs() const { return m_acceptedJobs; }
+
+private:
+	SamplePipeline& m_pipeline;
+	std::mutex m_mutex;
+	std::vector<std::shared_ptr<Deferral>> m_deferrals;
+	std::atomic<uint64_t> m_acceptedJobs;
+};
+
+// Jobs of one lane run in submission order, the samples of a stream come
+// out in order.
+static void TestOrder()
+{
+	SamplePipeline pipeline(2);
+	PullDriver driver(pipeline);
+	std::atomic<int> nextSample[2];
+	nextSample[0] = 0;
+	nextSample[1] = 0;
+
+	// Several requests outstanding at once, unlike the media source
+	std::vector<std::shared_ptr<Deferral>> deferrals[2];
+	for (int i = 0; i < 200; ++i)
+	{
+		deferrals[i % 2].push_back(driver.Request(i % 2, nextSample[i % 2], i % 7 == 0 ? 100 : 0));
+	}
+
+	pipeline.WaitIdle();
+
+	for (int lane = 0; lane < 2; ++lane)
+	{
+		for (size_t i = 0; i < deferrals[lane].size(); ++i)
+		{
+			CHECK(deferrals[lane][i]->GetCompletions() == 1);
+			CHECK(deferrals[lane][i]->GetSample() == static_cast<int>(i));
+		}
+	}
+
+	CHECK(pipeline.GetCompletedJobs() == 200);
+	CHECK(pipeline.GetCanceledJobs() == 0);
+}
+
+// Two streams pull one sample at a time, like the media source does, while
+// another thread seeks, which waits for the pipeline to become idle, and
+// the source is destroyed, which stops the pipeline. Every request must be
+// completed exactly once, whichever way it ends, and WaitIdle must only
+// return once the requests queued before it are completed.
+static void TestConcurrentPullSeekAndStop(unsigned int seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> runTime(1, 30);
+	int stopAfterMilliseconds = runTime(random);
+
+	SamplePipeline pipeline(2);
+	PullDriver driver(pipeline);
+	std::atomic<int> nextSample[2];
+	nextSample[0] = 0;
+	nextSample[1] = 0;
+	std::atomic<bool> stopped(false);
+	std::atomic<int> lostRequests(0);
+
+	std::vector<std::thread> streams;
+	for (int lane = 0; lane < 2; ++lane)
+	{
+		streams.emplace_back([&, lane]
+		{
+			std::mt19937 streamRandom(seed * 2 + lane);
+			std::uniform_int_distribution<int> work(0, 200);
+
+			// Requests keep coming for a while after the stop, the media
+			// foundation may still ask while the source is being destroyed
+			int afterStop = 0;
+			while (afterStop < 3)
+			{
+				if (stopped)
+				{
+					afterStop++;
+				}
+
+				auto deferral = driver.Request(lane, nextSample[lane], work(streamRandom));
+				if (!deferral->WaitCompleted())
+				{
+					lostRequests++;
+					break;
+				}
+			}
+		});
+	}
+
+	std::thread seeker([&]
+	{
+		while (!stopped)
+		{
+			auto submitted = driver.GetSubmitted();
+			pipeline.WaitIdle();
+
+			for (auto& deferral : submitted)
+			{
+				CHECK(deferral->GetCompletions() == 1);
+			}
+
+			std::this_thread::sleep_for(std::chrono::microseconds(300));
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(stopAfterMilliseconds));
+	pipeline.Stop();
+	stopped = true;
+
+	for (auto& stream : streams)
+	{
+		stream.join();
+	}
+	seeker.join();
+
+	CHECK(lostRequests == 0);
+
+	// Completed once, including the canceled ones and the refused ones
+	auto deferrals = driver.GetAll();
+	for (auto& deferral : deferrals)
+	{
+		CHECK(deferral->GetCompletions() == 1);
+	}
+
+	CHECK(pipeline.GetCompletedJobs() + pipeline.GetCanceledJobs() == driver.GetAcceptedJobs());
+
+	// WaitIdle returns after the stop too
+	pipeline.WaitIdle();
+}
+
+// Stopping with queued jobs runs them as canceled, without their work.
+static void TestStopCancelsQueued()
+{
+	SamplePipeline pipeline(1);
+	PullDriver driver(pipeline);
+	std::atomic<int> nextSample(0);
+
+	std::mutex blockMutex;
+	std::condition_variable blockChanged;
+	bool started = false;
+	bool release = false;
+
+	// Holds the lane until the other jobs are queued
+	pipeline.Submit(0, [&](bool)
+	{
+		std::unique_lock<std::mutex> lock(blockMutex);
+		started = true;
+		blockChanged.notify_all();
+		blockChanged.wait(lock, [&] { return release; });
+	});
+
+	{
+		std::unique_lock<std::mutex> lock(blockMutex);
+		blockChanged.wait(lock, [&] { return started; });
+	}
+
+	std::vector<std::shared_ptr<Deferral>> deferrals;
+	for (int i = 0; i < 10; ++i)
+	{
+		deferrals.push_back(driver.Request(0, nextSample, 0));
+	}
+
+	std::thread stopper([&] { pipeline.Stop(); });
+
+	// Stop must not return while a job runs. Once it refuses new jobs, all
+	// queued ones will be canceled.
+	while (true)
+	{
+		auto deferral = driver.Request(0, nextSample, 0);
+		deferrals.push_back(deferral);
+		if (!deferral->m_submitted)
+		{
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(blockMutex);
+		release = true;
+	}
+	blockChanged.notify_all();
+	stopper.join();
+
+	for (auto& deferral : deferrals)
+	{
+		CHECK(deferral->GetCompletions() == 1);
+		CHECK(deferral->GetSample() == -1);
+	}
+
+	CHECK(pipeline.GetCompletedJobs() == 1);
+	CHECK(pipeline.GetCanceledJobs() == driver.GetAcceptedJobs());
+	CHECK(!pipeline.Submit(0, [](bool) {}));
+}
+
+int main()
+{
+	TestOrder();
+	TestStopCancelsQueued();
+
+	for (unsigned int seed = 1; seed <= 20; ++seed)
+	{
+		TestConcurrentPullSeekAndStop(seed);
+	}
+
+	return TestResult("SamplePipelineTest");
+}
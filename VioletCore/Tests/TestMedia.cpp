@@ -0,0 +1,431 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Writes synthetic media files for the tests and benchmarks.
+* File Name: TestMedia.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TestMedia.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInterop::Tests;
+
+// The payload starts with a marker, the stream index and the packet index.
+static const uint32_t PayloadMarker = 0x56494f4c;
+static const int PayloadHeaderSize = 12;
+
+static void WriteUInt32(uint8_t* data, uint32_t value)
+{
+	data[0] = static_cast<uint8_t>(value >> 24);
+	data[1] = static_cast<uint8_t>(value >> 16);
+	data[2] = static_cast<uint8_t>(value >> 8);
+	data[3] = static_cast<uint8_t>(value);
+}
+
+static uint32_t ReadUInt32(const uint8_t* data)
+{
+	return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+static void SetStreamParameters(AVCodecParameters* codecpar, const TestStreamSpec& spec)
+{
+	codecpar->codec_type = spec.type;
+	codecpar->codec_id = spec.codecId;
+
+	if (spec.type == AVMEDIA_TYPE_VIDEO)
+	{
+		codecpar->width = 320;
+		codecpar->height = 240;
+		codecpar->format = AV_PIX_FMT_YUV420P;
+	}
+	else if (spec.type == AVMEDIA_TYPE_AUDIO)
+	{
+		codecpar->sample_rate = 48000;
+		codecpar->format = AV_SAMPLE_FMT_S16;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+		av_channel_layout_default(&codecpar->ch_layout, 2);
+#else
+		codecpar->channels = 2;
+		codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+#endif
+	}
+}
+
+std::string Tests::GetTemporaryPath(const char* name)
+{
+	const char* directory = getenv("TMPDIR");
+	std::string path = directory && *directory ? directory : "/tmp";
+	return path + "/VioletCoreTest-" + name;
+}
+
+int Tests::WriteTestMedia(const std::string& path, const char* format, const std::vector<TestStreamSpec>& streams, double seconds, TestMediaInfo& info)
+{
+	AVFormatContext* avFormatCtx = nullptr;
+	int ret = avformat_alloc_output_context2(&avFormatCtx, nullptr, format, path.c_str());
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	for (auto& spec : streams)
+	{
+		AVStream* avStream = avformat_new_stream(avFormatCtx, nullptr);
+		if (!avStream)
+		{
+			ret = AVERROR(ENOMEM);
+			break;
+		}
+
+		avStream->time_base = spec.timeBase;
+		SetStreamParameters(avStream->codecpar, spec);
+	}
+
+	if (ret >= 0)
+	{
+		ret = avio_open(&avFormatCtx->pb, path.c_str(), AVIO_FLAG_WRITE);
+	}
+	if (ret >= 0)
+	{
+		ret = avformat_write_header(avFormatCtx, nullptr);
+	}
+
+	// The muxer may have changed the time bases, the packets are created in
+	// the final ones
+	struct PendingPacket
+	{
+		double time;
+		int streamIndex;
+		int packetIndex;
+	};
+	std::vector<PendingPacket> pending;
+
+	info.timeBases.clear();
+	info.packets.assign(streams.size(), std::vector<TestPacket>());
+
+	std::mt19937 random(12345);
+	for (size_t i = 0; ret >= 0 && i < streams.size(); ++i)
+	{
+		const TestStreamSpec& spec = streams[i];
+		AVRational timeBase = avFormatCtx->streams[i]->time_base;
+		int64_t duration = av_rescale_q(spec.packetDuration, spec.timeBase, timeBase);
+		info.timeBases.push_back(timeBase);
+
+		std::uniform_int_distribution<int> sizes(std::max(spec.minSize, PayloadHeaderSize), std::max(spec.maxSize, PayloadHeaderSize));
+		for (int index = 0; ; ++index)
+		{
+			int64_t pts = index * duration;
+			double time = pts * av_q2d(timeBase);
+			if (time >= seconds)
+			{
+				break;
+			}
+
+			TestPacket packet = { pts, sizes(random), spec.keyframeInterval <= 1 || index % spec.keyframeInterval == 0 };
+			info.packets[i].push_back(packet);
+			pending.push_back({ time, static_cast<int>(i), index });
+		}
+	}
+
+	std::stable_sort(pending.begin(), pending.end(), [](const PendingPacket& a, const PendingPacket& b) { return a.time < b.time; });
+
+	AVPacket* avPacket = av_packet_alloc();
+	if (!avPacket && ret >= 0)
+	{
+		ret = AVERROR(ENOMEM);
+	}
+
+	for (size_t i = 0; ret >= 0 && i < pending.size(); ++i)
+	{
+		const TestStreamSpec& spec = streams[pending[i].streamIndex];
+		const TestPacket& packet = info.packets[pending[i].streamIndex][pending[i].packetIndex];
+
+		ret = av_new_packet(avPacket, packet.size);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		memset(avPacket->data, pending[i].packetIndex & 0xff, packet.size);
+		WriteUInt32(avPacket->data, PayloadMarker);
+		WriteUInt32(avPacket->data + 4, static_cast<uint32_t>(pending[i].streamIndex));
+		WriteUInt32(avPacket->data + 8, static_cast<uint32_t>(pending[i].packetIndex));
+
+		avPacket->stream_index = pending[i].streamIndex;
+		avPacket->pts = packet.pts;
+		avPacket->dts = packet.pts;
+		avPacket->duration = av_rescale_q(spec.packetDuration, spec.timeBase, info.timeBases[pending[i].streamIndex]);
+		avPacket->flags = packet.key ? AV_PKT_FLAG_KEY : 0;
+
+		ret = av_interleaved_write_frame(avFormatCtx, avPacket);
+	}
+
+	av_packet_free(&avPacket);
+
+	if (ret >= 0)
+	{
+		ret = av_write_trailer(avFormatCtx);
+	}
+
+	avio_closep(&avFormatCtx->pb);
+	avformat_free_context(avFormatCtx);
+
+	return ret;
+}
+
+// Codes the frames of one segment and writes their packets.
+static int WriteVideoSegment(AVFormatContext* avFormatCtx, const TestVideoSegment& segment, AVRational frameRate, int& frameIndex)
+{
+	AVStream* avStream = avFormatCtx->streams[0];
+	auto format = static_cast<AVPixelFormat>(avStream->codecpar->format);
+	const AVCodec* avCodec = avcodec_find_encoder(avStream->codecpar->codec_id);
+	if (!avCodec)
+	{
+		return AVERROR_ENCODER_NOT_FOUND;
+	}
+
+	AVCodecContext* avCodecCtx = avcodec_alloc_context3(avCodec);
+	AVFrame* avFrame = av_frame_alloc();
+	AVPacket* avPacket = av_packet_alloc();
+	if (!avCodecCtx || !avFrame || !avPacket)
+	{
+		avcodec_free_context(&avCodecCtx);
+		av_frame_free(&avFrame);
+		av_packet_free(&avPacket);
+		return AVERROR(ENOMEM);
+	}
+
+	avCodecCtx->width = segment.width;
+	avCodecCtx->height = segment.height;
+	avCodecCtx->pix_fmt = format;
+	avCodecCtx->time_base = av_inv_q(frameRate);
+
+	int ret = avcodec_open2(avCodecCtx, avCodec, nullptr);
+
+	avFrame->width = segment.width;
+	avFrame->height = segment.height;
+	avFrame->format = format;
+	if (ret >= 0)
+	{
+		ret = av_frame_get_buffer(avFrame, 0);
+	}
+
+	for (int i = 0; ret >= 0 && i <= segment.frames; ++i)
+	{
+		// The last round flushes the encoder
+		if (i < segment.frames)
+		{
+			ret = av_frame_make_writable(avFrame);
+			if (ret < 0)
+			{
+				break;
+			}
+
+			int chromaHeight = (segment.height + 1) / 2;
+			memset(avFrame->data[0], GetTestFrameLuma(frameIndex), avFrame->linesize[0] * segment.height);
+			memset(avFrame->data[1], 128, avFrame->linesize[1] * chromaHeight);
+			memset(avFrame->data[2], 128, avFrame->linesize[2] * chromaHeight);
+			avFrame->pts = frameIndex++;
+		}
+
+		ret = avcodec_send_frame(avCodecCtx, i < segment.frames ? avFrame : nullptr);
+		while (ret >= 0)
+		{
+			ret = avcodec_receive_packet(avCodecCtx, avPacket);
+			if (ret < 0)
+			{
+				break;
+			}
+
+			av_packet_rescale_ts(avPacket, avCodecCtx->time_base, avStream->time_base);
+			avPacket->stream_index = 0;
+			ret = av_interleaved_write_frame(avFormatCtx, avPacket);
+		}
+
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+		{
+			ret = 0;
+		}
+	}
+
+	avcodec_free_context(&avCodecCtx);
+	av_frame_free(&avFrame);
+	av_packet_free(&avPacket);
+
+	return ret;
+}
+
+int Tests::WriteVideoTestMedia(const std::string& path, const char* format, const std::vector<TestVideoSegment>& segments, AVRational frameRate, AVCodecID codecId)
+{
+	if (segments.empty())
+	{
+		return AVERROR(EINVAL);
+	}
+
+	AVFormatContext* avFormatCtx = nullptr;
+	int ret = avformat_alloc_output_context2(&avFormatCtx, nullptr, format, path.c_str());
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	AVStream* avStream = avformat_new_stream(avFormatCtx, nullptr);
+	if (!avStream)
+	{
+		ret = AVERROR(ENOMEM);
+	}
+	else
+	{
+		avStream->time_base = av_inv_q(frameRate);
+		avStream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+		avStream->codecpar->codec_id = codecId;
+		avStream->codecpar->width = segments[0].width;
+		avStream->codecpar->height = segments[0].height;
+		avStream->codecpar->format = codecId == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+	}
+
+	if (ret >= 0)
+	{
+		ret = avio_open(&avFormatCtx->pb, path.c_str(), AVIO_FLAG_WRITE);
+	}
+	if (ret >= 0)
+	{
+		ret = avformat_write_header(avFormatCtx, nullptr);
+	}
+
+	int frameIndex = 0;
+	for (size_t i = 0; ret >= 0 && i < segments.size(); ++i)
+	{
+		ret = WriteVideoSegment(avFormatCtx, segments[i], frameRate, frameIndex);
+	}
+
+	if (ret >= 0)
+	{
+		ret = av_write_trailer(avFormatCtx);
+	}
+
+	avio_closep(&avFormatCtx->pb);
+	avformat_free_context(avFormatCtx);
+
+	return ret;
+}
+
+int Tests::GetTestFrameLuma(int frameIndex)
+{
+	return 32 + 12 * (frameIndex % 16);
+}
+
+int Tests::ReadTestClip(const std::string& path, TestClip& clip)
+{
+	clip.codecpar = nullptr;
+	clip.packets.clear();
+
+	AVFormatContext* avFormatCtx = nullptr;
+	int ret = avformat_open_input(&avFormatCtx, path.c_str(), nullptr, nullptr);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	ret = avformat_find_stream_info(avFormatCtx, nullptr);
+	if (ret >= 0)
+	{
+		ret = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+	}
+
+	int streamIndex = ret;
+	if (ret >= 0)
+	{
+		clip.codecpar = avcodec_parameters_alloc();
+		ret = clip.codecpar ? avcodec_parameters_copy(clip.codecpar, avFormatCtx->streams[streamIndex]->codecpar) : AVERROR(ENOMEM);
+		clip.frameRate = avFormatCtx->streams[streamIndex]->avg_frame_rate;
+	}
+
+	AVPacket* avPacket = av_packet_alloc();
+	if (ret >= 0 && !avPacket)
+	{
+		ret = AVERROR(ENOMEM);
+	}
+
+	while (ret >= 0 && av_read_frame(avFormatCtx, avPacket) >= 0)
+	{
+		if (avPacket->stream_index == streamIndex)
+		{
+			AVPacket* copy = av_packet_clone(avPacket);
+			if (copy)
+			{
+				clip.packets.push_back(copy);
+			}
+			else
+			{
+				ret = AVERROR(ENOMEM);
+			}
+		}
+		av_packet_unref(avPacket);
+	}
+
+	if (ret >= 0 && clip.packets.empty())
+	{
+		ret = AVERROR_INVALIDDATA;
+	}
+
+	av_packet_free(&avPacket);
+	avformat_close_input(&avFormatCtx);
+
+	if (ret < 0)
+	{
+		FreeTestClip(clip);
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+void Tests::FreeTestClip(TestClip& clip)
+{
+	for (auto& avPacket : clip.packets)
+	{
+		av_packet_free(&avPacket);
+	}
+
+	clip.packets.clear();
+	avcodec_parameters_free(&clip.codecpar);
+}
+
+AVFormatContext* Tests::OpenTestMedia(const std::string& path)
+{
+	AVFormatContext* avFormatCtx = nullptr;
+	if (avformat_open_input(&avFormatCtx, path.c_str(), nullptr, nullptr) < 0)
+	{
+		return nullptr;
+	}
+
+	return avFormatCtx;
+}
+
+bool Tests::HasTestPayload(const AVPacket* avPacket, int streamIndex, int packetIndex)
+{
+	return avPacket->size >= PayloadHeaderSize
+		&& ReadUInt32(avPacket->data) == PayloadMarker
+		&& ReadUInt32(avPacket->data + 4) == static_cast<uint32_t>(streamIndex)
+		&& ReadUInt32(avPacket->data + 8) == static_cast<uint32_t>(packetIndex);
+}
+
+int Tests::GetTestPacketIndex(const AVPacket* avPacket)
+{
+	if (avPacket->size < PayloadHeaderSize || ReadUInt32(avPacket->data) != PayloadMarker)
+	{
+		return -1;
+	}
+
+	return static_cast<int>(ReadUInt32(avPacket->data + 8));
+}
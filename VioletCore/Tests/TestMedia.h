@@ -0,0 +1,114 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: Writes synthetic media files for the tests and benchmarks.
+* File Name: TestMedia.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FFmpegIncludes.h"
+
+namespace FFmpegInterop
+{
+	namespace Tests
+	{
+		// One stream of a synthetic file. The packets carry no real coded
+		// data, only their stream and packet index, so the file can be
+		// demuxed but not decoded.
+		struct TestStreamSpec
+		{
+			AVMediaType type;
+			AVCodecID codecId;
+			AVRational timeBase;
+
+			// The packet duration in the time base, the packets follow each
+			// other without gaps.
+			int64_t packetDuration;
+
+			// Every n-th packet is a keyframe, 1 makes all of them keyframes.
+			int keyframeInterval;
+
+			// The payload sizes, picked at random in this range.
+			int minSize;
+			int maxSize;
+		};
+
+		struct TestPacket
+		{
+			int64_t pts;
+			int size;
+			bool key;
+		};
+
+		// What was written, with the time bases the muxer chose.
+		struct TestMediaInfo
+		{
+			std::vector<AVRational> timeBases;
+			std::vector<std::vector<TestPacket>> packets;
+		};
+
+		// One part of a synthetic video clip, its frames all have the same
+		// size.
+		struct TestVideoSegment
+		{
+			int width;
+			int height;
+			int frames;
+		};
+
+		// The packets of the main video stream of a file, read into memory so
+		// that decoding can be timed without the demuxing.
+		struct TestClip
+		{
+			AVCodecParameters* codecpar;
+			AVRational frameRate;
+			std::vector<AVPacket*> packets;
+		};
+
+		// A path for a temporary file with the given name.
+		std::string GetTemporaryPath(const char* name);
+
+		// Writes a file of the given format ("nut", "matroska", ...) with
+		// the streams, interleaved by time.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int WriteTestMedia(const std::string& path, const char* format, const std::vector<TestStreamSpec>& streams, double seconds, TestMediaInfo& info);
+
+		// Writes a file of the given format with one MJPEG (YUVJ420P) video
+		// stream whose frame size changes from segment to segment. MJPEG
+		// codes the size in every frame, so the decoder follows the changes
+		// without new stream parameters, like it does for adaptive streams.
+		// The stream parameters have the size of the first segment. Every
+		// frame is flat, with the luma value GetTestFrameLuma(frameIndex).
+		// Other encoders of FFmpeg, like MPEG-2 for a decoder with slice
+		// threads, code YUV420P.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int WriteVideoTestMedia(const std::string& path, const char* format, const std::vector<TestVideoSegment>& segments, AVRational frameRate, AVCodecID codecId = AV_CODEC_ID_MJPEG);
+
+		// The luma value of the frames written by WriteVideoTestMedia.
+		int GetTestFrameLuma(int frameIndex);
+
+		// Reads the packets of the main video stream of any media file.
+		// Return value:
+		//   0 if successful, otherwise a negative AVERROR code.
+		int ReadTestClip(const std::string& path, TestClip& clip);
+
+		void FreeTestClip(TestClip& clip);
+
+		// Opens the file without probing the stream parameters.
+		// Return value:
+		//   The format context, or nullptr if it could not be opened.
+		AVFormatContext* OpenTestMedia(const std::string& path);
+
+		// Whether the packet is the given packet of the file.
+		bool HasTestPayload(const AVPacket* avPacket, int streamIndex, int packetIndex);
+
+		// The packet index stored in the payload, or -1 if there is none.
+		int GetTestPacketIndex(const AVPacket* avPacket);
+	}
+}
@@ -0,0 +1,50 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The checks shared by the tests of the portable sources.
+* File Name: TestUtilities.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+
+namespace FFmpegInterop
+{
+	namespace Tests
+	{
+		// The number of failed checks in this process, checks may fail on
+		// any thread.
+		inline std::atomic<int>& FailureCount()
+		{
+			static std::atomic<int> count(0);
+			return count;
+		}
+
+		// The exit code of the test executable.
+		inline int TestResult(const char* testName)
+		{
+			int failures = FailureCount();
+			if (failures > 0)
+			{
+				fprintf(stderr, "%s: %d checks failed\n", testName, failures);
+				return 1;
+			}
+
+			printf("%s: passed\n", testName);
+			return 0;
+		}
+	}
+}
+
+// Reports the failed condition and carries on, so one run shows all failures.
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++FFmpegInterop::Tests::FailureCount(); \
+		} \
+	} while (0)
@@ -0,0 +1,143 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The worker threads shared by the CPU heavy parts of the pipeline.
+* File Name: ThreadPool.cpp
+* License: The MIT License
+******************************************************************************/
+
+#include <atomic>
+
+#include "ThreadPool.h"
+
+using namespace FFmpegInterop;
+
+// The state of one ParallelFor call. Workers which pick up their task after
+// all indices are done still hold a reference, so it lives on the heap.
+struct ThreadPool::Batch
+{
+	Batch(int count, const std::function<void(int, int)>& body)
+		: body(body)
+		, count(count)
+		, next(0)
+		, nextSlot(0)
+		, completed(0)
+	{
+	}
+
+	const std::function<void(int, int)>& body;
+	const int count;
+	std::atomic<int> next;
+	std::atomic<int> nextSlot;
+	std::atomic<int> completed;
+	std::mutex mutex;
+	std::condition_variable done;
+};
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+	: m_stop(false)
+{
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		m_threads.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_taskAvailable.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetShared()
+{
+	// Never destroyed, joining threads while the module unloads can deadlock
+	static ThreadPool* sharedPool = new ThreadPool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+	return *sharedPool;
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& body)
+{
+	ParallelFor(count, count, [&](int index, int) { body(index); });
+}
+
+void ThreadPool::ParallelFor(int count, int maxSlots, const std::function<void(int index, int slot)>& body)
+{
+	if (count <= 1 || maxSlots <= 1 || m_threads.empty())
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			body(i, 0);
+		}
+		return;
+	}
+
+	auto batch = std::make_shared<Batch>(count, body);
+
+	// The calling thread takes one share itself
+	int helpers = count < maxSlots ? count - 1 : maxSlots - 1;
+	if (helpers > static_cast<int>(m_threads.size()))
+	{
+		helpers = static_cast<int>(m_threads.size());
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < helpers; ++i)
+		{
+			m_tasks.push_back([batch] { RunBatch(*batch); });
+		}
+	}
+	m_taskAvailable.notify_all();
+
+	RunBatch(*batch);
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->done.wait(lock, [&] { return batch->completed == count; });
+}
+
+void ThreadPool::RunBatch(Batch& batch)
+{
+	int slot = batch.nextSlot++;
+
+	int index;
+	while ((index = batch.next++) < batch.count)
+	{
+		batch.body(index, slot);
+
+		if (++batch.completed == batch.count)
+		{
+			std::lock_guard<std::mutex> lock(batch.mutex);
+			batch.done.notify_all();
+		}
+	}
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_taskAvailable.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+
+			if (m_stop && m_tasks.empty())
+			{
+				break;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+* Project: VioletCore
+* Description: The worker threads shared by the CPU heavy parts of the pipeline.
+* File Name: ThreadPool.h
+* License: The MIT License
+******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FFmpegInterop
+{
+	// A fixed set of worker threads which run queued tasks in FIFO order.
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(unsigned int threadCount);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// The pool shared by all media sources, with one thread per core.
+		static ThreadPool& GetShared();
+
+		unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_threads.size()); }
+
+		// Calls body with every index from 0 to count - 1, spread across the
+		// workers and the calling thread, and returns when all calls are done.
+		void ParallelFor(int count, const std::function<void(int)>& body);
+
+		// The same, but at most maxSlots threads take part and body is also
+		// given the slot of the calling thread. No two concurrent calls of one
+		// ParallelFor share a slot, so it can index per thread scratch memory.
+		// Indices are claimed one by one, a thread which is done early takes
+		// over the remaining work of the others.
+		void ParallelFor(int count, int maxSlots, const std::function<void(int index, int slot)>& body);
+
+	private:
+		struct Batch;
+
+		void WorkerLoop();
+		static void RunBatch(Batch& batch);
+
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_mutex;
+		std::condition_variable m_taskAvailable;
+		std::deque<std::function<void()>> m_tasks;
+		bool m_stop;
+	};
+}
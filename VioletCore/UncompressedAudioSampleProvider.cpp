@@ -20,6 +20,7 @@
 
 #include "UncompressedAudioSampleProvider.h"
 #include "NativeBufferFactory.h"
+#include "AudioConversion.h"
 
 extern "C"
 {
@@ -36,10 +37,36 @@ UncompressedAudioSampleProvider::UncompressedAudioSampleProvider(
 	int streamIndex)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx, config, streamIndex)
 	, m_pSwrCtx(nullptr)
+	, m_bufferPool(nullptr)
+	, m_retiredAllocations(0)
+	, m_passthroughFrames(0)
+	, m_interleavedFrames(0)
+	, m_resampledFrames(0)
 {
 }
 
 HRESULT FFmpegInterop::UncompressedAudioSampleProvider::AllocateResources()
+{
+	// A format the resampler cannot convert fails here rather than at the first frame which needs it.
+	// Streams which are passed through or only interleaved never need it, so it is freed again and
+	// created when a frame needs it.
+	HRESULT hr = CreateResampler();
+	if (FAILED(hr))
+	{
+		DebugMessage(L"The resampler does not support the audio format\n");
+		return hr;
+	}
+	swr_free(&m_pSwrCtx);
+
+	// Interleaved and resampled frames go into buffers of the pool, passed through ones keep the decoder buffer
+	int frameSamples = m_pAvCodecCtx->frame_size > 0 ? m_pAvCodecCtx->frame_size : 4096;
+	int bufferSize = av_samples_get_buffer_size(NULL, outChannels, frameSamples, outSampleFormat, 1);
+	m_bufferPool = new BufferPool(bufferSize > 0 ? bufferSize : 0, m_config->AudioBufferPoolDepth);
+
+	return S_OK;
+}
+
+HRESULT UncompressedAudioSampleProvider::CreateResampler()
 {
 	HRESULT hr = S_OK;
 	
@@ -79,25 +106,129 @@ UncompressedAudioSampleProvider::~UncompressedAudioSampleProvider()
 	{
 		swr_free(&m_pSwrCtx);
 	}
+
+	if (m_bufferPool)
+	{
+		// Samples which are still alive keep their buffers
+		m_bufferPool->Close();
+	}
+}
+
+BufferPool* UncompressedAudioSampleProvider::GetBufferPool(int size)
+{
+	if (m_bufferPool->GetBufferSize() < size)
+	{
+		// Frames of this size may come again, leave some room for variations
+		std::lock_guard<std::mutex> lock(m_bufferPoolMutex);
+		m_retiredAllocations += m_bufferPool->GetAllocations();
+		m_bufferPool->Close();
+		m_bufferPool = new BufferPool(size + size / 4, m_config->AudioBufferPoolDepth);
+	}
+
+	return m_bufferPool;
+}
+
+unsigned int UncompressedAudioSampleProvider::OutputBuffersInUse::get()
+{
+	std::lock_guard<std::mutex> lock(m_bufferPoolMutex);
+	return m_bufferPool ? m_bufferPool->GetBuffersInUse() : 0;
+}
+
+unsigned int UncompressedAudioSampleProvider::OutputBuffersIdle::get()
+{
+	std::lock_guard<std::mutex> lock(m_bufferPoolMutex);
+	return m_bufferPool ? m_bufferPool->GetIdleBuffers() : 0;
+}
+
+uint64 UncompressedAudioSampleProvider::OutputBufferAllocations::get()
+{
+	std::lock_guard<std::mutex> lock(m_bufferPoolMutex);
+	return m_retiredAllocations + (m_bufferPool ? m_bufferPool->GetAllocations() : 0);
 }
 
 HRESULT UncompressedAudioSampleProvider::CreateBufferFromFrame(IBuffer^* pBuffer, AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration)
 {
 	HRESULT hr = S_OK;
 
-	// Resample uncompressed frame to output format
-	uint8_t **resampledData = nullptr;
-	unsigned int aBufferSize = av_samples_alloc_array_and_samples(&resampledData, NULL, outChannels, avFrame->nb_samples, outSampleFormat, 0);
-	int resampledDataSize = swr_convert(m_pSwrCtx, resampledData, aBufferSize, (const uint8_t **)avFrame->extended_data, avFrame->nb_samples);
+	int bytesPerSample = outChannels * av_get_bytes_per_sample(outSampleFormat);
+	int frameSize = avFrame->nb_samples * bytesPerSample;
+	AVBufferRef* bufferRef = nullptr;
+
+	// Planar frames with the output rate and layout only need their channels interleaved
+	bool outputLayout = HasOutputLayout(avFrame);
+	AudioInterleaveFunction interleave = outputLayout && av_get_packed_sample_fmt(static_cast<AVSampleFormat>(avFrame->format)) == outSampleFormat
+		? GetAudioInterleave(static_cast<AVSampleFormat>(avFrame->format), outChannels)
+		: nullptr;
 
-	if (resampledDataSize < 0)
+	if (outputLayout && CanWrapFrame(avFrame, frameSize))
+	{
+		// The decoder output is already in the output format, the sample keeps a reference to the frame buffer
+		bufferRef = av_buffer_ref(avFrame->buf[0]);
+		if (bufferRef)
+		{
+			*pBuffer = NativeBuffer::NativeBufferFactory::CreateNativeBuffer(avFrame->data[0], frameSize, free_buffer, bufferRef);
+			m_passthroughFrames++;
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else if (interleave)
 	{
-		hr = E_FAIL;
+		// The sample returns the buffer to the pool when it is released
+		bufferRef = GetBufferPool(frameSize)->Acquire();
+		if (bufferRef)
+		{
+			interleave(avFrame->extended_data, bufferRef->data, avFrame->nb_samples);
+			*pBuffer = NativeBuffer::NativeBufferFactory::CreateNativeBuffer(bufferRef->data, frameSize, free_buffer, bufferRef);
+			m_interleavedFrames++;
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
 	}
 	else
 	{
-		auto size = min(aBufferSize, (unsigned int)(resampledDataSize * outChannels * av_get_bytes_per_sample(outSampleFormat)));
-		*pBuffer = NativeBuffer::NativeBufferFactory::CreateNativeBuffer(resampledData[0], size, av_freep, resampledData);
+		// Resample uncompressed frame to output format, into a buffer of the pool
+		if (!m_pSwrCtx)
+		{
+			hr = CreateResampler();
+		}
+
+		int outSamples = SUCCEEDED(hr) ? swr_get_out_samples(m_pSwrCtx, avFrame->nb_samples) : 0;
+		if (SUCCEEDED(hr) && outSamples < 0)
+		{
+			hr = E_FAIL;
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			bufferRef = GetBufferPool(outSamples * bytesPerSample)->Acquire();
+			if (!bufferRef)
+			{
+				hr = E_OUTOFMEMORY;
+			}
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			uint8_t* resampledData = bufferRef->data;
+			int resampledDataSize = swr_convert(m_pSwrCtx, &resampledData, outSamples, (const uint8_t **)avFrame->extended_data, avFrame->nb_samples);
+
+			if (resampledDataSize < 0)
+			{
+				hr = E_FAIL;
+				av_buffer_unref(&bufferRef);
+			}
+			else
+			{
+				// The sample returns the buffer to the pool when it is released
+				*pBuffer = NativeBuffer::NativeBufferFactory::CreateNativeBuffer(bufferRef->data, resampledDataSize * bytesPerSample, free_buffer, bufferRef);
+				m_resampledFrames++;
+			}
+		}
 	}
 	
 	if (SUCCEEDED(hr))
@@ -124,6 +255,26 @@ HRESULT UncompressedAudioSampleProvider::CreateBufferFromFrame(IBuffer^* pBuffer
 	return hr;
 }
 
+bool UncompressedAudioSampleProvider::HasOutputLayout(AVFrame* avFrame)
+{
+	// Samples which the resampler still holds have to come out before the ones of this frame
+	bool resamplerEmpty = !m_pSwrCtx || swr_get_delay(m_pSwrCtx, outSampleRate) == 0;
+
+	return resamplerEmpty
+		&& avFrame->sample_rate == outSampleRate
+		&& avFrame->channels == outChannels
+		&& (avFrame->channel_layout == 0 || static_cast<int64>(avFrame->channel_layout) == outChannelLayout)
+		&& inChannelLayout == outChannelLayout;
+}
+
+bool UncompressedAudioSampleProvider::CanWrapFrame(AVFrame* avFrame, int size)
+{
+	return avFrame->format == outSampleFormat
+		&& avFrame->buf[0] != nullptr
+		&& avFrame->data[0] >= avFrame->buf[0]->data
+		&& avFrame->data[0] + size <= avFrame->buf[0]->data + avFrame->buf[0]->size;
+}
+
 IMediaStreamDescriptor ^ FFmpegInterop::UncompressedAudioSampleProvider::CreateStreamDescriptor()
 {
 	inChannels = outChannels = m_pAvCodecCtx->profile == FF_PROFILE_AAC_HE_V2 && m_pAvCodecCtx->channels == 1 ? 2 : m_pAvCodecCtx->channels;
@@ -18,6 +18,8 @@
 
 #pragma once
 #include "UncompressedSampleProvider.h"
+#include "BufferPool.h"
+#include <mutex>
 
 extern "C"
 {
@@ -31,6 +33,29 @@ namespace FFmpegInterop
 	public:
 		virtual ~UncompressedAudioSampleProvider();
 
+		// Occupancy of the pool of sample buffers, and the number of buffers
+		// allocated so far. The allocations stop once the pool covers the
+		// samples held by the renderer.
+		property unsigned int OutputBuffersInUse { unsigned int get(); }
+		property unsigned int OutputBuffersIdle { unsigned int get(); }
+		property uint64 OutputBufferAllocations { uint64 get(); }
+
+		// Number of samples which wrap the decoded frame, of samples which
+		// only had their channels interleaved, and of samples which went
+		// through the resampler
+		property uint64 PassthroughFrames
+		{
+			uint64 get() { return m_passthroughFrames; }
+		}
+		property uint64 InterleavedFrames
+		{
+			uint64 get() { return m_interleavedFrames; }
+		}
+		property uint64 ResampledFrames
+		{
+			uint64 get() { return m_resampledFrames; }
+		}
+
 	internal:
 		UncompressedAudioSampleProvider(
 			FFmpegReader^ reader,
@@ -41,9 +66,26 @@ namespace FFmpegInterop
 		virtual HRESULT CreateBufferFromFrame(IBuffer^* pBuffer, AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration) override;
 		IMediaStreamDescriptor^ CreateStreamDescriptor() override;
 		virtual HRESULT AllocateResources() override;
+		// Every sample gets its own buffer
+		virtual bool CanDecodeAhead() override { return true; }
 	
 	private:
+		BufferPool* GetBufferPool(int size);
+		HRESULT CreateResampler();
+		bool HasOutputLayout(AVFrame* avFrame);
+		bool CanWrapFrame(AVFrame* avFrame, int size);
+
 		SwrContext* m_pSwrCtx;
+
+		// Every sample gets a buffer of the pool, which is replaced by a
+		// larger one when a frame does not fit
+		std::mutex m_bufferPoolMutex;
+		BufferPool* m_bufferPool;
+		uint64 m_retiredAllocations;
+
+		uint64 m_passthroughFrames;
+		uint64 m_interleavedFrames;
+		uint64 m_resampledFrames;
 		AVSampleFormat inSampleFormat, outSampleFormat;
 		int inSampleRate, outSampleRate, inChannels, outChannels;
 		int64 inChannelLayout, outChannelLayout;
@@ -18,6 +18,7 @@
 
 #include "pch.h"
 #include "UncompressedSampleProvider.h"
+#include "FFmpegReader.h"
 
 using namespace FFmpegInterop;
 
@@ -28,9 +29,69 @@ UncompressedSampleProvider::UncompressedSampleProvider(
 	FFmpegInteropConfig^ config,
 	int streamIndex)
 	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx, config, streamIndex)
+	, m_dropLateFrames(config->DropLateFrames && avCodecCtx->codec_type == AVMEDIA_TYPE_VIDEO)
+	, m_decoderDropLevel(FrameDropPolicy::DropNone)
+	, m_skipToKeyframe(false)
+	, m_frameIsKeyframe(false)
+	, m_droppedFrames(0)
+	, m_keyframeSkips(0)
+	, m_skippedPackets(0)
+	, m_lateness(0)
+	, m_maxLateness(0)
 {
 }
 
+MediaStreamSample^ UncompressedSampleProvider::GetNextSample()
+{
+	if (!m_dropLateFrames)
+	{
+		return MediaSampleProvider::GetNextSample();
+	}
+
+	m_clock.OnRequest();
+
+	// Lateness is judged here rather than when the frame was decoded, which
+	// is a while earlier with decode-ahead
+	auto sample = MediaSampleProvider::GetNextSample();
+	while (sample != nullptr)
+	{
+		int64_t position = sample->Timestamp.Duration;
+		int64_t lateness;
+		if (!m_clock.GetLateness(position, lateness))
+		{
+			break;
+		}
+
+		m_lateness = lateness;
+		if (lateness > m_maxLateness)
+		{
+			m_maxLateness = lateness;
+		}
+
+		m_dropPolicy.OnDeliver(position, lateness, sample->Duration.Duration);
+		if (!m_dropPolicy.ShouldDrop(sample->KeyFrame, lateness))
+		{
+			break;
+		}
+
+		// Decoded ahead while it was still in time
+		bool discontinuous = sample->Discontinuous;
+		m_droppedFrames++;
+		sample = MediaSampleProvider::GetNextSample();
+		if (sample != nullptr && discontinuous)
+		{
+			sample->Discontinuous = true;
+		}
+	}
+
+	if (sample != nullptr)
+	{
+		m_clock.OnDeliver(sample->Timestamp.Duration, sample->Duration.Duration);
+	}
+
+	return sample;
+}
+
 HRESULT UncompressedSampleProvider::CreateNextSampleBuffer(IBuffer^* pBuffer, int64_t& samplePts, int64_t& sampleDuration)
 {
 	HRESULT hr = S_OK;
@@ -52,6 +113,26 @@ HRESULT UncompressedSampleProvider::CreateNextSampleBuffer(IBuffer^* pBuffer, in
 			break;
 		}
 
+		if (SUCCEEDED(hr))
+		{
+			m_frameIsKeyframe = FrameDropPolicy::IsKeyframe(avFrame);
+		}
+
+		if (SUCCEEDED(hr) && m_dropLateFrames && !m_frameIsKeyframe)
+		{
+			// A frame which is late now is even later when it is delivered,
+			// dropping it saves the conversion. Frames which are still in time
+			// are judged again when they are delivered.
+			double timeBase = av_q2d(m_pAvStream->time_base) * 10000000;
+			int64_t lateness;
+			if (m_clock.GetLateness(LONGLONG(timeBase * samplePts) - m_startOffset, lateness) && m_dropPolicy.ShouldDrop(false, lateness))
+			{
+				av_frame_unref(avFrame);
+				m_droppedFrames++;
+				continue;
+			}
+		}
+
 		if (SUCCEEDED(hr))
 		{
 			hr = CreateBufferFromFrame(pBuffer, avFrame, samplePts, sampleDuration);
@@ -139,6 +220,11 @@ HRESULT UncompressedSampleProvider::FeedPacketToDecoder()
 	LONGLONG pts = 0;
 	LONGLONG dur = 0;
 
+	if (m_dropLateFrames)
+	{
+		ApplyDropLevel();
+	}
+
 	hr = GetNextPacket(&avPacket, pts, dur);
 	if (hr == S_FALSE)
 	{
@@ -155,8 +241,23 @@ HRESULT UncompressedSampleProvider::FeedPacketToDecoder()
 			hr = S_OK;
 		}
 	}
+	else if (SUCCEEDED(hr) && m_skipToKeyframe && !(avPacket->flags & AV_PKT_FLAG_KEY))
+	{
+		// Catching up with playback, nothing up to the next keyframe is decoded
+		m_skippedPackets++;
+	}
 	else if (SUCCEEDED(hr))
 	{
+		if (m_skipToKeyframe)
+		{
+			// The late frames the decoder still holds are not needed anymore
+			avcodec_flush_buffers(m_pAvCodecCtx);
+			m_skipToKeyframe = false;
+			m_isDiscontinuous = true;
+			m_keyframeSkips++;
+			m_dropPolicy.OnSkipEnd(LONGLONG(av_q2d(m_pAvStream->time_base) * 10000000 * pts) - m_startOffset);
+		}
+
 		// Feed packet to decoder.
 		int sendPacketResult = avcodec_send_packet(m_pAvCodecCtx, avPacket);
 		if (sendPacketResult == AVERROR(EAGAIN))
@@ -180,10 +281,8 @@ HRESULT UncompressedSampleProvider::FeedPacketToDecoder()
 		}
 	}
 
-	if (avPacket)
-	{
-		av_packet_free(&avPacket);
-	}
+	// Recycle the packet
+	m_pReader->ReleasePacket(avPacket);
 
 	return hr;
 }
@@ -194,4 +293,38 @@ void FFmpegInterop::UncompressedSampleProvider::Flush()
 
 	// after seek we need to get first packet pts again
 	hasNextFramePts = false;
+
+	// Playback starts over at the new position, in full quality
+	if (m_dropLateFrames)
+	{
+		m_clock.Reset();
+		m_dropPolicy.Reset();
+		ApplyDropLevel();
+		m_skipToKeyframe = false;
+		m_lateness = 0;
+	}
+}
+
+HRESULT UncompressedSampleProvider::SetSampleProperties(MediaStreamSample^ sample)
+{
+	// Late samples other than keyframes are dropped when they are delivered
+	sample->KeyFrame = m_frameIsKeyframe;
+	return S_OK;
+}
+
+void UncompressedSampleProvider::ApplyDropLevel()
+{
+	if (m_dropPolicy.TakeSkipRequest())
+	{
+		m_skipToKeyframe = true;
+	}
+
+	FrameDropPolicy::Level level = m_dropPolicy.GetLevel();
+	if (level != m_decoderDropLevel)
+	{
+		// Frame threads take the new values with the next packet
+		m_pAvCodecCtx->skip_frame = FrameDropPolicy::GetSkipFrame(level);
+		m_pAvCodecCtx->skip_loop_filter = FrameDropPolicy::GetSkipLoopFilter(level);
+		m_decoderDropLevel = level;
+	}
 }
@@ -18,6 +18,8 @@
 
 #pragma once
 #include "MediaSampleProvider.h"
+#include "FrameDropPolicy.h"
+#include "PresentationClock.h"
 
 extern "C"
 {
@@ -39,13 +41,66 @@ namespace FFmpegInterop
 		virtual HRESULT CreateBufferFromFrame(IBuffer^* pBuffer, AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration) = 0;
 		virtual HRESULT GetFrameFromFFmpegDecoder(AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration);
 		virtual HRESULT FeedPacketToDecoder();
+		virtual HRESULT SetSampleProperties(MediaStreamSample^ sample) override;
 
 	public:
+		virtual MediaStreamSample^ GetNextSample() override;
 		virtual void Flush() override;
 
+		// Late frames which were decoded but not delivered. Frames the decoder
+		// skipped as non-reference frames are not counted.
+		property uint64 DroppedFrames
+		{
+			uint64 get() { return m_droppedFrames; }
+		}
+
+		// How often decoding skipped ahead to the next keyframe, and the
+		// packets it did not decode for that
+		property uint64 KeyframeSkips
+		{
+			uint64 get() { return m_keyframeSkips; }
+		}
+		property uint64 SkippedPackets
+		{
+			uint64 get() { return m_skippedPackets; }
+		}
+
+		// How far the last delivered frame was behind the estimated playback
+		// position, and the most it was so far
+		property TimeSpan Lateness
+		{
+			TimeSpan get() { return { m_lateness.load() }; }
+		}
+		property TimeSpan MaxLateness
+		{
+			TimeSpan get() { return { m_maxLateness.load() }; }
+		}
+
+		// Number of pauses found by the playback position estimate
+		property uint64 DetectedPauses
+		{
+			uint64 get() { return m_clock.GetPauses(); }
+		}
+
 	private:
+		void ApplyDropLevel();
+
 		int64 nextFramePts;
 		bool hasNextFramePts;
+
+		bool m_dropLateFrames;
+		PresentationClock m_clock;
+		FrameDropPolicy m_dropPolicy;
+		// Used by the decoding thread only
+		FrameDropPolicy::Level m_decoderDropLevel;
+		bool m_skipToKeyframe;
+		bool m_frameIsKeyframe;
+		// Frames are dropped by the decoding thread and while they are delivered
+		std::atomic<uint64> m_droppedFrames;
+		std::atomic<uint64> m_keyframeSkips;
+		std::atomic<uint64> m_skippedPackets;
+		std::atomic<int64> m_lateness;
+		std::atomic<int64> m_maxLateness;
 	};
 }
 
@@ -19,7 +19,10 @@
 #include "pch.h"
 #include "UncompressedVideoSampleProvider.h"
 #include "NativeBufferFactory.h"
+#include "ThreadPool.h"
 #include <mfapi.h>
+#include <algorithm>
+#include <atomic>
 
 extern "C"
 {
@@ -30,6 +33,50 @@ using namespace FFmpegInterop;
 using namespace NativeBuffer;
 using namespace Windows::Media::MediaProperties;
 
+namespace
+{
+	// The decoder may write up to this many bytes beyond the planes
+	const int FrameBufferPadding = 64;
+
+	// Frames are only split into bands of at least this many pixels, the
+	// conversion of smaller ones is not worth a hand-off to another thread
+	const int MinBandPixels = 512 * 1024;
+
+	// Converters kept for streams which switch between a few frame formats
+	const size_t MaxConverters = 4;
+
+	// Moves the plane pointers of a picture down to the given luma row
+	void OffsetPlanes(const AVPixFmtDescriptor* descriptor, uint8_t* const data[4], const int linesize[4], int y, uint8_t* result[4])
+	{
+		for (int plane = 0; plane < 4; plane++)
+		{
+			int shift = plane == 1 || plane == 2 ? descriptor->log2_chroma_h : 0;
+			result[plane] = data[plane] ? data[plane] + (y >> shift) * linesize[plane] : nullptr;
+		}
+	}
+
+	// Bands start on even rows, so that they also split the chroma rows of 4:2:0 pictures
+	void GetBand(int band, int bands, int height, int& sliceY, int& sliceHeight)
+	{
+		int bandHeight = FFALIGN(height / bands, 2);
+
+		sliceY = band * bandHeight;
+		sliceHeight = band == bands - 1 ? height - sliceY : bandHeight;
+	}
+
+	// Computes the layout of an NV12 frame in a single buffer, which the
+	// decoder accepts and which is also the layout of the output samples.
+	// The chroma plane follows the luma plane with the same line size.
+	void GetContiguousLayout(AVCodecContext* avCodecCtx, int width, int height, int& lineSize, int& alignedHeight)
+	{
+		int linesizeAlign[AV_NUM_DATA_POINTERS];
+		avcodec_align_dimensions2(avCodecCtx, &width, &height, linesizeAlign);
+
+		lineSize = FFALIGN(width, 64);
+		alignedHeight = FFALIGN(height, 2);
+	}
+}
+
 UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(
 	FFmpegReader^ reader,
 	AVFormatContext* avFormatCtx,
@@ -37,132 +84,324 @@ UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(
 	FFmpegInteropConfig^ config,
 	int streamIndex)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx, config, streamIndex)
+	, m_maxOutputWidth(0)
+	, m_maxOutputHeight(0)
+	, m_decodedFrameBytes(0)
+	, m_outputFrameBytes(0)
+	, m_formatChanges(0)
+	, m_zeroCopy(false)
+	, m_zeroCopyFrames(0)
+	, m_convertedFrames(0)
 {
-	for (int i = 0; i < 4; i++)
-	{
-		this->m_VideoBufferLineSize[i] = 0;
-		this->m_VideoBufferData[i] = nullptr;
-	}
 }
 
 IMediaStreamDescriptor^ UncompressedVideoSampleProvider::CreateStreamDescriptor()
 {
-	// We use NV12 format, NV12 is generally the preferred format.
-	m_OutputPixelFormat = AV_PIX_FMT_NV12;
-	OutputMediaSubtype = MediaEncodingSubtypes::Nv12;
+	if (IsHighBitDepthFormat(m_pAvCodecCtx->pix_fmt) && !m_config->ForceNv12Output)
+	{
+		// P010 keeps the precision of 10 bit video
+		m_OutputPixelFormat = AV_PIX_FMT_P010;
+		OutputMediaSubtype = MediaEncodingSubtypes::P010;
+	}
+	else
+	{
+		// We use NV12 format, NV12 is generally the preferred format.
+		m_OutputPixelFormat = AV_PIX_FMT_NV12;
+		OutputMediaSubtype = MediaEncodingSubtypes::Nv12;
+	}
 
-	DecoderWidth = m_pAvCodecCtx->width;
-	DecoderHeight = m_pAvCodecCtx->height;
+	// Decoders which output NV12 and let us allocate their frames can hand them to the sample without a copy.
+	// The sample then has the padded size of the frame buffer, the aperture crops it.
+	m_zeroCopy = m_pAvCodecCtx->pix_fmt == AV_PIX_FMT_NV12 && (m_pAvCodecCtx->codec->capabilities & AV_CODEC_CAP_DR1);
+
+	m_maxOutputWidth = static_cast<int>(m_config->MaxVideoWidth);
+	m_maxOutputHeight = static_cast<int>(m_config->MaxVideoHeight);
+	m_frameFormat = GetOutputFormat(m_pAvCodecCtx->width, m_pAvCodecCtx->height, m_pAvCodecCtx->pix_fmt);
+	m_sampleFormat = m_frameFormat;
 
 	// Create the StreamDescriptor.
 	VideoEncodingProperties^ videoProperties = 
 		VideoEncodingProperties::CreateUncompressed(
-			OutputMediaSubtype, DecoderWidth, DecoderHeight);
+			OutputMediaSubtype, m_frameFormat.width, m_frameFormat.height);
 
 	SetCommonVideoEncodingProperties(videoProperties);
+	SetEncodingProperties(videoProperties, m_frameFormat);
 
-	if (DecoderWidth != m_pAvCodecCtx->width || DecoderHeight != m_pAvCodecCtx->height)
+	if (m_pAvCodecCtx->sample_aspect_ratio.num > 0 && m_pAvCodecCtx->sample_aspect_ratio.den != 0)
+	{
+		videoProperties->PixelAspectRatio->Numerator = m_pAvCodecCtx->sample_aspect_ratio.num;
+		videoProperties->PixelAspectRatio->Denominator = m_pAvCodecCtx->sample_aspect_ratio.den;
+	}
+
+	videoProperties->Properties->Insert(
+		Guid(MF_MT_INTERLACE_MODE),
+		ref new Box<uint32>(_MFVideoInterlaceMode::MFVideoInterlace_MixedInterlaceOrProgressive));
+
+	return ref new VideoStreamDescriptor(videoProperties);
+}
+
+void UncompressedVideoSampleProvider::SetEncodingProperties(VideoEncodingProperties^ videoProperties, const OutputFormat& format)
+{
+	videoProperties->Width = format.width;
+	videoProperties->Height = format.height;
+
+	auto properties = videoProperties->Properties;
+	if (format.width != format.displayWidth || format.height != format.displayHeight)
 	{
 		MFVideoArea area;
-		area.Area.cx = m_pAvCodecCtx->width;
-		area.Area.cy = m_pAvCodecCtx->height;
+		area.Area.cx = format.displayWidth;
+		area.Area.cy = format.displayHeight;
 		area.OffsetX.fract = 0;
 		area.OffsetX.value = 0;
 		area.OffsetY.fract = 0;
 		area.OffsetY.value = 0;
-		videoProperties->Properties->Insert(
+		properties->Insert(
 			Guid(MF_MT_MINIMUM_DISPLAY_APERTURE),
 			ArrayReference<byte>(reinterpret_cast<byte*>(&area), sizeof(MFVideoArea)));
 	}
-
-	if (m_pAvCodecCtx->sample_aspect_ratio.num > 0 && m_pAvCodecCtx->sample_aspect_ratio.den != 0)
+	else if (properties->HasKey(Guid(MF_MT_MINIMUM_DISPLAY_APERTURE)))
 	{
-		videoProperties->PixelAspectRatio->Numerator = m_pAvCodecCtx->sample_aspect_ratio.num;
-		videoProperties->PixelAspectRatio->Denominator = m_pAvCodecCtx->sample_aspect_ratio.den;
+		properties->Remove(Guid(MF_MT_MINIMUM_DISPLAY_APERTURE));
 	}
 
-	if (m_OutputPixelFormat == AV_PIX_FMT_YUVJ420P)
+	if (format.fullRange)
 	{
-		// YUVJ420P uses full range values
-		videoProperties->Properties->Insert(
+		// YUVJ420P uses full range values, which the NV12 conversion keeps
+		properties->Insert(
 			Guid(MF_MT_VIDEO_NOMINAL_RANGE),
 			ref new Box<uint32>(MFNominalRange_0_255));
 	}
+	else if (properties->HasKey(Guid(MF_MT_VIDEO_NOMINAL_RANGE)))
+	{
+		properties->Remove(Guid(MF_MT_VIDEO_NOMINAL_RANGE));
+	}
 
-	videoProperties->Properties->Insert(
-		Guid(MF_MT_INTERLACE_MODE),
-		ref new Box<uint32>(_MFVideoInterlaceMode::MFVideoInterlace_MixedInterlaceOrProgressive));
+	DecoderWidth = format.width;
+	DecoderHeight = format.height;
+}
 
-	return ref new VideoStreamDescriptor(videoProperties);
+UncompressedVideoSampleProvider::OutputFormat UncompressedVideoSampleProvider::GetOutputFormat(int width, int height, AVPixelFormat format)
+{
+	OutputFormat result;
+	result.width = width;
+	result.height = height;
+	result.displayWidth = width;
+	result.displayHeight = height;
+	result.fullRange = format == AV_PIX_FMT_YUVJ420P;
+
+	int maxWidth = m_maxOutputWidth;
+	int maxHeight = m_maxOutputHeight;
+	if ((maxWidth > 0 && width > maxWidth) || (maxHeight > 0 && height > maxHeight))
+	{
+		// Fit into the maximum size with the aspect ratio of the frame, the scaler converts to limited range
+		double scale = min(
+			maxWidth > 0 ? static_cast<double>(maxWidth) / width : 1.0,
+			maxHeight > 0 ? static_cast<double>(maxHeight) / height : 1.0);
+		result.width = max(2, static_cast<int>(width * scale) & ~1);
+		result.height = max(2, static_cast<int>(height * scale) & ~1);
+		result.displayWidth = result.width;
+		result.displayHeight = result.height;
+		result.fullRange = false;
+	}
+	else if (m_zeroCopy)
+	{
+		// Converted frames get the layout of the wrapped ones, so that the stream format stays the same
+		GetContiguousLayout(m_pAvCodecCtx, width, height, result.width, result.height);
+	}
+
+	return result;
 }
 
 HRESULT FFmpegInterop::UncompressedVideoSampleProvider::AllocateResources()
+{
+	if (m_zeroCopy)
+	{
+		m_pAvCodecCtx->opaque = &m_frameBufferPool;
+		m_pAvCodecCtx->get_buffer2 = GetContiguousBuffer;
+#if LIBAVCODEC_VERSION_MAJOR < 60
+		// GetContiguousBuffer is thread safe, so frame threads may call it
+		// directly. Like get_buffer2, the frame threads take it over with
+		// the next packet. From FFmpeg 6 on callbacks must always be thread
+		// safe and the field is gone.
+		m_pAvCodecCtx->thread_safe_callbacks = 1;
+#endif
+	}
+
+	// Prepare the conversion of the initial format, other ones are added when they show up
+	std::lock_guard<std::mutex> lock(m_convertersMutex);
+	FrameConverter* converter;
+	return CreateConverter(m_pAvCodecCtx->width, m_pAvCodecCtx->height, m_pAvCodecCtx->pix_fmt, m_frameFormat, &converter);
+}
+
+UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
+{
+	// The worker converts frames and the frame threads request buffers from
+	// the pool, both are gone once the decoder is closed
+	StopDecodeAhead();
+	avcodec_close(m_pAvCodecCtx);
+
+	for (auto converter : m_converters)
+	{
+		FreeConverter(converter);
+	}
+}
+
+HRESULT UncompressedVideoSampleProvider::GetConverter(AVFrame* avFrame, const OutputFormat& output, FrameConverter** converter)
+{
+	auto format = static_cast<AVPixelFormat>(avFrame->format);
+	auto matches = [&](FrameConverter* entry)
+	{
+		return entry->width == avFrame->width && entry->height == avFrame->height && entry->format == format && entry->output == output;
+	};
+
+	if (!m_converters.empty() && matches(m_converters.front()))
+	{
+		*converter = m_converters.front();
+		return S_OK;
+	}
+
+	std::lock_guard<std::mutex> lock(m_convertersMutex);
+	auto entry = std::find_if(m_converters.begin(), m_converters.end(), matches);
+	if (entry != m_converters.end())
+	{
+		// Move the format back to the front
+		*converter = *entry;
+		m_converters.erase(entry);
+		m_converters.insert(m_converters.begin(), *converter);
+		return S_OK;
+	}
+
+	return CreateConverter(avFrame->width, avFrame->height, format, output, converter);
+}
+
+HRESULT UncompressedVideoSampleProvider::CreateConverter(int width, int height, AVPixelFormat format, const OutputFormat& output, FrameConverter** converter)
 {
 	HRESULT hr = S_OK;
-	
+
+	// Called with the converters locked
+	auto result = new FrameConverter();
+	result->width = width;
+	result->height = height;
+	result->format = format;
+	result->output = output;
+
+	// Frames which are scaled down need the software scaler
+	bool scaled = output.displayWidth != width || output.displayHeight != height;
+	result->convert = scaled ? nullptr : GetPixelConversion(format, m_OutputPixelFormat);
+
 	// Setup software scaler to convert frame to output pixel type
-	m_pSwsCtx = sws_getContext(
-		m_pAvCodecCtx->width,
-		m_pAvCodecCtx->height,
-		m_pAvCodecCtx->pix_fmt,
-		m_pAvCodecCtx->width,
-		m_pAvCodecCtx->height,
+	result->swsCtx = sws_getContext(
+		width,
+		height,
+		format,
+		output.displayWidth,
+		output.displayHeight,
 		m_OutputPixelFormat,
 		SWS_BICUBIC,
 		NULL,
 		NULL,
 		NULL);
 
-	if (m_pSwsCtx == nullptr)
+	if (result->swsCtx == nullptr)
 	{
 		hr = E_OUTOFMEMORY;
 	}
 
-	// Allocate a frame for output.
+	// Split large frames into one band per conversion thread. Scaling, vertical chroma resampling and dithering need
+	// the rows of the neighbouring bands, they would leave seams, so those frames are converted at once.
+	bool banded = !scaled && (result->convert || CanConvertInBands(format, m_OutputPixelFormat));
+	unsigned int threads = m_config->ConversionThreads > 0 ? m_config->ConversionThreads : ThreadPool::GetShared().GetThreadCount() + 1;
+	result->bands = banded ? max(1, min(static_cast<int>(threads), width * height / MinBandPixels)) : 1;
+
+	for (int band = 0; SUCCEEDED(hr) && result->bands > 1 && band < result->bands; band++)
 	{
-		if (av_image_fill_linesizes(
-			this->m_VideoBufferLineSize, 
-			this->m_OutputPixelFormat,
-			DecoderWidth) < 0)
+		int sliceY, sliceHeight;
+		GetBand(band, result->bands, height, sliceY, sliceHeight);
+
+		// Every band is converted like a picture of its own
+		auto bandSwsCtx = sws_getContext(
+			width,
+			sliceHeight,
+			format,
+			width,
+			sliceHeight,
+			m_OutputPixelFormat,
+			SWS_BICUBIC,
+			NULL,
+			NULL,
+			NULL);
+
+		if (bandSwsCtx == nullptr)
 		{
-			hr = E_FAIL;
+			hr = E_OUTOFMEMORY;
 		}
 		else
 		{
-			int YBufferSize = this->m_VideoBufferLineSize[0] * DecoderHeight;
-			int UBufferSize = this->m_VideoBufferLineSize[1] * DecoderHeight / 2;
-			int VBufferSize = this->m_VideoBufferLineSize[2] * DecoderHeight / 2;
-			int YUVBufferSize = YBufferSize + UBufferSize + VBufferSize;
+			result->bandSwsCtx.push_back(bandSwsCtx);
+		}
+	}
 
-			this->m_VideoBuffer = reinterpret_cast<uint8_t*>(malloc(YUVBufferSize));
-			if (nullptr == this->m_VideoBuffer)
-			{
-				hr = E_OUTOFMEMORY;
-			}
+	// Create the pool of output frames.
+	if (SUCCEEDED(hr))
+	{
+		int YUVBufferSize = -1;
+		if (av_image_fill_linesizes(
+			result->lineSize, 
+			m_OutputPixelFormat,
+			result->output.width) >= 0)
+		{
+			// Odd heights have a chroma row more than half of the luma rows
+			YUVBufferSize = GetPlaneSizes(m_OutputPixelFormat, result->output.height, result->lineSize, result->planeSize);
+		}
 
-			this->m_VideoBufferData[0] = this->m_VideoBuffer;
-			this->m_VideoBufferData[1] = UBufferSize > 0 ? this->m_VideoBufferData[0] + YBufferSize : nullptr;
-			this->m_VideoBufferData[2] = VBufferSize > 0 ? this->m_VideoBufferData[1] + UBufferSize : nullptr;
-			this->m_VideoBufferData[3] = nullptr;
+		if (YUVBufferSize < 0)
+		{
+			hr = E_FAIL;
+		}
+		else
+		{
+			result->bufferPool = new BufferPool(YUVBufferSize, m_config->VideoBufferPoolDepth);
+		}
+	}
 
-			this->m_VideoBufferObject = M2MakeIBuffer(this->m_VideoBuffer, YUVBufferSize);
+	if (SUCCEEDED(hr))
+	{
+		if (m_converters.size() >= MaxConverters)
+		{
+			FreeConverter(m_converters.back());
+			m_converters.pop_back();
 		}
+
+		m_converters.insert(m_converters.begin(), result);
+		*converter = result;
+	}
+	else
+	{
+		FreeConverter(result);
 	}
 
 	return hr;
 }
 
-UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
+void UncompressedVideoSampleProvider::FreeConverter(FrameConverter* converter)
 {
-	if (nullptr != this->m_pSwsCtx)
+	if (nullptr != converter->swsCtx)
+	{
+		sws_freeContext(converter->swsCtx);
+	}
+
+	for (auto bandSwsCtx : converter->bandSwsCtx)
 	{
-		sws_freeContext(this->m_pSwsCtx);
+		sws_freeContext(bandSwsCtx);
 	}
 
-	if (nullptr != this->m_VideoBuffer)
+	if (nullptr != converter->bufferPool)
 	{
-		free(this->m_VideoBuffer);
+		// Samples which are still alive keep their buffers
+		converter->bufferPool->Close();
 	}
+
+	delete converter;
 }
 
 HRESULT UncompressedVideoSampleProvider::CreateBufferFromFrame(IBuffer^* pBuffer, AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration)
@@ -171,22 +410,46 @@ HRESULT UncompressedVideoSampleProvider::CreateBufferFromFrame(IBuffer^* pBuffer
 	
 	HRESULT hr = S_OK;
 
-	// Convert to output format using FFmpeg software scaler
-	if (sws_scale(
-		m_pSwsCtx,
-		(const uint8_t **)(avFrame->data),
-		avFrame->linesize,
-		0,
-		m_pAvCodecCtx->height,
-		this->m_VideoBufferData,
-		this->m_VideoBufferLineSize) > 0)
+	OutputFormat outputFormat = GetOutputFormat(avFrame->width, avFrame->height, static_cast<AVPixelFormat>(avFrame->format));
+	FrameConverter* converter = nullptr;
+
+	m_decodedFrameBytes = av_image_get_buffer_size(static_cast<AVPixelFormat>(avFrame->format), avFrame->width, avFrame->height, 1);
+
+	if (CanWrapFrame(avFrame, outputFormat))
 	{
-		*pBuffer = this->m_VideoBufferObject;
+		// The sample keeps a reference to the frame buffer until it is released
+		AVBufferRef* bufferRef = av_buffer_ref(avFrame->buf[0]);
+		if (bufferRef)
+		{
+			m_outputFrameBytes = outputFormat.width * outputFormat.height * 3 / 2;
+			*pBuffer = NativeBufferFactory::CreateNativeBuffer(avFrame->data[0], m_outputFrameBytes, free_buffer, bufferRef);
+			m_frameFormat = outputFormat;
+			m_zeroCopyFrames++;
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
 	}
-	else
+	else if (SUCCEEDED(hr = GetConverter(avFrame, outputFormat, &converter)))
 	{
-		av_freep(this->m_VideoBufferData);
-		hr = E_FAIL;
+		// The sample returns the buffer to the pool when it is released
+		AVBufferRef* bufferRef = converter->bufferPool->Acquire();
+		if (!bufferRef)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+		else if (SUCCEEDED(hr = ConvertFrame(avFrame, converter, bufferRef->data)))
+		{
+			m_outputFrameBytes = converter->bufferPool->GetBufferSize();
+			*pBuffer = NativeBufferFactory::CreateNativeBuffer(bufferRef->data, m_outputFrameBytes, free_buffer, bufferRef);
+			m_frameFormat = converter->output;
+			m_convertedFrames++;
+		}
+		else
+		{
+			av_buffer_unref(&bufferRef);
+		}
 	}
 
 	// Don't set a timestamp on S_FALSE
@@ -202,8 +465,191 @@ HRESULT UncompressedVideoSampleProvider::CreateBufferFromFrame(IBuffer^* pBuffer
 	return hr;
 }
 
+HRESULT UncompressedVideoSampleProvider::ConvertFrame(AVFrame* avFrame, FrameConverter* converter, uint8_t* buffer)
+{
+	HRESULT hr = S_OK;
+
+	uint8_t* outputData[4];
+	outputData[0] = buffer;
+	for (int plane = 1; plane < 4; plane++)
+	{
+		outputData[plane] = converter->planeSize[plane] > 0 ? outputData[plane - 1] + converter->planeSize[plane - 1] : nullptr;
+	}
+
+	// 4:2:0 planar only needs a luma copy and a chroma interleave
+	if (converter->convert)
+	{
+		ThreadPool::GetShared().ParallelFor(converter->bands, [&](int band)
+		{
+			int sliceY, sliceHeight;
+			GetBand(band, converter->bands, avFrame->height, sliceY, sliceHeight);
+
+			converter->convert(
+				avFrame->data,
+				avFrame->linesize,
+				outputData,
+				converter->lineSize,
+				avFrame->width,
+				sliceY,
+				sliceHeight);
+		});
+	}
+	// Convert to output format using FFmpeg software scaler, in parallel if the frame is large
+	else if (!converter->bandSwsCtx.empty())
+	{
+		if (!ScaleBands(avFrame, converter, outputData))
+		{
+			hr = E_FAIL;
+		}
+	}
+	else if (sws_scale(
+		converter->swsCtx,
+		(const uint8_t **)(avFrame->data),
+		avFrame->linesize,
+		0,
+		avFrame->height,
+		outputData,
+		converter->lineSize) <= 0)
+	{
+		hr = E_FAIL;
+	}
+
+	return hr;
+}
+
+bool UncompressedVideoSampleProvider::ScaleBands(AVFrame* avFrame, FrameConverter* converter, uint8_t* const outputData[4])
+{
+	auto sourceDescriptor = av_pix_fmt_desc_get(converter->format);
+	auto outputDescriptor = av_pix_fmt_desc_get(m_OutputPixelFormat);
+	std::atomic<bool> succeeded(sourceDescriptor != nullptr && outputDescriptor != nullptr);
+
+	if (succeeded)
+	{
+		ThreadPool::GetShared().ParallelFor(converter->bands, [&](int band)
+		{
+			int sliceY, sliceHeight;
+			GetBand(band, converter->bands, avFrame->height, sliceY, sliceHeight);
+
+			uint8_t* sourceData[4];
+			uint8_t* bandData[4];
+			OffsetPlanes(sourceDescriptor, avFrame->data, avFrame->linesize, sliceY, sourceData);
+			OffsetPlanes(outputDescriptor, outputData, converter->lineSize, sliceY, bandData);
+
+			if (sws_scale(converter->bandSwsCtx[band], sourceData, avFrame->linesize, 0, sliceHeight, bandData, converter->lineSize) <= 0)
+			{
+				succeeded = false;
+			}
+		});
+	}
+
+	return succeeded;
+}
+
+unsigned int UncompressedVideoSampleProvider::OutputBuffersInUse::get()
+{
+	std::lock_guard<std::mutex> lock(m_convertersMutex);
+	return m_converters.empty() ? 0 : m_converters.front()->bufferPool->GetBuffersInUse();
+}
+
+unsigned int UncompressedVideoSampleProvider::OutputBuffersIdle::get()
+{
+	std::lock_guard<std::mutex> lock(m_convertersMutex);
+	return m_converters.empty() ? 0 : m_converters.front()->bufferPool->GetIdleBuffers();
+}
+
+uint64 UncompressedVideoSampleProvider::OutputBufferAllocations::get()
+{
+	std::lock_guard<std::mutex> lock(m_convertersMutex);
+	return m_converters.empty() ? 0 : m_converters.front()->bufferPool->GetAllocations();
+}
+
+void UncompressedVideoSampleProvider::SetMaximumOutputSize(int width, int height)
+{
+	// Takes effect with the next frame, which gets another converter
+	m_maxOutputWidth = width;
+	m_maxOutputHeight = height;
+}
+
+void UncompressedVideoSampleProvider::OnDeliverSample(MediaStreamSample^ sample)
+{
+	std::lock_guard<std::mutex> lock(m_formatMutex);
+	if (!m_pendingFormats.empty() && m_pendingFormats.front().sample == sample)
+	{
+		ChangeOutputFormat(m_pendingFormats.front().format);
+		m_pendingFormats.pop_front();
+	}
+}
+
+void UncompressedVideoSampleProvider::Flush()
+{
+	UncompressedSampleProvider::Flush();
+
+	// The samples decoded ahead are gone, the stream continues in the format of the last one
+	std::lock_guard<std::mutex> lock(m_formatMutex);
+	if (!m_pendingFormats.empty())
+	{
+		ChangeOutputFormat(m_pendingFormats.back().format);
+		m_pendingFormats.clear();
+	}
+}
+
+void UncompressedVideoSampleProvider::ChangeOutputFormat(const OutputFormat& format)
+{
+	// The media source switches the format before it renders the next sample
+	auto videoDescriptor = safe_cast<VideoStreamDescriptor^>(StreamDescriptor);
+	SetEncodingProperties(videoDescriptor->EncodingProperties, format);
+	m_formatChanges++;
+}
+
+int UncompressedVideoSampleProvider::GetContiguousBuffer(AVCodecContext* avCodecCtx, AVFrame* avFrame, int flags)
+{
+	if (avFrame->format != AV_PIX_FMT_NV12)
+	{
+		return avcodec_default_get_buffer2(avCodecCtx, avFrame, flags);
+	}
+
+	int lineSize, alignedHeight;
+	GetContiguousLayout(avCodecCtx, avFrame->width, avFrame->height, lineSize, alignedHeight);
+
+	int lumaSize = lineSize * alignedHeight;
+	auto frameBufferPool = static_cast<FrameBufferPool*>(avCodecCtx->opaque);
+	AVBufferRef* buffer = frameBufferPool->Get(lumaSize + lumaSize / 2 + FrameBufferPadding);
+	if (!buffer)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	avFrame->buf[0] = buffer;
+	avFrame->data[0] = buffer->data;
+	avFrame->data[1] = buffer->data + lumaSize;
+	avFrame->linesize[0] = lineSize;
+	avFrame->linesize[1] = lineSize;
+	avFrame->extended_data = avFrame->data;
+
+	return 0;
+}
+
+bool UncompressedVideoSampleProvider::CanWrapFrame(AVFrame* avFrame, const OutputFormat& format)
+{
+	// Frames from another allocator, or which are scaled down, need the copy
+	int lumaSize = format.width * format.height;
+	return m_zeroCopy
+		&& format.displayWidth == avFrame->width
+		&& format.displayHeight == avFrame->height
+		&& avFrame->format == AV_PIX_FMT_NV12
+		&& avFrame->buf[0] != nullptr
+		&& avFrame->buf[1] == nullptr
+		&& avFrame->linesize[0] == format.width
+		&& avFrame->linesize[1] == format.width
+		&& avFrame->data[0] == avFrame->buf[0]->data
+		&& avFrame->data[1] == avFrame->data[0] + lumaSize
+		&& avFrame->buf[0]->size >= lumaSize + lumaSize / 2;
+}
+
 HRESULT UncompressedVideoSampleProvider::SetSampleProperties(MediaStreamSample^ sample)
 {
+	UncompressedSampleProvider::SetSampleProperties(sample);
+
 	MediaStreamSamplePropertySet^ ExtendedProperties = sample->ExtendedProperties;
 	
 	ExtendedProperties->Insert(
@@ -251,5 +697,14 @@ HRESULT UncompressedVideoSampleProvider::SetSampleProperties(MediaStreamSample^
 			ref new Box<uint32>(MFMTVideoChromaSitingValue));
 	}
 
+	if (!(m_frameFormat == m_sampleFormat))
+	{
+		// The stream descriptor changes when this sample is delivered
+		std::lock_guard<std::mutex> lock(m_formatMutex);
+		PendingFormat pending = { sample, m_frameFormat };
+		m_pendingFormats.push_back(pending);
+		m_sampleFormat = m_frameFormat;
+	}
+
 	return S_OK;
 }
@@ -18,6 +18,13 @@
 
 #pragma once
 #include "UncompressedSampleProvider.h"
+#include "BufferPool.h"
+#include "FrameBufferPool.h"
+#include "PixelConversion.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
 
 extern "C"
 {
@@ -36,6 +43,42 @@ namespace FFmpegInterop
 		property int DecoderWidth;
 		property int DecoderHeight;
 
+		// Number of samples which wrap the decoded frame, and of samples which
+		// were converted into the output buffer
+		property uint64 ZeroCopyFrames
+		{
+			uint64 get() { return m_zeroCopyFrames; }
+		}
+		property uint64 ConvertedFrames
+		{
+			uint64 get() { return m_convertedFrames; }
+		}
+
+		// Occupancy of the output buffer pool of the current frame size, buffers
+		// in use are held by decoded-ahead samples or by the renderer
+		property unsigned int OutputBuffersInUse { unsigned int get(); }
+		property unsigned int OutputBuffersIdle { unsigned int get(); }
+		property uint64 OutputBufferAllocations { uint64 get(); }
+
+		// Size of the last decoded frame, and of the last sample. The sample is
+		// smaller if the frame was scaled down to the maximum output size.
+		property unsigned int DecodedFrameBytes
+		{
+			unsigned int get() { return m_decodedFrameBytes; }
+		}
+		property unsigned int OutputFrameBytes
+		{
+			unsigned int get() { return m_outputFrameBytes; }
+		}
+
+		// Number of times the frame size or format changed during playback
+		property uint64 FormatChanges
+		{
+			uint64 get() { return m_formatChanges; }
+		}
+
+		virtual void Flush() override;
+
 	internal:
 		UncompressedVideoSampleProvider(
 			FFmpegReader^ reader,
@@ -47,21 +90,106 @@ namespace FFmpegInterop
 		virtual HRESULT AllocateResources() override;
 		virtual HRESULT CreateBufferFromFrame(IBuffer^* pBuffer, AVFrame* avFrame, int64_t& framePts, int64_t& frameDuration) override;
 		virtual HRESULT SetSampleProperties(MediaStreamSample^ sample) override;
+		virtual bool CanDecodeAhead() override { return true; }
+		virtual void OnDeliverSample(MediaStreamSample^ sample) override;
 		AVPixelFormat GetOutputPixelFormat() { return m_OutputPixelFormat; }
+		// Frames larger than this are scaled down, 0 means no limit
+		void SetMaximumOutputSize(int width, int height);
 
 	private:
+		// The layout of the output samples. The picture is in the top left
+		// corner of the buffer, the display size crops it.
+		struct OutputFormat
+		{
+			int width;
+			int height;
+			int displayWidth;
+			int displayHeight;
+			bool fullRange;
+
+			bool operator==(const OutputFormat& other) const
+			{
+				return width == other.width && height == other.height
+					&& displayWidth == other.displayWidth && displayHeight == other.displayHeight
+					&& fullRange == other.fullRange;
+			}
+		};
+
+		// Everything needed to convert frames of one size and pixel format
+		struct FrameConverter
+		{
+			int width;
+			int height;
+			AVPixelFormat format;
+			OutputFormat output;
+
+			// The fast conversion of the format if there is one, the software
+			// scaler otherwise
+			PixelConversionFunction convert;
+			SwsContext* swsCtx;
+
+			// Large frames are converted in horizontal bands on the shared
+			// thread pool if that leaves no seams, sws_scale needs a context
+			// per band for that
+			int bands;
+			std::vector<SwsContext*> bandSwsCtx;
+
+			// Every converted frame gets its own buffer, which returns to the
+			// pool when the sample is released
+			BufferPool* bufferPool;
+			int lineSize[4];
+			int planeSize[4];
+		};
+
+		// A format change which takes effect with the delivery of its sample
+		struct PendingFormat
+		{
+			MediaStreamSample^ sample;
+			OutputFormat format;
+		};
+
+		static int GetContiguousBuffer(AVCodecContext* avCodecCtx, AVFrame* avFrame, int flags);
+		OutputFormat GetOutputFormat(int width, int height, AVPixelFormat format);
+		bool CanWrapFrame(AVFrame* avFrame, const OutputFormat& format);
+		HRESULT GetConverter(AVFrame* avFrame, const OutputFormat& output, FrameConverter** converter);
+		HRESULT CreateConverter(int width, int height, AVPixelFormat format, const OutputFormat& output, FrameConverter** converter);
+		static void FreeConverter(FrameConverter* converter);
+		HRESULT ConvertFrame(AVFrame* avFrame, FrameConverter* converter, uint8_t* buffer);
+		bool ScaleBands(AVFrame* avFrame, FrameConverter* converter, uint8_t* const outputData[4]);
+		void SetEncodingProperties(VideoEncodingProperties^ videoProperties, const OutputFormat& format);
+		void ChangeOutputFormat(const OutputFormat& format);
+
 		AVPixelFormat m_OutputPixelFormat;
-		SwsContext* m_pSwsCtx;
 		bool m_interlaced_frame;
 		bool m_top_field_first;
 		AVChromaLocation m_chroma_location;
 
-		IBuffer^ m_VideoBufferObject = nullptr;
+		std::atomic<int> m_maxOutputWidth;
+		std::atomic<int> m_maxOutputHeight;
+		unsigned int m_decodedFrameBytes;
+		unsigned int m_outputFrameBytes;
+
+		// Converters of the recently seen frame formats, the current one first
+		std::mutex m_convertersMutex;
+		std::vector<FrameConverter*> m_converters;
 
-		int m_VideoBufferLineSize[4];
-		uint8_t* m_VideoBufferData[4];
+		// The format of the last frame, and of the last sample with a format
+		// change. The stream descriptor switches to the new format when that
+		// sample is delivered, after the samples decoded ahead of it.
+		OutputFormat m_frameFormat;
+		OutputFormat m_sampleFormat;
+		std::mutex m_formatMutex;
+		std::deque<PendingFormat> m_pendingFormats;
+		uint64 m_formatChanges;
 
-		uint8_t* m_VideoBuffer = nullptr;
+		// NV12 frames are decoded into one buffer with the layout of the
+		// output, so that samples can wrap them. The buffers are recycled,
+		// the decoder reaches the pool through the opaque pointer of the
+		// codec context.
+		bool m_zeroCopy;
+		FrameBufferPool m_frameBufferPool;
+		uint64 m_zeroCopyFrames;
+		uint64 m_convertedFrames;
 	};
 }
 
@@ -89,3 +89,8 @@ MediaStreamSource ^ VioletCore::VioletCoreMSS::GetMediaStreamSource()
 {
 	return this->m_interop->GetMediaStreamSource();
 }
+
+void VioletCore::VioletCoreMSS::SetMaximumOutputSize(unsigned int width, unsigned int height)
+{
+	this->m_interop->SetMaximumOutputSize(width, height);
+}
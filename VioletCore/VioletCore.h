@@ -78,6 +78,10 @@ namespace VioletCore
 		// Contructor
 		MediaStreamSource^ GetMediaStreamSource();
 
+		// Scales video frames larger than this down before they are handed
+		// out, 0 means no limit
+		void SetMaximumOutputSize(unsigned int width, unsigned int height);
+
 		// Properties
 		property TimeSpan Duration
 		{